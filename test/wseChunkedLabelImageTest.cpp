@@ -0,0 +1,191 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    wseChunkedLabelImageTest.cpp
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+
+// Writes label images with itk::ChunkedLabelImageWriter and reads them
+// back with itk::ChunkedLabelImageReader, whole, by region and by slice,
+// with and without compression, and as a section of a larger file.
+//
+// Usage: wseChunkedLabelImageTest [directory for the temporary files]
+
+#include "itkChunkedLabelImageReader.h"
+#include "itkChunkedLabelImageWriter.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+typedef itk::Image<unsigned long, 3> ImageType;
+
+/** Returns an image of long runs of labels, as the watershed makes, with
+    a size that is not a multiple of the brick size. */
+static ImageType::Pointer MakeLabels()
+{
+  ImageType::Pointer image = ImageType::New();
+  ImageType::IndexType index;
+  index[0] = 3;  index[1] = -2;  index[2] = 5;
+  ImageType::SizeType size;
+  size[0] = 70;  size[1] = 45;  size[2] = 33;
+  image->SetRegions(ImageType::RegionType(index, size));
+
+  ImageType::SpacingType spacing;
+  spacing[0] = 0.5;  spacing[1] = 0.75;  spacing[2] = 2.0;
+  image->SetSpacing(spacing);
+  image->Allocate();
+
+  std::srand(7);
+  unsigned long *p = image->GetBufferPointer();
+  const unsigned long n = size[0] * size[1] * size[2];
+  unsigned long label = 1;
+  for (unsigned long i = 0; i < n; i++)
+    {
+      if (std::rand() % 23 == 0)  { label = std::rand() % 100000 + 1; }
+      p[i] = (i % 997 == 0) ? 0xfffffffful : label;
+    }
+  return image;
+}
+
+/** Returns the number of voxels of the region r that differ between
+    the image "read" and the image "expected". */
+static unsigned long Compare(const ImageType *expected, const ImageType *read,
+                             const ImageType::RegionType &r)
+{
+  if (read->GetBufferedRegion() != r)  { return r.GetNumberOfPixels() + 1; }
+
+  unsigned long differ = 0;
+  ImageType::IndexType idx;
+  for (idx[2] = r.GetIndex()[2]; idx[2] < r.GetIndex()[2] + static_cast<long>(r.GetSize()[2]); idx[2]++)
+    for (idx[1] = r.GetIndex()[1]; idx[1] < r.GetIndex()[1] + static_cast<long>(r.GetSize()[1]); idx[1]++)
+      for (idx[0] = r.GetIndex()[0]; idx[0] < r.GetIndex()[0] + static_cast<long>(r.GetSize()[0]); idx[0]++)
+        {
+          if (expected->GetPixel(idx) != read->GetPixel(idx))  { differ++; }
+        }
+  return differ;
+}
+
+/** Reads the file back in every way and returns the number of
+    failures. */
+static int Check(const ImageType *expected, const std::string &fname,
+                 itk::uint64_t offset, const char *name)
+{
+  int failures = 0;
+  itk::ChunkedLabelImageReader<ImageType>::Pointer reader
+    = itk::ChunkedLabelImageReader<ImageType>::New();
+  reader->SetFileName(fname.c_str());
+  reader->SetFileOffset(offset);
+
+  const ImageType::RegionType largest = expected->GetBufferedRegion();
+  if (reader->GetLargestPossibleRegion() != largest)
+    {
+      std::cerr << name << ": the region of the file differs" << std::endl;
+      return 1;
+    }
+
+  ImageType::Pointer whole = reader->Read();
+  if (Compare(expected, whole, largest) != 0)
+    {
+      std::cerr << name << ": the whole image differs" << std::endl;
+      failures++;
+    }
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      if (whole->GetSpacing()[i] != expected->GetSpacing()[i])
+        {
+          std::cerr << name << ": the spacing differs" << std::endl;
+          failures++;
+          break;
+        }
+    }
+
+  // A region across brick boundaries
+  ImageType::IndexType index = largest.GetIndex();
+  ImageType::SizeType size;
+  index[0] += 60;  index[1] += 10;  index[2] += 1;
+  size[0] = 9;  size[1] = 30;  size[2] = 31;
+  const ImageType::RegionType roi(index, size);
+  if (Compare(expected, reader->ReadRegion(roi), roi) != 0)
+    {
+      std::cerr << name << ": the region differs" << std::endl;
+      failures++;
+    }
+
+  // Every slice
+  for (unsigned long k = 0; k < largest.GetSize()[2]; k++)
+    {
+      ImageType::RegionType slice = largest;
+      ImageType::IndexType si = slice.GetIndex();
+      ImageType::SizeType ss = slice.GetSize();
+      si[2] += k;
+      ss[2] = 1;
+      slice.SetIndex(si);
+      slice.SetSize(ss);
+      if (Compare(expected, reader->ReadSlice(si[2]), slice) != 0)
+        {
+          std::cerr << name << ": slice " << k << " differs" << std::endl;
+          failures++;
+          break;
+        }
+    }
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  const std::string dir = argc > 1 ? std::string(argv[1]) + "/" : std::string();
+  const std::string fname = dir + "wseChunkedLabelImageTest.lbl";
+  ImageType::Pointer labels = MakeLabels();
+  int failures = 0;
+
+  try
+    {
+      for (unsigned int compress = 0; compress < 2; compress++)
+        {
+          const char *name = compress ? "deflated" : "run-length";
+
+          // A file of its own, with small bricks so that the image spans
+          // several of them in every direction
+          itk::ChunkedLabelImageWriter<ImageType>::Pointer writer
+            = itk::ChunkedLabelImageWriter<ImageType>::New();
+          writer->SetInput(labels);
+          writer->SetFileName(fname.c_str());
+          writer->SetBrickSize(16);
+          writer->SetCompression(compress != 0);
+          writer->Write();
+          failures += Check(labels, fname, 0, name);
+
+          // A section of a larger file, as in a segmentation bundle
+          const itk::uint64_t offset = 4096;
+          {
+            std::ofstream out(fname.c_str(), std::ios::binary | std::ios::trunc);
+            const std::string padding(offset, 'x');
+            out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+            writer->SetBrickSize(64);
+            writer->Write(out);
+            out.write("trailer", 7);
+          }
+          failures += Check(labels, fname, offset, name);
+        }
+    }
+  catch (itk::ExceptionObject &e)
+    {
+      std::cerr << e << std::endl;
+      failures++;
+    }
+
+  std::remove(fname.c_str());
+  if (failures != 0)
+    {
+      std::cerr << failures << " checks failed" << std::endl;
+      return EXIT_FAILURE;
+    }
+  std::cout << "All checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
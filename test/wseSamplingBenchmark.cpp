@@ -0,0 +1,114 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    wseSamplingBenchmark.cpp
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+
+// Compares the per-point sampling functions of wse::Image,
+// getLinearInterpolatedPixel() and getNearestInterpolatedPixel(), with
+// the batched sampleLinear() and sampleNearest() on a synthetic volume.
+//
+// Usage: wseSamplingBenchmark [size] [points]
+
+#include "wseImage.hxx"
+
+#include <QTime>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+typedef wse::FloatImage::itkImageType ImageType;
+
+/** Returns a size^3 volume with a smooth pattern, a non-unit spacing and
+    a non-zero origin. */
+static ImageType::Pointer MakeVolume(unsigned long size)
+{
+  ImageType::Pointer image = ImageType::New();
+  ImageType::RegionType region;
+  ImageType::SizeType dims;
+  dims.Fill(size);
+  region.SetSize(dims);
+  image->SetRegions(region);
+
+  ImageType::SpacingType spacing;
+  spacing[0] = 0.7;  spacing[1] = 0.9;  spacing[2] = 1.5;
+  image->SetSpacing(spacing);
+  ImageType::PointType origin;
+  origin[0] = -10.0;  origin[1] = 5.0;  origin[2] = 2.0;
+  image->SetOrigin(origin);
+  image->Allocate();
+
+  float *p = image->GetBufferPointer();
+  for (unsigned long k = 0; k < size; k++)
+    for (unsigned long j = 0; j < size; j++)
+      for (unsigned long i = 0; i < size; i++)
+        {
+          *p++ = static_cast<float>(std::sin(0.1 * i) + std::cos(0.07 * j) + 0.01 * k);
+        }
+  return image;
+}
+
+/** Returns the milliseconds since start. */
+static int Elapsed(const QTime &start)
+{
+  return start.msecsTo(QTime::currentTime());
+}
+
+int main(int argc, char *argv[])
+{
+  const unsigned long size = argc > 1 ? std::atol(argv[1]) : 256;
+  const unsigned long n = argc > 2 ? std::atol(argv[2]) : 2000000;
+
+  wse::FloatImage image(MakeVolume(size));
+  const ImageType::PointType &origin = image.itkImage()->GetOrigin();
+  const ImageType::SpacingType &spacing = image.itkImage()->GetSpacing();
+
+  // Random points over the volume and a little beyond its edges
+  std::vector<double> points(3 * n);
+  std::srand(1);
+  for (unsigned long i = 0; i < 3 * n; i++)
+    {
+      const unsigned int a = i % 3;
+      const double u = std::rand() / static_cast<double>(RAND_MAX) * 1.02 - 0.01;
+      points[i] = origin[a] + u * spacing[a] * (size - 1);
+    }
+
+  std::vector<float> single(n), batched(n);
+  for (unsigned int linear = 0; linear < 2; linear++)
+    {
+      const char *name = linear ? "linear" : "nearest";
+
+      QTime start = QTime::currentTime();
+      for (unsigned long i = 0; i < n; i++)
+        {
+          double p[3] = { points[3 * i], points[3 * i + 1], points[3 * i + 2] };
+          single[i] = linear ? image.getLinearInterpolatedPixel(p) : image.getNearestInterpolatedPixel(p);
+        }
+      const int singleMsecs = Elapsed(start);
+
+      start = QTime::currentTime();
+      if (linear) { image.sampleLinear(&points[0], n, &batched[0]); }
+      else        { image.sampleNearest(&points[0], n, &batched[0]); }
+      const int batchedMsecs = Elapsed(start);
+
+      // Points on the edge of the image may differ, since the ITK
+      // functions and the batched ones treat its border differently.
+      unsigned long differ = 0;
+      double largest = 0.0;
+      for (unsigned long i = 0; i < n; i++)
+        {
+          const double d = std::fabs(single[i] - batched[i]);
+          if (d > 1e-4) { differ++; }
+          largest = std::max(largest, d);
+        }
+
+      std::cout << name << ": " << n << " points, per point " << singleMsecs << " ms, batched "
+                << batchedMsecs << " ms, " << differ << " samples differ (largest difference "
+                << largest << ")" << std::endl;
+    }
+  return 0;
+}
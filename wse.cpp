@@ -1,6 +1,7 @@
 #include "wse.h"
 #include "vtkMatrix4x4.h"
 #include "vtkRendererCollection.h"
+#include "vtkInteractorStyleTrackballCamera.h"
 
 
 namespace wse {
@@ -21,24 +22,30 @@ public:
 
   virtual void Execute(vtkObject *obj, unsigned long event, void *) 
   {
+    vtkRenderWindowInteractor *interactor = vtkRenderWindowInteractor::SafeDownCast(obj);
+
     if (event == vtkCommand::MouseWheelBackwardEvent) 
       {
-	wse_->changeSlice(false);
+	wse_->changeSlice(false, interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer());
       } 
     else if (event == vtkCommand::MouseWheelForwardEvent) 
       {
-	wse_->changeSlice(true);
+	wse_->changeSlice(true, interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer());
+      }
+    else if (event == vtkCommand::LeftButtonPressEvent)
+      {
+        int x,y;
+        interactor->GetEventPosition(x,y);
+        wse_->crosshairPick((double)x, (double)y,
+                            interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer());
       }
     //    else if (event == vtkCommand::LeftButtonPressEvent)
     else if (event == vtkCommand::MouseMoveEvent)
      {
-       vtkRenderWindowInteractor *interactor = vtkRenderWindowInteractor::SafeDownCast(obj);
-       
        int x,y;
-       interactor->GetLastEventPosition(x,y);
-       wse_->cellPickSegment((double)x, (double)y, true,
-                             // Seriously?
-                             interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer());
+       interactor->GetEventPosition(x,y);
+       wse_->queueProbe((double)x, (double)y,
+                        interactor->GetRenderWindow()->GetRenderers()->GetFirstRenderer());
      }
   }
 };
@@ -96,6 +103,45 @@ wseGUI::wseGUI(QWidget *parent, Qt::WFlags flags) :
   mSegmentSliceViewer = SegmentationViewer::New();
   mSegmentSliceViewer->SetImageMask(NULL);
 
+  // Create the XZ and YZ panes of the MPR view.  Their widgets are
+  // created in setupUIMPR.
+  mCoronalViewer = SliceViewer::New();
+  mCoronalViewer->SetSliceOrientationToXZ();
+  mSagittalViewer = SliceViewer::New();
+  mSagittalViewer->SetSliceOrientationToYZ();
+  mMPRPanes = NULL;
+  mCoronalWidget = NULL;
+  mSagittalWidget = NULL;
+  mCrosshair[0] = mCrosshair[1] = mCrosshair[2] = -1;
+
+  // Mouse moves over the slice view are probed at most once per
+  // display refresh (about 60 Hz).
+  mProbeTimer = new QTimer(this);
+  mProbeTimer->setSingleShot(true);
+  mProbeTimer->setInterval(16);
+  mProbeRenderer = NULL;
+  mProbeX = mProbeY = 0.0f;
+  mRenderScheduler = new RenderScheduler(this);
+  mSliceViewer->SetRenderScheduler(mRenderScheduler);
+  mSegmentSliceViewer->SetRenderScheduler(mRenderScheduler);
+  mCoronalViewer->SetRenderScheduler(mRenderScheduler);
+  mSagittalViewer->SetRenderScheduler(mRenderScheduler);
+
+  // The surface of the selected region.  Its actor is added to the 3D
+  // view in setupUI.
+  mRegionSurface = new RegionSurface();
+  mRegionSurfaceMapper = vtkPolyDataMapper::New();
+  mRegionSurfaceMapper->ScalarVisibilityOff();
+  mRegionSurfaceActor = vtkActor::New();
+  mRegionSurfaceActor->SetMapper(mRegionSurfaceMapper);
+  mRegionSurfaceRenderer = vtkRenderer::New();
+  mRegionSurfaceLOD = new SurfaceLOD();
+  mRegionSurfaceLOD->SetMapper(mRegionSurfaceMapper);
+
+  // The defaults of SliceViewer
+  mThresholdLower = 160.0f;
+  mThresholdUpper = std::numeric_limits<float>::max();
+
   // Create the QThread objects that execute filtering
   mITKFilteringThread  = new 
     itk::QThreadITKFilter<itk::ImageToImageFilter<FloatImage::itkImageType,FloatImage::itkImageType> >;
@@ -104,6 +150,9 @@ wseGUI::wseGUI(QWidget *parent, Qt::WFlags flags) :
 
   // Create key member variables
   mImageStack = new FloatImageStack();
+  mImageLoader = new ImageLoader();
+  mImageExporter = new ImageExporter();
+  mImportAddedImage = false;
 
 #ifdef WIN32
   RedirectIOToConsole();
@@ -131,18 +180,47 @@ wseGUI::wseGUI(QWidget *parent, Qt::WFlags flags) :
   connect(mITKFilteringThread,SIGNAL(started()),this,SLOT(mITKFilteringThread_started()));
   connect(mITKSegmentationThread,SIGNAL(finished()),this,SLOT(mITKSegmentationThread_finished()));
   connect(mITKSegmentationThread,SIGNAL(started()),this,SLOT(mITKSegmentationThread_started()));
+  connect(mProbeTimer,SIGNAL(timeout()),this,SLOT(mProbeTimer_timeout()));
+  connect(mImageLoader,SIGNAL(started(int)),this,SLOT(mImageLoader_started(int)));
+  connect(mImageLoader,SIGNAL(progress(int,int)),this,SLOT(mImageLoader_progress(int,int)));
+  connect(mImageLoader,SIGNAL(loaded(int)),this,SLOT(mImageLoader_loaded(int)));
+  connect(mImageLoader,SIGNAL(failed(int,QString,QString)),this,SLOT(mImageLoader_failed(int,QString,QString)));
+  connect(mImageLoader,SIGNAL(cancelled(int,QString)),this,SLOT(mImageLoader_cancelled(int,QString)));
+  connect(mImageLoader,SIGNAL(finished()),this,SLOT(mImageLoader_finished()));
+  connect(mImageExporter,SIGNAL(started(int,QString)),this,SLOT(mImageExporter_started(int,QString)));
+  connect(mImageExporter,SIGNAL(progress(int,int)),this,SLOT(mImageExporter_progress(int,int)));
+  connect(mImageExporter,SIGNAL(saved(int,QString)),this,SLOT(mImageExporter_saved(int,QString)));
+  connect(mImageExporter,SIGNAL(failed(int,QString,QString)),this,SLOT(mImageExporter_failed(int,QString,QString)));
+  connect(mImageExporter,SIGNAL(cancelled(int,QString)),this,SLOT(mImageExporter_cancelled(int,QString)));
+  connect(mImageExporter,SIGNAL(finished()),this,SLOT(mImageExporter_finished()));
 }
 
 wseGUI::~wseGUI()
 {
+  // Stop the viewers from reading the images and the segmentation
+  // deleted below.
+  mSliceViewer->DisableDisplay();
+  mSegmentSliceViewer->DisableDisplay();
+  mCoronalViewer->DisableDisplay();
+  mSagittalViewer->DisableDisplay();
+
+  delete mImageLoader;
+  delete mImageExporter;
   delete mITKFilteringThread;
   delete mITKSegmentationThread;
+  delete mRegionSurfaceLOD;
+  delete mRegionSurface;
   delete mSegmentation;
 
   if (mImageStack) { delete mImageStack; }
   //mVTKImageViewer->Delete();
   mSliceViewer->Delete();
+  mCoronalViewer->Delete();
+  mSagittalViewer->Delete();
   mNullVTKImageData->Delete();
+  mRegionSurfaceActor->Delete();
+  mRegionSurfaceMapper->Delete();
+  mRegionSurfaceRenderer->Delete();
 }
 
 void wseApplication::loadStyleSheet(const char *fn)
@@ -227,6 +305,8 @@ void wseGUI::setupUI()
   ui.vtkSegmentationWidget->SetRenderWindow(mSegmentSliceViewer->GetRenderWindow());
   mSegmentSliceViewer->SetupInteractor(ui.vtkSegmentationWidget->GetRenderWindow()->GetInteractor());
 
+  this->setupUIMPR();
+
  // Set up the slice selection widgets and connections
   ui.sliceSelector->setEnabled(false);
 
@@ -254,11 +334,6 @@ void wseGUI::setupUI()
   //  mPointPicker3D->AddObserver(vtkCommand::EndPickEvent, new PickerCallback3D(this));
   ui.vtkRenderWidget->GetInteractor()->SetPicker(mPointPicker3D);
 
-  mCellPickerSegment = vtkPointPicker::New();
-  mCellPickerSegment->SetTolerance(0.005);
-  //  mCellPickerSegment->AddObserver(vtkCommand::EndPickEvent, new PickerCallbackSegment(this));
-  mSliceViewer->GetInteractor()->SetPicker(mCellPickerSegment);  
-
   // Connect the visualization selection buttons
   connect(ui.setIsosurfaceButton, SIGNAL(released()), this, SLOT(setIsosurface()));
   connect(ui.setImageMaskButton,  SIGNAL(released()), this, SLOT(setImageMask()));
@@ -316,6 +391,17 @@ void wseGUI::setupUI()
   mCrosshairActor = vtkActor::New();
   mSliceViewer->GetRenderer()->AddActor(mCrosshairActor);
 
+  // Add the region surface to the 3D view
+  mRegionSurfaceRenderer->AddActor(mRegionSurfaceActor);
+  ui.vtkRenderWidget->GetRenderWindow()->AddRenderer(mRegionSurfaceRenderer);
+
+  // Draw a decimated surface while the camera of the 3D view moves.  The
+  // levels follow the interaction events of the trackball style.
+  vtkInteractorStyleTrackballCamera *trackball = vtkInteractorStyleTrackballCamera::New();
+  ui.vtkRenderWidget->GetInteractor()->SetInteractorStyle(trackball);
+  trackball->Delete();
+  mRegionSurfaceLOD->SetInteractor(ui.vtkRenderWidget->GetInteractor());
+
   // set defaults for basic mode
   //ui.scalarMethodComboBox->setCurrentIndex(scalarMethods.size()-1);
   ui.smoothGroupBox->setChecked(false);
@@ -341,9 +427,36 @@ void wseGUI::setupUIMenu()
   mImportImageAction->setShortcut(tr("Load image volumes from file"));
   connect(mImportImageAction, SIGNAL(triggered()),this,SLOT(on_addButton_released()));
 
+  mCancelImportAction = new QAction(tr("Cancel Loading"), this);
+  mCancelImportAction->setStatusTip(tr("Cancel the volumes that are still loading"));
+  mCancelImportAction->setEnabled(false);
+  connect(mCancelImportAction, SIGNAL(triggered()),this,SLOT(cancelImport()));
+
   // Save volume action
   mExportImageAction = new QAction(tr("Save Volume"), this);
   connect(mExportImageAction, SIGNAL(triggered()),this,SLOT(on_saveImageButton_released()));
+
+  mExportAllImagesAction = new QAction(tr("Save All Volumes..."), this);
+  mExportAllImagesAction->setStatusTip(tr("Save every volume into a directory as compressed NRRD files"));
+  connect(mExportAllImagesAction, SIGNAL(triggered()),this,SLOT(exportAllImages()));
+
+  mCancelExportAction = new QAction(tr("Cancel Saving"), this);
+  mCancelExportAction->setStatusTip(tr("Cancel the volumes that are still being saved"));
+  mCancelExportAction->setEnabled(false);
+  connect(mCancelExportAction, SIGNAL(triggered()),this,SLOT(cancelExport()));
+
+  mFullPrecisionResultsAction = new QAction(tr("Keep Filter Results at Full Precision"), this);
+  mFullPrecisionResultsAction->setStatusTip(tr("Keep filter results as 32-bit floats instead of 16-bit values while they are not displayed"));
+  mFullPrecisionResultsAction->setCheckable(true);
+  mFullPrecisionResultsAction->setChecked(g_settings->value("derived_image_storage", "float32").toString() == "float32");
+  connect(mFullPrecisionResultsAction, SIGNAL(toggled(bool)),this,SLOT(setFullPrecisionResults(bool)));
+
+  // Load and save segmentation actions
+  mImportWSSegmentationAction = new QAction(tr("Load Segmentation"), this);
+  connect(mImportWSSegmentationAction, SIGNAL(triggered()),this,SLOT(importSegmentation()));
+
+  mExportWSSegmentationAction = new QAction(tr("Save Segmentation"), this);
+  connect(mExportWSSegmentationAction, SIGNAL(triggered()),this,SLOT(exportSegmentation()));
  
   // mExportColormapAction = new QAction(tr("Export Colormap"), this);
   // mExportColormapAction->setShortcut(tr("Export selected colormaps"));
@@ -377,6 +490,21 @@ void wseGUI::setupUIMenu()
   mIsoSurfaceView->setShortcut((tr("Ctrl+4")));
   connect(mIsoSurfaceView, SIGNAL(triggered()), this, SLOT(setIsoSurfaceView()));
 
+  // MPR view action
+  mMPRView = new QAction(tr("Go to &MPR View"), this);
+  mMPRView->setShortcut((tr("Ctrl+5")));
+  connect(mMPRView, SIGNAL(triggered()), this, SLOT(setMPRView()));
+
+  // Region boundaries action
+  mShowBoundariesAction = new QAction(tr("Show Region &Boundaries"), this);
+  mShowBoundariesAction->setCheckable(true);
+  connect(mShowBoundariesAction, SIGNAL(triggered()), this, SLOT(toggleRegionBoundaries()));
+
+  // Render timing action
+  mRenderStatisticsAction = new QAction(tr("Show Render &Statistics"), this);
+  mRenderStatisticsAction->setStatusTip(tr("Print the frame times of the image views since the last report"));
+  connect(mRenderStatisticsAction, SIGNAL(triggered()), this, SLOT(showRenderStatistics()));
+
   // Preferences action
   QAction *prefAction = new QAction(tr("&Preferences..."),this);
   prefAction->setStatusTip(tr("Set program preferences"));
@@ -391,7 +519,15 @@ void wseGUI::setupUIMenu()
  // Construct file menu
   QMenu *fileMenu = ui.menuBar->addMenu(tr("&File"));
   fileMenu->addAction(mImportImageAction);
+  fileMenu->addAction(mCancelImportAction);
   fileMenu->addAction(mExportImageAction);
+  fileMenu->addAction(mExportAllImagesAction);
+  fileMenu->addAction(mCancelExportAction);
+  fileMenu->addSeparator();
+  fileMenu->addAction(mImportWSSegmentationAction);
+  fileMenu->addAction(mExportWSSegmentationAction);
+  fileMenu->addSeparator();
+  fileMenu->addAction(mFullPrecisionResultsAction);
   fileMenu->addAction(prefAction);
   fileMenu->addAction(exitAction);
  
@@ -420,6 +556,10 @@ void wseGUI::setupUIMenu()
   viewMenu->addAction(mDualView);
   viewMenu->addAction(mSliceView);
   viewMenu->addAction(mIsoSurfaceView);
+  viewMenu->addAction(mMPRView);
+  viewMenu->addSeparator();
+  viewMenu->addAction(mShowBoundariesAction);
+  viewMenu->addAction(mRenderStatisticsAction);
   viewMenu->addSeparator();
   viewMenu->addAction(mViewDataWindowAction);
   viewMenu->addAction(mViewWatershedWindowAction);
@@ -432,11 +572,18 @@ void wseGUI::setupUIMenu()
   mEditMergeAction     = new QAction(tr("Merge"),this);
   mEditUndoMergeAction = new QAction(tr("Undo Merge"),this);
 
+  mShowRegionSurfaceAction = new QAction(tr("Show Region &Surface"), this);
+  mShowRegionSurfaceAction->setShortcut(tr("Ctrl+R"));
+  mShowRegionSurfaceAction->setStatusTip(tr("Show the surface of the region under the crosshair in the 3D view"));
+  connect(mShowRegionSurfaceAction, SIGNAL(triggered()), this, SLOT(showRegionSurface()));
+
   QMenu *editorMenu = ui.menuBar->addMenu(tr("&Editor"));
   editorMenu->addAction(mEditAddAction);
   editorMenu->addAction(mEditSubtractAction);
   editorMenu->addAction(mEditMergeAction);
   editorMenu->addAction(mEditUndoMergeAction);
+  editorMenu->addSeparator();
+  editorMenu->addAction(mShowRegionSurfaceAction);
 
   //
   mHelpAction = new QAction(tr("Help"),this);
@@ -515,12 +662,13 @@ void wseGUI::syncRegisteredImageComboBoxes()
       // Clear all entries
       mRegisteredImageComboBoxes[j]->clear();
 
-      // Populate with the names in the image list widget
-      for (int i=0; i<ui.imageListWidget->count(); i++)
+      // Populate with the names in the image list widget, leaving out
+      // the volumes that are still loading
+      for (int i=0; i<mImageStack->numImages(); i++)
 	{
 	  mRegisteredImageComboBoxes[j]->addItem(ui.imageListWidget->item(i)->text());
 	}
-      mRegisteredImageComboBoxes[j]->setCurrentIndex(ui.imageListWidget->count()-1);
+      mRegisteredImageComboBoxes[j]->setCurrentIndex(mImageStack->numImages()-1);
     }
 }
   
@@ -571,9 +719,27 @@ void wseGUI::updateImageListIcons()
   }
 }
 
+/**
+  Pin the images shown by the viewers and apply the memory budget to
+  the others.  updateImageDisplay() calls this once the viewers have
+  switched to their new inputs, so that an image is released only
+  after nothing shows it.
+ */
+void wseGUI::pinDisplayedImages()
+{
+  // The images shown by the viewers are connected to their pipelines
+  // and slice caches, so they must stay in memory.
+  mImageStack->clearPins();
+  if (mImageData != -1)       { mImageStack->setPinned(mImageData, true); }
+  if (mImageMask != -1)       { mImageStack->setPinned(mImageMask, true); }
+  if (mIsosurfaceImage != -1) { mImageStack->setPinned(mIsosurfaceImage, true); }
+  mImageStack->enforceMemoryBudget();
+}
+
 
 void wseGUI::on_setImageDataButton_released()
 {
+  if (ui.imageListWidget->currentRow() >= mImageStack->numImages())  { return; }
   mImageData = ui.imageListWidget->currentRow();
   //  ui.setImageDataButton->setEnabled(false);
   //  ui.setImageMaskButton->setEnabled(true);
@@ -609,6 +775,7 @@ void wseGUI::setIsosurface()
   if (mImageStack->image(selection)->isBinarySegmentation()) {
     mIsosurfaceImage = ui.imageListWidget->currentRow();//mImageStack->selectedImageVTK(true)->GetOutputPort();
     updateImageListIcons();
+    pinDisplayedImages();
 
     //    this->visualizePage();
   } else {
@@ -645,6 +812,18 @@ void wseGUI::readSettings()
   if (g_settings->value("import_path").isNull()) { g_settings->setValue("import_path", tr(".")); }
   if (g_settings->value("export_path").isNull()) { g_settings->setValue("export_path", tr(".")); }
 
+  // The memory, in MB, that the image volumes may hold before the least
+  // recently viewed of them are spilled to the disk cache.  0 is
+  // unlimited.
+  if (g_settings->value("image_memory_budget").isNull()) { g_settings->setValue("image_memory_budget", 4096); }
+  if (g_settings->value("image_cache_path").isNull()) { g_settings->setValue("image_cache_path", QDir::tempPath()); }
+  mImageStack->setMemoryBudget(g_settings->value("image_memory_budget").toLongLong() * 1024 * 1024);
+  mImageStack->setCacheDirectory(g_settings->value("image_cache_path").toString());
+
+  // How filter results are stored while they are not displayed:
+  // "float32" (the default), or the lossy "uint16" or "float16".
+  if (g_settings->value("derived_image_storage").isNull()) { g_settings->setValue("derived_image_storage", "float32"); }
+
   // Restore histogram settings
   //  if (g_settings->value("histogram_low_thresh").isNull()) {g_settings->setValue("histogram_low_thresh",
 
@@ -659,17 +838,22 @@ void wseGUI::viewerChangeSlice()
   ss << this->ui.sliceSelector->value();
   ui.sliceNumberLabel->setText(QString(ss.str().c_str()));
   
-  // Change the slice number in the floating point image viewer
-  this->mSliceViewer->SetZSlice(this->ui.sliceSelector->value());
-  this->mSliceViewer->Render();
-
-  // Change the slice number of the segmentation image 
-  if (mSegmentation != NULL)
+  // In the MPR view the slice selector moves the crosshair, which
+  // updates every pane.
+  if (this->isMPRView())
     {
-      this->mSegmentSliceViewer->SetZSlice(this->ui.sliceSelector->value());
-      this->mSegmentSliceViewer->Render();
+      this->setCrosshair(mCrosshair[0], mCrosshair[1], this->ui.sliceSelector->value());
+      return;
     }
 
+  // Change the slice number in the floating point image viewer and in
+  // the segmentation viewer.  Their slices are computed concurrently.
+  SliceViewer *viewers[2] = { mSliceViewer, mSegmentSliceViewer };
+  int slices[2] = { this->ui.sliceSelector->value(), this->ui.sliceSelector->value() };
+  const int n = mSegmentation != NULL ? 2 : 1;
+  SliceViewer::SetSlices(viewers, slices, n, false);
+  for (int i = 0; i < n; i++)  { mRenderScheduler->scheduleRender(viewers[i]); }
+
   mCrosshairActor->SetMapper(NULL);
 
   // mIsoRenderer->setSliceDisplayExtent(mSliceViewer->GetImageActor()->GetDisplayExtent());
@@ -679,11 +863,20 @@ void wseGUI::viewerChangeSlice()
 
 void wseGUI::updateImageDisplay() 
 {
+  // While the viewers switch, both the images they show now and the
+  // ones about to replace them are connected, so both stay pinned
+  // until pinDisplayedImages() drops the old ones.  Fetching an image
+  // below may reload it and apply the memory budget.
+  if (mImageData != -1)  { mImageStack->setPinned(mImageData, true); }
+  if (mImageMask != -1)  { mImageStack->setPinned(mImageMask, true); }
+
   if (mImageData != -1) 
     {
       mSliceViewer->SetImageMask(NULL);
       
       // Connect selected image to the viewer port
+      const FloatImage::Statistics &stats = mImageStack->image(mImageData)->statistics();
+      mSliceViewer->SetInputScalarRange(stats.minimum, stats.maximum);
       mSliceViewer->SetInputConnection(mImageStack->image(mImageData)->vtkImporter()->GetOutputPort());
       
       // Connect segmentation to the segmentation viewer port if it
@@ -728,6 +921,9 @@ void wseGUI::updateImageDisplay()
     ui.sliceSelector->setMaximum(mImageStack->image(mImageData)->nSlices()-1);
     ui.sliceSelector->setSingleStep(1);
     ui.sliceSelector->setPageStep(1);
+
+    this->updateMPRDisplay();
+    this->updateBoundaryDisplay();
     } 
   else 
     {
@@ -735,7 +931,13 @@ void wseGUI::updateImageDisplay()
       //mVTKImageViewer2->SetInput(mNullVTKImageData);
       mSliceViewer->DisableDisplay();
       mSegmentSliceViewer->DisableDisplay();
+      mCoronalViewer->DisableDisplay();
+      mSagittalViewer->DisableDisplay();
     }
+
+  // Only now that nothing shows them may the images displayed before
+  // be stored compactly or released.
+  this->pinDisplayedImages();
   
   //  QTime startTime =  QTime::currentTime();
   this->updateHistogram();
@@ -786,57 +988,257 @@ void wseGUI::on_saveImageButton_released()
   
   if (fileName.isEmpty()) return;
 
-  this->output(QString("Saving volume file ") + fileName);
+  // The volume is written in the background; mImageExporter_finished
+  // reports any error.
+  this->queueExport(mImageData, fileName);
+
+  QFileInfo fi(fileName);
+  QString path = fi.canonicalPath();
+  if (!path.isNull()) {  g_settings->setValue("export_path", path); }
+
+
+}
+
+void wseGUI::setFullPrecisionResults(bool on)
+{
+  // Images that are already in the stack keep their storage.
+  g_settings->setValue("derived_image_storage", on ? "float32" : "uint16");
+}
+
+void wseGUI::showRenderStatistics()
+{
+  const RenderScheduler::Statistics &stats = mRenderScheduler->statistics();
+  const double average = stats.frames > 0
+    ? static_cast<double>(stats.totalRenderMsecs) / stats.frames : 0.0;
+  this->output(QString("Rendering: %1 frames, %2 viewer renders, %3 requests coalesced")
+               .arg(stats.frames).arg(stats.renders).arg(stats.coalesced));
+  this->output(QString("Frame time %1 ms average, %2 ms longest; latency %3 ms longest; %4 frames dropped")
+               .arg(average, 0, 'f', 1).arg(stats.maximumRenderMsecs)
+               .arg(stats.maximumLatencyMsecs).arg(stats.droppedFrames));
+  mRenderScheduler->resetStatistics();
+}
+
+void wseGUI::exportAllImages()
+{
+  if (mImageStack->numImages() == 0)
+    {
+    QMessageBox::warning(this, tr("WSE"),
+                                   tr("There are no image volumes to save."),
+                                   QMessageBox::Ok);
+    return;
+    }
+
+  QString dirName = QFileDialog::getExistingDirectory(this, tr("Save All Volumes"),
+                                                      g_settings->value("export_path").toString());
+  if (dirName.isEmpty()) return;
+
+  // One queued batch: the exporter writes the files one after the
+  // other.  Volumes of the same name get a numeric suffix, so that none
+  // overwrites another.
+  QDir dir(dirName);
+  QSet<QString> used;
+  for (int i = 0; i < mImageStack->numImages(); i++)
+    {
+      const QString base = QFileInfo(mImageStack->name(i)).completeBaseName();
+      QString name = base;
+      for (int n = 2; used.contains(name.toLower()); n++)
+        {
+          name = base + QString("_%1").arg(n);
+        }
+      used.insert(name.toLower());
+      this->queueExport(i, dir.filePath(name + ".nrrd"));
+    }
+  g_settings->setValue("export_path", dir.absolutePath());
+}
+
+void wseGUI::queueExport(int i, const QString &fname)
+{
+  mExportQueue.append(qMakePair(mImageStack->imageWithoutReload(i), fname));
+  mCancelExportAction->setEnabled(true);
+  if (! mImageExporter->isSaving())  { this->exportNextImage(); }
+}
+
+bool wseGUI::exportNextImage()
+{
+  while (! mExportQueue.isEmpty())
+    {
+      const QPair<const FloatImage *, QString> next = mExportQueue.takeFirst();
+      const int i = mImageStack->indexOf(next.first);
+      if (i < 0)
+        {
+          this->output(QString("Not saving ") + next.second + ", its volume has been deleted");
+          continue;
+        }
+
+      // The job holds a reference to the pixels until it is done.
+      mImageExporter->save(mImageStack->image(i)->itkImage(), next.second);
+      return true;
+    }
+  return false;
+}
+
+void wseGUI::mImageExporter_started(int, QString fname)
+{
+  this->output(QString("Saving volume file ") + fname);
+  ui.progressBar->setValue(0);
+}
+
+void wseGUI::mImageExporter_progress(int, int percent)
+{
+  ui.progressBar->setValue(percent);
+}
+
+void wseGUI::mImageExporter_saved(int, QString fname)
+{
+  this->output(QString("Saved ") + fname);
+}
+
+void wseGUI::mImageExporter_failed(int, QString fname, QString error)
+{
+  this->output(QString("Error saving ") + fname);
+  mExportErrors << fname + ": " + error;
+}
+
+void wseGUI::mImageExporter_cancelled(int, QString fname)
+{
+  this->output(QString("Cancelled saving ") + fname);
+}
+
+void wseGUI::mImageExporter_finished()
+{
+  // Files may have been queued since the exporter finished.
+  if (mImageExporter->isSaving())  { return; }
+
+  // The volume just saved may be stored compactly or spilled again
+  // before the next one is fetched.
+  mImageStack->enforceMemoryBudget();
+  if (this->exportNextImage())  { return; }
+  mCancelExportAction->setEnabled(false);
+  ui.progressBar->setValue(0);
+
+  if (! mExportErrors.isEmpty())
+    {
+    QMessageBox::warning(this, tr("WSE"),
+                                   tr("Failed to save image volume.\n") + mExportErrors.join("\n"),
+                                   QMessageBox::Ok);
+    }
+  mExportErrors.clear();
+}
+
+void wseGUI::cancelExport()
+{
+  for (int i = 0; i < mExportQueue.size(); i++)
+    {
+      this->output(QString("Cancelled saving ") + mExportQueue.at(i).second);
+    }
+  mExportQueue.clear();
+  mImageExporter->cancel();
+}
 
+void wseGUI::exportSegmentation()
+{
+  if (mSegmentation == NULL)
+    {
+    QMessageBox::warning(this, tr("WSE"),
+                         tr("There is no segmentation to save."),
+                         QMessageBox::Ok);
+    return;
+    }
+
+  QString filter = "Segmentations (*.wseg)";
+  QString fileName = QFileDialog::getSaveFileName(this, tr("Save Segmentation"),
+						  g_settings->value("export_path").toString(), 
+						  filter, &filter,0);
+  if (fileName.isEmpty()) return;
+  if (QFileInfo(fileName).suffix().isEmpty()) { fileName += ".wseg"; }
+
+  this->output(QString("Saving segmentation file ") + fileName);
 
   bool ans;
   QString errStr;
-
   try 
     {
-      ans = mImageStack->image(mImageData)->write(fileName);
+      ans = mSegmentation->write(fileName.toAscii());
+    }
+  catch (Exception &e)
+    {
+      ans = false;
+      errStr = e.info.c_str();
     }
   catch (itk::ExceptionObject &e)
     {
       ans = false;
       errStr = e.GetDescription();
     }
-    
+
   if (ans == false)
     {
     QMessageBox::warning(this, tr("WSE"),
-                                   tr("Failed to save image volume.\n" + errStr),
-                                   QMessageBox::Ok);
+                         tr("Failed to save segmentation.\n") + errStr,
+                         QMessageBox::Ok);
     }
 
-
   QFileInfo fi(fileName);
   QString path = fi.canonicalPath();
   if (!path.isNull()) {  g_settings->setValue("export_path", path); }
+}
+
+void wseGUI::importSegmentation()
+{
+  if (mITKSegmentationThread->isFiltering())
+    {
+      QMessageBox::warning(this, "WSE", QString("Please wait until the current filtering operation has finished."));
+      return;
+    }
 
+  QString fileName = QFileDialog::getOpenFileName(this, tr("Load Segmentation"),
+                                                  g_settings->value("import_path").toString(), 
+                                                  tr("Segmentations (*.wseg)"));
+  if (fileName.isEmpty()) return;
+
+  this->output(QString("Loading segmentation from ") + fileName);
 
+  Segmentation *seg = new Segmentation;
+  bool ans;
+  QString errStr;
+  try
+    {
+      ans = seg->read(fileName.toAscii());
+    }
+  catch (Exception &e)
+    {
+      ans = false;
+      errStr = e.info.c_str();
+    }
+  catch (itk::ExceptionObject &e)
+    {
+      ans = false;
+      errStr = e.GetDescription();
+    }
+
+  if (ans == false)
+    {
+      delete seg;
+      this->output(QString("Error loading ") + fileName);
+      QMessageBox::warning(this, tr("WSE"),
+                           tr("There was an error loading segmentation %1\n").arg(fileName) + errStr,
+                           QMessageBox::Ok);
+      return;
+    }
+
+  this->installSegmentation(seg);
+
+  QFileInfo fi(fileName);
+  QString path = fi.canonicalPath();
+  if (!path.isNull()) {  g_settings->setValue("import_path", path); }
 }
 
 void wseGUI::on_addButton_released()
 {
-  bool added = false; // did we actually add an image?
-  
   QStringList files = QFileDialog::getOpenFileNames(this, tr("Import Images"),
                                                     g_settings->value("import_path").toString(), 
                                                     tr("Volumes (*.nrrd *.dcm *.mhd *.mha)"));
-  for (int i = 0; i < files.size(); i++)
-  {
-    QString imagePath = files.at(i);
-    if ( ! addImageFromFile(imagePath) )
-      {
-      break;
-      }
-    added = true;
-
-  }
-
-  // Switch view to the last image loaded
-  if (added == true) this->on_setImageDataButton_released();
+  this->addImagesFromFiles(files);
 }
 
 void wseGUI::importDelete()
@@ -849,27 +1251,33 @@ void wseGUI::importDelete()
       QListWidgetItem *item = items.at(i);
       int row = ui.imageListWidget->row(item);
       QString name = item->text();
-      if (mImageStack->removeImage(name))
-	{
-	  ui.imageListWidget->takeItem(row);
-	  delete item;
-	}
-
 
+      // The viewers must let go of a displayed image, and of the slices
+      // they cached from it, before it is deleted.
+      const bool displayed = (row == mImageData || row == mImageMask);
       if (row == mImageData) 
 	{
 	  mImageData = -1;
 	  ui.sliceSelector->setEnabled(false);
-	  updateImageDisplay();
 	} 
-      else if (row == mImageMask) 
+      if (row == mImageMask) 
 	{
 	  mImageMask = -1;
 	} 
-      else if (row == mIsosurfaceImage) 
+      if (row == mIsosurfaceImage) 
 	{
 	  mIsosurfaceImage = -1;
 	}
+      if (displayed)
+        {
+          updateImageDisplay();
+        }
+
+      if (mImageStack->removeImage(name))
+	{
+	  ui.imageListWidget->takeItem(row);
+	  delete item;
+	}
       
       if (mImageData > row) 
 	{
@@ -897,7 +1305,7 @@ void wseGUI::importDelete()
 
 void wseGUI::imageDropped(QString fname)
 {
-  addImageFromFile(fname);
+  this->addImagesFromFiles(QStringList(fname));
 }
 
 bool wseGUI::addImageFromData(FloatImage *img)
@@ -927,49 +1335,117 @@ bool wseGUI::addImageFromData(FloatImage *img)
 }
 
 
-bool wseGUI::addImageFromFile(QString fname)
+void wseGUI::addImagesFromFiles(const QStringList &files)
 {
-  this->output(QString("Loading volume from ") + fname);
+  if (files.isEmpty())  { return; }
 
-  bool ans = true;  
-  QString errStr;
-  try 
-    {
-      ans = mImageStack->addImage(fname);
-    }
-  catch(itk::ExceptionObject &e)
+  // A new import, rather than files added to a running one
+  if (mLoadingItems.isEmpty())
     {
-      errStr = e.GetDescription();
-      ans = false;
+      mImportAddedImage = false;
+      mImportErrors.clear();
     }
 
-  if (ans == true)
+  // Each file gets a disabled row after the loaded images, which shows
+  // its progress until it is ready.
+  const int first = mImageLoader->load(files);
+  for (int i = 0; i < files.size(); i++)
     {
+      this->output(QString("Loading volume from ") + files.at(i));
+
       QListWidgetItem *item = new QListWidgetItem;
-      
-      item->setText(mImageStack->selectedName());
-      ui.imageListWidget->insertItem(ui.imageListWidget->count(), item);
-      ui.imageListWidget->setCurrentRow(ui.imageListWidget->count()-1);
-      //    ui.setIsosurfaceButton->setEnabled(true);
-      //    ui.setImageMaskButton->setEnabled(true);
-      ui.setImageDataButton->setEnabled(true);
-      //    mExportAction->setEnabled(true);
+      item->setData(Qt::UserRole, QFileInfo(files.at(i)).fileName());
+      item->setText(item->data(Qt::UserRole).toString() + tr(" (waiting)"));
+      item->setFlags(Qt::NoItemFlags);
+      ui.imageListWidget->addItem(item);
+      mLoadingItems.insert(first + i, item);
     }
-  else
-    {
-      this->output(QString("Error loading ") + fname);
-      int ret = QMessageBox::warning(this, tr("WSE"),
-				     tr("There was an error loading image at $1!\n").arg(fname) + errStr,
-				     QMessageBox::Ok);
-      return ret;
-      
-    }
-  QFileInfo fi(fname);
+  mCancelImportAction->setEnabled(true);
+
+  QFileInfo fi(files.last());
   QString path = fi.canonicalPath();
   if (!path.isNull()) {  g_settings->setValue("import_path", path); }
-  
+}
+
+void wseGUI::mImageLoader_started(int id)
+{
+  QListWidgetItem *item = mLoadingItems.value(id);
+  if (item)  { item->setText(item->data(Qt::UserRole).toString() + tr(" (loading)")); }
+}
+
+void wseGUI::mImageLoader_progress(int id, int percent)
+{
+  QListWidgetItem *item = mLoadingItems.value(id);
+  if (item)  { item->setText(item->data(Qt::UserRole).toString() + tr(" (%1%)").arg(percent)); }
+}
+
+void wseGUI::mImageLoader_loaded(int id)
+{
+  QListWidgetItem *item = mLoadingItems.take(id);
+  FloatImage *img = mImageLoader->takeImage(id);
+  if (item == NULL || img == NULL)
+    {
+      delete item;
+      delete img;
+      return;
+    }
+  mImageStack->addImage(img);
+
+  // The rows of the loaded images come first, in the order of the image
+  // stack, so the row moves up to the end of them.
+  ui.imageListWidget->takeItem(ui.imageListWidget->row(item));
+  item->setText(img->name());
+  item->setData(Qt::UserRole, QVariant());
+  item->setFlags(Qt::ItemIsSelectable | Qt::ItemIsUserCheckable | Qt::ItemIsEnabled | Qt::ItemIsDragEnabled);
+  ui.imageListWidget->insertItem(mImageStack->numImages()-1, item);
+  ui.setImageDataButton->setEnabled(true);
+  mImportAddedImage = true;
+
+  // addImage() selects the new image; keep the selection of the list.
+  this->on_imageListWidget_itemSelectionChanged();
+
+  this->output(QString("Loaded ") + img->name());
   this->syncRegisteredImageComboBoxes();
-  return true;
+}
+
+void wseGUI::mImageLoader_failed(int id, QString fname, QString error)
+{
+  delete mLoadingItems.take(id);
+  this->output(QString("Error loading ") + fname);
+  mImportErrors << fname + ": " + error;
+}
+
+void wseGUI::mImageLoader_cancelled(int id, QString fname)
+{
+  delete mLoadingItems.take(id);
+  this->output(QString("Cancelled loading ") + fname);
+}
+
+void wseGUI::mImageLoader_finished()
+{
+  // Files may have been added since the loader finished.
+  if (! mLoadingItems.isEmpty())  { return; }
+  mCancelImportAction->setEnabled(false);
+
+  // Switch view to the last image loaded
+  if (mImportAddedImage)
+    {
+      ui.imageListWidget->setCurrentRow(mImageStack->numImages()-1);
+      this->on_setImageDataButton_released();
+    }
+  if (! mImportErrors.isEmpty())
+    {
+      QMessageBox::warning(this, tr("WSE"),
+                           tr("There was an error loading these images:\n") + mImportErrors.join("\n"),
+                           QMessageBox::Ok);
+    }
+  mImportAddedImage = false;
+  mImportErrors.clear();
+}
+
+void wseGUI::cancelImport()
+{
+  mImageLoader->cancel();
 }
 
 
@@ -1078,7 +1554,10 @@ void wseGUI::updateHistogram()
     mask = mImageStack->image(mImageMask)->itkImage();
     mHistogram = new Histogram<FloatImage::itkImageType>(image, mask, numBins);
   } else {
-    mHistogram = new Histogram<FloatImage::itkImageType>(image, numBins);
+    // The image statistics are cached, so only the binning pass is run.
+    const FloatImage::Statistics &stats = mImageStack->image(mImageData)->statistics();
+    mHistogram = new Histogram<FloatImage::itkImageType>(image, numBins, stats.minimum, stats.maximum,
+                                                         stats.mean(), stats.count);
   }
     
   //  ui.lowerThresholdSpinBox->setRange(mHistogram->min(), mHistogram->max());
@@ -1176,8 +1655,12 @@ void wseGUI::thresholdChanged(double lower, double upper)
   mThresholdLower = (max-min) * lower + min;
   mThresholdUpper = (max-min) * upper + min;
   
-  mSliceViewer->SetThreshold(mThresholdLower, mThresholdUpper);
-  mSliceViewer->Render();
+  std::vector<SliceViewer *> viewers = this->imageViewers();
+  for (unsigned int i = 0; i < viewers.size(); i++)
+    {
+      viewers[i]->SetThreshold(mThresholdLower, mThresholdUpper);
+      mRenderScheduler->scheduleRender(viewers[i]);
+    }
   //  mIsoRenderer->setThreshold(mThresholdLower, mThresholdUpper);
   
   //  mThresholdTimer.stop();
@@ -1186,8 +1669,12 @@ void wseGUI::thresholdChanged(double lower, double upper)
 
 void wseGUI::on_showMaskCheckBox_stateChanged(int state)
 {
-  mSliceViewer->SetShowMask(state == Qt::Checked); 
-  this->mSliceViewer->Render();
+  std::vector<SliceViewer *> viewers = this->imageViewers();
+  for (unsigned int i = 0; i < viewers.size(); i++)
+    {
+      viewers[i]->SetShowMask(state == Qt::Checked);
+      mRenderScheduler->scheduleRender(viewers[i]);
+    }
   // mIsoRenderer->setSlice(mSliceViewer->GetFinalOutput());
   // mIsoRenderer->updateSlice();
   // redrawIsoSurface();
@@ -1195,15 +1682,23 @@ void wseGUI::on_showMaskCheckBox_stateChanged(int state)
 
 void wseGUI::on_imageMaskOpacitySlider_valueChanged(int value)
 {
-  mSliceViewer->SetMaskOpacity(value / 100.0f);
-  this->mSliceViewer->Render();
+  std::vector<SliceViewer *> viewers = this->imageViewers();
+  for (unsigned int i = 0; i < viewers.size(); i++)
+    {
+      viewers[i]->SetMaskOpacity(value / 100.0f);
+      mRenderScheduler->scheduleRender(viewers[i]);
+    }
   redrawIsoSurface();
 }
 
 void wseGUI::on_showThresholdCheckBox_stateChanged(int state)
 {
-  mSliceViewer->SetShowThreshold(state == Qt::Checked);
-  this->mSliceViewer->Render();
+  std::vector<SliceViewer *> viewers = this->imageViewers();
+  for (unsigned int i = 0; i < viewers.size(); i++)
+    {
+      viewers[i]->SetShowThreshold(state == Qt::Checked);
+      mRenderScheduler->scheduleRender(viewers[i]);
+    }
   //  mIsoRenderer->setSlice(mSliceViewer->GetFinalOutput());
   // mIsoRenderer->updateSlice();
   // redrawIsoSurface();
@@ -1211,15 +1706,23 @@ void wseGUI::on_showThresholdCheckBox_stateChanged(int state)
 
 void wseGUI::on_thresholdOpacitySlider_valueChanged(int value)
 {
-  mSliceViewer->SetThresholdOpacity(value / 100.0f);
-  this->mSliceViewer->Render();
+  std::vector<SliceViewer *> viewers = this->imageViewers();
+  for (unsigned int i = 0; i < viewers.size(); i++)
+    {
+      viewers[i]->SetThresholdOpacity(value / 100.0f);
+      mRenderScheduler->scheduleRender(viewers[i]);
+    }
   redrawIsoSurface();
 }
 
 void wseGUI::on_clipThresholdCheckBox_stateChanged(int state)
 {
-  mSliceViewer->SetClipThresholdToMask(state == Qt::Checked);
-  this->mSliceViewer->Render();
+  std::vector<SliceViewer *> viewers = this->imageViewers();
+  for (unsigned int i = 0; i < viewers.size(); i++)
+    {
+      viewers[i]->SetClipThresholdToMask(state == Qt::Checked);
+      mRenderScheduler->scheduleRender(viewers[i]);
+    }
 }
 
 //void wseGUI::thresholdTimerEvent() {
@@ -1295,6 +1798,8 @@ void wseGUI::toggleFullScreen()
 
 void wseGUI::setDualView()
 {
+  this->hideMPRPanes();
+
   // QList<int> controlSizes;
   // controlSizes.push_back(0);
   // controlSizes.push_back(100);
@@ -1313,6 +1818,8 @@ void wseGUI::setDualView()
 
 void wseGUI::setNormalView()
 {
+  this->hideMPRPanes();
+
   // QList<int> newSizes;
   // newSizes.push_back(20);
   // newSizes.push_back(100);
@@ -1332,6 +1839,8 @@ void wseGUI::setNormalView()
 
 void wseGUI::setSliceView()
 {
+  this->hideMPRPanes();
+
   // QList<int> controlSizes;
   // controlSizes.push_back(0);
   // controlSizes.push_back(100);
@@ -1355,6 +1864,8 @@ ui.histogramSplitter->setSizes(histSizes);
 
 void wseGUI::setIsoSurfaceView()
 {
+  this->hideMPRPanes();
+
   //  QList<int> controlSizes;
   // controlSizes.push_back(0);
   // controlSizes.push_back(100);
@@ -1372,6 +1883,279 @@ void wseGUI::setIsoSurfaceView()
   ui.viewSplitter->setSizes(viewSizes);
 }
 
+void wseGUI::setMPRView()
+{
+  QList<int> histSizes;
+  histSizes.push_back(100);
+  if (mImageData != -1) { histSizes.push_back(20); }
+  else { histSizes.push_back(0); }
+  ui.histogramSplitter->setSizes(histSizes);
+
+  // The XY pane and the XZ / YZ panes share the view equally
+  mMPRPanes->show();
+  QList<int> viewSizes;
+  viewSizes.push_back(ui.viewSplitter->width()/2);
+  viewSizes.push_back(0);
+  viewSizes.push_back(0);
+  viewSizes.push_back(ui.viewSplitter->width()/2);
+  ui.viewSplitter->setSizes(viewSizes);
+
+  this->updateMPRDisplay();
+}
+
+void wseGUI::setupUIMPR()
+{
+  mMPRPanes = new QWidget(ui.viewSplitter);
+  QVBoxLayout *layout = new QVBoxLayout(mMPRPanes);
+  layout->setSpacing(2);
+  layout->setMargin(0);
+
+  mCoronalWidget = new QVTKWidget(mMPRPanes);
+  mSagittalWidget = new QVTKWidget(mMPRPanes);
+  layout->addWidget(mCoronalWidget);
+  layout->addWidget(mSagittalWidget);
+  ui.viewSplitter->addWidget(mMPRPanes);
+
+  mCoronalWidget->SetRenderWindow(mCoronalViewer->GetRenderWindow());
+  mCoronalViewer->SetupInteractor(mCoronalWidget->GetRenderWindow()->GetInteractor());
+  mSagittalWidget->SetRenderWindow(mSagittalViewer->GetRenderWindow());
+  mSagittalViewer->SetupInteractor(mSagittalWidget->GetRenderWindow()->GetInteractor());
+
+  mMPRPanes->hide();
+}
+
+void wseGUI::hideMPRPanes()
+{
+  if (mMPRPanes == NULL || mMPRPanes->isHidden()) { return; }
+
+  mMPRPanes->hide();
+  mCoronalViewer->DisableDisplay();
+  mSagittalViewer->DisableDisplay();
+  mSliceViewer->SetShowCursor(false);
+  mSegmentSliceViewer->SetShowCursor(false);
+  if (mImageData != -1) { mSliceViewer->Render(); }
+}
+
+void wseGUI::updateMPRDisplay()
+{
+  if (! this->isMPRView() || mImageData == -1) { return; }
+
+  FloatImage *image = mImageStack->image(mImageData);
+  const FloatImage::Statistics &stats = image->statistics();
+
+  // The panes show the image, mask and overlays of mSliceViewer
+  SliceViewer *panes[2] = { mCoronalViewer, mSagittalViewer };
+  for (unsigned int i = 0; i < 2; i++)
+    {
+      panes[i]->SetImageMask(NULL);
+      panes[i]->SetInputScalarRange(stats.minimum, stats.maximum);
+      panes[i]->SetInputConnection(image->vtkImporter()->GetOutputPort());
+      if (mImageMask != -1) 
+        {
+          panes[i]->SetImageMask(mImageStack->image(mImageMask)->vtkImporter()->GetOutputPort());
+        }
+      panes[i]->SetColorWindow(mSliceViewer->GetColorWindow());
+      panes[i]->SetColorLevel(mSliceViewer->GetColorLevel());
+      panes[i]->SetShowMask(ui.showMaskCheckBox->isChecked());
+      panes[i]->SetMaskOpacity(ui.imageMaskOpacitySlider->value() / 100.0f);
+      panes[i]->SetShowThreshold(ui.showThresholdCheckBox->isChecked());
+      panes[i]->SetThresholdOpacity(ui.thresholdOpacitySlider->value() / 100.0f);
+      panes[i]->SetThreshold(mThresholdLower, mThresholdUpper);
+      panes[i]->SetClipThresholdToMask(ui.clipThresholdCheckBox->isChecked());
+      panes[i]->SetShowCursor(true);
+    }
+  mSliceViewer->SetShowCursor(true);
+  mSegmentSliceViewer->SetShowCursor(mSegmentation != NULL);
+
+  // Start at the center of the XY slice being shown, or when the
+  // crosshair falls outside of a new image.
+  vtkImageData *input = mSliceViewer->GetInput();
+  input->UpdateInformation();
+  const int *ext = input->GetWholeExtent();
+  if (mCrosshair[0] < ext[0] || mCrosshair[0] > ext[1]
+      || mCrosshair[1] < ext[2] || mCrosshair[1] > ext[3])
+    {
+      mCrosshair[0] = (ext[0] + ext[1]) / 2;
+      mCrosshair[1] = (ext[2] + ext[3]) / 2;
+    }
+  this->setCrosshair(mCrosshair[0], mCrosshair[1], ui.sliceSelector->value());
+}
+
+void wseGUI::setCrosshair(int i, int j, int k)
+{
+  vtkImageData *input = mSliceViewer->GetInput();
+  if (mImageData == -1 || input == NULL) { return; }
+
+  input->UpdateInformation();
+  const int *ext = input->GetWholeExtent();
+  int idx[3] = { i, j, k };
+  for (unsigned int c = 0; c < 3; c++)
+    {
+      if (idx[c] < ext[2*c])   { idx[c] = ext[2*c]; }
+      if (idx[c] > ext[2*c+1]) { idx[c] = ext[2*c+1]; }
+      mCrosshair[c] = idx[c];
+    }
+
+  // Keep the slice selector on the XY slice without re-entering
+  // viewerChangeSlice.
+  ui.sliceSelector->blockSignals(true);
+  ui.sliceSelector->setValue(idx[2]);
+  ui.sliceSelector->blockSignals(false);
+  ui.sliceNumberLabel->setText(QString::number(idx[2]));
+
+  const double *orig = input->GetOrigin();
+  const double *spac = input->GetSpacing();
+  double p[3];
+  for (unsigned int c = 0; c < 3; c++) { p[c] = orig[c] + spac[c] * idx[c]; }
+
+  // Every pane shows the slice through the crosshair.  The slices are
+  // computed concurrently, then the panes are drawn.
+  SliceViewer *viewers[4];
+  int slices[4];
+  int n = 0;
+  viewers[n] = mSliceViewer;     slices[n++] = idx[2];
+  if (mSegmentation != NULL)
+    { viewers[n] = mSegmentSliceViewer;  slices[n++] = idx[2]; }
+  viewers[n] = mCoronalViewer;   slices[n++] = idx[1];
+  viewers[n] = mSagittalViewer;  slices[n++] = idx[0];
+  for (int v = 0; v < n; v++) { viewers[v]->SetCursorPosition(p[0], p[1], p[2]); }
+  SliceViewer::SetSlices(viewers, slices, n, false);
+  for (int v = 0; v < n; v++) { mRenderScheduler->scheduleRender(viewers[v]); }
+
+  mCrosshairActor->SetMapper(NULL);
+}
+
+void wseGUI::crosshairPick(float x, float y, vtkRenderer *ren)
+{
+  if (mImageData == -1 || ! this->isMPRView()) { return; }
+
+  SliceViewer *viewer = NULL;
+  if (ren == mSliceViewer->GetRenderer())              { viewer = mSliceViewer; }
+  else if (ren == mSegmentSliceViewer->GetRenderer())  { viewer = mSegmentSliceViewer; }
+  else if (ren == mCoronalViewer->GetRenderer())       { viewer = mCoronalViewer; }
+  else if (ren == mSagittalViewer->GetRenderer())      { viewer = mSagittalViewer; }
+  if (viewer == NULL || viewer->GetInput() == NULL) { return; }
+
+  // The panes use parallel projection, so the depth of the display
+  // point does not matter.  The coordinate normal to the slice is that
+  // of the slice itself.
+  double w[4];
+  ren->SetDisplayPoint(x, y, 0.0);
+  ren->DisplayToWorld();
+  ren->GetWorldPoint(w);
+  if (w[3] != 0.0) { w[0] /= w[3];  w[1] /= w[3];  w[2] /= w[3]; }
+
+  const double *orig = viewer->GetInput()->GetOrigin();
+  const double *spac = viewer->GetInput()->GetSpacing();
+  int idx[3];
+  for (unsigned int c = 0; c < 3; c++)
+    {  idx[c] = static_cast<int>(floor((w[c] - orig[c]) / spac[c] + 0.5));  }
+  idx[viewer->GetSliceOrientation()] = viewer->GetSlice();
+
+  this->setCrosshair(idx[0], idx[1], idx[2]);
+}
+
+void wseGUI::toggleRegionBoundaries()
+{
+  this->updateBoundaryDisplay();
+
+  std::vector<SliceViewer *> viewers = this->imageViewers();
+  for (unsigned int i = 0; i < viewers.size(); i++)
+    {
+      mRenderScheduler->scheduleRender(viewers[i]);
+    }
+}
+
+void wseGUI::updateBoundaryDisplay()
+{
+  // The outlines are only drawn when the segmentation could have been
+  // computed from the displayed image (see updateImageDisplay).
+  const bool show = mShowBoundariesAction->isChecked()
+    && mSegmentation != NULL && mImageData != -1
+    && mSegmentation->nSlices() == mImageStack->image(mImageData)->nSlices();
+
+  SliceViewer *viewers[3] = { mSliceViewer, mCoronalViewer, mSagittalViewer };
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      if (show)
+        {
+          viewers[i]->SetBoundaryLabels(mSegmentation->GetOutputPort(),
+                                        mSegmentation->lookupTableManager());
+        }
+      else
+        {
+          viewers[i]->SetBoundaryLabels(NULL, NULL);
+        }
+      viewers[i]->SetShowBoundaries(show);
+    }
+}
+
+void wseGUI::showRegionSurface()
+{
+  // The crosshair of the MPR view selects the region.
+  if (mSegmentation == NULL || mCrosshair[0] < 0)
+    {
+      this->showStatusMessage(tr("Select a region with the crosshair of the MPR view first."), 5000);
+      return;
+    }
+
+  vtkImageData *labels = mSegmentation->vtkImporter()->GetOutput();
+  labels->UpdateInformation();
+  int ext[6];
+  labels->GetWholeExtent(ext);
+  if (mCrosshair[0] < ext[0] || mCrosshair[0] > ext[1]
+      || mCrosshair[1] < ext[2] || mCrosshair[1] > ext[3]
+      || mCrosshair[2] < ext[4] || mCrosshair[2] > ext[5])
+    {
+      this->showStatusMessage(tr("The crosshair lies outside of the segmentation."), 5000);
+      return;
+    }
+  labels->SetUpdateExtent(ext);
+  labels->Update();
+  const unsigned long label = static_cast<unsigned long>(
+    labels->GetScalarComponentAsDouble(mCrosshair[0], mCrosshair[1], mCrosshair[2], 0));
+
+  QTime startTime = QTime::currentTime();
+  mRegionSurface->SetLabels(mSegmentation->GetOutputPort(),
+                            mSegmentation->lookupTableManager(),
+                            mSegmentation->boundingBoxManager());
+  vtkPolyData *surface = mRegionSurface->Update(label);
+  if (surface == NULL)
+    {
+      this->showStatusMessage(tr("The surface of the region could not be extracted."), 5000);
+      return;
+    }
+  const qint32 msecs = startTime.msecsTo(QTime::currentTime());
+
+  // Draw the surface in the color of the region
+  double rgba[4];
+  mSegmentation->GetLookupTable()->GetTableValue(static_cast<vtkIdType>(label), rgba);
+  mRegionSurfaceActor->GetProperty()->SetColor(rgba[0], rgba[1], rgba[2]);
+  mRegionSurfaceLOD->SetInput(surface);
+  mRegionSurfaceRenderer->ResetCamera();
+
+  this->setIsoSurfaceView();
+  ui.vtkRenderWidget->GetRenderWindow()->Render();
+
+  this->output(QString("Region of label %1: %2 labels, %3 triangles in %4 ms")
+               .arg(mSegmentation->originalLabel(label))
+               .arg(mRegionSurface->GetNumberOfRegionLabels())
+               .arg(surface->GetNumberOfPolys())
+               .arg(msecs));
+}
+
+std::vector<SliceViewer *> wseGUI::imageViewers()
+{
+  std::vector<SliceViewer *> viewers;
+  viewers.push_back(mSliceViewer);
+  if (this->isMPRView())
+    {
+      viewers.push_back(mCoronalViewer);
+      viewers.push_back(mSagittalViewer);
+    }
+  return viewers;
+}
+
 void wseGUI::on_endoSurfaceComboBox_currentIndexChanged( int index )
 {
   // mIsoRenderer->setRenderMethods(ui.wallSurfaceComboBox->currentText().toStdString(), 
@@ -1589,6 +2373,17 @@ void wseGUI::changeSlice( bool direction )
   ui.sliceSelector->setValue(slice);
 }
 
+void wseGUI::changeSlice(bool direction, vtkRenderer *ren)
+{
+  const int step = direction ? 1 : -1;
+  if (this->isMPRView() && ren == mCoronalViewer->GetRenderer())
+    {  this->setCrosshair(mCrosshair[0], mCrosshair[1] + step, mCrosshair[2]);  }
+  else if (this->isMPRView() && ren == mSagittalViewer->GetRenderer())
+    {  this->setCrosshair(mCrosshair[0] + step, mCrosshair[1], mCrosshair[2]);  }
+  else
+    {  this->changeSlice(direction);  }
+}
+
 void wseGUI::wheelEvent(QWheelEvent * event) 
 {
   if (event->delta() > 0) {
@@ -1617,6 +2412,23 @@ void wseGUI::setMouseHandling()
   ui.vtkRenderWidget->GetRenderWindow()->GetInteractor()->RemoveObservers(vtkCommand::MouseWheelForwardEvent);
   ui.vtkRenderWidget->GetRenderWindow()->GetInteractor()->AddObserver(vtkCommand::MouseWheelBackwardEvent, mVTKCallback);
   ui.vtkRenderWidget->GetRenderWindow()->GetInteractor()->AddObserver(vtkCommand::MouseWheelForwardEvent, mVTKCallback);
+
+  // Clicking in a slice pane moves the MPR crosshair.  The wheel steps
+  // the slice of the XZ and YZ panes.
+  QVTKWidget *panes[4] = { ui.vtkImageWidget, ui.vtkSegmentationWidget, mCoronalWidget, mSagittalWidget };
+  for (unsigned int i = 0; i < 4; i++)
+    {
+      vtkRenderWindowInteractor *interactor = panes[i]->GetRenderWindow()->GetInteractor();
+      interactor->RemoveObservers(vtkCommand::LeftButtonPressEvent);
+      interactor->AddObserver(vtkCommand::LeftButtonPressEvent, mVTKCallback);
+      if (i >= 2)
+        {
+          interactor->RemoveObservers(vtkCommand::MouseWheelBackwardEvent);
+          interactor->RemoveObservers(vtkCommand::MouseWheelForwardEvent);
+          interactor->AddObserver(vtkCommand::MouseWheelBackwardEvent, mVTKCallback);
+          interactor->AddObserver(vtkCommand::MouseWheelForwardEvent, mVTKCallback);
+        }
+    }
 }
 
 
@@ -1680,7 +2492,7 @@ void wseGUI::pointPick3D()
  
   mCrosshairActor->SetMapper(mapper);
 
-  mSliceViewer->Render();
+  mRenderScheduler->scheduleRender(mSliceViewer);
 }
 
 void wseGUI::on_gaussianRadioButton_toggled(bool on)
@@ -1803,141 +2615,94 @@ void wseGUI::floodLevelChanged()
   // Set the segmentation 
   //  mSegmentSliceViewermanager->ClearHighlightedValuesToSameColor();
   mSegmentation->Merge(lvl / 100.0);
-  mSegmentSliceViewer->Render();
+  mRenderScheduler->scheduleRender(mSegmentSliceViewer);
+
+  // The region outlines follow the merge
+  if (mShowBoundariesAction->isChecked())
+    {
+      std::vector<SliceViewer *> viewers = this->imageViewers();
+      for (unsigned int i = 0; i < viewers.size(); i++)
+        {
+          mRenderScheduler->scheduleRender(viewers[i]);
+        }
+    }
   //  this->updateImageDisplay();
 }
 
-void wseGUI::cellPickSegment(float x, float y, bool repick, vtkRenderer *ren)
+void wseGUI::queueProbe(float x, float y, vtkRenderer *ren)
 {
-  if (mImageData == -1) return; // make sure image data is selected
-  
-  // Need to trigger pick event
-  if (repick == true)
-    {     mCellPickerSegment->Pick(x,y,0.0,ren);    }
+  mProbeX = x;
+  mProbeY = y;
+  mProbeRenderer = ren;
+  if (! mProbeTimer->isActive())  { mProbeTimer->start(); }
+}
 
-  double pickPosition[3];
-  mCellPickerSegment->GetPickPosition(pickPosition);
+void wseGUI::mProbeTimer_timeout()
+{
+  if (mProbeRenderer != NULL)
+    {  this->cellPickSegment(mProbeX, mProbeY, mProbeRenderer);  }
+}
+
+void wseGUI::cellPickSegment(float x, float y, vtkRenderer *ren)
+{
+  if (mImageData == -1) return; // make sure image data is selected
+  if (mSliceViewer->GetInput() == NULL) return;
+
+  // The slice view uses parallel projection, so the point under the
+  // cursor follows from the camera alone, without searching the points
+  // of the slice with a picker.  The coordinate normal to the slice is
+  // that of the slice itself.
+  double pickPosition[4];
+  ren->SetDisplayPoint(x, y, 0.0);
+  ren->DisplayToWorld();
+  ren->GetWorldPoint(pickPosition);
+  if (pickPosition[3] != 0.0)
+    {
+      pickPosition[0] /= pickPosition[3];
+      pickPosition[1] /= pickPosition[3];
+      pickPosition[2] /= pickPosition[3];
+    }
 
-  // TODO: The vtkPicker for some reason does not return the correct z
-  // coordinate for the point position (GetPickPosition).  I can't
-  // figure out why, so I'm computing it explicitly here. -- JC
   const double *orig =  mSliceViewer->GetInput()->GetOrigin();
   const double *spac =  mSliceViewer->GetInput()->GetSpacing();
-  pickPosition[2] = orig[2] + spac[2] * (double)(mSliceViewer->GetSlice());
-  float val = mImageStack->image(mImageData)->getLinearInterpolatedPixel(pickPosition);
+  const int normal = mSliceViewer->GetSliceOrientation();
+  pickPosition[normal] = orig[normal] + spac[normal] * (double)(mSliceViewer->GetSlice());
+  FloatImage *image = mImageStack->image(mImageData);
+  float val;
+  image->sampleLinear(pickPosition, 1, &val);
+
+  QString message = QString("X: %1  Y: %2  Z: %3  Value: %4")
+    .arg(pickPosition[0]).arg(pickPosition[1]).arg(pickPosition[2]).arg(val);
+
+  // The watershed label of the voxel and the region it is merged into
+  // at the current flood level, which the root table holds for every
+  // label (see updateImageDisplay for when the segmentation is shown).
+  if (mSegmentation != NULL && mSegmentation->nSlices() == image->nSlices())
+    {
+      const ULongImage *labels = mSegmentation->watershedTransform();
+      const unsigned int size[3] = { labels->width(), labels->height(), labels->nSlices() };
+      int idx[3];
+      bool inside = true;
+      for (unsigned int c = 0; c < 3; c++)
+        {
+          idx[c] = static_cast<int>(floor((pickPosition[c] - orig[c]) / spac[c] + 0.5));
+          inside = inside && idx[c] >= 0 && idx[c] < static_cast<int>(size[c]);
+        }
+      if (inside)
+        {
+          vtkWSLookupTableManager *lut = mSegmentation->lookupTableManager();
+          const unsigned long label = labels->getPixel(idx);
+          const unsigned long *roots = lut->GetRootTable();
+          const unsigned long region = (roots != NULL && label < lut->GetNumberOfLabels())
+            ? roots[label] : lut->GetMergedToLabel(label);
+          message += QString("  Label: %1  Region: %2")
+            .arg(mSegmentation->originalLabel(label)).arg(mSegmentation->originalLabel(region));
+        }
+    }
 
   // Print info to console
   // this->output(QString("[%1 %2 %3] = %4").arg(pickPosition[0]).arg(pickPosition[1]).arg(pickPosition[2]).arg(val));
-  this->statusBar()->showMessage(QString("X: %1  Y: %2  Z: %3  Value: %4").arg(pickPosition[0]).arg(pickPosition[1]).arg(pickPosition[2]).arg(val));
-
-  // DEBUG INFO
-  // double data[3];
-  //  mCellPickerSegment->GetSelectionPoint(data);
-  //  std::cout << "Pick: Selection Point = (" << data[0] << ", " << data[1] << ", " << data[2] << ")\n";
-
-  // std::cout << "img origin = " << orig[0] << " " << orig[1] << " " << orig[2] << std::endl;
-  // std::cout << "img spac = " << spac[0] << " " << spac[1] << " " << spac[2] << std::endl;  
-  // std::cout << "zpos = " << zpos << std::endl;
-  // int x,y,z;
-  // int x[3];
-  // mCellPickerSegment->GetPointIJK(x);
-  // std::cout << "Pick: PointIJK = " << "(" << x[0] << ", " << x[1] << ", " << x[2] << ")\n"; 
-  //
-  // int i,j,k;
-  // mCellPickerSegment->GetCellIJK(i,j,k);
-  // std::cout << "Pick: CellIJK = " << "(" << i << ", " << j << ", " << k << ")\n"; 
-
-  //  double pCoords[3];
-  // mCellPickerSegment->GetPCoords(pCoords);
-  // std::cout << "Pick: Parameteric Coords = (" << pCoords[0] << ", " << pCoords[1] << ", " << pCoords[2] << ")\n";
-
-  //std::cout << "Pick: Cell Id = " <<  mCellPickerSegment->GetCellId() << std::endl;
-  //  std::cout << "Pick: Point Id = " <<  mCellPickerSegment->GetPointId() << std::endl;
-
-  // std::cout << "Prop3d size = " << mCellPickerSegment->GetProp3Ds()->GetNumberOfItems() << std::endl;
-
-
-
-  //  std::cout << "Pixel value = " << mImageStack->image(mImageData)->getLinearInterpolatedPixel(pickPosition) << std::endl;
-  // std::cout << "ITK image origin = " << mImageStack->image(mImageData)->itkImage()->GetOrigin() << std::endl;
-  // std::cout << "ITK image spacing = " << mImageStack->image(mImageData)->itkImage()->GetSpacing() << std::endl;
-
-  // double spc[3];
-  // mImageStack->image(mImageData)->vtkImporter()->GetDataSpacing(spc);
-  // std::cout << "vtkImporter->GetDataSpacing() = " << spc[0] << ", " << spc[1] << ", " << spc[2] << std::endl;
-
-  // double mpos[3];
-  // mCellPickerSegment->GetMapperPosition(mpos);
-  //std::cout << "picker->GetMapperPosition() = " << mpos[0] << ", " << mpos[1] << ", " << mpos[2] << std::endl;
-
-  // if (mCellPickerSegment->GetProp3Ds()->GetNumberOfItems() > 0)
-  //   {
-  //     std::cout << "here" << std::endl;
-  //     vtkMatrix4x4 *m = vtkMatrix4x4::New();
-  //     m = mCellPickerSegment->GetProp3Ds()->GetLastProp()->GetMatrix();
-
-  //      for (unsigned r = 0; r < 3; r++)
-  //        {
-  //          for(unsigned c = 0; c < 3; c++)
-  //            {
-  //              std::cout <<  m->GetElement(r,c) << " ";
-  //            }
-  //          std::cout << std::endl;
-  //        }
-  //   }
-
-  //  mCellPickerSegment->GetProp3Ds()->
-  
-  // int slice = mImageStack->image(mImageData)->getSliceForPoint(pickPosition);
-  // std::cout << "Pick: slice: " << slice << "\n";
-  // ui.sliceSelector->setValue(slice);
-
-  // const int length = 3;
-  // double x = pickPosition[0];
-  // double y = pickPosition[1];
-  // //double z = pickPosition[2];
-  // double z = mImageStack->image(mImageData)->getClosestSlicePoint(pickPosition);
-  // vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
-  // points->SetNumberOfPoints(5);
-  // points->SetPoint(0, x, y, z);
-  // points->SetPoint(1, x+length, y, z);
-  // points->SetPoint(2, x, y+length, z);
-  // points->SetPoint(3, x-length, y, z);
-  // points->SetPoint(4, x, y-length, z);
-
-
-  // vtkSmartPointer<vtkCellArray> lines = vtkSmartPointer<vtkCellArray>::New();
-
-  // for (int i=1; i<5; i++) {
-  //   lines->InsertNextCell(2);
-  //   lines->InsertCellPoint(0);
-  //   lines->InsertCellPoint(i);
-  // }
-
-  // vtkSmartPointer<vtkUnsignedCharArray> colors = vtkSmartPointer<vtkUnsignedCharArray>::New();
-  // colors->SetName("Colors");
-  // colors->SetNumberOfComponents(3);
-  // colors->SetNumberOfTuples(5);
-  // for (int i = 0; i < 5 ;i++) 
-  //   {
-  //     colors->InsertTuple3(i, 255, 255, 0);
-  //   }
-  
-  // vtkSmartPointer<vtkPolyData> polyData = vtkSmartPointer<vtkPolyData>::New();
-  // polyData->SetPoints(points);
-  // polyData->SetLines(lines);
-  // polyData->GetPointData()->AddArray(colors);
-
-  // vtkSmartPointer<vtkPolyDataMapper> mapper = vtkSmartPointer<vtkPolyDataMapper>::New();
-  // mapper->SetInput(polyData);
-
-  // mapper->ScalarVisibilityOn();
-  // mapper->SetScalarModeToUsePointFieldData();
-  // mapper->SelectColorArray("Colors");
- 
-  // mCrosshairActor->SetMapper(mapper);
-
-  // mSliceViewer->Render();
+  this->statusBar()->showMessage(message);
 }
 
 } // end namespace
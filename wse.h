@@ -12,6 +12,7 @@
 #include <QtGui/QMainWindow>
 #include <QtGui/QProgressBar>
 #include <QSettings>
+#include <QTimer>
 #include <QDebug>
 #include "ui_wse.h"
 
@@ -58,6 +59,11 @@
 #include "wseHistogram.hxx"
 #include "wseSliceViewer.h"
 #include "wseSegmentationViewer.h"
+#include "wseRegionSurface.h"
+#include "wseImageLoader.h"
+#include "wseImageExporter.h"
+#include "wseRenderScheduler.h"
+#include "wseSurfaceLOD.h"
 //#include "IsoRenderer.h"
 #include "wseUtils.h"
 #include "wseSegmentation.h"
@@ -131,9 +137,9 @@ public:
   /** Updates and re-renders all of the viewer windows. */
   void updateImageDisplay();
 
-  /** Add an image to the image stack from a file.  The argument is
-      the filename.  Returns true on success and false otherwise. */
-  bool addImageFromFile(QString fname);
+  /** Loads images from files in the background.  Each image is added
+      to the image stack as soon as it has loaded. */
+  void addImagesFromFiles(const QStringList &files);
 
   /** Add an image to the image stack from a FloatImage pointer.
       Responsibility for freeing the image data is passed to this
@@ -154,6 +160,8 @@ public:
 
 public slots:
   void importDelete();
+  void importSegmentation();
+  void exportSegmentation();
   void imageDropped(QString);
   void visClassCheckAll();
   void visClassUncheckAll();
@@ -176,14 +184,42 @@ public slots:
   void setSliceView();
   void setIsoSurfaceView();
 
+  /** Shows the image in three orthogonal panes (XY, XZ and YZ) with a
+      crosshair linking them. */
+  void setMPRView();
+
+  /** Shows or hides the outlines of the merged segmentation regions
+      over the image views. */
+  void toggleRegionBoundaries();
+
+  /** Extracts the surface of the merged region under the crosshair and
+      shows it in the 3D view. */
+  void showRegionSurface();
+
   /** Picking callback for the 3D render window. */
   void pointPick3D();
 
-  /** Picking callback for the 2D segment render window. */
-  void cellPickSegment(float x, float y, bool repick, vtkRenderer *ren);
+  /** Picking callback for the 2D segment render window.  Shows the
+      position, the image value, and the watershed label and merged
+      region under the display point (x,y) of ren in the status bar. */
+  void cellPickSegment(float x, float y, vtkRenderer *ren);
+
+  /** Probes the display point (x,y) of ren with cellPickSegment() at
+      the next refresh of the display.  A burst of mouse moves is
+      probed once, at its last position. */
+  void queueProbe(float x, float y, vtkRenderer *ren);
 
   void changeSlice(bool direction);
 
+  /** Steps the slice of the pane drawn by ren.  The XZ and YZ panes of
+      the MPR view move the crosshair; every other pane changes the
+      slice selector. */
+  void changeSlice(bool direction, vtkRenderer *ren);
+
+  /** Moves the crosshair of the MPR view to the point under the display
+      position (x, y) of the pane drawn by ren. */
+  void crosshairPick(float x, float y, vtkRenderer *ren);
+
   /** Syncronizes all registered combo boxes
       (mRegisteredImageComboBoxes) with the names of image data in the
       ui.imageListWidget.*/
@@ -219,14 +255,23 @@ private:
 
   /** Actions triggered from the main interface */
   QAction *mExportImageAction;
+  QAction *mExportAllImagesAction;
+  QAction *mCancelExportAction;
+  QAction *mFullPrecisionResultsAction;
   QAction *mImportImageAction;
+  QAction *mCancelImportAction;
   QAction *mImportWSSegmentationAction;
+  QAction *mExportWSSegmentationAction;
   //  QAction *mExportColormapAction;
   QAction *mFullScreenAction;
   QAction *mNormalView;
   QAction *mDualView;
   QAction *mSliceView;
   QAction *mIsoSurfaceView;
+  QAction *mMPRView;
+  QAction *mShowBoundariesAction;
+  QAction *mRenderStatisticsAction;
+  QAction *mShowRegionSurfaceAction;
   QAction *mViewControlWindowAction;
   QAction *mViewDataWindowAction;
   QAction *mViewWatershedWindowAction;
@@ -240,6 +285,30 @@ private:
   /** The stack of image volumes in memory */
   FloatImageStack *mImageStack;
 
+  /** Reads imported volumes in the background.  The rows of the
+      ui.imageListWidget beyond those of mImageStack show the files that
+      are still loading, keyed here by their loader job. */
+  ImageLoader *mImageLoader;
+  QMap<int, QListWidgetItem *> mLoadingItems;
+  QStringList mImportErrors;
+  bool mImportAddedImage;
+
+  /** Writes saved volumes in the background, one file after the
+      other.  The volumes waiting to be saved are queued here with
+      their file names, and each is only fetched from the image stack
+      when its turn comes, so that a batch does not bring every volume
+      into memory at once. */
+  ImageExporter *mImageExporter;
+  QList<QPair<const FloatImage *, QString> > mExportQueue;
+  QStringList mExportErrors;
+
+  /** Queues a volume of the image stack for saving to fname. */
+  void queueExport(int i, const QString &fname);
+
+  /** Passes the next queued volume that is still in the image stack to
+      the exporter.  Returns false if there is none. */
+  bool exportNextImage();
+
   /** The watershed segmentation.  This object is NULL if no
       segmentation exists. This version of wse only supports one
       segmentation at a time.*/
@@ -271,11 +340,44 @@ private:
       output */
   SegmentationViewer *mSegmentSliceViewer;
 
+  /** The XZ and YZ panes of the MPR view, which show the same image
+      and mask as mSliceViewer. */
+  SliceViewer *mCoronalViewer;
+  SliceViewer *mSagittalViewer;
+
+  /** The widget holding the XZ and YZ panes, hidden unless the MPR
+      view is selected. */
+  QWidget *mMPRPanes;
+  QVTKWidget *mCoronalWidget;
+  QVTKWidget *mSagittalWidget;
+
+  /** The voxel index of the MPR crosshair. */
+  int mCrosshair[3];
+
+  /** Coalesces mouse moves for queueProbe(), and the last display
+      point and renderer that were queued. */
+  QTimer *mProbeTimer;
+  float mProbeX;
+  float mProbeY;
+  vtkRenderer *mProbeRenderer;
+
+  /** Renders the slice viewers at most once per display refresh.
+      Slots that change what a viewer shows schedule a render here
+      instead of calling Render() themselves. */
+  RenderScheduler *mRenderScheduler;
+
   /** TODO: Document */
   vtkImageData *mNullVTKImageData;
 
   /** TODO: Document */
   vtkActor *mCrosshairActor;
+
+  /** The surface of the selected region, drawn in the 3D view. */
+  RegionSurface *mRegionSurface;
+  SurfaceLOD *mRegionSurfaceLOD;
+  vtkPolyDataMapper *mRegionSurfaceMapper;
+  vtkActor *mRegionSurfaceActor;
+  vtkRenderer *mRegionSurfaceRenderer;
   
   //  IsoRenderer *mIsoRenderer;
 
@@ -310,9 +412,6 @@ private:
   /** Picker object for the 3D Render window */
   vtkPointPicker *mPointPicker3D;
 
-  /** Picker object for the 2D Segmentation window */
-  vtkPointPicker *mCellPickerSegment;
-
   /** TODO: Document */
   bool mFullScreen;
 
@@ -355,6 +454,11 @@ private:
   /** Run the watershed segmentation filter */
   void runWatershedSegmentation();
 
+  /** Replaces the current segmentation (if any) with s and updates the
+      flood level controls and viewers to display it.  This class takes
+      ownership of s. */
+  void installSegmentation(Segmentation *s);
+
   /** Requests termination of filtering operations. */
   void requestAbortITKFilter()
   {
@@ -416,6 +520,36 @@ private:
   /** TODO: Document. */
   void updateColorMap();
 
+  /** Creates the XZ and YZ panes of the MPR view. */
+  void setupUIMPR();
+
+  /** Returns true if the MPR view is selected. */
+  bool isMPRView() const
+  { return mMPRPanes != NULL && ! mMPRPanes->isHidden(); }
+
+  /** Connects the MPR panes to the displayed image and mask. */
+  void updateMPRDisplay();
+
+  /** Pins the displayed images in the image stack and releases the
+      others as the memory budget requires. */
+  void pinDisplayedImages();
+
+  /** Hides the MPR panes and releases their pipelines. */
+  void hideMPRPanes();
+
+  /** Moves the MPR crosshair to voxel (i, j, k) and shows the slices
+      through it in every pane. */
+  void setCrosshair(int i, int j, int k);
+
+  /** Connects the region outlines of the image views to the
+      segmentation, or removes them if they are switched off or the
+      segmentation does not match the displayed image. */
+  void updateBoundaryDisplay();
+
+  /** Returns the viewers of the image volume: mSliceViewer, and the MPR
+      panes if the MPR view is selected. */
+  std::vector<SliceViewer *> imageViewers();
+
 private slots:
   void unimplemented()
   {  QMessageBox::warning(this, tr("Sorry"), QString("This function is not yet implemented."));  }
@@ -488,10 +622,42 @@ private slots:
   void displayHelp();
 
   // Won't connect automatically
+  void mProbeTimer_timeout();
   void mITKFilteringThread_finished();
   void mITKFilteringThread_started();
   void mITKSegmentationThread_finished();
   void mITKSegmentationThread_started();
+  void mImageLoader_started(int id);
+  void mImageLoader_progress(int id, int percent);
+  void mImageLoader_loaded(int id);
+  void mImageLoader_failed(int id, QString fname, QString error);
+  void mImageLoader_cancelled(int id, QString fname);
+  void mImageLoader_finished();
+
+  /** Cancels the volumes that are still loading. */
+  void cancelImport();
+
+  void mImageExporter_started(int id, QString fname);
+  void mImageExporter_progress(int id, int percent);
+  void mImageExporter_saved(int id, QString fname);
+  void mImageExporter_failed(int id, QString fname, QString error);
+  void mImageExporter_cancelled(int id, QString fname);
+  void mImageExporter_finished();
+
+  /** Saves every volume of the image stack into a directory, as one
+      batch of compressed NRRD files. */
+  void exportAllImages();
+
+  /** Cancels the volumes that are still being saved. */
+  void cancelExport();
+
+  /** Chooses whether filter results are kept at full precision or
+      stored compactly while they are not displayed. */
+  void setFullPrecisionResults(bool on);
+
+  /** Prints the frame timing of the render scheduler to the console
+      and starts a new measurement. */
+  void showRenderStatistics();
 
 }; // end class wseGUI
 
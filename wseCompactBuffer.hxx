@@ -0,0 +1,228 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    wseCompactBuffer.hxx
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+#ifndef _wse_compact_buffer_hxx
+#define _wse_compact_buffer_hxx
+
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#include "wseParallel.hxx"
+
+namespace wse {
+
+/** The ways an image may store its pixels when it is not in use.
+    FullPrecision keeps the pixel type of the image.  HalfFloat stores
+    IEEE 754 binary16 values, which keep about three significant
+    digits at any magnitude up to 65504.  Quantized16 stores 16-bit
+    codes spread evenly between the minimum and maximum of the image. */
+enum CompactStorage
+{
+  FullPrecision,
+  HalfFloat,
+  Quantized16
+};
+
+/** Converts a float to the nearest binary16 value, rounding ties to
+    even.  Values beyond the range of binary16 become infinities. */
+inline unsigned short FloatToHalf(float f)
+{
+  unsigned int u;
+  std::memcpy(&u, &f, sizeof(u));
+  const unsigned int sign = (u >> 16) & 0x8000;
+  u &= 0x7fffffff;
+
+  if (u >= 0x7f800000)  // Infinity or NaN
+    {  return static_cast<unsigned short>(sign | 0x7c00 | (u > 0x7f800000 ? 0x200 : 0));  }
+  if (u >= 0x477ff000)  // Rounds beyond 65504
+    {  return static_cast<unsigned short>(sign | 0x7c00);  }
+  if (u < 0x38800000)   // Below 2^-14: a subnormal binary16 or zero
+    {
+      if (u < 0x33000000)  {  return static_cast<unsigned short>(sign);  }
+      const unsigned int shift = 126 - (u >> 23);
+      const unsigned int m = (u & 0x7fffff) | 0x800000;
+      unsigned int h = m >> shift;
+      const unsigned int rem = m & ((1u << shift) - 1);
+      const unsigned int halfway = 1u << (shift - 1);
+      if (rem > halfway || (rem == halfway && (h & 1)))  { h++; }
+      return static_cast<unsigned short>(sign | h);
+    }
+
+  // Rebias the exponent from 127 to 15.  A mantissa that rounds up
+  // carries into the exponent, which is what rounding should do.
+  unsigned int h = (u - 0x38000000) >> 13;
+  const unsigned int rem = u & 0x1fff;
+  if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))  { h++; }
+  return static_cast<unsigned short>(sign | h);
+}
+
+/** Converts a binary16 value to a float, which is exact. */
+inline float HalfToFloat(unsigned short h)
+{
+  const unsigned int sign = (static_cast<unsigned int>(h) & 0x8000) << 16;
+  unsigned int e = (h >> 10) & 0x1f;
+  unsigned int m = h & 0x3ff;
+  unsigned int u;
+  if (e == 0)
+    {
+      if (m == 0)  {  u = sign;  }
+      else
+        {
+          // Normalize a subnormal value.
+          e = 113;
+          while ((m & 0x400) == 0)  { m <<= 1; e--; }
+          u = sign | (e << 23) | ((m & 0x3ff) << 13);
+        }
+    }
+  else if (e == 31)  {  u = sign | 0x7f800000 | (m << 13);  }
+  else               {  u = sign | ((e + 112) << 23) | (m << 13);  }
+
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+/** Holds the pixels of an image as 16-bit codes, in one of the
+    CompactStorage formats, and widens them back to the pixel type on
+    request.  Encoding and decoding run on all threads. */
+class CompactBuffer
+{
+public:
+  CompactBuffer() : mStorage(FullPrecision), mScale(1.0), mOffset(0.0) {}
+
+  /** Encodes n values.  "minimum" and "maximum" are the range of the
+      values, which Quantized16 spreads its codes over. */
+  template<class T>
+  void encode(const T *values, unsigned long n, CompactStorage storage,
+              double minimum, double maximum);
+
+  /** Widens every code into values, which must hold size() values. */
+  template<class T>
+  void decode(T *values) const;
+
+  /** Returns the widened value of code i. */
+  double value(unsigned long i) const
+  {
+    if (mStorage == HalfFloat)  {  return HalfToFloat(mCodes[i]);  }
+    return mOffset + mScale * mCodes[i];
+  }
+
+  /** Releases the codes and returns to FullPrecision. */
+  void clear()
+  {
+    std::vector<unsigned short>().swap(mCodes);
+    mStorage = FullPrecision;
+  }
+
+  CompactStorage storage() const { return mStorage; }
+  unsigned long size() const { return mCodes.size(); }
+  unsigned short *codes() { return mCodes.empty() ? NULL : &mCodes[0]; }
+  const unsigned short *codes() const { return mCodes.empty() ? NULL : &mCodes[0]; }
+
+  /** Resizes the codes without changing the format, as when reading
+      them back from a file. */
+  void resize(unsigned long n) { mCodes.resize(n); }
+
+  /** Releases the codes but keeps the format, scale and offset, as when
+      writing them to a file. */
+  void releaseCodes() { std::vector<unsigned short>().swap(mCodes); }
+
+private:
+  template<class T> friend struct CompactEncodeFunctor;
+  template<class T> friend struct CompactDecodeFunctor;
+
+  CompactStorage mStorage;
+  double mScale;
+  double mOffset;
+  std::vector<unsigned short> mCodes;
+};
+
+template<class T>
+struct CompactEncodeFunctor
+{
+  const T *values;
+  CompactBuffer *buffer;
+  double inverseScale;
+
+  void operator()(unsigned long begin, unsigned long end, unsigned int) const
+  {
+    unsigned short *codes = &buffer->mCodes[0];
+    if (buffer->mStorage == HalfFloat)
+      {
+        for (unsigned long i = begin; i < end; i++)
+          {  codes[i] = FloatToHalf(static_cast<float>(values[i]));  }
+      }
+    else
+      {
+        const double offset = buffer->mOffset;
+        for (unsigned long i = begin; i < end; i++)
+          {
+            const double c = (static_cast<double>(values[i]) - offset) * inverseScale + 0.5;
+            codes[i] = static_cast<unsigned short>(c < 0.0 ? 0.0 : (c > 65535.0 ? 65535.0 : c));
+          }
+      }
+  }
+};
+
+template<class T>
+struct CompactDecodeFunctor
+{
+  T *values;
+  const CompactBuffer *buffer;
+
+  void operator()(unsigned long begin, unsigned long end, unsigned int) const
+  {
+    const unsigned short *codes = &buffer->mCodes[0];
+    if (buffer->mStorage == HalfFloat)
+      {
+        for (unsigned long i = begin; i < end; i++)
+          {  values[i] = static_cast<T>(HalfToFloat(codes[i]));  }
+      }
+    else
+      {
+        const double offset = buffer->mOffset;
+        const double scale = buffer->mScale;
+        for (unsigned long i = begin; i < end; i++)
+          {  values[i] = static_cast<T>(offset + scale * codes[i]);  }
+      }
+  }
+};
+
+template<class T>
+void CompactBuffer::encode(const T *values, unsigned long n, CompactStorage storage,
+                           double minimum, double maximum)
+{
+  mStorage = storage;
+  mOffset = minimum;
+  mScale = (maximum > minimum) ? (maximum - minimum) / 65535.0 : 0.0;
+  mCodes.resize(n);
+  if (n == 0)  { return; }
+
+  CompactEncodeFunctor<T> f;
+  f.values = values;
+  f.buffer = this;
+  f.inverseScale = mScale > 0.0 ? 1.0 / mScale : 0.0;
+  parallelFor(n, f, 1 << 16);
+}
+
+template<class T>
+void CompactBuffer::decode(T *values) const
+{
+  if (mCodes.empty())  { return; }
+
+  CompactDecodeFunctor<T> f;
+  f.values = values;
+  f.buffer = this;
+  parallelFor(mCodes.size(), f, 1 << 16);
+}
+
+} // end namespace wse
+
+#endif
@@ -10,10 +10,12 @@
 #include "vtkHedgeHog.h"
 #include "vtkImageData.h"
 #include "vtkLinearSubdivisionFilter.h"
-#include "vtkImageConstantPad.h"
+#include "wseVolumeSampler.h"
 
 #include <QTime>
 
+#include <vector>
+
 const std::string IsoRenderer::RENDER_HIDDEN("Not Shown");
 const std::string IsoRenderer::RENDER_SURFACE("Show as Surface");
 const std::string IsoRenderer::RENDER_MESH("Show as Mesh");
@@ -45,28 +47,20 @@ void IsoRenderer::installPipeline()
   mEndoContourFilter->SetValue(0, 0.5);
   mEndoContourFilter->SetNumberOfContours(1);
 
-  mEndoMarchingCubes = vtkMarchingCubes::New();
-  mEndoMarchingCubes->SetValue(0,0.5);
-  mEndoMarchingCubes->SetNumberOfContours(1);
+  mEndoMarchingCubes = wse::ParallelMarchingCubes::New();
+  mEndoMarchingCubes->SetValue(0.5);
 
   mWallContourFilter = vtkContourFilter::New();
   mWallContourFilter->SetValue(0, 0.5);
   mWallContourFilter->SetNumberOfContours(1);
 
-  mWallMarchingCubes = vtkMarchingCubes::New();
-  mWallMarchingCubes->SetValue(0,0.5);
-  mWallMarchingCubes->SetNumberOfContours(1);
-
-
-  mEndoPolyDataNormals = vtkPolyDataNormals::New();
-  //mPolyDataNormals->SetInput(mContourFilter->GetOutput());
-  //mPolyDataNormals->SetFeatureAngle(45);
-  //mPolyDataNormals->SplittingOn();
-  mEndoPolyDataNormals->SplittingOff();
+  mWallMarchingCubes = wse::ParallelMarchingCubes::New();
+  mWallMarchingCubes->SetValue(0.5);
 
 
-  mWallPolyDataNormals = vtkPolyDataNormals::New();
-  mWallPolyDataNormals->SplittingOff();
+  // The surfaces on display, copied from the marching cubes outputs
+  mEndoPolyData = vtkPolyData::New();
+  mWallPolyData = vtkPolyData::New();
 
 
   //vtkSmoothPolyDataFilter *smoothPolyDataFilter = vtkSmoothPolyDataFilter::New();
@@ -87,13 +81,13 @@ void IsoRenderer::installPipeline()
 
 
   mEndoContourMapper = vtkPolyDataMapper::New();
-  mEndoContourMapper->SetInput(mEndoPolyDataNormals->GetOutput());
+  mEndoContourMapper->SetInput(mEndoPolyData);
   mEndoContourMapper->ScalarVisibilityOn();
   mEndoContourMapper->SetLookupTable(mScalarLUT);
   mEndoContourMapper->SetScalarRange(0,1001);
 
   mWallContourMapper = vtkPolyDataMapper::New();
-  mWallContourMapper->SetInput(mWallPolyDataNormals->GetOutput());
+  mWallContourMapper->SetInput(mWallPolyData);
   mWallContourMapper->ScalarVisibilityOn();
   mWallContourMapper->SetLookupTable(mScalarLUT);
   mWallContourMapper->SetScalarRange(0,1001);
@@ -199,69 +193,43 @@ void IsoRenderer::createIsoSurfaces()
   }
 
 
-  vtkPolyData *endoPolyData;
-  vtkPolyData *wallPolyData;
-  int volextent[6];
-
-  // constant pad for endo
-  vtkImageConstantPad *endoConstantPad = vtkImageConstantPad::New();
-  endoConstantPad->SetInputConnection(endoImage->GetOutputPort());
-  endoConstantPad->SetConstant(0); 
-
-  endoImage->GetWholeExtent(volextent);
-  volextent[0]-=1; volextent[1]+=1; volextent[2]-=1;
-  volextent[3]+=1; volextent[4]-=1; volextent[5]+=1;
-  endoConstantPad->SetOutputWholeExtent(volextent);
-  endoConstantPad->Update();
-
-  // constant pad for wall
-  vtkImageConstantPad *wallConstantPad = vtkImageConstantPad::New();
-  wallConstantPad->SetInputConnection(wallImage->GetOutputPort());
-  wallConstantPad->SetConstant(0); 
-
-  wallImage->GetWholeExtent(volextent);
-  volextent[0]-=1; volextent[1]+=1; volextent[2]-=1;
-  volextent[3]+=1; volextent[4]-=1; volextent[5]+=1;
-  wallConstantPad->SetOutputWholeExtent(volextent);
-  wallConstantPad->Update();
-
-
-  // removed this option from the UI since they both look the same to me.
-  //if (ui.visMethodCB->currentIndex() == 0) {
-  if (0) {
-    mEndoContourFilter->SetInputConnection(endoConstantPad->GetOutputPort());
-    mWallContourFilter->SetInputConnection(wallConstantPad->GetOutputPort());
-    endoPolyData = mEndoContourFilter->GetOutput();
-    wallPolyData = mWallContourFilter->GetOutput();
-  } else {
-    //mEndoMarchingCubes->SetInputConnection(endoImage);
-    mEndoMarchingCubes->SetInputConnection(endoConstantPad->GetOutputPort());
-    mWallMarchingCubes->SetInputConnection(wallConstantPad->GetOutputPort());
-    endoPolyData = mEndoMarchingCubes->GetOutput();
-    wallPolyData = mWallMarchingCubes->GetOutput();
-  }
+  // The marching cubes read zero outside of the images, which closes
+  // the surfaces at the boundary without padding copies of them.
+  mEndoMarchingCubes->SetInputConnection(endoImage->GetOutputPort());
+  mEndoMarchingCubes->CapBoundariesOn();
+  mEndoMarchingCubes->SetPadValue(0);
+  mWallMarchingCubes->SetInputConnection(wallImage->GetOutputPort());
+  mWallMarchingCubes->CapBoundariesOn();
+  mWallMarchingCubes->SetPadValue(0);
 
 
   std::cerr << "\nComputing isosurfaces...\n";
 
   QTime startTime =  QTime::currentTime();
 
+  // Both surfaces are extracted at once, with normals
+  wse::ParallelMarchingCubes *marchingCubes[2] = { mEndoMarchingCubes, mWallMarchingCubes };
+  wse::ParallelMarchingCubes::UpdateConcurrently(marchingCubes, 2);
+  mEndoPolyData->ShallowCopy(mEndoMarchingCubes->GetOutput());
+
   // Mesh subdivision
   if (mSubDivideMesh) {
-    vtkLinearSubdivisionFilter *subdivisionFilter = vtkLinearSubdivisionFilter::New();
+    vtkSmartPointer<vtkLinearSubdivisionFilter> subdivisionFilter = vtkSmartPointer<vtkLinearSubdivisionFilter>::New();
     //vtkButterflySubdivisionFilter *subdivisionFilter = vtkButterflySubdivisionFilter::New();
     //vtkLoopSubdivisionFilter *subdivisionFilter = vtkLoopSubdivisionFilter::New();
     //subdivisionFilter->SetNumberOfSubdivisions(1);
-    subdivisionFilter->SetInput(wallPolyData);
-    wallPolyData = subdivisionFilter->GetOutput();
+    subdivisionFilter->SetInput(mWallMarchingCubes->GetOutput());
+
+    // interpolated normals are no longer unit length
+    vtkSmartPointer<vtkPolyDataNormals> wallPolyDataNormals = vtkSmartPointer<vtkPolyDataNormals>::New();
+    wallPolyDataNormals->SplittingOff();
+    wallPolyDataNormals->SetInputConnection(subdivisionFilter->GetOutputPort());
+    wallPolyDataNormals->Update();
+    mWallPolyData->ShallowCopy(wallPolyDataNormals->GetOutput());
+  } else {
+    mWallPolyData->ShallowCopy(mWallMarchingCubes->GetOutput());
   }
 
-  mWallPolyDataNormals->SetInput(wallPolyData);
-  mEndoPolyDataNormals->SetInput(endoPolyData);
-
-  mEndoPolyDataNormals->Update();
-  mWallPolyDataNormals->Update();
-
   qint32 msecs = startTime.msecsTo( QTime::currentTime() );
   std::cerr << "Isosurface generation took " << msecs << "ms\n";
 
@@ -442,16 +410,16 @@ void IsoRenderer::updateBackgroundColor()
 
 void IsoRenderer::updateIsoScalars() {
   if (mScalarOnWall) {
-    setIsoScalars(mWallPolyDataNormals, true);
-    eraseIsoScalars(mEndoPolyDataNormals);
+    setIsoScalars(mWallPolyData, true);
+    eraseIsoScalars(mEndoPolyData);
   } else {
-    setIsoScalars(mEndoPolyDataNormals, false);
-    eraseIsoScalars(mWallPolyDataNormals);
+    setIsoScalars(mEndoPolyData, false);
+    eraseIsoScalars(mWallPolyData);
   }
   //CHECK: updateColorMap();
 }
 
-void IsoRenderer::setIsoScalars(vtkPolyDataNormals *polyDataNormals, bool negativeNormal) 
+void IsoRenderer::setIsoScalars(vtkPolyData *polyData, bool negativeNormal) 
 {
 
   if (mImageData == NULL || mWallData == NULL || mEndoData == NULL) {
@@ -463,7 +431,6 @@ void IsoRenderer::setIsoScalars(vtkPolyDataNormals *polyDataNormals, bool negati
 
   vtkImageData *imageData = mImageData->originalVTK()->GetOutput();
 
-  vtkPolyData *polyData = polyDataNormals->GetOutput();
   if (!polyData || !polyData->GetPointData() || !polyData->GetPointData()->GetNormals()) {
     std::cerr << "\nError: Bad poly data (too much smoothing?)\n";
     return;
@@ -478,46 +445,46 @@ void IsoRenderer::setIsoScalars(vtkPolyDataNormals *polyDataNormals, bool negati
     return;
   }
 
-  int numPoints = normals->GetNumberOfTuples();
-
+  const vtkIdType numPoints = normals->GetNumberOfTuples();
 
   vtkFloatArray *scalars = vtkFloatArray::New();
   scalars->SetNumberOfValues(numPoints);
 
 
-  float maxValueEncountered = std::numeric_limits<float>::min();
-  float minValueEncountered = std::numeric_limits<float>::max();
-
-
-  double minimumSpacing = mImageData->getMinimumSpacing();
-
-  for (int i=0; i < numPoints; i++) {
-    double *normal = normals->GetTuple(i);
-    double *point = points->GetPoint(i);
-
-    double x = point[0];
-    double y = point[1];
-    double z = point[2];
+  // The points, and the steps along their normals scaled to the
+  // smallest voxel spacing, as arrays for the batched sampling
+  const double minimumSpacing = mImageData->getMinimumSpacing();
+  const double direction = negativeNormal ? -minimumSpacing : minimumSpacing;
+  std::vector<float> pointArray(3 * numPoints);
+  std::vector<float> stepArray(3 * numPoints);
+  std::vector<char> badNormal(numPoints);
+  for (vtkIdType i = 0; i < numPoints; i++) {
+    double point[3], normal[3];
+    points->GetPoint(i, point);
+    normals->GetTuple(i, normal);
+    for (int c = 0; c < 3; c++) {
+      pointArray[3*i+c] = static_cast<float>(point[c]);
+      stepArray[3*i+c] = static_cast<float>(normal[c] * direction);
+    }
+    badNormal[i] = (std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2])) * minimumSpacing < 0.5f;
+  }
 
-    // adjust normal for spacing
-    normal[0] = normal[0] * minimumSpacing;
-    normal[1] = normal[1] * minimumSpacing;
-    normal[2] = normal[2] * minimumSpacing;
+  if (numPoints > 0) {
+    computeIsoScalars(&pointArray[0], &stepArray[0], numPoints, scalars->GetPointer(0));
+  }
 
-    int nVolIdx = imageData->FindPoint(x,y,z);
-    double *p = imageData->GetPoint(nVolIdx);
+  float maxValueEncountered = std::numeric_limits<float>::min();
+  float minValueEncountered = std::numeric_limits<float>::max();
 
-    float value = 0.0f;
+  for (vtkIdType i = 0; i < numPoints; i++) {
+    float value = scalars->GetValue(i);
 
-    if (std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]) < 0.5f) {
-      std::cerr << "Uh oh, bad normal found for point " 
-        << i << ", x: " << normal[0] << ", y: " << normal[1] << ", z: " << normal[2] << "\n";
-    } else {
-      value = computeIsoScalar(point, normal, negativeNormal);
+    if (badNormal[i]) {
+      std::cerr << "Uh oh, bad normal found for point " << i << "\n";
+      value = 0.0f;
+      scalars->SetValue(i, value);
     }
 
-    scalars->SetValue(i, value);
-
     if (value >= 0.0f) {
       minValueEncountered = std::min(minValueEncountered, value);
       maxValueEncountered = std::max(maxValueEncountered, value);
@@ -543,7 +510,7 @@ void IsoRenderer::setIsoScalars(vtkPolyDataNormals *polyDataNormals, bool negati
   float range = maxValueEncountered - minValueEncountered;
 
   // rescale scalars based on the max value
-  for (int i=0; i < numPoints; i++) {
+  for (vtkIdType i=0; i < numPoints; i++) {
     float value = scalars->GetValue(i);
 
     value = (value - minValueEncountered) / range * 1000.0f;
@@ -566,13 +533,12 @@ void IsoRenderer::setIsoScalars(vtkPolyDataNormals *polyDataNormals, bool negati
   updateHedgeHogs();
 }
 
-void IsoRenderer::eraseIsoScalars(vtkPolyDataNormals *polyDataNormals) {
+void IsoRenderer::eraseIsoScalars(vtkPolyData *polyData) {
   if (mImageData == NULL || mWallData == NULL || mEndoData == NULL) {
     // requires all three
     return;
   }
 
-  vtkPolyData *polyData = polyDataNormals->GetOutput();
   vtkPoints *points = polyData->GetPoints();
 
   vtkFloatArray *normals = vtkFloatArray::SafeDownCast(polyData->GetPointData()->GetNormals());
@@ -596,127 +562,114 @@ void IsoRenderer::eraseIsoScalars(vtkPolyDataNormals *polyDataNormals) {
 }
 
 
-float IsoRenderer::computeIsoScalar(double *point, double *normal, bool negativeNormal) {
-  float imageValue = 0.0f;
-  //float isoValue = 1.0f;
-  float maskValue = 1.0f; // start "in" the mask
+void IsoRenderer::computeIsoScalars(const float *points, const float *steps, vtkIdType n, float *values) {
+  VolumeSampler maskSampler;
+  maskSampler.SetImage(mWallData->originalVTK()->GetOutput());
+  maskSampler.SetLinear(mMaskLinearInterpolation);
 
-  vtkImageData *imageData = mImageData->originalVTK()->GetOutput();
+  VolumeSampler imageSampler;
+  imageSampler.SetImage(mImageData->originalVTK()->GetOutput());
+  imageSampler.SetLinear(mDataLinearInterpolation);
 
-  //int ijk[3];
-  //double pcoords[] = { 0.0f, 0.0f, 0.0f };
-  //imageData->ComputeStructuredCoordinates(point, ijk, pcoords);
+  const float maskCheck = 0.25f;
 
-  double p[3];
-
-  p[0] = point[0];
-  p[1] = point[1];
-  p[2] = point[2];  
-
-  int stepsTraveled = 0;
-  float maxIntensity = 0.0f;
-  float numIncluded = 0.0f;
-  float numExcluded = 0.0f;
-
-  
-
-  //maskValue = maskImage->getInterpolatedPixel(p);
-  //imageValue = image->getInterpolatedPixel(p);
-  maskValue = getInterpolatedValue(mWallData, p, mMaskLinearInterpolation);
-  imageValue = getInterpolatedValue(mImageData, p, mDataLinearInterpolation);
-  float sumIncluded = 0.0f;
-  float sumExcluded = 0.0f;
-
-
-  float returnValue = -1.0f;
-
-  int maskCount = 0;
+  const int maxSteps = 10;
 
-  float maskCheck = 0.25f;
+  // The neighborhood offsets
+  const int numOffsets = 27;
 
-  const int maxSteps = 10;
+  // The samples of each point are taken in batches over all of the
+  // points of a block, then reduced point by point.
+  const vtkIdType blockSize = 65536;
+  const int numSamples = mScalarMethod.alongNormal ? maxSteps : numOffsets;
+  std::vector<float> maskValues(numSamples * blockSize);
+  std::vector<float> imageValues(numSamples * blockSize);
 
-  if (mScalarMethod.alongNormal == true) {
-    while ((maskValue >= maskCheck || stepsTraveled < 3) && stepsTraveled < maxSteps) { // while still inside the mask
-
-      if (maskValue >= maskCheck) {
-        // maximum intensity value, but only if above threshold
-        float value = applyThreshold(imageValue);
-        if (value > 0.0f) {
-          maxIntensity = std::max(maxIntensity, value);
-          sumIncluded += value;
-          numIncluded++;
-        } else {
-          sumExcluded += value;
-          numExcluded++;
-        }
+  for (vtkIdType b = 0; b < n; b += blockSize) {
+    const vtkIdType m = std::min(blockSize, n - b);
+    const float *p = points + 3 * b;
 
-        // counting the number of pixels along the normal (within the mask)
-        maskCount++;
+    if (mScalarMethod.alongNormal == true) {
+      for (int s = 0; s < maxSteps; s++) {
+        maskSampler.SampleAlong(p, steps + 3 * b, s, m, &maskValues[s * m]);
+        imageSampler.SampleAlong(p, steps + 3 * b, s, m, &imageValues[s * m]);
       }
-
-      // move along the normal
-      stepsTraveled++;
-
-      if (negativeNormal) {
-        // we go the opposite way for the wall
-        p[0] = p[0] - normal[0];
-        p[1] = p[1] - normal[1];
-        p[2] = p[2] - normal[2];
-      } else {
-        p[0] = p[0] + normal[0];
-        p[1] = p[1] + normal[1];
-        p[2] = p[2] + normal[2];
+    } else {
+      int s = 0;
+      for (float xAdd = -1.0f; xAdd <= 1.0f ; xAdd++) {
+        for (float yAdd = -1.0f; yAdd <= 1.0f ; yAdd++) {
+          for (float zAdd = -1.0f; zAdd <= 1.0f ; zAdd++, s++) {
+            const double offset[3] = { xAdd, yAdd, zAdd };
+            maskSampler.Sample(p, offset, m, &maskValues[s * m]);
+            imageSampler.Sample(p, offset, m, &imageValues[s * m]);
+          }
+        }
       }
-
-      maskValue = getInterpolatedValue(mWallData, p, mMaskLinearInterpolation);
-      imageValue = getInterpolatedValue(mImageData, p, mDataLinearInterpolation);
     }
 
-    if (maskCount >= 1) {
-      if (mScalarMethod == ScalarMethod::NORMAL_MAXIMUM_INTENSITY) {
-        returnValue = maxIntensity;
-      } else if (mScalarMethod == ScalarMethod::NORMAL_PERCENTAGE) {
-        returnValue = numIncluded / (numIncluded + numExcluded) * 100.0f;
-      } else if (mScalarMethod == ScalarMethod::NORMAL_SUM) {
-        returnValue = sumIncluded;
-      } else if (mScalarMethod == ScalarMethod::NORMAL_WALL_THICKNESS) {
-        // return count of pixels in the mask along normal instead
-        returnValue = maskCount;
-      } else if (mScalarMethod == ScalarMethod::HIT_THRESHOLD) {
-        if (numIncluded > 0) {
-          returnValue = 100;
-        } else {
-          returnValue = 0;
-        }
-      } else if (mScalarMethod == ScalarMethod::NORMAL_AVERAGE_POST_THRESHOLD) {
-        float average = (sumIncluded + sumExcluded) / (numExcluded+numIncluded);
-        returnValue = applyThreshold(average);
-
-        // AKM: For the grey non-threshold pictures
-        //if (returnValue == 0.0f) {
-        //  returnValue = -1;
-        //}
+    for (vtkIdType i = 0; i < m; i++) {
+      float maxIntensity = 0.0f;
+      float numIncluded = 0.0f;
+      float numExcluded = 0.0f;
+      float sumIncluded = 0.0f;
+      float sumExcluded = 0.0f;
+      int maskCount = 0;
+      float returnValue = -1.0f;
+
+      if (mScalarMethod.alongNormal == true) {
+        // while still inside the mask, but at least 3 steps
+        for (int s = 0; s < maxSteps; s++) {
+          const float maskValue = maskValues[s * m + i];
+          if (!(maskValue >= maskCheck || s < 3)) {
+            break;
+          }
 
-      }
-    }
+          if (maskValue >= maskCheck) {
+            // maximum intensity value, but only if above threshold
+            float value = applyThreshold(imageValues[s * m + i]);
+            if (value > 0.0f) {
+              maxIntensity = std::max(maxIntensity, value);
+              sumIncluded += value;
+              numIncluded++;
+            } else {
+              sumExcluded += value;
+              numExcluded++;
+            }
 
-  } else { // neighborhood
+            // counting the number of pixels along the normal (within the mask)
+            maskCount++;
+          }
+        }
 
-    for (float xAdd = -1.0f; xAdd <= 1.0f ; xAdd++) {
-      for (float yAdd = -1.0f; yAdd <= 1.0f ; yAdd++) {
-        for (float zAdd = -1.0f; zAdd <= 1.0f ; zAdd++) {
-          p[0] = point[0] + xAdd;
-          p[1] = point[1] + xAdd;
-          p[2] = point[2] + zAdd;  
+        if (maskCount >= 1) {
+          if (mScalarMethod == ScalarMethod::NORMAL_MAXIMUM_INTENSITY) {
+            returnValue = maxIntensity;
+          } else if (mScalarMethod == ScalarMethod::NORMAL_PERCENTAGE) {
+            returnValue = numIncluded / (numIncluded + numExcluded) * 100.0f;
+          } else if (mScalarMethod == ScalarMethod::NORMAL_SUM) {
+            returnValue = sumIncluded;
+          } else if (mScalarMethod == ScalarMethod::NORMAL_WALL_THICKNESS) {
+            // return count of pixels in the mask along normal instead
+            returnValue = maskCount;
+          } else if (mScalarMethod == ScalarMethod::HIT_THRESHOLD) {
+            if (numIncluded > 0) {
+              returnValue = 100;
+            } else {
+              returnValue = 0;
+            }
+          } else if (mScalarMethod == ScalarMethod::NORMAL_AVERAGE_POST_THRESHOLD) {
+            float average = (sumIncluded + sumExcluded) / (numExcluded+numIncluded);
+            returnValue = applyThreshold(average);
+          }
+        }
 
-          maskValue = getInterpolatedValue(mWallData, p, mMaskLinearInterpolation);
-          imageValue = getInterpolatedValue(mImageData, p, mDataLinearInterpolation);
+      } else { // neighborhood
 
-          if (maskValue >= maskCheck) {
+        for (int s = 0; s < numOffsets; s++) {
+          if (maskValues[s * m + i] >= maskCheck) {
             maskCount++;
             // maximum intensity value, but only if above threshold
-            float value = applyThreshold(imageValue);
+            float value = applyThreshold(imageValues[s * m + i]);
             if (value > 0.0f) {
               maxIntensity = std::max(maxIntensity, value);
               sumIncluded += value;
@@ -726,24 +679,24 @@ float IsoRenderer::computeIsoScalar(double *point, double *normal, bool negative
             }
           }
         }
-      }
-    }
 
-    if (maskCount >= 1) {
-      if (mScalarMethod == ScalarMethod::NEIGHBORHOOD_MAXIMUM_INTENSITY) {
-        returnValue = maxIntensity;
-      } else if (mScalarMethod == ScalarMethod::NEIGHBORHOOD_PERCENTAGE) {
-        returnValue = numIncluded / (numIncluded + numExcluded) * 100.0f;
-      } else if (mScalarMethod == ScalarMethod::NEIGHBORHOOD_SUM) {
-        returnValue = sumIncluded;
-      } else if (mScalarMethod == ScalarMethod::NEIGHBORHOOD_WALL_THICKNESS) {
-        // return count of pixels in the mask along normal instead
-        returnValue = maskCount;
+        if (maskCount >= 1) {
+          if (mScalarMethod == ScalarMethod::NEIGHBORHOOD_MAXIMUM_INTENSITY) {
+            returnValue = maxIntensity;
+          } else if (mScalarMethod == ScalarMethod::NEIGHBORHOOD_PERCENTAGE) {
+            returnValue = numIncluded / (numIncluded + numExcluded) * 100.0f;
+          } else if (mScalarMethod == ScalarMethod::NEIGHBORHOOD_SUM) {
+            returnValue = sumIncluded;
+          } else if (mScalarMethod == ScalarMethod::NEIGHBORHOOD_WALL_THICKNESS) {
+            // return count of pixels in the mask along normal instead
+            returnValue = maskCount;
+          }
+        }
       }
+
+      values[b + i] = returnValue;
     }
   }
-
-  return returnValue;
 }
 
 void IsoRenderer::updateHedgeHogs() {
@@ -757,9 +710,9 @@ void IsoRenderer::updateHedgeHogs() {
     vtkSmartPointer<vtkHedgeHog> hedgehog = vtkSmartPointer<vtkHedgeHog>::New();
 
     if (mScalarOnWall) {
-      hedgehog->SetInput(mWallPolyDataNormals->GetOutput());
+      hedgehog->SetInput(mWallPolyData);
     } else {
-      hedgehog->SetInput(mEndoPolyDataNormals->GetOutput());
+      hedgehog->SetInput(mEndoPolyData);
     }
     hedgehog->SetVectorModeToUseNormal();
     hedgehog->SetScaleFactor(1.0f);
@@ -800,15 +753,6 @@ void IsoRenderer::setLinearInterpolation( bool image, bool mask )
 }
 
 
-float IsoRenderer::getInterpolatedValue( Image *image, double p[3], bool linear) 
-{
-  if (linear) {
-    return image->getLinearInterpolatedPixel(p);
-  } else {
-    return image->getNearestInterpolatedPixel(p);
-  }
-}
-
 void IsoRenderer::setScalarMethod( ScalarMethod method )
 {
   mScalarMethod = method;
@@ -17,7 +17,7 @@
 #include "vtkLookupTable.h"
 #include "vtkImageViewer2.h"
 #include "vtkPolyDataNormals.h"
-#include "vtkMarchingCubes.h"
+#include "wseParallelMarchingCubes.h"
 #include "vtkImageMapToColors.h"
 #include "vtkImageBlend.h"
 
@@ -76,10 +76,9 @@ private:
   void updateSliceVisibility();
   void updateBackgroundColor();
 
-  void setIsoScalars(vtkPolyDataNormals *polyDataNormals, bool negativeNormal);
-  void eraseIsoScalars(vtkPolyDataNormals *polyDataNormals);
-  float computeIsoScalar(double *point, double *normal, bool negativeNormal);
-  float getInterpolatedValue( Image *image, double p[3], bool linear);
+  void setIsoScalars(vtkPolyData *polyData, bool negativeNormal);
+  void eraseIsoScalars(vtkPolyData *polyData);
+  void computeIsoScalars(const float *points, const float *steps, vtkIdType n, float *values);
 
   float applyThreshold(float value);
 
@@ -92,14 +91,14 @@ private:
   // -- vtk objects --
   vtkRenderer *mSurfaceRenderer;
   vtkContourFilter *mEndoContourFilter;
-  vtkMarchingCubes *mEndoMarchingCubes;
+  wse::ParallelMarchingCubes *mEndoMarchingCubes;
   vtkPolyDataMapper *mEndoContourMapper;
-  vtkPolyDataNormals *mEndoPolyDataNormals;
+  vtkPolyData *mEndoPolyData;
   vtkActor *mEndoSurfaceActor;
   vtkContourFilter *mWallContourFilter;
-  vtkMarchingCubes *mWallMarchingCubes;
+  wse::ParallelMarchingCubes *mWallMarchingCubes;
   vtkPolyDataMapper *mWallContourMapper;
-  vtkPolyDataNormals *mWallPolyDataNormals;
+  vtkPolyData *mWallPolyData;
   vtkActor *mWallSurfaceActor;
   vtkPolyDataMapper *mHedgeHogMapper;
   vtkPolyDataMapper *mVTKPolyDataMapper;
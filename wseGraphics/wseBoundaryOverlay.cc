@@ -0,0 +1,246 @@
+#include "wseBoundaryOverlay.h"
+
+#include "vtkAlgorithm.h"
+#include "vtkMultiThreader.h"
+#include "vtkPointData.h"
+#include "vtkWSLookupTableManager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace wse {
+
+BoundaryOverlay::BoundaryOverlay()
+{
+  this->Labels = NULL;
+  this->Manager = NULL;
+  this->Output = vtkImageData::New();
+  this->Color[0] = 255;
+  this->Color[1] = 255;
+  this->Color[2] = 255;
+  this->Color[3] = 255;
+
+  this->Valid = false;
+  this->LabelData = NULL;
+  this->LabelMTime = 0;
+  this->RootTableMTime = 0;
+  this->Orientation = 2;
+  this->Slice = 0;
+}
+
+BoundaryOverlay::~BoundaryOverlay()
+{
+  this->SetLabels(NULL, NULL);
+  this->Output->Delete();
+}
+
+void BoundaryOverlay::SetLabels(vtkAlgorithmOutput *labels, vtkWSLookupTableManager *manager)
+{
+  if (manager != this->Manager)
+    {
+      if (manager)       { manager->Register(NULL); }
+      if (this->Manager) { this->Manager->UnRegister(NULL); }
+      this->Manager = manager;
+    }
+  this->Labels = labels;
+  this->Valid = false;
+}
+
+void BoundaryOverlay::SetColor(double r, double g, double b)
+{
+  this->Color[0] = static_cast<unsigned char>(r * 255.0 + 0.5);
+  this->Color[1] = static_cast<unsigned char>(g * 255.0 + 0.5);
+  this->Color[2] = static_cast<unsigned char>(b * 255.0 + 0.5);
+  this->Valid = false;
+}
+
+void BoundaryOverlay::SetOpacity(double a)
+{
+  this->Color[3] = static_cast<unsigned char>(a * 255.0 + 0.5);
+  this->Valid = false;
+}
+
+/** Arguments of BoundaryOverlayCompute().  The slice is nu by nv
+    pixels; label (u, v) is at labels + u * uInc + v * vInc. */
+struct BoundaryOverlayWork
+{
+  vtkImageData *labelData;
+  void *labels;
+  vtkIdType uInc;
+  vtkIdType vInc;
+  int nu;
+  int nv;
+  const unsigned long *roots;
+  unsigned long numberOfRoots;
+  vtkTypeUInt32 color;
+  unsigned char *out;
+};
+
+/** Looks up the roots of the labels of row v. */
+template <class T>
+static void BoundaryOverlayGatherRow(const BoundaryOverlayWork &w, const T *labels,
+                                     int v, unsigned long *row)
+{
+  const T *l = labels + v * w.vInc;
+  for (int u = 0; u < w.nu; u++)
+    {
+      const unsigned long label = static_cast<unsigned long>(l[u * w.uInc]);
+      row[u] = (label < w.numberOfRoots) ? w.roots[label] : label;
+    }
+}
+
+/** Computes the rows v0 to v1 - 1 of the outlines.  Each row of roots
+    is gathered once and compared with the rows above and below it, so
+    that the comparisons run over contiguous arrays. */
+template <class T>
+static void BoundaryOverlayExecute(const BoundaryOverlayWork &w, const T *labels, int v0, int v1)
+{
+  const int nu = w.nu;
+  std::vector<unsigned long> buffer(3 * nu);
+  unsigned long *prev = &buffer[0];
+  unsigned long *cur  = prev + nu;
+  unsigned long *next = cur + nu;
+  std::vector<vtkTypeUInt32> pixels(nu);
+
+  if (v0 > 0)
+    {
+      BoundaryOverlayGatherRow(w, labels, v0 - 1, prev);
+    }
+  BoundaryOverlayGatherRow(w, labels, v0, cur);
+
+  for (int v = v0; v < v1; v++)
+    {
+      if (v + 1 < w.nv)
+        {
+          BoundaryOverlayGatherRow(w, labels, v + 1, next);
+        }
+      const unsigned long *up   = (v > 0) ? prev : cur;
+      const unsigned long *down = (v + 1 < w.nv) ? next : cur;
+
+      for (int u = 0; u < nu; u++)
+        {
+          const unsigned long r = cur[u];
+          const unsigned long left  = (u > 0) ? cur[u - 1] : r;
+          const unsigned long right = (u + 1 < nu) ? cur[u + 1] : r;
+          const vtkTypeUInt32 edge = (r != left) | (r != right) | (r != up[u]) | (r != down[u]);
+          pixels[u] = w.color & (0u - edge);
+        }
+      std::memcpy(w.out + 4 * static_cast<vtkIdType>(v) * nu, &pixels[0], 4 * nu);
+
+      unsigned long *t = prev;
+      prev = cur;
+      cur = next;
+      next = t;
+    }
+}
+
+/** Thread entry point of Update().  Each thread computes a contiguous
+    band of rows. */
+static VTK_THREAD_RETURN_TYPE BoundaryOverlayCompute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *info = static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  const BoundaryOverlayWork *w = static_cast<const BoundaryOverlayWork *>(info->UserData);
+  const int v0 = static_cast<int>(static_cast<vtkIdType>(w->nv) * info->ThreadID / info->NumberOfThreads);
+  const int v1 = static_cast<int>(static_cast<vtkIdType>(w->nv) * (info->ThreadID + 1) / info->NumberOfThreads);
+  if (v0 >= v1)
+    {
+      return VTK_THREAD_RETURN_VALUE;
+    }
+
+  switch (w->labelData->GetScalarType())
+    {
+      vtkTemplateMacro(BoundaryOverlayExecute(*w, static_cast<const VTK_TT *>(w->labels), v0, v1));
+    default:
+      break;
+    }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+vtkImageData *BoundaryOverlay::Update(int orientation, int s)
+{
+  if (! this->HasLabels() || this->Manager->GetRootTable() == NULL)
+    {
+      return NULL;
+    }
+
+  vtkImageData *labels = vtkImageData::SafeDownCast(
+    this->Labels->GetProducer()->GetOutputDataObject(this->Labels->GetIndex()));
+  if (labels == NULL)
+    {
+      return NULL;
+    }
+  labels->UpdateInformation();
+  int ext[6];
+  labels->GetWholeExtent(ext);
+  if (s < ext[2 * orientation] || s > ext[2 * orientation + 1])
+    {
+      return NULL;
+    }
+  labels->SetUpdateExtent(ext);
+  labels->Update();
+
+  if (this->Valid
+      && labels == this->LabelData
+      && labels->GetMTime() == this->LabelMTime
+      && this->Manager->GetRootTableMTime() == this->RootTableMTime
+      && orientation == this->Orientation
+      && s == this->Slice)
+    {
+      return this->Output;
+    }
+
+  // The in-plane axes, u varying fastest in the output
+  ext[2 * orientation] = s;
+  ext[2 * orientation + 1] = s;
+  const int a = (orientation == 0) ? 1 : 0;
+  const int b = (orientation == 2) ? 1 : 2;
+
+  int *oext = this->Output->GetExtent();
+  if (oext[0] != ext[0] || oext[1] != ext[1] || oext[2] != ext[2]
+      || oext[3] != ext[3] || oext[4] != ext[4] || oext[5] != ext[5]
+      || this->Output->GetPointData()->GetScalars() == NULL)
+    {
+      this->Output->Initialize();
+      this->Output->SetExtent(ext);
+      this->Output->SetWholeExtent(ext);
+      this->Output->SetScalarTypeToUnsignedChar();
+      this->Output->SetNumberOfScalarComponents(4);
+      this->Output->AllocateScalars();
+    }
+  this->Output->SetSpacing(labels->GetSpacing());
+  this->Output->SetOrigin(labels->GetOrigin());
+
+  vtkIdType inc[3];
+  labels->GetIncrements(inc);
+
+  BoundaryOverlayWork w;
+  w.labelData = labels;
+  w.labels = labels->GetScalarPointerForExtent(ext);
+  w.uInc = inc[a];
+  w.vInc = inc[b];
+  w.nu = ext[2 * a + 1] - ext[2 * a] + 1;
+  w.nv = ext[2 * b + 1] - ext[2 * b] + 1;
+  w.roots = this->Manager->GetRootTable();
+  w.numberOfRoots = this->Manager->GetNumberOfLabels();
+  std::memcpy(&w.color, this->Color, 4);
+  w.out = static_cast<unsigned char *>(this->Output->GetScalarPointer());
+
+  // Bands of fewer than 64 rows are not worth a thread.
+  vtkMultiThreader *threader = vtkMultiThreader::New();
+  threader->SetNumberOfThreads(std::max(1, std::min(threader->GetNumberOfThreads(), w.nv / 64)));
+  threader->SetSingleMethod(BoundaryOverlayCompute, &w);
+  threader->SingleMethodExecute();
+  threader->Delete();
+  this->Output->Modified();
+
+  this->Valid = true;
+  this->LabelData = labels;
+  this->LabelMTime = labels->GetMTime();
+  this->RootTableMTime = this->Manager->GetRootTableMTime();
+  this->Orientation = orientation;
+  this->Slice = s;
+  return this->Output;
+}
+
+} // end namespace wse
@@ -0,0 +1,66 @@
+#ifndef _wse_boundary_overlay_h
+#define _wse_boundary_overlay_h
+
+#include "vtkImageData.h"
+#include "vtkAlgorithmOutput.h"
+
+class vtkWSLookupTableManager;
+
+namespace wse {
+
+/** BoundaryOverlay draws the outlines of the merged regions of a
+    watershed segmentation on a single slice.  A pixel lies on an
+    outline when the label its region is merged to differs from that of
+    one of its four neighbors in the plane of the slice.  The merged
+    labels are read from the dense root table of a
+    vtkWSLookupTableManager, so the outlines follow the flood level.
+
+    The output is an RGBA image of the slice in which outline pixels
+    have the outline color and all other pixels are transparent, to be
+    drawn by a vtkImageActor over the slice of another image.  Only the
+    requested slice is computed, split across threads by rows. */
+class BoundaryOverlay
+{
+public:
+  BoundaryOverlay();
+  ~BoundaryOverlay();
+
+  /** Set the labeled image and the manager that holds its merges.
+      Passing NULL for either disables the overlay. */
+  void SetLabels(vtkAlgorithmOutput *labels, vtkWSLookupTableManager *manager);
+  bool HasLabels() const
+  { return this->Labels != NULL && this->Manager != NULL; }
+
+  /** Set the color and opacity of the outlines.  The default is opaque
+      white. */
+  void SetColor(double r, double g, double b);
+  void SetOpacity(double a);
+
+  /** Returns the outlines of slice s in the given orientation (0, 1 or
+      2 for the YZ, XZ and XY planes), recomputing them only if the
+      slice, the labels or their merges have changed since the last
+      call.  Returns NULL if there are no labels or s lies outside of
+      them.  The image is owned by the overlay. */
+  vtkImageData *Update(int orientation, int s);
+
+private:
+  BoundaryOverlay(const BoundaryOverlay&);  // Not implemented.
+  void operator=(const BoundaryOverlay&);  // Not implemented.
+
+  vtkAlgorithmOutput *Labels;
+  vtkWSLookupTableManager *Manager;
+  vtkImageData *Output;
+  unsigned char Color[4];
+
+  // What the output was computed from
+  bool Valid;
+  vtkImageData *LabelData;
+  unsigned long LabelMTime;
+  unsigned long RootTableMTime;
+  int Orientation;
+  int Slice;
+};
+
+} // end namespace wse
+
+#endif
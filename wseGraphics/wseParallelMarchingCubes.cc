@@ -0,0 +1,623 @@
+#include "wseParallelMarchingCubes.h"
+
+#include "vtkCellArray.h"
+#include "vtkFloatArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkImageData.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkMarchingCubesCases.h"
+#include "vtkMultiThreader.h"
+#include "vtkObjectFactory.h"
+#include "vtkPointData.h"
+#include "vtkPoints.h"
+#include "vtkPolyData.h"
+#include "vtkStreamingDemandDrivenPipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace wse {
+
+vtkCxxRevisionMacro(ParallelMarchingCubes, "$Revision: 1.1 $");
+vtkStandardNewMacro(ParallelMarchingCubes);
+
+ParallelMarchingCubes::ParallelMarchingCubes()
+{
+  this->Value = 0.5;
+  this->ComputeNormals = 1;
+  this->CapBoundaries = 1;
+  this->PadValue = 0.0;
+  this->NumberOfThreads = vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+  for (int a = 0; a < 3; a++)
+    {
+      this->VOI[2 * a] = VTK_INT_MIN;
+      this->VOI[2 * a + 1] = VTK_INT_MAX;
+    }
+  this->UseLabelTable = false;
+}
+
+void ParallelMarchingCubes::SetLabelTable(const unsigned char *table, vtkIdType n)
+{
+  this->LabelTable.assign(table, table + n);
+  this->UseLabelTable = true;
+  this->Modified();
+}
+
+void ParallelMarchingCubes::RemoveLabelTable()
+{
+  if (this->UseLabelTable)
+    {
+      this->LabelTable.clear();
+      this->UseLabelTable = false;
+      this->Modified();
+    }
+}
+
+int ParallelMarchingCubes::FillInputPortInformation(int vtkNotUsed(port), vtkInformation *info)
+{
+  info->Set(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkImageData");
+  return 1;
+}
+
+int ParallelMarchingCubes::RequestUpdateExtent(vtkInformation *vtkNotUsed(request),
+                                               vtkInformationVector **inputVector,
+                                               vtkInformationVector *vtkNotUsed(outputVector))
+{
+  // The whole image is needed, as vtkMarchingCubes does.
+  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
+  inInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(),
+              inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT()), 6);
+  return 1;
+}
+
+/** The corners of a cell and the corners joined by each of its edges,
+    in the order of the vtkMarchingCubes case table. */
+static const int ParallelMarchingCubesCorners[8][3] = {
+  {0,0,0}, {1,0,0}, {1,1,0}, {0,1,0}, {0,0,1}, {1,0,1}, {1,1,1}, {0,1,1} };
+static const int ParallelMarchingCubesEdges[12][2] = {
+  {0,1}, {1,2}, {3,2}, {0,3}, {4,5}, {5,6}, {7,6}, {4,7}, {0,4}, {1,5}, {3,7}, {2,6} };
+
+/** The output of one slab.  Triangles refer to the slab's own points
+    by their index, and to the points on the first plane of the next
+    slab by -1 - key, where key indexes that slab's bottom table. */
+struct ParallelMarchingCubesSlab
+{
+  std::vector<float> points;
+  std::vector<float> normals;
+  std::vector<vtkIdType> triangles;
+
+  /** The points on the x edges, then the y edges, of the first plane. */
+  std::vector<vtkIdType> bottom;
+
+  vtkIdType pointOffset;
+  vtkIdType triangleOffset;
+};
+
+/** Shared state of one execution.  The sample lattice covers the
+    extent to contour and is dims points wide; lattice point (i, j, k)
+    is voxel (i, j, k) - border of that extent, where border is 1 if
+    the boundaries are capped. */
+struct ParallelMarchingCubesWork
+{
+  int phase;
+
+  void *scalars;
+  int scalarType;
+  vtkIdType inc[3];
+  int imageExtent[6];
+  int extent[6];
+  int border;
+  double pad;
+  bool useLabelTable;
+  const unsigned char *labelTable;
+  vtkIdType labelTableSize;
+  double value;
+  bool computeNormals;
+  double origin[3];
+  double spacing[3];
+  int dims[3];
+
+  std::vector<ParallelMarchingCubesSlab> slabs;
+
+  // The merged output
+  float *points;
+  float *normals;
+  vtkIdType *cells;
+};
+
+/** Reads the lattice, returning the pad value outside of the image. */
+template <class T>
+struct ParallelMarchingCubesSampler
+{
+  const T *scalars;
+  vtkIdType inc[3];
+  int offset[3];
+  int n[3];
+  double pad;
+
+  ParallelMarchingCubesSampler(const ParallelMarchingCubesWork &w)
+  {
+    this->scalars = static_cast<const T *>(w.scalars);
+    this->pad = w.pad;
+    for (int a = 0; a < 3; a++)
+      {
+        this->inc[a] = w.inc[a];
+        this->offset[a] = w.extent[2 * a] - w.border - w.imageExtent[2 * a];
+        this->n[a] = w.imageExtent[2 * a + 1] - w.imageExtent[2 * a] + 1;
+      }
+  }
+
+  /** Returns the voxel under lattice point (i, j, k), or NULL if it
+      lies outside of the image. */
+  const T *Find(int i, int j, int k) const
+  {
+    i += this->offset[0];
+    j += this->offset[1];
+    k += this->offset[2];
+    if (i < 0 || j < 0 || k < 0 || i >= this->n[0] || j >= this->n[1] || k >= this->n[2])
+      {
+        return NULL;
+      }
+    return this->scalars + i * this->inc[0] + j * this->inc[1] + k * this->inc[2];
+  }
+
+  double operator()(int i, int j, int k) const
+  {
+    const T *p = this->Find(i, j, k);
+    return p ? static_cast<double>(*p) : this->pad;
+  }
+};
+
+/** Reads the lattice of a labeled image through the label table. */
+template <class T>
+struct ParallelMarchingCubesLabelSampler : public ParallelMarchingCubesSampler<T>
+{
+  const unsigned char *table;
+  vtkIdType size;
+
+  ParallelMarchingCubesLabelSampler(const ParallelMarchingCubesWork &w)
+    : ParallelMarchingCubesSampler<T>(w)
+  {
+    this->table = w.labelTable;
+    this->size = w.labelTableSize;
+  }
+
+  double operator()(int i, int j, int k) const
+  {
+    const T *p = this->Find(i, j, k);
+    if (p == NULL)
+      {
+        return this->pad;
+      }
+    const vtkIdType label = static_cast<vtkIdType>(*p);
+    return (label >= 0 && label < this->size) ? this->table[label] : 0.0;
+  }
+};
+
+/** Computes the negated gradient at a lattice point, with one sided
+    differences on the edge of the lattice, as vtkMarchingCubes does. */
+template <class S>
+static void ParallelMarchingCubesGradient(const ParallelMarchingCubesWork &w, const S &s,
+                                          const int p[3], double g[3])
+{
+  for (int a = 0; a < 3; a++)
+    {
+      int lo[3] = { p[0], p[1], p[2] };
+      int hi[3] = { p[0], p[1], p[2] };
+      if (p[a] > 0)             { lo[a]--; }
+      if (p[a] < w.dims[a] - 1) { hi[a]++; }
+      const int h = hi[a] - lo[a];
+      g[a] = (h > 0)
+        ? (s(lo[0], lo[1], lo[2]) - s(hi[0], hi[1], hi[2])) / (h * w.spacing[a])
+        : 0.0;
+    }
+}
+
+/** Adds the point where the isosurface crosses the edge from lattice
+    point p along the given axis, whose ends have values v0 and v1. */
+template <class S>
+static vtkIdType ParallelMarchingCubesAddPoint(const ParallelMarchingCubesWork &w, const S &s,
+                                               ParallelMarchingCubesSlab &slab,
+                                               int i, int j, int k, int axis,
+                                               double v0, double v1)
+{
+  const double t = (w.value - v0) / (v1 - v0);
+  const int p0[3] = { i, j, k };
+  for (int a = 0; a < 3; a++)
+    {
+      double x = w.extent[2 * a] + p0[a] - w.border + (a == axis ? t : 0.0);
+      slab.points.push_back(static_cast<float>(w.origin[a] + w.spacing[a] * x));
+    }
+
+  if (w.computeNormals)
+    {
+      int p1[3] = { i, j, k };
+      p1[axis]++;
+      double g0[3], g1[3], n[3];
+      ParallelMarchingCubesGradient(w, s, p0, g0);
+      ParallelMarchingCubesGradient(w, s, p1, g1);
+      for (int a = 0; a < 3; a++)
+        {
+          n[a] = g0[a] + t * (g1[a] - g0[a]);
+        }
+      const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for (int a = 0; a < 3; a++)
+        {
+          slab.normals.push_back(static_cast<float>(length > 0.0 ? n[a] / length : 0.0));
+        }
+    }
+  return static_cast<vtkIdType>(slab.points.size() / 3 - 1);
+}
+
+/** Samples plane k of the lattice. */
+template <class S>
+static void ParallelMarchingCubesPlane(const ParallelMarchingCubesWork &w, const S &s,
+                                       int k, double *values)
+{
+  for (int j = 0; j < w.dims[1]; j++)
+    {
+      for (int i = 0; i < w.dims[0]; i++)
+        {
+          *values++ = s(i, j, k);
+        }
+    }
+}
+
+/** Adds the points on the x and y edges of plane k. */
+template <class S>
+static void ParallelMarchingCubesPlanePoints(const ParallelMarchingCubesWork &w, const S &s,
+                                             ParallelMarchingCubesSlab &slab, int k,
+                                             const double *values, vtkIdType *xIds, vtkIdType *yIds)
+{
+  const int nx = w.dims[0];
+  for (int j = 0; j < w.dims[1]; j++)
+    {
+      for (int i = 0; i < nx; i++)
+        {
+          const vtkIdType idx = j * nx + i;
+          const bool inside = values[idx] >= w.value;
+          if (i + 1 < nx && inside != (values[idx + 1] >= w.value))
+            {
+              xIds[idx] = ParallelMarchingCubesAddPoint(w, s, slab, i, j, k, 0,
+                                                        values[idx], values[idx + 1]);
+            }
+          if (j + 1 < w.dims[1] && inside != (values[idx + nx] >= w.value))
+            {
+              yIds[idx] = ParallelMarchingCubesAddPoint(w, s, slab, i, j, k, 1,
+                                                        values[idx], values[idx + nx]);
+            }
+        }
+    }
+}
+
+/** Extracts the surface in the cells of one slab.  Two planes of
+    samples and of edge points are kept, so that every edge point is
+    computed once and shared by the cells around it. */
+template <class S>
+static void ParallelMarchingCubesExecute(ParallelMarchingCubesWork &w, const S &s, int slabIndex)
+{
+  ParallelMarchingCubesSlab &slab = w.slabs[slabIndex];
+  const int nslabs = static_cast<int>(w.slabs.size());
+  const int nx = w.dims[0];
+  const int ny = w.dims[1];
+  const vtkIdType planeSize = static_cast<vtkIdType>(nx) * ny;
+  const int cells = w.dims[2] - 1;
+  const int c0 = static_cast<int>(static_cast<vtkIdType>(cells) * slabIndex / nslabs);
+  const int c1 = static_cast<int>(static_cast<vtkIdType>(cells) * (slabIndex + 1) / nslabs);
+  const bool last = (slabIndex == nslabs - 1);
+
+  std::vector<double> va(planeSize), vb(planeSize);
+  std::vector<vtkIdType> xa(planeSize), ya(planeSize), xb(planeSize), yb(planeSize), ze(planeSize);
+
+  ParallelMarchingCubesPlane(w, s, c0, &va[0]);
+  ParallelMarchingCubesPlanePoints(w, s, slab, c0, &va[0], &xa[0], &ya[0]);
+  slab.bottom.resize(2 * planeSize);
+  std::copy(xa.begin(), xa.end(), slab.bottom.begin());
+  std::copy(ya.begin(), ya.end(), slab.bottom.begin() + planeSize);
+
+  vtkMarchingCubesTriangleCases *cases = vtkMarchingCubesTriangleCases::GetCases();
+  for (int k = c0; k < c1; k++)
+    {
+      ParallelMarchingCubesPlane(w, s, k + 1, &vb[0]);
+      if (k + 1 == c1 && ! last)
+        {
+          // The top plane belongs to the next slab.
+          for (vtkIdType idx = 0; idx < planeSize; idx++)
+            {
+              xb[idx] = -1 - idx;
+              yb[idx] = -1 - (planeSize + idx);
+            }
+        }
+      else
+        {
+          ParallelMarchingCubesPlanePoints(w, s, slab, k + 1, &vb[0], &xb[0], &yb[0]);
+        }
+
+      for (int j = 0; j < ny; j++)
+        {
+          for (int i = 0; i < nx; i++)
+            {
+              const vtkIdType idx = j * nx + i;
+              if ((va[idx] >= w.value) != (vb[idx] >= w.value))
+                {
+                  ze[idx] = ParallelMarchingCubesAddPoint(w, s, slab, i, j, k, 2, va[idx], vb[idx]);
+                }
+            }
+        }
+
+      for (int j = 0; j + 1 < ny; j++)
+        {
+          for (int i = 0; i + 1 < nx; i++)
+            {
+              const vtkIdType idx = j * nx + i;
+              const double c[8] = { va[idx], va[idx + 1], va[idx + nx + 1], va[idx + nx],
+                                    vb[idx], vb[idx + 1], vb[idx + nx + 1], vb[idx + nx] };
+              int index = 0;
+              for (int n = 0; n < 8; n++)
+                {
+                  if (c[n] >= w.value) { index |= (1 << n); }
+                }
+              if (index == 0 || index == 255)
+                {
+                  continue;
+                }
+
+              // The points of the twelve edges of the cell
+              const vtkIdType ids[12] = {
+                xa[idx], ya[idx + 1], xa[idx + nx], ya[idx],
+                xb[idx], yb[idx + 1], xb[idx + nx], yb[idx],
+                ze[idx], ze[idx + 1], ze[idx + nx], ze[idx + nx + 1] };
+
+              for (EDGE_LIST *edge = cases[index].edges; edge[0] > -1; edge += 3)
+                {
+                  slab.triangles.push_back(ids[edge[0]]);
+                  slab.triangles.push_back(ids[edge[1]]);
+                  slab.triangles.push_back(ids[edge[2]]);
+                }
+            }
+        }
+
+      va.swap(vb);
+      xa.swap(xb);
+      ya.swap(yb);
+    }
+}
+
+/** Copies one slab into the output, resolving its references to the
+    points of the next slab. */
+static void ParallelMarchingCubesMerge(ParallelMarchingCubesWork &w, int slabIndex)
+{
+  const ParallelMarchingCubesSlab &slab = w.slabs[slabIndex];
+  if (! slab.points.empty())
+    {
+      std::memcpy(w.points + 3 * slab.pointOffset, &slab.points[0],
+                  slab.points.size() * sizeof(float));
+    }
+  if (w.computeNormals && ! slab.normals.empty())
+    {
+      std::memcpy(w.normals + 3 * slab.pointOffset, &slab.normals[0],
+                  slab.normals.size() * sizeof(float));
+    }
+
+  const ParallelMarchingCubesSlab *next =
+    (slabIndex + 1 < static_cast<int>(w.slabs.size())) ? &w.slabs[slabIndex + 1] : NULL;
+  vtkIdType *cell = w.cells + 4 * slab.triangleOffset;
+  for (std::size_t t = 0; t < slab.triangles.size(); t += 3)
+    {
+      *cell++ = 3;
+      for (int v = 0; v < 3; v++)
+        {
+          const vtkIdType id = slab.triangles[t + v];
+          *cell++ = (id >= 0) ? slab.pointOffset + id
+                              : next->pointOffset + next->bottom[-1 - id];
+        }
+    }
+}
+
+/** Thread entry point of RequestData().  Each thread handles every
+    NumberOfThreads-th slab. */
+static VTK_THREAD_RETURN_TYPE ParallelMarchingCubesThread(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *info = static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  ParallelMarchingCubesWork *w = static_cast<ParallelMarchingCubesWork *>(info->UserData);
+  const int nslabs = static_cast<int>(w->slabs.size());
+  for (int slab = info->ThreadID; slab < nslabs; slab += info->NumberOfThreads)
+    {
+      if (w->phase == 0 && w->useLabelTable)
+        {
+          switch (w->scalarType)
+            {
+              vtkTemplateMacro(ParallelMarchingCubesExecute(
+                                 *w, ParallelMarchingCubesLabelSampler<VTK_TT>(*w), slab));
+            }
+        }
+      else if (w->phase == 0)
+        {
+          switch (w->scalarType)
+            {
+              vtkTemplateMacro(ParallelMarchingCubesExecute(
+                                 *w, ParallelMarchingCubesSampler<VTK_TT>(*w), slab));
+            }
+        }
+      else
+        {
+          ParallelMarchingCubesMerge(*w, slab);
+        }
+    }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+int ParallelMarchingCubes::RequestData(vtkInformation *vtkNotUsed(request),
+                                       vtkInformationVector **inputVector,
+                                       vtkInformationVector *outputVector)
+{
+  vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
+  vtkInformation *outInfo = outputVector->GetInformationObject(0);
+  vtkImageData *input = vtkImageData::SafeDownCast(inInfo->Get(vtkDataObject::DATA_OBJECT()));
+  vtkPolyData *output = vtkPolyData::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
+
+  if (input == NULL || input->GetPointData()->GetScalars() == NULL)
+    {
+      vtkErrorMacro("No input scalars.");
+      return 1;
+    }
+
+  ParallelMarchingCubesWork w;
+  input->GetExtent(w.imageExtent);
+  input->GetIncrements(w.inc);
+  input->GetOrigin(w.origin);
+  input->GetSpacing(w.spacing);
+  w.scalars = input->GetScalarPointer();
+  w.scalarType = input->GetScalarType();
+  w.border = this->CapBoundaries ? 1 : 0;
+  w.pad = this->PadValue;
+  w.useLabelTable = this->UseLabelTable;
+  w.labelTable = this->LabelTable.empty() ? NULL : &this->LabelTable[0];
+  w.labelTableSize = static_cast<vtkIdType>(this->LabelTable.size());
+  w.value = this->Value;
+  w.computeNormals = this->ComputeNormals != 0;
+  for (int a = 0; a < 3; a++)
+    {
+      w.extent[2 * a] = std::max(this->VOI[2 * a], w.imageExtent[2 * a]);
+      w.extent[2 * a + 1] = std::min(this->VOI[2 * a + 1], w.imageExtent[2 * a + 1]);
+      if (w.extent[2 * a] > w.extent[2 * a + 1])
+        {
+          return 1;
+        }
+      w.dims[a] = w.extent[2 * a + 1] - w.extent[2 * a] + 1 + 2 * w.border;
+    }
+
+  const int cells = w.dims[2] - 1;
+  if (w.dims[0] < 2 || w.dims[1] < 2 || cells < 1)
+    {
+      return 1;
+    }
+  w.slabs.resize(std::min(this->NumberOfThreads, cells));
+
+  // Extract the slabs
+  vtkMultiThreader *threader = vtkMultiThreader::New();
+  threader->SetNumberOfThreads(static_cast<int>(w.slabs.size()));
+  threader->SetSingleMethod(ParallelMarchingCubesThread, &w);
+  w.phase = 0;
+  threader->SingleMethodExecute();
+
+  vtkIdType numberOfPoints = 0;
+  vtkIdType numberOfTriangles = 0;
+  for (std::size_t i = 0; i < w.slabs.size(); i++)
+    {
+      w.slabs[i].pointOffset = numberOfPoints;
+      w.slabs[i].triangleOffset = numberOfTriangles;
+      numberOfPoints += static_cast<vtkIdType>(w.slabs[i].points.size() / 3);
+      numberOfTriangles += static_cast<vtkIdType>(w.slabs[i].triangles.size() / 3);
+    }
+
+  // Merge them into the output
+  vtkFloatArray *points = vtkFloatArray::New();
+  points->SetNumberOfComponents(3);
+  points->SetNumberOfTuples(numberOfPoints);
+  w.points = points->GetPointer(0);
+
+  vtkFloatArray *normals = NULL;
+  w.normals = NULL;
+  if (w.computeNormals)
+    {
+      normals = vtkFloatArray::New();
+      normals->SetName("Normals");
+      normals->SetNumberOfComponents(3);
+      normals->SetNumberOfTuples(numberOfPoints);
+      w.normals = normals->GetPointer(0);
+    }
+
+  vtkIdTypeArray *connectivity = vtkIdTypeArray::New();
+  connectivity->SetNumberOfValues(4 * numberOfTriangles);
+  w.cells = connectivity->GetPointer(0);
+
+  w.phase = 1;
+  threader->SingleMethodExecute();
+  threader->Delete();
+
+  vtkPoints *outPoints = vtkPoints::New();
+  outPoints->SetData(points);
+  output->SetPoints(outPoints);
+  outPoints->Delete();
+  points->Delete();
+
+  vtkCellArray *polys = vtkCellArray::New();
+  polys->SetCells(numberOfTriangles, connectivity);
+  output->SetPolys(polys);
+  polys->Delete();
+  connectivity->Delete();
+
+  if (normals)
+    {
+      output->GetPointData()->SetNormals(normals);
+      normals->Delete();
+    }
+  return 1;
+}
+
+/** Arguments of ParallelMarchingCubesUpdate(). */
+struct ParallelMarchingCubesFilters
+{
+  ParallelMarchingCubes **filters;
+  int n;
+};
+
+/** Thread entry point of UpdateConcurrently(). */
+static VTK_THREAD_RETURN_TYPE ParallelMarchingCubesUpdate(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *info = static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  ParallelMarchingCubesFilters *data = static_cast<ParallelMarchingCubesFilters *>(info->UserData);
+  for (int i = info->ThreadID; i < data->n; i += info->NumberOfThreads)
+    {
+      data->filters[i]->Update();
+    }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+void ParallelMarchingCubes::UpdateConcurrently(ParallelMarchingCubes **filters, int n)
+{
+  if (n < 1)
+    {
+      return;
+    }
+
+  for (int i = 0; i < n; i++)
+    {
+      vtkImageData *input = vtkImageData::SafeDownCast(filters[i]->GetInput());
+      if (input)
+        {
+          input->UpdateInformation();
+          input->SetUpdateExtent(input->GetWholeExtent());
+          input->Update();
+        }
+    }
+
+  ParallelMarchingCubesFilters data;
+  data.filters = filters;
+  data.n = n;
+  vtkMultiThreader *threader = vtkMultiThreader::New();
+  threader->SetNumberOfThreads(n);
+  threader->SetSingleMethod(ParallelMarchingCubesUpdate, &data);
+  threader->SingleMethodExecute();
+  threader->Delete();
+}
+
+void ParallelMarchingCubes::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Value: " << this->Value << "\n";
+  os << indent << "ComputeNormals: " << this->ComputeNormals << "\n";
+  os << indent << "CapBoundaries: " << this->CapBoundaries << "\n";
+  os << indent << "PadValue: " << this->PadValue << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "VOI: (" << this->VOI[0] << ", " << this->VOI[1] << ", " << this->VOI[2]
+     << ", " << this->VOI[3] << ", " << this->VOI[4] << ", " << this->VOI[5] << ")\n";
+  os << indent << "LabelTable: "
+     << (this->UseLabelTable ? static_cast<vtkIdType>(this->LabelTable.size()) : 0) << " entries\n";
+}
+
+} // end namespace wse
@@ -0,0 +1,113 @@
+#ifndef _wse_parallel_marching_cubes_h
+#define _wse_parallel_marching_cubes_h
+
+#include "vtkPolyDataAlgorithm.h"
+
+#include <vector>
+
+namespace wse {
+
+/** ParallelMarchingCubes extracts an isosurface of an image with the
+    marching cubes cases of vtkMarchingCubes, on several threads.
+
+    The image is cut into slabs of consecutive z planes, one per
+    thread.  Within a slab, each intersected edge of the voxel grid
+    gets a single vertex that all the cells around it share.  A
+    vertex on the plane between two slabs belongs to the slab above;
+    the triangles of the slab below refer to it by its edge, and these
+    references are resolved when the slabs are merged into the output.
+    The result is a connected surface, as from vtkMarchingCubes.
+
+    Normals are computed inline from the gradient of the image, so no
+    vtkPolyDataNormals pass is needed.
+
+    When CapBoundaries is on (the default), samples outside of the
+    image read as PadValue, which closes surfaces that touch the
+    boundary without padding a copy of the image first.
+
+    The surface of a set of labels of a labeled image can be extracted
+    through a label table, without thresholding a copy of the image,
+    and limited to their bounding box with SetVOI(). */
+class ParallelMarchingCubes : public vtkPolyDataAlgorithm
+{
+public:
+  static ParallelMarchingCubes *New();
+  vtkTypeRevisionMacro(ParallelMarchingCubes,vtkPolyDataAlgorithm);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  // Description:
+  // Set the isovalue.  The default is 0.5.
+  vtkSetMacro(Value, double);
+  vtkGetMacro(Value, double);
+
+  // Description:
+  // Set whether point normals are computed.  On by default.
+  vtkSetMacro(ComputeNormals, int);
+  vtkGetMacro(ComputeNormals, int);
+  vtkBooleanMacro(ComputeNormals, int);
+
+  // Description:
+  // Set whether the surface is closed at the boundary of the image, and
+  // the value of the samples outside of it.  The defaults are on and 0.
+  vtkSetMacro(CapBoundaries, int);
+  vtkGetMacro(CapBoundaries, int);
+  vtkBooleanMacro(CapBoundaries, int);
+  vtkSetMacro(PadValue, double);
+  vtkGetMacro(PadValue, double);
+
+  // Description:
+  // Set the maximum number of threads.  The default is the global
+  // default of vtkMultiThreader.
+  vtkSetClampMacro(NumberOfThreads, int, 1, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
+  // Description:
+  // Set the extent of the image that is contoured, e.g. the bounding box
+  // of a region.  It is clipped to the extent of the input, which it
+  // covers by default.
+  vtkSetVector6Macro(VOI, int);
+  vtkGetVector6Macro(VOI, int);
+
+  // Description:
+  // Contour a labeled image through a table of n entries instead of its
+  // values: each voxel reads as the entry of its label, and labels
+  // outside of the table read as 0.  A table of 0 and 1 with a Value of
+  // 0.5 gives the surface of the labels marked 1.  The table is copied.
+  void SetLabelTable(const unsigned char *table, vtkIdType n);
+  void RemoveLabelTable();
+
+  // Description:
+  // Update several filters at once, one per thread.  Their inputs are
+  // brought up to date first, on the calling thread, so the filters
+  // must not share any other part of their pipelines.
+  static void UpdateConcurrently(ParallelMarchingCubes **filters, int n);
+
+protected:
+  ParallelMarchingCubes();
+  ~ParallelMarchingCubes() {}
+
+  virtual int FillInputPortInformation(int port, vtkInformation *info);
+  virtual int RequestUpdateExtent(vtkInformation *request,
+                                  vtkInformationVector **inputVector,
+                                  vtkInformationVector *outputVector);
+  virtual int RequestData(vtkInformation *request,
+                          vtkInformationVector **inputVector,
+                          vtkInformationVector *outputVector);
+
+  double Value;
+  int ComputeNormals;
+  int CapBoundaries;
+  double PadValue;
+  int NumberOfThreads;
+  int VOI[6];
+  std::vector<unsigned char> LabelTable;
+  bool UseLabelTable;
+
+private:
+  ParallelMarchingCubes(const ParallelMarchingCubes&);  // Not implemented.
+  void operator=(const ParallelMarchingCubes&);  // Not implemented.
+};
+
+} // end namespace wse
+
+#endif
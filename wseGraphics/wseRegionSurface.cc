@@ -0,0 +1,145 @@
+#include "wseRegionSurface.h"
+
+#include "vtkAlgorithm.h"
+#include "vtkImageData.h"
+#include "vtkWSBoundingBoxManager.h"
+#include "vtkWSLookupTableManager.h"
+#include "wseParallelMarchingCubes.h"
+
+#include <algorithm>
+
+namespace wse {
+
+RegionSurface::RegionSurface()
+{
+  this->Labels = NULL;
+  this->Manager = NULL;
+  this->Boxes = NULL;
+  this->MarchingCubes = ParallelMarchingCubes::New();
+  this->MarchingCubes->SetValue(0.5);
+  this->MarchingCubes->CapBoundariesOn();
+  this->MarchingCubes->SetPadValue(0.0);
+  this->NumberOfRegionLabels = 0;
+
+  this->Valid = false;
+  this->LabelData = NULL;
+  this->LabelMTime = 0;
+  this->RootTableMTime = 0;
+  this->Root = 0;
+}
+
+RegionSurface::~RegionSurface()
+{
+  this->SetLabels(NULL, NULL, NULL);
+  this->MarchingCubes->Delete();
+}
+
+void RegionSurface::SetLabels(vtkAlgorithmOutput *labels, vtkWSLookupTableManager *manager,
+                              vtkWSBoundingBoxManager *boxes)
+{
+  if (labels == this->Labels && manager == this->Manager && boxes == this->Boxes)
+    {
+      return;
+    }
+  if (manager != this->Manager)
+    {
+      if (manager)       { manager->Register(NULL); }
+      if (this->Manager) { this->Manager->UnRegister(NULL); }
+      this->Manager = manager;
+    }
+  if (boxes != this->Boxes)
+    {
+      if (boxes)       { boxes->Register(NULL); }
+      if (this->Boxes) { this->Boxes->UnRegister(NULL); }
+      this->Boxes = boxes;
+    }
+  this->Labels = labels;
+  this->MarchingCubes->SetInputConnection(labels);
+  this->Valid = false;
+}
+
+vtkPolyData *RegionSurface::Update(unsigned long label)
+{
+  if (! this->HasLabels() || this->Manager->GetRootTable() == NULL
+      || label >= this->Manager->GetNumberOfLabels())
+    {
+      return NULL;
+    }
+
+  vtkImageData *labels = vtkImageData::SafeDownCast(
+    this->Labels->GetProducer()->GetOutputDataObject(this->Labels->GetIndex()));
+  if (labels == NULL)
+    {
+      return NULL;
+    }
+  labels->UpdateInformation();
+  labels->SetUpdateExtent(labels->GetWholeExtent());
+  labels->Update();
+
+  const unsigned long *roots = this->Manager->GetRootTable();
+  const unsigned long root = roots[label];
+  if (this->Valid
+      && labels == this->LabelData
+      && labels->GetMTime() == this->LabelMTime
+      && this->Manager->GetRootTableMTime() == this->RootTableMTime
+      && root == this->Root)
+    {
+      return this->MarchingCubes->GetOutput();
+    }
+
+  // The boxes are only generated from an unsigned long image.
+  if (labels->GetScalarType() != VTK_UNSIGNED_LONG)
+    {
+      return NULL;
+    }
+  if (this->Boxes->GetBoundingBoxTable().size() == 0)
+    {
+      this->Boxes->GenerateBoundingBoxes();
+    }
+
+  // Mark the labels of the region and collect the union of their boxes.
+  const unsigned long n = this->Manager->GetNumberOfLabels();
+  const vtkBoundingBoxHash &table = this->Boxes->GetBoundingBoxTable();
+  this->Members.assign(n, 0);
+  this->NumberOfRegionLabels = 0;
+  int voi[6] = { VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN };
+  for (unsigned long l = 0; l < n; l++)
+    {
+      if (roots[l] != root)
+        {
+          continue;
+        }
+      this->Members[l] = 1;
+      this->NumberOfRegionLabels++;
+
+      vtkBoundingBoxHash::const_iterator box = table.find(l);
+      if (box != table.end())
+        {
+          voi[0] = std::min(voi[0], box->second.x0);
+          voi[1] = std::max(voi[1], box->second.x1);
+          voi[2] = std::min(voi[2], box->second.y0);
+          voi[3] = std::max(voi[3], box->second.y1);
+          voi[4] = std::min(voi[4], box->second.z0);
+          voi[5] = std::max(voi[5], box->second.z1);
+        }
+    }
+
+  // A region without voxels gets an empty box and an empty surface.
+  if (voi[0] > voi[1])
+    {
+      voi[0] = voi[2] = voi[4] = 0;
+      voi[1] = voi[3] = voi[5] = -1;
+    }
+  this->MarchingCubes->SetVOI(voi);
+  this->MarchingCubes->SetLabelTable(&this->Members[0], static_cast<vtkIdType>(n));
+  this->MarchingCubes->Update();
+
+  this->Valid = true;
+  this->LabelData = labels;
+  this->LabelMTime = labels->GetMTime();
+  this->RootTableMTime = this->Manager->GetRootTableMTime();
+  this->Root = root;
+  return this->MarchingCubes->GetOutput();
+}
+
+} // end namespace wse
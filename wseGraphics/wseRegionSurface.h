@@ -0,0 +1,73 @@
+#ifndef _wse_region_surface_h
+#define _wse_region_surface_h
+
+#include "vtkAlgorithmOutput.h"
+#include "vtkPolyData.h"
+
+#include <vector>
+
+class vtkWSBoundingBoxManager;
+class vtkWSLookupTableManager;
+
+namespace wse {
+
+class ParallelMarchingCubes;
+
+/** RegionSurface extracts the surface of a merged region of a watershed
+    segmentation directly from its labeled image.
+
+    The region is the set of labels that are merged to the same label
+    in the dense root table of a vtkWSLookupTableManager.  Rather than
+    building a binary volume of the region, the labeled image is
+    contoured through a table that marks the labels of the region, and
+    only inside the union of their boxes in a vtkWSBoundingBoxManager.
+    The boxes are generated the first time they are needed. */
+class RegionSurface
+{
+public:
+  RegionSurface();
+  ~RegionSurface();
+
+  /** Set the labeled image, the manager that holds its merges and the
+      manager of the bounding boxes of its labels.  Passing NULL for any
+      of them disables the surface. */
+  void SetLabels(vtkAlgorithmOutput *labels, vtkWSLookupTableManager *manager,
+                 vtkWSBoundingBoxManager *boxes);
+  bool HasLabels() const
+  { return this->Labels != NULL && this->Manager != NULL && this->Boxes != NULL; }
+
+  /** Returns the surface of the region that contains the given label,
+      recomputing it only if the region, the labels or their merges have
+      changed since the last call.  Returns NULL if there are no labels
+      or the label does not exist.  The surface is owned by the
+      RegionSurface. */
+  vtkPolyData *Update(unsigned long label);
+
+  /** Returns the number of labels in the last region extracted. */
+  unsigned long GetNumberOfRegionLabels() const
+  { return this->NumberOfRegionLabels; }
+
+private:
+  RegionSurface(const RegionSurface&);  // Not implemented.
+  void operator=(const RegionSurface&);  // Not implemented.
+
+  vtkAlgorithmOutput *Labels;
+  vtkWSLookupTableManager *Manager;
+  vtkWSBoundingBoxManager *Boxes;
+  ParallelMarchingCubes *MarchingCubes;
+
+  /** 1 for the labels of the region, 0 for all others. */
+  std::vector<unsigned char> Members;
+  unsigned long NumberOfRegionLabels;
+
+  // What the surface was computed from
+  bool Valid;
+  vtkImageData *LabelData;
+  unsigned long LabelMTime;
+  unsigned long RootTableMTime;
+  unsigned long Root;
+};
+
+} // end namespace wse
+
+#endif
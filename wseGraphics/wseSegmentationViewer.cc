@@ -41,24 +41,17 @@ void SegmentationViewer::InstallPipeline()
      this->Interactor->SetRenderWindow(this->RenderWindow);
    }
 
-  // setup mask image map using the lookup table
-  MaskImageMapToColors->SetLookupTable(mMaskLUT);
-  MaskImageMapToColors->PassAlphaToOutputOn();
-  MaskImageMapToColors->SetOutputFormatToRGBA();
-
-  if (mImageLookupTable != NULL)
-    {
-      WindowLevel->SetLookupTable(mImageLookupTable);
-    }
-  WindowLevel->PassAlphaToOutputOff();
-  WindowLevel->SetOutputFormatToRGBA();
-
-  //ImageActor->SetInput(mImageBlend->GetOutput());
+  // Labels are colored through the lookup table, gathering each label's
+  // entry directly.
+  Compositor->SetLookupTable(mImageLookupTable);
+  Compositor->LabelMapOn();
 
   if (this->Renderer && this->ImageActor)
   {
     this->Renderer->AddViewProp(this->ImageActor);
     this->Renderer->AddViewProp(this->MaskImageActor);
+    this->Renderer->AddViewProp(this->BoundaryActor);
+    this->Renderer->AddViewProp(this->CursorActor);
   }
   mPipelineInstalled = true;
 }
@@ -67,11 +60,12 @@ void SegmentationViewer::PrintSelf(ostream& os, vtkIndent indent)
 {  this->Superclass::PrintSelf(os, indent);}
 
 
-void SegmentationViewer::ResetWindowLevel(vtkImageMapToWindowLevelColors *windowLevel)
+void SegmentationViewer::ResetWindowLevel(SliceCompositor *windowLevel)
 {
   if (windowLevel) 
     {
       // These settings should nullify any window / leveling.
+      // SliceCompositor follows vtkImageMapToWindowLevelColors.
       // From the vtk documentation for vtkImageMapToWindowLevelColors: 
       //   "modulation will be performed on the color based on 
       //    (S - (L - W/2))/W where S is the scalar
@@ -8,6 +8,8 @@ namespace wse {
 /** This is a subclass of SliceViewer that is designed for displaying
     labeled image maps.  It redefines certain functions
     (e.g. window/leveling) to be more appropriate for labeled images.
+    Its compositor runs in label map mode, so that a merge recolors the
+    cached slices in place instead of computing them again.
     See wse::SliceViewer for more information. */
 class SegmentationViewer : public SliceViewer
 {
@@ -34,7 +36,7 @@ private:
   SegmentationViewer(const SegmentationViewer&);  // Not implemented.
   void operator=(const SegmentationViewer&);  // Not implemented.
 
-  virtual void ResetWindowLevel(vtkImageMapToWindowLevelColors *windowLevel);
+  virtual void ResetWindowLevel(SliceCompositor *windowLevel);
 };
 
 } // end namespace wse
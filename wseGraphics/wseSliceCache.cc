@@ -0,0 +1,619 @@
+#include "wseSliceCache.h"
+
+#include "vtkAlgorithmOutput.h"
+#include "vtkDataArray.h"
+#include "vtkPointData.h"
+
+#include <QMutexLocker>
+#include <QThread>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace wse {
+
+/** The thread that computes the slices queued by SliceCache::Prefetch(). */
+class SlicePrefetcher : public QThread
+{
+public:
+  SlicePrefetcher(SliceCache *cache) : mCache(cache) {}
+
+protected:
+  void run() { mCache->RunPrefetcher(); }
+
+private:
+  SliceCache *mCache;
+};
+
+SliceCache::SliceCache()
+{
+  this->Compositor = SliceCompositor::New();
+  this->Image = NULL;
+  this->Mask = NULL;
+  this->ImageSlab = vtkImageData::New();
+  this->MaskSlab = vtkImageData::New();
+  this->SlabBegin = 1;
+  this->SlabEnd = 0;
+  for (int i = 0; i < 6; i++)
+    {
+      this->WholeExtent[i] = 0;
+    }
+  this->Orientation = 2;
+  this->SliceBytes = 0;
+
+  this->Source = NULL;
+  this->SourceImage = NULL;
+  this->SourceMask = NULL;
+  this->SourceMTime = 0;
+  this->SourceParametersMTime = 0;
+  this->SourceImageMTime = 0;
+  this->SourceMaskMTime = 0;
+
+  this->Generation = 0;
+  this->Bytes = 0;
+  this->Budget = 256 * 1024 * 1024;
+  this->PrefetchDepth = 32;
+  this->Quit = false;
+  this->Prefetcher = NULL;
+}
+
+SliceCache::~SliceCache()
+{
+  if (this->Prefetcher)
+    {
+      this->Mutex.lock();
+      this->Quit = true;
+      this->Queue.clear();
+      this->Wake.wakeAll();
+      this->Mutex.unlock();
+
+      this->Prefetcher->wait();
+      delete this->Prefetcher;
+    }
+
+  this->Clear();
+  this->Compositor->Delete();
+  this->ImageSlab->Delete();
+  this->MaskSlab->Delete();
+}
+
+void SliceCache::SetMemoryBudget(unsigned long bytes)
+{
+  QMutexLocker lock(&this->Mutex);
+  this->Budget = bytes;
+}
+
+/** Returns the time of the last change to data or to the pipeline
+    that produces it.  UpdateInformation() must have been called. */
+static unsigned long SliceCacheInputMTime(vtkImageData *data)
+{
+  const unsigned long t = data->GetMTime();
+  const unsigned long p = data->GetPipelineMTime();
+  return (p > t) ? p : t;
+}
+
+bool SliceCache::Update(SliceCompositor *source, int orientation)
+{
+  vtkImageData *image = vtkImageData::SafeDownCast(source->GetInput());
+  if (image == NULL)
+    {
+      this->Clear();
+      return false;
+    }
+  vtkImageData *mask = NULL;
+  if (source->GetNumberOfInputConnections(1) > 0)
+    {
+      mask = vtkImageData::SafeDownCast(source->GetInputDataObject(1, 0));
+    }
+
+  // The information pass is cheap and tells whether anything upstream
+  // of the inputs has changed since the snapshot, without executing
+  // the pipeline.
+  image->UpdateInformation();
+  if (mask)
+    {
+      mask->UpdateInformation();
+    }
+  const bool sameInputs = source == this->Source
+    && image == this->SourceImage
+    && mask == this->SourceMask
+    && orientation == this->Orientation
+    && SliceCacheInputMTime(image) == this->SourceImageMTime
+    && (mask == NULL || SliceCacheInputMTime(mask) == this->SourceMaskMTime);
+
+  if (sameInputs && source->GetMTime() == this->SourceMTime)
+    {
+      return true;
+    }
+
+  if (sameInputs
+      && source->GetParametersMTime() == this->SourceParametersMTime
+      && this->RecolorSlices(source))
+    {
+      this->SourceMTime = source->GetMTime();
+      return true;
+    }
+
+  // A new snapshot is taken, so the whole inputs are brought up to
+  // date first.
+  image->SetUpdateExtent(image->GetWholeExtent());
+  image->Update();
+  if (mask)
+    {
+      mask->SetUpdateExtent(mask->GetWholeExtent());
+      mask->Update();
+    }
+
+  // Wait for the prefetcher to finish the slice it is computing, then
+  // discard everything computed from the old snapshot.
+  QMutexLocker computeLock(&this->ComputeMutex);
+  {
+    QMutexLocker lock(&this->Mutex);
+    this->DiscardSlices();
+    this->Generation++;
+
+    if (this->Image == NULL)
+      {
+        this->Image = vtkImageData::New();
+      }
+    this->Image->ShallowCopy(image);
+    this->Image->SetWholeExtent(this->Image->GetExtent());
+
+    if (mask)
+      {
+        if (this->Mask == NULL)
+          {
+            this->Mask = vtkImageData::New();
+          }
+        this->Mask->ShallowCopy(mask);
+        this->Mask->SetWholeExtent(this->Mask->GetExtent());
+      }
+    else if (this->Mask)
+      {
+        this->Mask->Delete();
+        this->Mask = NULL;
+      }
+
+    // YZ slices are composited from slabs gathered by GatherSlab(), the
+    // other orientations directly from the snapshot.
+    this->SlabBegin = 1;
+    this->SlabEnd = 0;
+    if (orientation == 0)
+      {
+        this->Compositor->SetInput(this->ImageSlab);
+        this->Compositor->SetMaskConnection(mask ? this->MaskSlab->GetProducerPort() : NULL);
+      }
+    else
+      {
+        this->Compositor->SetInput(this->Image);
+        this->Compositor->SetMaskConnection(mask ? this->Mask->GetProducerPort() : NULL);
+      }
+    this->Compositor->CopyParameters(source);
+
+    image->GetWholeExtent(this->WholeExtent);
+    this->Orientation = orientation;
+    this->SliceBytes = 4;
+    for (int i = 0; i < 3; i++)
+      {
+        if (i != orientation)
+          {
+            this->SliceBytes *= this->WholeExtent[2 * i + 1] - this->WholeExtent[2 * i] + 1;
+          }
+      }
+  }
+
+  this->Source = source;
+  this->SourceImage = image;
+  this->SourceMask = mask;
+  this->SourceMTime = source->GetMTime();
+  this->SourceParametersMTime = source->GetParametersMTime();
+  this->SourceImageMTime = SliceCacheInputMTime(image);
+  this->SourceMaskMTime = mask ? SliceCacheInputMTime(mask) : 0;
+  return true;
+}
+
+bool SliceCache::RecolorSlices(SliceCompositor *source)
+{
+  vtkLookupTable *table = source->GetLookupTable();
+  vtkLookupTable *copy = this->Compositor->GetLookupTable();
+  if (! source->GetLabelMap() || table == NULL || copy == NULL || this->Image == NULL)
+    {
+      return false;
+    }
+
+  table->Build();
+  const int n = table->GetNumberOfTableValues();
+  if (n <= 0 || n != copy->GetNumberOfTableValues()
+      || table->GetTableRange()[0] != copy->GetTableRange()[0]
+      || table->GetTableRange()[1] != copy->GetTableRange()[1])
+    {
+      return false;
+    }
+
+  QMutexLocker computeLock(&this->ComputeMutex);
+  QMutexLocker lock(&this->Mutex);
+
+  // Flag the labels whose color differs from the snapshot's.
+  std::vector<unsigned char> changed(n, 0);
+  const unsigned char *a = copy->GetPointer(0);
+  const unsigned char *b = table->GetPointer(0);
+  bool any = false;
+  for (int i = 0; i < n; i++)
+    {
+      if (std::memcmp(a + 4 * i, b + 4 * i, 4) != 0)
+        {
+          changed[i] = 1;
+          any = true;
+        }
+    }
+  this->Compositor->CopyParameters(source);
+  if (! any)
+    {
+      return true;
+    }
+
+  // A slice the prefetcher computed with the old colors but has not
+  // inserted yet would miss the recoloring below, so it must be
+  // dropped.
+  this->Generation++;
+
+  for (std::map<int, vtkImageData *>::iterator it = this->Slices.begin();
+       it != this->Slices.end(); ++it)
+    {
+      if (this->Compositor->RecolorLabels(this->Image, it->second, changed) < 0)
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+vtkImageData *SliceCache::GetSlice(int s)
+{
+  if (this->Image == NULL
+      || s < this->WholeExtent[2 * this->Orientation]
+      || s > this->WholeExtent[2 * this->Orientation + 1])
+    {
+      return NULL;
+    }
+
+  unsigned long generation;
+  {
+    QMutexLocker lock(&this->Mutex);
+    std::map<int, vtkImageData *>::iterator it = this->Slices.find(s);
+    if (it != this->Slices.end())
+      {
+        return it->second;
+      }
+    generation = this->Generation;
+  }
+
+  // Snapshots only change on this thread, so the slice is always
+  // computed here.
+  vtkImageData *slice = this->ComputeSlice(s, generation);
+  if (slice == NULL)
+    {
+      return NULL;
+    }
+
+  QMutexLocker lock(&this->Mutex);
+  std::map<int, vtkImageData *>::iterator it = this->Slices.find(s);
+  if (it != this->Slices.end())
+    {
+      // The prefetcher finished it first
+      slice->Delete();
+      return it->second;
+    }
+  this->Slices[s] = slice;
+  this->Bytes += this->SliceBytes;
+  this->Evict(s, 0, this->Budget);
+  return slice;
+}
+
+void SliceCache::Prefetch(int s, int direction)
+{
+  if (this->Image == NULL || this->SliceBytes == 0 || this->PrefetchDepth < 1)
+    {
+      return;
+    }
+
+  QMutexLocker lock(&this->Mutex);
+
+  // Leave room for the current slice
+  const unsigned long capacity = this->Budget / this->SliceBytes;
+  if (capacity < 2)
+    {
+      return;
+    }
+  int depth = this->PrefetchDepth;
+  if (static_cast<unsigned long>(depth) > capacity - 1)
+    {
+      depth = static_cast<int>(capacity - 1);
+    }
+
+  const int lo = this->WholeExtent[2 * this->Orientation];
+  const int hi = this->WholeExtent[2 * this->Orientation + 1];
+  this->Queue.clear();
+  for (int i = 1; i <= depth; i++)
+    {
+      int n;
+      if (direction > 0)      { n = s + i; }
+      else if (direction < 0) { n = s - i; }
+      else                    { n = (i % 2) ? s + (i + 1) / 2 : s - i / 2; }
+
+      if (n >= lo && n <= hi && this->Slices.find(n) == this->Slices.end())
+        {
+          this->Queue.push_back(n);
+        }
+    }
+  if (this->Queue.empty())
+    {
+      return;
+    }
+
+  // Make room for the queued slices, keeping the ones inside the
+  // prefetch window.
+  const int keep = (direction == 0) ? (depth + 1) / 2 : depth;
+  this->Evict(s, keep, this->Budget - this->Queue.size() * this->SliceBytes);
+
+  if (this->Prefetcher == NULL)
+    {
+      this->Prefetcher = new SlicePrefetcher(this);
+      this->Prefetcher->start(QThread::LowPriority);
+    }
+  this->Wake.wakeOne();
+}
+
+void SliceCache::Clear()
+{
+  QMutexLocker computeLock(&this->ComputeMutex);
+  QMutexLocker lock(&this->Mutex);
+  this->DiscardSlices();
+  this->Generation++;
+
+  this->Compositor->SetInputConnection(0, NULL);
+  this->Compositor->SetMaskConnection(NULL);
+  this->Compositor->SetLookupTable(NULL);
+  if (this->Image)
+    {
+      this->Image->Delete();
+      this->Image = NULL;
+    }
+  if (this->Mask)
+    {
+      this->Mask->Delete();
+      this->Mask = NULL;
+    }
+  this->ImageSlab->Initialize();
+  this->MaskSlab->Initialize();
+  this->SlabBegin = 1;
+  this->SlabEnd = 0;
+  this->SliceBytes = 0;
+
+  this->Source = NULL;
+  this->SourceImage = NULL;
+  this->SourceMask = NULL;
+}
+
+void SliceCache::RunPrefetcher()
+{
+  QMutexLocker lock(&this->Mutex);
+  while (! this->Quit)
+    {
+      if (this->Queue.empty())
+        {
+          this->Wake.wait(&this->Mutex);
+          continue;
+        }
+
+      const int s = this->Queue.front();
+      this->Queue.pop_front();
+      if (this->Slices.find(s) != this->Slices.end())
+        {
+          continue;
+        }
+
+      // The prefetcher never evicts; it stops when the cache is full.
+      if (this->Bytes + this->SliceBytes > this->Budget)
+        {
+          this->Queue.clear();
+          continue;
+        }
+
+      const unsigned long generation = this->Generation;
+      lock.unlock();
+      vtkImageData *slice = this->ComputeSlice(s, generation);
+      lock.relock();
+
+      if (slice == NULL)
+        {
+          continue;
+        }
+      if (generation != this->Generation
+          || this->Slices.find(s) != this->Slices.end()
+          || this->Bytes + this->SliceBytes > this->Budget)
+        {
+          slice->Delete();
+          continue;
+        }
+      this->Slices[s] = slice;
+      this->Bytes += this->SliceBytes;
+    }
+}
+
+vtkImageData *SliceCache::ComputeSlice(int s, unsigned long generation)
+{
+  QMutexLocker computeLock(&this->ComputeMutex);
+  {
+    QMutexLocker lock(&this->Mutex);
+    if (generation != this->Generation || this->Image == NULL)
+      {
+        return NULL;
+      }
+  }
+
+  int ext[6];
+  this->SliceExtent(s, ext);
+
+  // The extent computed by the compositor.  A YZ slice is the plane s of
+  // the slab, whose axes are ordered y, z, x.
+  int cext[6];
+  if (this->Orientation == 0)
+    {
+      if (s < this->SlabBegin || s > this->SlabEnd)
+        {
+          this->GatherSlab(s);
+        }
+      cext[0] = ext[2];  cext[1] = ext[3];
+      cext[2] = ext[4];  cext[3] = ext[5];
+      cext[4] = s;       cext[5] = s;
+    }
+  else
+    {
+      for (int i = 0; i < 6; i++)
+        {
+          cext[i] = ext[i];
+        }
+    }
+
+  vtkImageData *out = this->Compositor->GetOutput();
+  out->UpdateInformation();
+  out->SetUpdateExtent(cext);
+  out->Update();
+
+  // A single plane is stored in the same order whatever its axes, so
+  // the pixels are copied as they are under the extent of the slice.
+  vtkImageData *slice = vtkImageData::New();
+  slice->SetExtent(ext);
+  slice->SetWholeExtent(ext);
+  slice->SetSpacing(this->Image->GetSpacing());
+  slice->SetOrigin(this->Image->GetOrigin());
+  slice->SetScalarTypeToUnsignedChar();
+  slice->SetNumberOfScalarComponents(4);
+  vtkDataArray *scalars = out->GetPointData()->GetScalars()->NewInstance();
+  scalars->DeepCopy(out->GetPointData()->GetScalars());
+  slice->GetPointData()->SetScalars(scalars);
+  scalars->Delete();
+  return slice;
+}
+
+/** Copies the planes x0 to x1 of in into slab, reordering the axes to
+    y, z, x so that each YZ plane becomes contiguous. */
+template <class T>
+void SliceCacheGather(vtkImageData *in, vtkImageData *slab, int x0, int x1, T *)
+{
+  const int *e = in->GetExtent();
+  const int nc = in->GetNumberOfScalarComponents();
+  const vtkIdType nx = e[1] - e[0] + 1;
+  const vtkIdType ny = e[3] - e[2] + 1;
+  const vtkIdType nz = e[5] - e[4] + 1;
+  const vtkIdType plane = ny * nz * nc;
+  const int nb = x1 - x0 + 1;
+
+  const T *src = static_cast<T *>(in->GetScalarPointer());
+  T *dst = static_cast<T *>(slab->GetScalarPointer());
+
+  // The nb voxels of each row that belong to the slab are read
+  // together, and written to nb sequential streams, one per plane.
+  for (vtkIdType z = 0; z < nz; z++)
+    {
+    for (vtkIdType y = 0; y < ny; y++)
+      {
+        const T *row = src + ((z * ny + y) * nx + (x0 - e[0])) * nc;
+        T *out = dst + (z * ny + y) * nc;
+        for (int b = 0; b < nb; b++)
+          {
+          for (int c = 0; c < nc; c++)
+            {
+              out[b * plane + c] = row[b * nc + c];
+            }
+          }
+      }
+    }
+}
+
+/** Fills slab with the planes x0 to x1 of in. */
+static void SliceCacheGatherSlab(vtkImageData *in, vtkImageData *slab, int x0, int x1)
+{
+  const int *e = in->GetExtent();
+  slab->Initialize();
+  slab->SetExtent(e[2], e[3], e[4], e[5], x0, x1);
+  slab->SetWholeExtent(e[2], e[3], e[4], e[5], x0, x1);
+  slab->SetScalarType(in->GetScalarType());
+  slab->SetNumberOfScalarComponents(in->GetNumberOfScalarComponents());
+  slab->AllocateScalars();
+
+  switch (in->GetScalarType())
+    {
+      vtkTemplateMacro(SliceCacheGather(in, slab, x0, x1, static_cast<VTK_TT *>(NULL)));
+    default:
+      vtkGenericWarningMacro("SliceCache: unknown scalar type");
+      break;
+    }
+  slab->Modified();
+}
+
+void SliceCache::GatherSlab(int s)
+{
+  const int x0 = this->WholeExtent[0]
+    + ((s - this->WholeExtent[0]) / SliceCache::SlabWidth) * SliceCache::SlabWidth;
+  int x1 = x0 + SliceCache::SlabWidth - 1;
+  if (x1 > this->WholeExtent[1])
+    {
+      x1 = this->WholeExtent[1];
+    }
+
+  SliceCacheGatherSlab(this->Image, this->ImageSlab, x0, x1);
+  if (this->Mask)
+    {
+      SliceCacheGatherSlab(this->Mask, this->MaskSlab, x0, x1);
+    }
+  this->SlabBegin = x0;
+  this->SlabEnd = x1;
+}
+
+void SliceCache::SliceExtent(int s, int ext[6]) const
+{
+  for (int i = 0; i < 6; i++)
+    {
+      ext[i] = this->WholeExtent[i];
+    }
+  ext[2 * this->Orientation]     = s;
+  ext[2 * this->Orientation + 1] = s;
+}
+
+void SliceCache::Evict(int s, int keep, unsigned long budget)
+{
+  // The slice farthest from s is always the first or the last one.
+  while (this->Bytes > budget && ! this->Slices.empty())
+    {
+      std::map<int, vtkImageData *>::iterator first = this->Slices.begin();
+      std::map<int, vtkImageData *>::iterator last  = this->Slices.end();
+      --last;
+      const int dfirst = std::abs(first->first - s);
+      const int dlast  = std::abs(last->first - s);
+
+      std::map<int, vtkImageData *>::iterator it = (dfirst >= dlast) ? first : last;
+      if (std::abs(it->first - s) <= keep)
+        {
+          break;
+        }
+      it->second->Delete();
+      this->Slices.erase(it);
+      this->Bytes -= this->SliceBytes;
+    }
+}
+
+void SliceCache::DiscardSlices()
+{
+  for (std::map<int, vtkImageData *>::iterator it = this->Slices.begin();
+       it != this->Slices.end(); ++it)
+    {
+      it->second->Delete();
+    }
+  this->Slices.clear();
+  this->Queue.clear();
+  this->Bytes = 0;
+}
+
+} // end namespace wse
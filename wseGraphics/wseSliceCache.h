@@ -0,0 +1,173 @@
+#ifndef _wse_slice_cache_h
+#define _wse_slice_cache_h
+
+#include "vtkImageData.h"
+#include "wseSliceCompositor.h"
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <deque>
+#include <map>
+
+namespace wse {
+
+class SlicePrefetcher;
+
+/** SliceCache holds composited RGBA slices of a SliceCompositor so that
+    returning to, or scrolling onto, a slice that has already been
+    computed does not execute the compositor again.
+
+    The cache works on a snapshot of the compositor: its parameters and
+    lookup table are copied and its inputs are shallow copied into a
+    private pipeline.  The snapshot shares the pixels of the inputs, so
+    the cache must be cleared with Clear() before they are freed; the
+    prefetch thread may otherwise still be reading them.  Update() compares the compositor, its inputs and
+    the slice orientation against the snapshot and discards every
+    cached slice when any of them has changed.  The exception is a
+    label map compositor whose lookup table alone has changed, as after
+    a merge: the cached slices are then recolored in place, rewriting
+    only the rows that hold a label whose color changed.
+
+    The voxels of a YZ slice are a whole row apart in memory, so
+    compositing one directly from the image reads a cache line per
+    voxel.  YZ slices are instead composited from a slab of
+    SlabWidth consecutive planes, gathered row by row into a copy
+    whose axes are ordered y, z, x.  Each row read then serves all of
+    the planes of the slab, and the planes are contiguous.
+
+    Prefetch() asks a background thread to compute the slices that
+    follow the current one in the scroll direction.  The cache holds at
+    most SetMemoryBudget() bytes of slices; when it is full, the slices
+    farthest from the current one are evicted first.
+
+    Update(), Prefetch() and Clear() must be called from the GUI thread,
+    which owns the compositor being cached.  GetSlice() may also be
+    called from another thread while the GUI thread waits for it, as
+    SliceViewer::SetSlices() does. */
+class SliceCache
+{
+public:
+  SliceCache();
+  ~SliceCache();
+
+  /** Set the maximum number of bytes of cached slices.  The default is
+      256 MB. */
+  void SetMemoryBudget(unsigned long bytes);
+  unsigned long GetMemoryBudget() const
+  { return this->Budget; }
+
+  /** Set the maximum number of slices computed ahead by Prefetch().  The
+      default is 32. */
+  void SetPrefetchDepth(int n)
+  { this->PrefetchDepth = n; }
+  int GetPrefetchDepth() const
+  { return this->PrefetchDepth; }
+
+  /** Synchronize the cache with the given compositor and slice
+      orientation (0, 1 or 2 for the YZ, XZ and XY planes).  Only the
+      pipeline information of the inputs is updated to detect a change;
+      the whole inputs are brought up to date only when a new snapshot
+      is taken.  Returns false if the compositor has no input. */
+  bool Update(SliceCompositor *source, int orientation);
+
+  /** Returns the composited slice s, computing it if it is not cached.
+      The slice is owned by the cache and stays valid until the next
+      call to Update(), Prefetch() or GetSlice() (register it to keep
+      it longer). */
+  vtkImageData *GetSlice(int s);
+
+  /** Queue the slices that follow slice s for computation in the
+      background, replacing any slices still queued.  A positive
+      direction prefetches increasing slice numbers, a negative one
+      decreasing numbers and 0 both, alternately. */
+  void Prefetch(int s, int direction);
+
+  /** Discard all cached slices and the snapshot of the compositor,
+      after waiting for the prefetch thread to finish the slice it is
+      computing. */
+  void Clear();
+
+protected:
+  friend class SlicePrefetcher;
+
+  /** The body of the prefetch thread. */
+  void RunPrefetcher();
+
+private:
+  SliceCache(const SliceCache&);  // Not implemented.
+  void operator=(const SliceCache&);  // Not implemented.
+
+  /** Computes slice s with the private pipeline.  Returns NULL if the
+      snapshot is no longer the given generation. */
+  vtkImageData *ComputeSlice(int s, unsigned long generation);
+
+  /** Gathers the slab of YZ planes that contains slice s. */
+  void GatherSlab(int s);
+
+  /** Recolors the cached slices after a change of the lookup table of
+      a label map source.  Returns false if the slices cannot be
+      recolored and must be discarded. */
+  bool RecolorSlices(SliceCompositor *source);
+
+  /** Computes the extent of slice s. */
+  void SliceExtent(int s, int ext[6]) const;
+
+  /** Evicts the cached slices farthest from slice s until no more than
+      budget bytes are cached, but never one closer than keep slices.
+      Must be called with the Mutex locked. */
+  void Evict(int s, int keep, unsigned long budget);
+
+  /** Discards all cached slices and queued requests.  Must be called
+      with the Mutex locked. */
+  void DiscardSlices();
+
+  // The snapshot of the cached compositor
+  SliceCompositor *Compositor;
+  vtkImageData *Image;
+  vtkImageData *Mask;
+  int WholeExtent[6];
+  int Orientation;
+  unsigned long SliceBytes;
+
+  // The slab of YZ planes SlabBegin to SlabEnd, empty if SlabBegin is
+  // greater than SlabEnd
+  enum { SlabWidth = 16 };
+  vtkImageData *ImageSlab;
+  vtkImageData *MaskSlab;
+  int SlabBegin;
+  int SlabEnd;
+
+  // What the snapshot was taken from
+  SliceCompositor *Source;
+  vtkImageData *SourceImage;
+  vtkImageData *SourceMask;
+  unsigned long SourceMTime;
+  unsigned long SourceParametersMTime;
+  unsigned long SourceImageMTime;
+  unsigned long SourceMaskMTime;
+
+  /** Incremented whenever the snapshot or its lookup table changes, so
+      that slices computed from an older snapshot are discarded. */
+  unsigned long Generation;
+
+  std::map<int, vtkImageData *> Slices;
+  std::deque<int> Queue;
+  unsigned long Bytes;
+  unsigned long Budget;
+  int PrefetchDepth;
+
+  /** Guards Slices, Queue, Bytes, Generation and Quit. */
+  QMutex Mutex;
+
+  /** Guards the snapshot and its pipeline.  Locked before Mutex when
+      both are needed. */
+  QMutex ComputeMutex;
+
+  QWaitCondition Wake;
+  bool Quit;
+  SlicePrefetcher *Prefetcher;
+};
+
+} // end namespace wse
+
+#endif
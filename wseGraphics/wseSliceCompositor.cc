@@ -0,0 +1,503 @@
+#include "wseSliceCompositor.h"
+
+#include "vtkImageData.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkObjectFactory.h"
+#include "vtkAlgorithmOutput.h"
+#include "vtkDataObject.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace wse {
+
+vtkCxxRevisionMacro(SliceCompositor, "$Revision: 1.1 $");
+vtkStandardNewMacro(SliceCompositor);
+
+SliceCompositor::SliceCompositor()
+{
+  this->Window = 255.0;
+  this->Level  = 127.5;
+  this->LookupTable = NULL;
+  this->LabelMap = 0;
+
+  this->ShowMask = 1;
+  this->MaskColor[0] = 1.0;
+  this->MaskColor[1] = 0.0;
+  this->MaskColor[2] = 0.0;
+  this->MaskOpacity = 0.5;
+}
+
+SliceCompositor::~SliceCompositor()
+{
+  this->SetLookupTable(NULL);
+}
+
+vtkCxxSetObjectMacro(SliceCompositor, LookupTable, vtkLookupTable);
+
+void SliceCompositor::CopyParameters(SliceCompositor *other)
+{
+  this->SetWindow(other->Window);
+  this->SetLevel(other->Level);
+  this->SetLabelMap(other->LabelMap);
+  this->SetShowMask(other->ShowMask);
+  this->SetMaskColor(other->MaskColor);
+  this->SetMaskOpacity(other->MaskOpacity);
+  this->SetShowThreshold(other->ShowThreshold);
+  this->SetThreshold(other->ThresholdLower, other->ThresholdUpper);
+  this->SetThresholdColor(other->ThresholdColor);
+  this->SetThresholdOpacity(other->ThresholdOpacity);
+  this->SetClipThresholdToMask(other->ClipThresholdToMask);
+
+  if (other->LookupTable == NULL)
+    {
+      this->SetLookupTable(NULL);
+      return;
+    }
+
+  // The table values are written last, so that Build() treats them as
+  // user supplied and does not regenerate them from the ramp.
+  other->LookupTable->Build();
+  const int n = other->LookupTable->GetNumberOfTableValues();
+  const double *range = other->LookupTable->GetTableRange();
+
+  // A table of the same size and range is overwritten in place, which
+  // spares reallocating a table of millions of labels after each merge.
+  if (this->LookupTable && this->LookupTable != other->LookupTable
+      && this->LookupTable->GetNumberOfTableValues() == n
+      && this->LookupTable->GetTableRange()[0] == range[0]
+      && this->LookupTable->GetTableRange()[1] == range[1])
+    {
+      if (n > 0 && std::memcmp(this->LookupTable->GetPointer(0),
+                               other->LookupTable->GetPointer(0), 4 * n) != 0)
+        {
+          std::memcpy(this->LookupTable->WritePointer(0, n), other->LookupTable->GetPointer(0), 4 * n);
+          this->Modified();
+        }
+      return;
+    }
+
+  vtkLookupTable *table = vtkLookupTable::New();
+  table->SetNumberOfTableValues(n);
+  table->SetTableRange(range[0], range[1]);
+  if (n > 0)
+    {
+      std::memcpy(table->WritePointer(0, n), other->LookupTable->GetPointer(0), 4 * n);
+    }
+  this->SetLookupTable(table);
+  table->Delete();
+}
+
+unsigned long SliceCompositor::GetMTime()
+{
+  unsigned long t = this->Superclass::GetMTime();
+  if (this->LookupTable && this->LookupTable->GetMTime() > t)
+    {
+      t = this->LookupTable->GetMTime();
+    }
+  return t;
+}
+
+int SliceCompositor::RequestInformation(vtkInformation *request,
+                                        vtkInformationVector **inputVector,
+                                        vtkInformationVector *outputVector)
+{
+  // The table is built here, before the threads are started, as
+  // vtkImageMapToColors does.
+  if (this->LookupTable)
+    {
+      this->LookupTable->Build();
+    }
+  return this->Superclass::RequestInformation(request, inputVector, outputVector);
+}
+
+/** Per-execution constants of the compositing kernel, with colors and
+    opacities converted to 8 bit fixed point. */
+struct SliceCompositorParameters
+{
+  // Window / level
+  double shift;
+  double scale;
+  double lower;
+  double upper;
+
+  // Lookup table, NULL for gray levels
+  const unsigned char *table;
+  int maxIndex;
+  double tableShift;
+  double tableScale;
+
+  // Label map mode: label v is entry v - labelOffset of the table, and
+  // entries before labelFirst are drawn black.
+  vtkIdType labelOffset;
+  vtkIdType labelFirst;
+
+  bool showMask;
+  int maskColor[3];
+  int maskAlpha;
+
+  ThresholdOverlayPaint threshold;
+};
+
+static const unsigned char SliceCompositorBlack[4] = { 0, 0, 0, 255 };
+
+/** Sets the window / level constants of p. */
+static void SliceCompositorWindowLevel(double window, double level,
+                                       SliceCompositorParameters &p)
+{
+  p.shift = window / 2.0 - level;
+  p.scale = 255.0 / window;
+  p.lower = -p.shift;
+  p.upper = p.lower + window;
+  if (window < 0.0)
+    {
+      p.lower = p.lower + window;
+      p.upper = -p.shift;
+    }
+}
+
+/** Sets the lookup table constants of p, leaving p.table NULL if there
+    is no table. */
+static void SliceCompositorTable(vtkLookupTable *lut, SliceCompositorParameters &p)
+{
+  p.table = NULL;
+  if (lut == NULL || lut->GetNumberOfTableValues() <= 0)
+    {
+      return;
+    }
+
+  const double *range = lut->GetTableRange();
+  const int n = lut->GetNumberOfTableValues();
+  p.table      = lut->GetPointer(0);
+  p.maxIndex   = n - 1;
+  p.tableShift = -range[0];
+  p.tableScale = (range[1] > range[0]) ? n / (range[1] - range[0]) : 0.0;
+
+  // Labels are integers, so those at or below the bottom of the window
+  // are the ones below floor(lower) + 1.
+  p.labelOffset = static_cast<vtkIdType>(std::floor(range[0]));
+  const double first = std::floor(p.lower) + 1.0 - p.labelOffset;
+  p.labelFirst = (first > 0.0) ? static_cast<vtkIdType>(std::min(first, n + 1.0)) : 0;
+}
+
+/** Returns the table entry of label v in label map mode, or -1 if the
+    label is drawn black. */
+template <class IT>
+static inline vtkIdType SliceCompositorLabelIndex(const SliceCompositorParameters &p, IT v)
+{
+  vtkIdType i = static_cast<vtkIdType>(v) - p.labelOffset;
+  if (i < p.labelFirst) { return -1; }
+  if (i > p.maxIndex)   { i = p.maxIndex; }
+  return i;
+}
+
+static inline const unsigned char *SliceCompositorLabelColor(const SliceCompositorParameters &p,
+                                                             vtkIdType i)
+{
+  return (i < 0) ? SliceCompositorBlack : p.table + 4 * i;
+}
+
+static inline int SliceCompositorBlend(int c, int color, int alpha)
+{
+  return c + ((color - c) * alpha) / 256;
+}
+
+/** The compositing kernel.  maskData is NULL if there is no mask. */
+template <class IT, class MT>
+void SliceCompositorExecute(const SliceCompositorParameters &p,
+                            vtkImageData *imageData, IT *,
+                            vtkImageData *maskData, MT *,
+                            vtkImageData *outData, int ext[6])
+{
+  const IT *img = static_cast<IT *>(imageData->GetScalarPointerForExtent(ext));
+  const MT *mask = maskData ? static_cast<MT *>(maskData->GetScalarPointerForExtent(ext)) : NULL;
+  unsigned char *out = static_cast<unsigned char *>(outData->GetScalarPointerForExtent(ext));
+
+  vtkIdType iInc[3], mInc[3], oInc[3];
+  imageData->GetContinuousIncrements(ext, iInc[0], iInc[1], iInc[2]);
+  outData->GetContinuousIncrements(ext, oInc[0], oInc[1], oInc[2]);
+  int nm = 0;
+  if (mask)
+    {
+      maskData->GetContinuousIncrements(ext, mInc[0], mInc[1], mInc[2]);
+      nm = maskData->GetNumberOfScalarComponents();
+    }
+  const int ni = imageData->GetNumberOfScalarComponents();
+
+  const int nx = ext[1] - ext[0] + 1;
+  for (int z = ext[4]; z <= ext[5]; z++)
+    {
+    for (int y = ext[2]; y <= ext[3]; y++)
+      {
+      for (int x = 0; x < nx; x++)
+        {
+          const double v = static_cast<double>(*img);
+
+          // Window / level, as in vtkImageMapToWindowLevelColors
+          int wl;
+          if (v <= p.lower)      { wl = 0; }
+          else if (v >= p.upper) { wl = 255; }
+          else                   { wl = static_cast<int>((v + p.shift) * p.scale); }
+
+          int r, g, b, a;
+          if (p.table)
+            {
+              double f = (v + p.tableShift) * p.tableScale;
+              if (f < 0.0)        { f = 0.0; }
+              if (f > p.maxIndex) { f = p.maxIndex; }
+              const unsigned char *c = p.table + 4 * static_cast<int>(f);
+              r = (c[0] * wl) >> 8;
+              g = (c[1] * wl) >> 8;
+              b = (c[2] * wl) >> 8;
+              a = c[3];
+            }
+          else
+            {
+              r = g = b = wl;
+              a = 255;
+            }
+
+          const bool inMask = mask != NULL && static_cast<double>(*mask) >= 0.5;
+          if (p.showMask && inMask)
+            {
+              r = SliceCompositorBlend(r, p.maskColor[0], p.maskAlpha);
+              g = SliceCompositorBlend(g, p.maskColor[1], p.maskAlpha);
+              b = SliceCompositorBlend(b, p.maskColor[2], p.maskAlpha);
+            }
+
+          if (p.threshold.Selects(v, inMask))
+            {
+              p.threshold.Paint(r, g, b);
+            }
+
+          out[0] = static_cast<unsigned char>(r);
+          out[1] = static_cast<unsigned char>(g);
+          out[2] = static_cast<unsigned char>(b);
+          out[3] = static_cast<unsigned char>(a);
+
+          img += ni;
+          out += 4;
+          if (mask) { mask += nm; }
+        }
+      img += iInc[1];  out += oInc[1];
+      if (mask) { mask += mInc[1]; }
+      }
+    img += iInc[2];  out += oInc[2];
+    if (mask) { mask += mInc[2]; }
+    }
+}
+
+/** The label map kernel: one table gather per voxel, copying the four
+    packed bytes of the entry. */
+template <class IT>
+void SliceCompositorExecuteLabels(const SliceCompositorParameters &p,
+                                  vtkImageData *imageData, IT *,
+                                  vtkImageData *outData, int ext[6])
+{
+  const IT *img = static_cast<IT *>(imageData->GetScalarPointerForExtent(ext));
+  unsigned char *out = static_cast<unsigned char *>(outData->GetScalarPointerForExtent(ext));
+
+  vtkIdType iInc[3], oInc[3];
+  imageData->GetContinuousIncrements(ext, iInc[0], iInc[1], iInc[2]);
+  outData->GetContinuousIncrements(ext, oInc[0], oInc[1], oInc[2]);
+  const int ni = imageData->GetNumberOfScalarComponents();
+
+  const int nx = ext[1] - ext[0] + 1;
+  for (int z = ext[4]; z <= ext[5]; z++)
+    {
+    for (int y = ext[2]; y <= ext[3]; y++)
+      {
+      for (int x = 0; x < nx; x++)
+        {
+          const vtkIdType i = SliceCompositorLabelIndex(p, img[x * ni]);
+          std::memcpy(out + 4 * x, SliceCompositorLabelColor(p, i), 4);
+        }
+      img += nx * ni + iInc[1];
+      out += 4 * nx + oInc[1];
+      }
+    img += iInc[2];
+    out += oInc[2];
+    }
+}
+
+/** Rewrites the rows of outData, from the first voxel whose label is
+    flagged in changed onwards.  Returns the number of rows rewritten. */
+template <class IT>
+int SliceCompositorRecolorLabels(const SliceCompositorParameters &p,
+                                 const unsigned char *changed,
+                                 vtkImageData *imageData, IT *,
+                                 vtkImageData *outData, int ext[6])
+{
+  const IT *img = static_cast<IT *>(imageData->GetScalarPointerForExtent(ext));
+  unsigned char *out = static_cast<unsigned char *>(outData->GetScalarPointerForExtent(ext));
+
+  // The voxels of the image need not be contiguous: a YZ slice is
+  // strided through the volume.
+  vtkIdType iInc[3], oInc[3];
+  imageData->GetIncrements(iInc);
+  outData->GetIncrements(oInc);
+
+  int rows = 0;
+  const int nx = ext[1] - ext[0] + 1;
+  for (int z = ext[4]; z <= ext[5]; z++)
+    {
+    for (int y = ext[2]; y <= ext[3]; y++)
+      {
+        const IT *irow = img + (z - ext[4]) * iInc[2] + (y - ext[2]) * iInc[1];
+        unsigned char *orow = out + (z - ext[4]) * oInc[2] + (y - ext[2]) * oInc[1];
+
+        int x = 0;
+        vtkIdType i = -1;
+        for (; x < nx; x++)
+          {
+            i = SliceCompositorLabelIndex(p, irow[x * iInc[0]]);
+            if (i >= 0 && changed[i]) { break; }
+          }
+        if (x == nx)
+          {
+            continue;
+          }
+
+        rows++;
+        for (; x < nx; x++)
+          {
+            i = SliceCompositorLabelIndex(p, irow[x * iInc[0]]);
+            std::memcpy(orow + x * oInc[0], SliceCompositorLabelColor(p, i), 4);
+          }
+      }
+    }
+  return rows;
+}
+
+/** Second level of the type dispatch, on the mask scalar type. */
+template <class IT>
+void SliceCompositorExecuteMask(const SliceCompositorParameters &p,
+                                vtkImageData *imageData, IT *imgType,
+                                vtkImageData *maskData,
+                                vtkImageData *outData, int ext[6])
+{
+  if (maskData == NULL)
+    {
+      SliceCompositorExecute(p, imageData, imgType,
+                             static_cast<vtkImageData *>(NULL), static_cast<unsigned char *>(NULL),
+                             outData, ext);
+      return;
+    }
+
+  switch (maskData->GetScalarType())
+    {
+      vtkTemplateMacro(SliceCompositorExecute(p, imageData, imgType,
+                                              maskData, static_cast<VTK_TT *>(NULL),
+                                              outData, ext));
+    default:
+      vtkGenericWarningMacro("SliceCompositor: unknown mask scalar type");
+      return;
+    }
+}
+
+void SliceCompositor::ThreadedRequestData(vtkInformation *vtkNotUsed(request),
+                                          vtkInformationVector **inputVector,
+                                          vtkInformationVector *vtkNotUsed(outputVector),
+                                          vtkImageData ***inData,
+                                          vtkImageData **outData,
+                                          int outExt[6], int vtkNotUsed(threadId))
+{
+  vtkImageData *imageData = inData[0][0];
+  if (! ThresholdOverlay::CoversExtent(imageData, outExt))
+    {
+      vtkErrorMacro("The image does not cover the requested extent.");
+      return;
+    }
+  vtkImageData *maskData = this->GetMaskData(inputVector, inData, outExt);
+
+  SliceCompositorParameters p;
+  SliceCompositorWindowLevel(this->Window, this->Level, p);
+  SliceCompositorTable(this->LookupTable, p);
+
+  if (this->LabelMap && p.table)
+    {
+      switch (imageData->GetScalarType())
+        {
+          vtkTemplateMacro(SliceCompositorExecuteLabels(p, imageData, static_cast<VTK_TT *>(NULL),
+                                                        outData[0], outExt));
+        default:
+          vtkErrorMacro("Unknown image scalar type.");
+        }
+      return;
+    }
+
+  p.showMask  = this->ShowMask && maskData != NULL;
+  p.maskAlpha = static_cast<int>(this->MaskOpacity * 256.0 + 0.5);
+  for (int c = 0; c < 3; c++)
+    {
+      p.maskColor[c] = static_cast<int>(this->MaskColor[c] * 255.0 + 0.5);
+    }
+  this->GetPaint(p.threshold, maskData != NULL);
+
+  switch (imageData->GetScalarType())
+    {
+      vtkTemplateMacro(SliceCompositorExecuteMask(p, imageData, static_cast<VTK_TT *>(NULL),
+                                                  maskData, outData[0], outExt));
+    default:
+      vtkErrorMacro("Unknown image scalar type.");
+      return;
+    }
+}
+
+int SliceCompositor::RecolorLabels(vtkImageData *image, vtkImageData *slice,
+                                   const std::vector<unsigned char> &changed)
+{
+  if (! this->LabelMap || this->LookupTable == NULL
+      || static_cast<vtkIdType>(changed.size()) != this->LookupTable->GetNumberOfTableValues()
+      || slice->GetScalarType() != VTK_UNSIGNED_CHAR
+      || slice->GetNumberOfScalarComponents() != 4)
+    {
+      return -1;
+    }
+
+  int ext[6];
+  slice->GetExtent(ext);
+  if (! ThresholdOverlay::CoversExtent(image, ext))
+    {
+      return -1;
+    }
+
+  this->LookupTable->Build();
+  SliceCompositorParameters p;
+  SliceCompositorWindowLevel(this->Window, this->Level, p);
+  SliceCompositorTable(this->LookupTable, p);
+  if (p.table == NULL)
+    {
+      return -1;
+    }
+
+  int rows = 0;
+  switch (image->GetScalarType())
+    {
+      vtkTemplateMacro(rows = SliceCompositorRecolorLabels(p, &changed[0], image,
+                                                           static_cast<VTK_TT *>(NULL),
+                                                           slice, ext));
+    default:
+      return -1;
+    }
+  if (rows > 0)
+    {
+      slice->Modified();
+    }
+  return rows;
+}
+
+void SliceCompositor::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "Window: " << this->Window << "\n";
+  os << indent << "Level: " << this->Level << "\n";
+  os << indent << "LookupTable: " << this->LookupTable << "\n";
+  os << indent << "LabelMap: " << this->LabelMap << "\n";
+  os << indent << "ShowMask: " << this->ShowMask << "\n";
+  os << indent << "MaskOpacity: " << this->MaskOpacity << "\n";
+}
+
+} // end namespace wse
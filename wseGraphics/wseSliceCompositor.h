@@ -0,0 +1,136 @@
+#ifndef _wse_slice_compositor_h
+#define _wse_slice_compositor_h
+
+#include "wseThresholdOverlay.h"
+#include "vtkLookupTable.h"
+
+#include <vector>
+
+class vtkAlgorithmOutput;
+
+namespace wse {
+
+/** SliceCompositor produces the final RGBA display image of a
+    SliceViewer in a single pass, with no intermediate images.  For
+    each voxel it
+
+      1. maps the image value to a color, either to a gray level
+         through the window and level, or through the lookup table
+         modulated by the window and level (as
+         vtkImageMapToWindowLevelColors does),
+      2. blends the mask color over voxels inside the mask, and
+      3. blends the threshold color over voxels whose values lie inside
+         the threshold range (and, optionally, inside the mask).
+
+    It is a ThresholdOverlay that renders its base in the same pass,
+    and it takes the threshold parameters, the paint and the mask from
+    the overlay.
+    Input 0 is the scalar image and the optional input 1 is the mask,
+    where values of 0.5 or more are inside.  Both inputs must share the
+    same extent.  The output is unsigned char RGBA.
+
+    In label map mode the image holds integer labels, and each label is
+    an index into the lookup table (the bottom of the table range is
+    entry 0).  The color is gathered from the table as packed RGBA with
+    no floating point mapping; labels at or below the bottom of the
+    window are drawn black, and the mask and threshold are not drawn.
+
+    Only the update extent requested downstream is computed.  When the
+    output feeds a vtkImageActor this is the displayed slice, which is
+    split across threads by rows. */
+class SliceCompositor : public ThresholdOverlay
+{
+public:
+  static SliceCompositor *New();
+  vtkTypeRevisionMacro(SliceCompositor,ThresholdOverlay);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  // Description:
+  // Set the window and level used to map image values.  The defaults
+  // are 255 and 127.5.
+  vtkSetMacro(Window, double);
+  vtkGetMacro(Window, double);
+  vtkSetMacro(Level, double);
+  vtkGetMacro(Level, double);
+
+  // Description:
+  // Set the lookup table used to color image values.  If no table is
+  // set, the image is drawn in gray levels.
+  virtual void SetLookupTable(vtkLookupTable *);
+  vtkGetObjectMacro(LookupTable, vtkLookupTable);
+
+  // Description:
+  // Set whether the image is a label map.  Off by default.
+  vtkSetMacro(LabelMap, int);
+  vtkGetMacro(LabelMap, int);
+  vtkBooleanMacro(LabelMap, int);
+
+  // Description:
+  // Set whether the mask is drawn, and its color and opacity.  The
+  // default is half transparent red.
+  vtkSetMacro(ShowMask, int);
+  vtkGetMacro(ShowMask, int);
+  vtkBooleanMacro(ShowMask, int);
+  vtkSetVector3Macro(MaskColor, double);
+  vtkGetVector3Macro(MaskColor, double);
+  vtkSetClampMacro(MaskOpacity, double, 0.0, 1.0);
+  vtkGetMacro(MaskOpacity, double);
+
+  // Description:
+  // Copy the display parameters of another compositor, but not its
+  // inputs.  The lookup table is copied rather than shared, so that the
+  // other compositor's table may be changed while this one executes on
+  // another thread.  Must be called from the thread that owns other.
+  void CopyParameters(SliceCompositor *other);
+
+  // Description:
+  // Include the modified time of the lookup table.
+  unsigned long GetMTime();
+
+  // Description:
+  // The modified time of the parameters alone, excluding the lookup
+  // table.
+  unsigned long GetParametersMTime()
+  { return this->Superclass::GetMTime(); }
+
+  // Description:
+  // In label map mode, bring slice, an earlier output computed from
+  // image, up to date with the current lookup table when only the
+  // table entries flagged in changed differ from those it was computed
+  // with.  Only the rows that hold one of those labels are rewritten.
+  // Returns the number of rows rewritten, or -1 if slice cannot be
+  // updated this way and must be computed again.
+  int RecolorLabels(vtkImageData *image, vtkImageData *slice,
+                    const std::vector<unsigned char> &changed);
+
+protected:
+  SliceCompositor();
+  ~SliceCompositor();
+
+  virtual int RequestInformation(vtkInformation *request,
+                                 vtkInformationVector **inputVector,
+                                 vtkInformationVector *outputVector);
+  virtual void ThreadedRequestData(vtkInformation *request,
+                                   vtkInformationVector **inputVector,
+                                   vtkInformationVector *outputVector,
+                                   vtkImageData ***inData,
+                                   vtkImageData **outData,
+                                   int outExt[6], int threadId);
+
+  double Window;
+  double Level;
+  vtkLookupTable *LookupTable;
+  int LabelMap;
+
+  int ShowMask;
+  double MaskColor[3];
+  double MaskOpacity;
+
+private:
+  SliceCompositor(const SliceCompositor&);  // Not implemented.
+  void operator=(const SliceCompositor&);  // Not implemented.
+};
+
+} // end namespace wse
+
+#endif
@@ -1,4 +1,13 @@
 #include "wseSliceViewer.h"
+#include "wseRenderScheduler.h"
+
+#include "vtkCellArray.h"
+#include "vtkMultiThreader.h"
+#include "vtkPoints.h"
+#include "vtkPolyDataMapper.h"
+#include "vtkProperty.h"
+
+#include <vector>
 
 namespace wse {
 
@@ -111,48 +120,73 @@ void imageViewerCallback::Execute(vtkObject *caller,
 SliceViewer::SliceViewer()
 {
   this->mImageLookupTable = NULL;
+  this->mRenderScheduler = NULL;
   this->RenderWindow    = NULL;
   this->Renderer        = NULL;
   this->ImageActor      = vtkImageActor::New();
-  this->WindowLevel     = vtkImageMapToWindowLevelColors::New();
+  this->Compositor      = SliceCompositor::New();
+  this->mSliceCache     = new SliceCache;
   this->MaskImageActor      = vtkImageActor::New();
-  this->MaskWindowLevel     = vtkImageMapToWindowLevelColors::New();
-  this->MaskImageMapToColors = vtkImageMapToColors::New();
-  this->mImageBlend = vtkImageBlend::New();
+  this->BoundaryActor   = vtkImageActor::New();
+  this->BoundaryActor->PickableOff();
+  this->BoundaryActor->VisibilityOff();
+  this->mBoundaryOverlay = new BoundaryOverlay;
   this->Interactor      = NULL;
   this->InteractorStyle = NULL;
   this->mThresholdLower = 160.0f;
+  this->mThresholdUpper = VTK_FLOAT_MAX;
   this->mShowMask = true;
   this->mMaskOpacity = 0.50f;
   this->mThresholdOpacity = 0.75f;
   this->Slice = 0;
+  this->SliceDirection = 0;
   this->FirstRender = 1;
   this->SliceOrientation = SliceViewer::SLICE_ORIENTATION_XY;
   this->mShowThreshold = true;
   this->mClipThresholdToMask = true;
   this->mPipelineInstalled = false;
+  this->mHasInputScalarRange = false;
+  this->mShowBoundaries = false;
+  this->mShowCursor = false;
+  this->mCursorPosition[0] = 0.0;
+  this->mCursorPosition[1] = 0.0;
+  this->mCursorPosition[2] = 0.0;
+
+  // The cursor is two yellow lines, updated by UpdateCursor()
+  vtkPoints *cursorPoints = vtkPoints::New();
+  cursorPoints->SetNumberOfPoints(4);
+  vtkCellArray *cursorCells = vtkCellArray::New();
+  cursorCells->InsertNextCell(2);
+  cursorCells->InsertCellPoint(0);
+  cursorCells->InsertCellPoint(1);
+  cursorCells->InsertNextCell(2);
+  cursorCells->InsertCellPoint(2);
+  cursorCells->InsertCellPoint(3);
+  this->CursorLines = vtkPolyData::New();
+  this->CursorLines->SetPoints(cursorPoints);
+  this->CursorLines->SetLines(cursorCells);
+  cursorPoints->Delete();
+  cursorCells->Delete();
+
+  vtkPolyDataMapper *cursorMapper = vtkPolyDataMapper::New();
+  cursorMapper->SetInput(this->CursorLines);
+  this->CursorActor = vtkActor::New();
+  this->CursorActor->SetMapper(cursorMapper);
+  this->CursorActor->GetProperty()->SetColor(1.0, 1.0, 0.0);
+  this->CursorActor->PickableOff();
+  this->CursorActor->VisibilityOff();
+  cursorMapper->Delete();
 
-  mImageThreshold = vtkImageThreshold::New();
-  mFinalBlend = vtkImageBlend::New();
-  mAlphaMap = vtkImageMapToColors::New();
-  mAlphaLUT = vtkLookupTable::New();
-  mStencilBlend = vtkImageBlend::New();
-  mStencilLUT = vtkLookupTable::New();
-  mThresholdImageMapToColors = vtkImageMapToColors::New();
-  mThresholdLUT = vtkLookupTable::New();
-  mStencilLUT = vtkLookupTable::New();
-  mStencilMap = vtkImageMapToColors::New();
-  mAlphaLUT = vtkLookupTable::New();
   //  mImageFlip = vtkImageFlip::New();
 
-
-  // create lookup table for mask, currently red with the const mMaskOpacity
-  mMaskLUT = vtkLookupTable::New();
-  mMaskLUT->SetRange(0,1);
-  mMaskLUT->SetNumberOfColors(2);
-  mMaskLUT->Build();
-  mMaskLUT->SetTableValue(0,0,0,0,0.0);
-  mMaskLUT->SetTableValue(1,1,0,0,mMaskOpacity);
+  // The mask is drawn in red with the opacity mMaskOpacity, and the
+  // threshold in green.
+  this->Compositor->SetMaskColor(1.0, 0.0, 0.0);
+  this->Compositor->SetMaskOpacity(mMaskOpacity);
+  this->Compositor->SetThreshold(mThresholdLower, mThresholdUpper);
+  this->Compositor->SetThresholdColor(0.0, 1.0, 0.0);
+  this->Compositor->SetThresholdOpacity(mThresholdOpacity);
+  this->Compositor->SetClipThresholdToMask(mClipThresholdToMask);
 
   this->mImage = NULL;
   this->mMask = NULL;
@@ -167,18 +201,24 @@ SliceViewer::SliceViewer()
   this->SetRenderer(ren);
   ren->Delete();
 
-  //  MaskWindowLevel->SetInput(vtkImageData::New());
-  //  WindowLevel->SetInput(vtkImageData::New());
-
   this->InstallPipeline();
 }
 
 SliceViewer::~SliceViewer()
 {
-  if (this->WindowLevel)
+  if (this->mRenderScheduler)
   {
-    this->WindowLevel->Delete();
-    this->WindowLevel = NULL;
+    this->mRenderScheduler->cancel(this);
+  }
+
+  // Stops the prefetcher before the pipeline it reads from goes away
+  delete this->mSliceCache;
+  this->mSliceCache = NULL;
+
+  if (this->Compositor)
+  {
+    this->Compositor->Delete();
+    this->Compositor = NULL;
   }
 
   if (this->ImageActor)
@@ -187,6 +227,22 @@ SliceViewer::~SliceViewer()
     this->ImageActor = NULL;
   }
 
+  delete this->mBoundaryOverlay;
+  this->mBoundaryOverlay = NULL;
+  if (this->BoundaryActor)
+  {
+    this->BoundaryActor->Delete();
+    this->BoundaryActor = NULL;
+  }
+
+  if (this->CursorActor)
+  {
+    this->CursorActor->Delete();
+    this->CursorActor = NULL;
+    this->CursorLines->Delete();
+    this->CursorLines = NULL;
+  }
+
   if (this->Renderer)
   {
     this->Renderer->Delete();
@@ -374,7 +430,7 @@ int SliceViewer::GetSliceMax()
 }
 
 
-void SliceViewer::SetSlice(int slice)
+int SliceViewer::ClampSlice(int slice)
 {
   int *range = this->GetSliceRange();
   if (range)
@@ -388,17 +444,127 @@ void SliceViewer::SetSlice(int slice)
       slice = range[1];
     }
   }
+  return slice;
+}
+
+
+void SliceViewer::SetSlice(int slice)
+{
+  slice = this->ClampSlice(slice);
 
   if (this->Slice == slice)
   {
     return;
   }
 
+  this->SliceDirection = (slice > this->Slice) ? 1 : -1;
   this->Slice = slice;
   this->Modified();
 
   this->UpdateDisplayExtent();
-  this->Render();
+  if (this->mRenderScheduler)
+  {
+    this->mRenderScheduler->scheduleRender(this);
+  }
+  else
+  {
+    this->Render();
+  }
+
+  // Compute the next slices in the scroll direction while the user is
+  // looking at this one.
+  if (mPipelineInstalled && mImage)
+  {
+    this->mSliceCache->Prefetch(this->Slice, this->SliceDirection);
+  }
+}
+
+
+/** Arguments of SliceViewerComputeSlices(). */
+struct SliceViewerSlices
+{
+  SliceCache **caches;
+  const int *slices;
+  int n;
+};
+
+
+/** Thread entry point of SetSlices().  Each thread fills the caches of
+    every NumberOfThreads-th viewer. */
+static VTK_THREAD_RETURN_TYPE SliceViewerComputeSlices(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *info = static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  SliceViewerSlices *data = static_cast<SliceViewerSlices *>(info->UserData);
+  for (int i = info->ThreadID; i < data->n; i += info->NumberOfThreads)
+  {
+    if (data->caches[i])
+    {
+      data->caches[i]->GetSlice(data->slices[i]);
+    }
+  }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+
+void SliceViewer::SetSlices(SliceViewer **viewers, const int *slices, int n,
+                            bool render)
+{
+  if (n < 1)
+  {
+    return;
+  }
+
+  // The caches are synchronized on this thread, as the viewers usually
+  // share their inputs.
+  std::vector<SliceCache *> caches(n, static_cast<SliceCache *>(NULL));
+  std::vector<int> clamped(n);
+  for (int i = 0; i < n; i++)
+  {
+    SliceViewer *v = viewers[i];
+    const int slice = v->ClampSlice(slices[i]);
+    if (slice != v->Slice)
+    {
+      v->SliceDirection = (slice > v->Slice) ? 1 : -1;
+      v->Slice = slice;
+      v->Modified();
+    }
+    clamped[i] = slice;
+
+    if (v->mPipelineInstalled && v->mImage
+        && v->mSliceCache->Update(v->Compositor, v->SliceOrientation))
+    {
+      caches[i] = v->mSliceCache;
+    }
+  }
+
+  // Each cache has its own pipeline, so the slices can be composited
+  // concurrently.  Rendering below then only draws cached slices.
+  if (n > 1)
+  {
+    SliceViewerSlices data;
+    data.caches = &caches[0];
+    data.slices = &clamped[0];
+    data.n = n;
+
+    vtkMultiThreader *threader = vtkMultiThreader::New();
+    threader->SetNumberOfThreads(n);
+    threader->SetSingleMethod(SliceViewerComputeSlices, &data);
+    threader->SingleMethodExecute();
+    threader->Delete();
+  }
+
+  for (int i = 0; i < n; i++)
+  {
+    viewers[i]->UpdateDisplayExtent();
+    if (render)
+    {
+      viewers[i]->Render();
+    }
+    if (caches[i])
+    {
+      caches[i]->Prefetch(viewers[i]->Slice, viewers[i]->SliceDirection);
+    }
+  }
 }
 
 
@@ -522,6 +688,10 @@ void SliceViewer::UpdateDisplayExtent()
                                              w_ext[2], w_ext[3], w_ext[4], w_ext[5]);
       break;
     }
+
+  this->UpdateCachedSlice();
+  this->UpdateBoundaries();
+  this->UpdateCursor();
   
   // Figure out the correct clipping range
   if (this->Renderer)
@@ -584,25 +754,25 @@ void SliceViewer::SetParentId(void *a)
 
 double SliceViewer::GetColorWindow()
 {
-  return this->WindowLevel->GetWindow();
+  return this->Compositor->GetWindow();
 }
 
 
 double SliceViewer::GetColorLevel()
 {
-  return this->WindowLevel->GetLevel();
+  return this->Compositor->GetLevel();
 }
 
 
 void SliceViewer::SetColorWindow(double s)
 {
-  this->WindowLevel->SetWindow(s);
+  this->Compositor->SetWindow(s);
 }
 
 
 void SliceViewer::SetColorLevel(double s)
 {
-  this->WindowLevel->SetLevel(s);
+  this->Compositor->SetLevel(s);
 }
 
 void SliceViewer::InstallPipeline()
@@ -633,24 +803,14 @@ void SliceViewer::InstallPipeline()
   }
 
 
-  // setup mask image map using the lookup table
-  MaskImageMapToColors->SetLookupTable(mMaskLUT);
-  MaskImageMapToColors->PassAlphaToOutputOn();
-  MaskImageMapToColors->SetOutputFormatToRGBA();
-
-  if (mImageLookupTable != NULL)
-    {
-      WindowLevel->SetLookupTable(mImageLookupTable);
-    }
-  WindowLevel->PassAlphaToOutputOn();
-  WindowLevel->SetOutputFormatToRGBA();
-
-  //ImageActor->SetInput(mImageBlend->GetOutput());
+  Compositor->SetLookupTable(mImageLookupTable);
 
   if (this->Renderer && this->ImageActor)
   {
     this->Renderer->AddViewProp(this->ImageActor);
     this->Renderer->AddViewProp(this->MaskImageActor);
+    this->Renderer->AddViewProp(this->BoundaryActor);
+    this->Renderer->AddViewProp(this->CursorActor);
   }
   mPipelineInstalled = true;
 }
@@ -668,10 +828,15 @@ void SliceViewer::UnInstallPipeline()
     this->MaskImageActor->SetInput(NULL);
   }
 
+  this->BoundaryActor->SetInput(NULL);
+  this->BoundaryActor->VisibilityOff();
+
   if (this->Renderer && this->ImageActor)
   {
     this->Renderer->RemoveViewProp(this->ImageActor);
     this->Renderer->RemoveViewProp(this->MaskImageActor);
+    this->Renderer->RemoveViewProp(this->BoundaryActor);
+    this->Renderer->RemoveViewProp(this->CursorActor);
   }
 
   if (this->RenderWindow && this->Renderer)
@@ -686,7 +851,8 @@ void SliceViewer::UnInstallPipeline()
   }
   
   this->SetInput(NULL);
-  mImageBlend->RemoveAllInputs();
+  this->Compositor->SetMaskConnection(NULL);
+  this->mSliceCache->Clear();
 
   this->mImage = NULL;
   this->mMask = NULL;
@@ -754,11 +920,84 @@ void SliceViewer::Render()
   }
   if (this->GetInput())
   {
+    this->UpdateCachedSlice();
+    this->UpdateBoundaries();
     this->RenderWindow->Render();
   }
 }
 
 
+void SliceViewer::UpdateCachedSlice()
+{
+  if (mPipelineInstalled == false || mImage == NULL)
+  {
+    return;
+  }
+
+  // The cache notices any change to the compositor or its inputs and
+  // recomputes the slice; otherwise the stored slice is shown as is.
+  if (this->mSliceCache->Update(this->Compositor, this->SliceOrientation))
+  {
+    vtkImageData *slice = this->mSliceCache->GetSlice(this->Slice);
+    if (slice)
+    {
+      this->ImageActor->SetInput(slice);
+    }
+  }
+}
+
+
+void SliceViewer::SetBoundaryLabels(vtkAlgorithmOutput *labels, vtkWSLookupTableManager *manager)
+{
+  this->mBoundaryOverlay->SetLabels(labels, manager);
+  this->UpdateBoundaries();
+}
+
+
+void SliceViewer::SetShowBoundaries(bool show)
+{
+  mShowBoundaries = show;
+  this->UpdateBoundaries();
+}
+
+
+void SliceViewer::UpdateBoundaries()
+{
+  vtkImageData *boundaries = NULL;
+  if (mShowBoundaries && mPipelineInstalled && this->GetInput())
+  {
+    boundaries = this->mBoundaryOverlay->Update(this->SliceOrientation, this->Slice);
+  }
+  if (boundaries == NULL)
+  {
+    this->BoundaryActor->VisibilityOff();
+    return;
+  }
+
+  this->BoundaryActor->SetInput(boundaries);
+  this->BoundaryActor->SetDisplayExtent(boundaries->GetExtent());
+
+  // Lift the outlines a tenth of a voxel towards the camera, so that
+  // they are drawn over the slice rather than fighting with it.
+  double offset[3] = { 0.0, 0.0, 0.0 };
+  vtkCamera *cam = this->Renderer ? this->Renderer->GetActiveCamera() : NULL;
+  if (cam)
+  {
+    const int o = this->SliceOrientation;
+    offset[o] = (cam->GetDirectionOfProjection()[o] > 0.0 ? -0.1 : 0.1)
+      * boundaries->GetSpacing()[o];
+  }
+  this->BoundaryActor->SetPosition(offset);
+  this->BoundaryActor->VisibilityOn();
+}
+
+
+void SliceViewer::SetSliceCacheBudget(unsigned long bytes)
+{
+  this->mSliceCache->SetMemoryBudget(bytes);
+}
+
+
 const char* SliceViewer::GetWindowName()
 {
   return this->RenderWindow->GetWindowName();
@@ -779,14 +1018,14 @@ int SliceViewer::GetOffScreenRendering()
 
 void SliceViewer::SetInput(vtkImageData *in)
 {
-  this->WindowLevel->SetInput(in);
+  this->Compositor->SetInput(in);
   this->UpdateDisplayExtent();
 }
 
 
 vtkImageData* SliceViewer::GetInput()
 {
-  return vtkImageData::SafeDownCast(this->WindowLevel->GetInput());
+  return vtkImageData::SafeDownCast(this->Compositor->GetInput());
 }
 
 
@@ -798,15 +1037,27 @@ void SliceViewer::SetInputConnection(vtkAlgorithmOutput* input)
     }
   if (mImage == input) 
     {
+      mHasInputScalarRange = false;
       return;
     }
   
+  // The cache shares the pixels of the old input, which its owner may
+  // release once it is no longer displayed.
+  this->mSliceCache->Clear();
   mImage = input;
   this->UpdateDisplay(); 
-  ResetWindowLevel(WindowLevel);
+  ResetWindowLevel(Compositor);
+  mHasInputScalarRange = false;
   this->UpdateDisplayExtent();
 }
 
+void SliceViewer::SetInputScalarRange(double lo, double hi)
+{
+  mInputScalarRange[0] = lo;
+  mInputScalarRange[1] = hi;
+  mHasInputScalarRange = true;
+}
+
 void SliceViewer::DisableDisplay()
 {
   this->UnInstallPipeline();
@@ -816,139 +1067,24 @@ void SliceViewer::UpdateDisplay()
 {
   if (mPipelineInstalled == false)  {   return;  }
 
-  mImageBlend->RemoveAllInputs();
-  
+  // The image, mask and threshold layers are composited into the
+  // displayed RGBA slice in a single pass.
   if (mImage) 
     {
-      this->WindowLevel->SetInputConnection(mImage);
-      if (mImageLookupTable != NULL) 
-        {
-          this->WindowLevel->SetLookupTable(mImageLookupTable);
-        }
-      mImageBlend->AddInputConnection(WindowLevel->GetOutputPort());
+      this->Compositor->SetInputConnection(mImage);
+      this->Compositor->SetLookupTable(mImageLookupTable);
     }
-  
-  if (mMask && mShowMask) 
-    {
-      this->MaskImageMapToColors->SetInputConnection(mMask);
-      mImageBlend->AddInputConnection(MaskImageMapToColors->GetOutputPort());
-    }
-  
-  if (mImage && mMask && mShowThreshold) 
-    {
-      // Use a vtkImageThreshold to apply the histogram threshold to the original image
-      mImageThreshold->RemoveAllInputs();
-      mImageThreshold->SetInputConnection(mImage);
-      //mImageThreshold->ThresholdByUpper(mThresholdLower);
-      mImageThreshold->ThresholdBetween(mThresholdLower, mThresholdUpper);
-      mImageThreshold->ReplaceInOn();
-      mImageThreshold->ReplaceOutOn();
-      mImageThreshold->SetInValue(0);
-      mImageThreshold->SetOutValue(1);
-      mImageThreshold->Update();
-      
-      // Threshold image table sets alpha values depending on the clipping
-      mThresholdLUT->SetRange(0,1);
-      mThresholdLUT->SetNumberOfColors(2);
-      mThresholdLUT->Build();
-      if (mClipThresholdToMask) {
-        mThresholdLUT->SetTableValue(0,1,1,1,1);
-      } else {
-        mThresholdLUT->SetTableValue(0,0,1,0,1);
-      }
-      mThresholdLUT->SetTableValue(1,0,0,0,0 /*opacity*/);
-      
-      // vtkImageMapToColors applies the mThresholdLUT to the mImageThreshold
-      mThresholdImageMapToColors->RemoveAllInputs();
-      mThresholdImageMapToColors->SetLookupTable(mThresholdLUT);
-      mThresholdImageMapToColors->PassAlphaToOutputOn();
-      mThresholdImageMapToColors->SetOutputFormatToRGBA();
-      mThresholdImageMapToColors->SetInputConnection(mImageThreshold->GetOutputPort());
-      
-      // create stencil LUT for the mask
-      mStencilLUT->SetRange(0,1);
-      mStencilLUT->SetNumberOfColors(2);
-      mStencilLUT->Build();
-      mStencilLUT->SetTableValue(0,0,0,0,0);
-      mStencilLUT->SetTableValue(1,0,0,0,1);
-      
-      // vtkImageMapToColors for the mask
-      mStencilMap->RemoveAllInputs();
-      mStencilMap->SetInputConnection(mMask);
-      mStencilMap->SetLookupTable(mStencilLUT);
-      mStencilMap->PassAlphaToOutputOn();
-      mStencilMap->SetOutputFormatToRGBA();
-      
-      // a vtkImageBlend to clip the threshold image against the mask
-      mStencilBlend->RemoveAllInputs();
-      mStencilBlend->AddInputConnection(mStencilMap->GetOutputPort());
-      mStencilBlend->AddInputConnection(mThresholdImageMapToColors->GetOutputPort());
-      
-      // a vtkLookupTable to apply transparency for the clipped threshold
-      mAlphaLUT->SetRange(0,1);
-      mAlphaLUT->SetNumberOfColors(2);
-      mAlphaLUT->Build();
-      mAlphaLUT->SetTableValue(0,0,0,0,0);
-      mAlphaLUT->SetTableValue(1,0,1,0,1);
-      
-      // a vtkImageMapToColors to apply the lookuptable to the clipped threshold
-      mAlphaMap->RemoveAllInputs();
-      mAlphaMap->SetInputConnection(mStencilBlend->GetOutputPort());
-      mAlphaMap->SetLookupTable(mAlphaLUT);
-      mAlphaMap->PassAlphaToOutputOn();
-      mAlphaMap->SetOutputFormatToRGBA();
-      
-      // the final vtkImageBlend merging the original image (plus optional mask) with the threshold
-      mFinalBlend->RemoveAllInputs();
-      mFinalBlend->AddInputConnection(mImageBlend->GetOutputPort());
-      
-      if (mClipThresholdToMask) {
-        mFinalBlend->AddInputConnection(mAlphaMap->GetOutputPort());
-      } else {
-        mFinalBlend->AddInputConnection(mThresholdImageMapToColors->GetOutputPort());
-      }
-      
-      mFinalBlend->SetOpacity(1,mThresholdOpacity);
-      
-      //finalBlend->AddInputConnection(stencilBlend->GetOutputPort());
-      
-      //ImageActor->SetInput(imageMapToColors->GetOutput());
-      //ImageActor->SetInput(mStencilBlend->GetOutput());
-      
-      
-      mFinalOutput = mFinalBlend->GetOutputPort();
-      ImageActor->SetInput(mFinalBlend->GetOutput());
-      
-    } 
-  else 
-    {
+  this->Compositor->SetMaskConnection(mMask);
+  this->Compositor->SetShowMask(mShowMask);
+  this->Compositor->SetShowThreshold(mShowThreshold && mMask != NULL);
+  this->Compositor->SetThreshold(mThresholdLower, mThresholdUpper);
+  this->Compositor->SetThresholdOpacity(mThresholdOpacity);
+  this->Compositor->SetClipThresholdToMask(mClipThresholdToMask);
 
-    if (mImage || mMask) 
-      {
-        mFinalOutput = mImageBlend->GetOutputPort();
-        ImageActor->SetInput(mImageBlend->GetOutput());
-        
-        // DEBUG
-        //  double *orig = ImageActor->GetInput()->GetOrigin();
-        //  double *spac = ImageActor->GetInput()->GetSpacing();
-        
-        //        double *orig = mImageBlend->GetOutput()->GetOrigin();
-        //        double *spac = mImageBlend->GetOutput()->GetSpacing();
-
-        //     double *orig =  vtkImageData::SafeDownCast(WindowLevel->GetInput())->GetOrigin();
-        // double *spac =  vtkImageData::SafeDownCast(WindowLevel->GetInput())->GetSpacing();
-        
-        //  std::cout << "img origin = " << orig[0] << " " << orig[1] << " " << orig[2] << std::endl;
-        /// std::cout << "img spac = " << spac[0] << " " << spac[1] << " " << spac[2] << std::endl;
-        
-        
-        // TEST
-        // mImageFlip->SetInputConnection(mFinalOutput);
-        // mImageFlip->SetFilteredAxis(0);        
-        // ImageActor->SetInput(mImageFlip->GetOutput());
-        // END TEST
-        
-      }
+  if (mImage) 
+    {
+      mFinalOutput = this->Compositor->GetOutputPort();
+      ImageActor->SetInput(this->Compositor->GetOutput());
     }
   
   // disable interpolation
@@ -958,6 +1094,10 @@ void SliceViewer::UpdateDisplay()
 
 void SliceViewer::SetImageMask(vtkAlgorithmOutput* mask)
 {
+  if (mMask != mask)
+    {
+      this->mSliceCache->Clear();
+    }
   mMask = mask;
   UpdateDisplay();
   this->UpdateDisplayExtent();
@@ -1002,8 +1142,8 @@ void SliceViewer::PrintSelf(ostream& os, vtkIndent indent)
   this->Renderer->PrintSelf(os,indent.GetNextIndent());
   os << indent << "ImageActor:\n";
   this->ImageActor->PrintSelf(os,indent.GetNextIndent());
-  os << indent << "WindowLevel:\n" << endl;
-  this->WindowLevel->PrintSelf(os,indent.GetNextIndent());
+  os << indent << "Compositor:\n" << endl;
+  this->Compositor->PrintSelf(os,indent.GetNextIndent());
   os << indent << "Slice: " << this->Slice << endl;
   os << indent << "SliceOrientation: " << this->SliceOrientation << endl;
   os << indent << "InteractorStyle: " << endl;
@@ -1019,12 +1159,16 @@ void SliceViewer::PrintSelf(ostream& os, vtkIndent indent)
 }
 
 
-void SliceViewer::ResetWindowLevel(vtkImageMapToWindowLevelColors *windowLevel)
+void SliceViewer::ResetWindowLevel(SliceCompositor *windowLevel)
 {
   if (windowLevel) 
     {
-    vtkImageData *data = vtkImageData::SafeDownCast(windowLevel->GetInput());
-    double *range = data->GetScalarRange();
+    double *range = mInputScalarRange;
+    if (! mHasInputScalarRange)
+      {
+        vtkImageData *data = vtkImageData::SafeDownCast(windowLevel->GetInput());
+        range = data->GetScalarRange();
+      }
     windowLevel->SetWindow(range[1] - range[0]);
     windowLevel->SetLevel(0.5 * (range[1] + range[0]));
     
@@ -1036,35 +1180,38 @@ void SliceViewer::ResetWindowLevel(vtkImageMapToWindowLevelColors *windowLevel)
     }
 }
 
+// The display settings below only modify the compositor, which
+// recomputes the displayed slice on the next render.  The pipeline
+// itself does not need to be rebuilt.
 void SliceViewer::SetShowMask(bool showMask) {
   this->mShowMask = showMask;
-  this->UpdateDisplay();
+  this->Compositor->SetShowMask(showMask);
 }
 
 void SliceViewer::SetShowThreshold(bool showThreshold) {
   this->mShowThreshold = showThreshold;
-  this->UpdateDisplay();
+  this->Compositor->SetShowThreshold(mShowThreshold && mMask != NULL);
 }
 
 void SliceViewer::SetMaskOpacity(float opacity) {
   this->mMaskOpacity = opacity;
-  mMaskLUT->SetTableValue(1,1,0,0,mMaskOpacity);
+  this->Compositor->SetMaskOpacity(opacity);
 }
 
 void SliceViewer::SetThresholdOpacity(float opacity) {
   this->mThresholdOpacity = opacity;
-  this->UpdateDisplay();
+  this->Compositor->SetThresholdOpacity(opacity);
 }
 
 void SliceViewer::SetThreshold(float lower, float upper) {
   mThresholdLower = lower;
   mThresholdUpper = upper;
-  this->UpdateDisplay();
+  this->Compositor->SetThreshold(lower, upper);
 }
 
 void SliceViewer::SetClipThresholdToMask(bool value) {
   mClipThresholdToMask = value;
-  this->UpdateDisplay();
+  this->Compositor->SetClipThresholdToMask(value);
 }
 
 
@@ -1072,4 +1219,58 @@ vtkAlgorithmOutput *SliceViewer:: GetFinalOutput() {
   return mFinalOutput;
 }
 
+void SliceViewer::SetCursorPosition(double x, double y, double z) {
+  mCursorPosition[0] = x;
+  mCursorPosition[1] = y;
+  mCursorPosition[2] = z;
+  this->UpdateCursor();
+}
+
+void SliceViewer::SetShowCursor(bool show) {
+  mShowCursor = show;
+  this->UpdateCursor();
+}
+
+void SliceViewer::UpdateCursor()
+{
+  vtkImageData *input = this->GetInput();
+  if (! mShowCursor || input == NULL)
+  {
+    this->CursorActor->VisibilityOff();
+    return;
+  }
+
+  input->UpdateInformation();
+  const int *w_ext = input->GetWholeExtent();
+  const double *origin = input->GetOrigin();
+  const double *spacing = input->GetSpacing();
+
+  // Axis o is normal to the slice, a and b lie in it.  Line 0-1 runs
+  // along a and line 2-3 along b, both in the plane of the slice.
+  const int o = this->SliceOrientation;
+  const int a = (o + 1) % 3;
+  const int b = (o + 2) % 3;
+  double p[4][3];
+  for (int i = 0; i < 4; i++)
+  {
+    for (int c = 0; c < 3; c++)
+    {
+      p[i][c] = mCursorPosition[c];
+    }
+    p[i][o] = origin[o] + spacing[o] * this->Slice;
+  }
+  p[0][a] = origin[a] + spacing[a] * w_ext[2 * a];
+  p[1][a] = origin[a] + spacing[a] * w_ext[2 * a + 1];
+  p[2][b] = origin[b] + spacing[b] * w_ext[2 * b];
+  p[3][b] = origin[b] + spacing[b] * w_ext[2 * b + 1];
+
+  vtkPoints *points = this->CursorLines->GetPoints();
+  for (int i = 0; i < 4; i++)
+  {
+    points->SetPoint(i, p[i]);
+  }
+  points->Modified();
+  this->CursorActor->VisibilityOn();
+}
+
 } // end namespace wse
@@ -24,9 +24,17 @@
 #include "vtkImageMask.h"
 #include "vtkImageFlip.h"
 #include "vtkPointPicker.h"
+#include "vtkActor.h"
+#include "vtkPolyData.h"
+
+#include "wseSliceCompositor.h"
+#include "wseSliceCache.h"
+#include "wseBoundaryOverlay.h"
 
 namespace wse {
 
+class RenderScheduler;
+
 /** SliceViewer is a class based on the vtkImageViewer class.  It
     provides similar functionality, but is tailored for working with
     3D floating point grayscale image displays (e.g. medical image
@@ -71,7 +79,15 @@ public:
   virtual vtkImageData *GetInput();
   virtual void SetInputConnection(vtkAlgorithmOutput* input);
 
-  /** Disassemble the rendering pipeline. */
+  // Description:
+  // Set the scalar range of the next input passed to SetInputConnection,
+  // when it is already known, so that resetting the window and level
+  // does not need to scan the input.
+  void SetInputScalarRange(double lo, double hi);
+
+  /** Disassemble the rendering pipeline.  Like a change of the input
+      or the mask, this discards the cached slices, so the pixels of
+      the old inputs may be freed afterwards. */
   virtual void DisableDisplay();
 
   /** set transparent image mask */
@@ -101,6 +117,16 @@ public:
   vtkGetMacro(Slice, int);
   virtual void SetSlice(int s);
 
+  // Description:
+  // Set the slices of several viewers at once and render them.  The new
+  // slices are composited concurrently, one viewer per thread, and the
+  // windows are then rendered one after the other.  Unlike SetSlice(),
+  // every viewer is rendered even if its slice does not change.  With
+  // render false the slices are composited but the windows are left for
+  // the caller to render.
+  static void SetSlices(SliceViewer **viewers, const int *slices, int n,
+                        bool render = true);
+
   // Description:
   // Update the display extent manually so that the proper slice for the
   // given orientation is displayed. It will also try to set a
@@ -155,7 +181,7 @@ public:
   vtkGetObjectMacro(RenderWindow,vtkRenderWindow);
   vtkGetObjectMacro(Renderer, vtkRenderer);
   vtkGetObjectMacro(ImageActor,vtkImageActor);
-  vtkGetObjectMacro(WindowLevel,vtkImageMapToWindowLevelColors);
+  vtkGetObjectMacro(Compositor,SliceCompositor);
   vtkGetObjectMacro(InteractorStyle,vtkInteractorStyleImage);
 
   // Description:
@@ -204,8 +230,44 @@ public:
 
   vtkAlgorithmOutput* GetFinalOutput();
 
+  // Description:
+  // Set the world position of the crosshair cursor, which is drawn as
+  // two lines through the position across the displayed slice.  The
+  // cursor is hidden by default.
+  void SetCursorPosition(double x, double y, double z);
+  void SetShowCursor(bool);
+
+  // Description:
+  // Outline the merged regions of a watershed segmentation over the
+  // displayed slice.  labels is the labeled image, which must share the
+  // extent of the input, and manager holds its merges; the outlines
+  // follow the merges as they change.  Passing NULL removes them.
+  void SetBoundaryLabels(vtkAlgorithmOutput *labels, vtkWSLookupTableManager *manager);
+  void SetShowBoundaries(bool);
+  bool GetShowBoundaries() const
+  { return mShowBoundaries; }
+
+  // Description:
+  // Set the memory, in bytes, available for caching composited slices.
+  // Slices ahead of the current one in the direction of the last slice
+  // change are computed in the background up to this limit.  A budget
+  // smaller than two slices disables prefetching.  The default is 256 MB.
+  void SetSliceCacheBudget(unsigned long bytes);
+  unsigned long GetSliceCacheBudget()
+  { return this->mSliceCache->GetMemoryBudget(); }
+
   vtkRenderWindowInteractor *GetInteractor()
   {return Interactor; }
+
+  // Description:
+  // Set the scheduler that coalesces the renders of this viewer.  With
+  // a scheduler, SetSlice() asks it for a render at the next display
+  // refresh instead of rendering at once.  The viewer withdraws its
+  // pending render when it is deleted.
+  void SetRenderScheduler(RenderScheduler *scheduler)
+  { this->mRenderScheduler = scheduler; }
+  RenderScheduler *GetRenderScheduler()
+  { return this->mRenderScheduler; }
   
 protected:
   SliceViewer();
@@ -214,50 +276,51 @@ protected:
   virtual void InstallPipeline();
   virtual void UnInstallPipeline();
 
-  vtkImageMapToWindowLevelColors  *WindowLevel;
-  vtkImageMapToWindowLevelColors  *MaskWindowLevel;
-  vtkImageMapToColors             *MaskImageMapToColors;
+  SliceCompositor                 *Compositor;
+  SliceCache                      *mSliceCache;
   vtkRenderWindow                 *RenderWindow;
   vtkRenderer                     *Renderer;
   vtkImageActor                   *ImageActor;
   vtkImageActor                   *MaskImageActor;
+  vtkImageActor                   *BoundaryActor;
+  BoundaryOverlay                 *mBoundaryOverlay;
+  vtkActor                        *CursorActor;
+  vtkPolyData                     *CursorLines;
   vtkRenderWindowInteractor       *Interactor;
   vtkInteractorStyleImage         *InteractorStyle;
-  vtkImageBlend                   *mImageBlend;
   //  vtkImageFlip                    *mImageFlip;
 
   vtkLookupTable                  *mImageLookupTable;
 
+  RenderScheduler                 *mRenderScheduler;
+
   vtkAlgorithmOutput              *mImage;
   vtkAlgorithmOutput              *mMask;
   vtkAlgorithmOutput              *mFinalOutput;
 
-  vtkLookupTable *mMaskLUT;
-
   bool mPipelineInstalled;
 
+  bool mHasInputScalarRange;
+  double mInputScalarRange[2];
+
   int SliceOrientation;
   int FirstRender;
   int Slice;
+  int SliceDirection;
 
   bool mShowMask;
   bool mShowThreshold;
   bool mClipThresholdToMask;
 
-  vtkImageThreshold *mImageThreshold;
   float mThresholdLower;
   float mThresholdUpper;
   float mMaskOpacity;
   float mThresholdOpacity;
 
-  vtkImageBlend *mFinalBlend;
-  vtkImageBlend *mStencilBlend;
-  vtkLookupTable *mAlphaLUT;
-  vtkLookupTable *mStencilLUT;
-  vtkLookupTable *mThresholdLUT;
-  vtkImageMapToColors *mAlphaMap;
-  vtkImageMapToColors *mThresholdImageMapToColors;
-  vtkImageMapToColors *mStencilMap;
+  bool mShowBoundaries;
+
+  bool mShowCursor;
+  double mCursorPosition[3];
 
   virtual void UpdateOrientation();
 
@@ -266,10 +329,23 @@ private:
   void operator=(const SliceViewer&);  // Not implemented.
 
   /** */
-  virtual void ResetWindowLevel(vtkImageMapToWindowLevelColors *windowLevel);
+  virtual void ResetWindowLevel(SliceCompositor *windowLevel);
 
   /** */
   virtual void UpdateDisplay();
+
+  /** Show the current slice from the slice cache. */
+  void UpdateCachedSlice();
+
+  /** Shows the region outlines of the current slice. */
+  void UpdateBoundaries();
+
+  /** Clamps s to the slice range of the input. */
+  int ClampSlice(int s);
+
+  /** Moves the cursor lines to the cursor position and the current
+      slice. */
+  void UpdateCursor();
 };
 
 
@@ -0,0 +1,281 @@
+#include "wseSurfaceLOD.h"
+
+#include "vtkCommand.h"
+#include "vtkDecimatePro.h"
+#include "vtkInteractorObserver.h"
+
+#include <QMutexLocker>
+#include <QThread>
+
+namespace wse {
+
+/** The thread that decimates the surfaces set by SurfaceLOD::SetInput(). */
+class SurfaceLODBuilder : public QThread
+{
+public:
+  SurfaceLODBuilder(SurfaceLOD *lod) : mLOD(lod) {}
+
+protected:
+  void run() { mLOD->RunBuilder(); }
+
+private:
+  SurfaceLOD *mLOD;
+};
+
+/** Forwards the interaction events of an interactor style. */
+class SurfaceLODCallback : public vtkCommand
+{
+public:
+  static SurfaceLODCallback *New()
+  { return new SurfaceLODCallback; }
+
+  virtual void Execute(vtkObject *, unsigned long event, void *)
+  {
+    if (event == vtkCommand::StartInteractionEvent)    { this->LOD->StartInteraction(); }
+    else if (event == vtkCommand::EndInteractionEvent) { this->LOD->EndInteraction(); }
+  }
+
+  SurfaceLOD *LOD;
+};
+
+SurfaceLOD::SurfaceLOD()
+{
+  this->Mapper = NULL;
+  this->Style = NULL;
+  SurfaceLODCallback *callback = SurfaceLODCallback::New();
+  callback->LOD = this;
+  this->Callback = callback;
+  this->Surface = NULL;
+  this->SurfaceMTime = 0;
+  this->InteractiveTriangles = 250000;
+  this->Pending = NULL;
+  this->Generation = 0;
+  this->Quit = false;
+  this->Builder = NULL;
+}
+
+SurfaceLOD::~SurfaceLOD()
+{
+  if (this->Builder)
+    {
+      this->Mutex.lock();
+      this->Quit = true;
+      this->Wake.wakeAll();
+      this->Mutex.unlock();
+
+      this->Builder->wait();
+      delete this->Builder;
+    }
+
+  this->SetInteractor(NULL);
+  this->SetInput(NULL);
+  this->SetMapper(NULL);
+  this->Callback->Delete();
+}
+
+void SurfaceLOD::SetMapper(vtkPolyDataMapper *mapper)
+{
+  if (mapper != this->Mapper)
+    {
+      if (mapper)       { mapper->Register(NULL); }
+      if (this->Mapper) { this->Mapper->UnRegister(NULL); }
+      this->Mapper = mapper;
+    }
+}
+
+void SurfaceLOD::SetInteractor(vtkRenderWindowInteractor *interactor)
+{
+  vtkInteractorObserver *style = interactor ? interactor->GetInteractorStyle() : NULL;
+  if (style == this->Style)
+    {
+      return;
+    }
+  if (this->Style)
+    {
+      this->Style->RemoveObserver(this->Callback);
+      this->Style->UnRegister(NULL);
+    }
+  this->Style = style;
+  if (style)
+    {
+      style->Register(NULL);
+      style->AddObserver(vtkCommand::StartInteractionEvent, this->Callback);
+      style->AddObserver(vtkCommand::EndInteractionEvent, this->Callback);
+    }
+}
+
+void SurfaceLOD::SetInput(vtkPolyData *surface)
+{
+  // Nothing to rebuild if the surface has not changed.
+  if (surface == this->Surface && (surface == NULL || surface->GetMTime() == this->SurfaceMTime))
+    {
+      if (this->Mapper)
+        {
+          this->Mapper->SetInput(surface);
+        }
+      return;
+    }
+  this->SurfaceMTime = surface ? surface->GetMTime() : 0;
+  if (surface != this->Surface)
+    {
+      if (surface)       { surface->Register(NULL); }
+      if (this->Surface) { this->Surface->UnRegister(NULL); }
+      this->Surface = surface;
+    }
+
+  // The builder works on a deep copy, so that it never shares data, or
+  // reference counts, with the pipeline of the GUI thread.
+  vtkPolyData *copy = NULL;
+  if (surface && surface->GetNumberOfPolys() > this->InteractiveTriangles)
+    {
+      copy = vtkPolyData::New();
+      copy->DeepCopy(surface);
+    }
+
+  this->Mutex.lock();
+  this->Generation++;
+  this->DiscardLevels();
+  if (this->Pending)
+    {
+      this->Pending->Delete();
+    }
+  this->Pending = copy;
+  if (copy)
+    {
+      if (this->Builder == NULL)
+        {
+          this->Builder = new SurfaceLODBuilder(this);
+          this->Builder->start(QThread::LowPriority);
+        }
+      this->Wake.wakeOne();
+    }
+  this->Mutex.unlock();
+
+  if (this->Mapper)
+    {
+      this->Mapper->SetInput(surface);
+    }
+}
+
+void SurfaceLOD::StartInteraction()
+{
+  if (this->Mapper == NULL || this->Surface == NULL)
+    {
+      return;
+    }
+
+  // The finest level within the budget, or else the coarsest so far
+  QMutexLocker lock(&this->Mutex);
+  vtkPolyData *level = NULL;
+  for (std::size_t i = 0; i < this->Levels.size(); i++)
+    {
+      level = this->Levels[i];
+      if (level->GetNumberOfPolys() <= this->InteractiveTriangles)
+        {
+          break;
+        }
+    }
+  if (level)
+    {
+      this->Mapper->SetInput(level);
+    }
+}
+
+void SurfaceLOD::EndInteraction()
+{
+  // The interactor style renders once the interaction has ended.
+  if (this->Mapper && this->Mapper->GetInput() != this->Surface)
+    {
+      this->Mapper->SetInput(this->Surface);
+    }
+}
+
+void SurfaceLOD::DiscardLevels()
+{
+  for (std::size_t i = 0; i < this->Levels.size(); i++)
+    {
+      if (this->Mapper && this->Mapper->GetInput() == this->Levels[i])
+        {
+          this->Mapper->SetInput(this->Surface);
+        }
+      this->Levels[i]->Delete();
+    }
+  this->Levels.clear();
+}
+
+void SurfaceLOD::RunBuilder()
+{
+  QMutexLocker lock(&this->Mutex);
+  while (! this->Quit)
+    {
+      if (this->Pending == NULL)
+        {
+          this->Wake.wait(&this->Mutex);
+          continue;
+        }
+
+      vtkPolyData *current = this->Pending;
+      this->Pending = NULL;
+      const unsigned long generation = this->Generation;
+      const vtkIdType budget = this->InteractiveTriangles;
+      lock.unlock();
+
+      // Each level is decimated from the one before, which is cheaper
+      // than decimating the full surface every time.  The chain belongs
+      // to this thread alone: the GUI thread gets a deep copy of each
+      // level, as a level handed to the mapper must not also be the
+      // input of the next decimation.
+      vtkPolyData *input = current;
+      while (input->GetNumberOfPolys() > budget)
+        {
+          vtkDecimatePro *decimate = vtkDecimatePro::New();
+          decimate->SetInput(input);
+          decimate->SetTargetReduction(0.75);
+          decimate->PreserveTopologyOff();
+          decimate->SplittingOn();
+          decimate->BoundaryVertexDeletionOn();
+          decimate->Update();
+
+          vtkPolyData *level = vtkPolyData::New();
+          level->ShallowCopy(decimate->GetOutput());
+          decimate->Delete();
+
+          // Stop if the decimation can go no further.
+          const bool stalled = level->GetNumberOfPolys() * 10 > input->GetNumberOfPolys() * 9;
+
+          vtkPolyData *published = vtkPolyData::New();
+          published->DeepCopy(level);
+
+          lock.relock();
+          const bool stale = (generation != this->Generation || this->Quit);
+          if (! stale)
+            {
+              this->Levels.push_back(published);
+              published = NULL;
+            }
+          lock.unlock();
+          if (published)
+            {
+              published->Delete();
+            }
+
+          if (input != current)
+            {
+              input->Delete();
+            }
+          input = level;
+          if (stale || stalled)
+            {
+              break;
+            }
+        }
+      if (input != current)
+        {
+          input->Delete();
+        }
+      current->Delete();
+      lock.relock();
+    }
+}
+
+} // end namespace wse
@@ -0,0 +1,104 @@
+#ifndef _wse_surface_lod_h
+#define _wse_surface_lod_h
+
+#include "vtkPolyData.h"
+#include "vtkPolyDataMapper.h"
+#include "vtkRenderWindowInteractor.h"
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <vector>
+
+class vtkCommand;
+class vtkInteractorObserver;
+
+namespace wse {
+
+class SurfaceLODBuilder;
+
+/** SurfaceLOD keeps a large surface interactive in a 3D view by drawing
+    a decimated copy of it while the camera moves.
+
+    When a surface is set, a background thread builds a chain of
+    decimated levels from a private copy of it, each with about a
+    quarter of the triangles of the one before, until a level has no
+    more than SetInteractiveTriangles() triangles.  The interaction
+    events of the interactor style switch the mapper to the finest
+    level built so far that is within that budget when the camera
+    starts moving, and back to the full resolution surface when it
+    stops.  Surfaces within the budget are always drawn at full
+    resolution.
+
+    All methods must be called from the GUI thread. */
+class SurfaceLOD
+{
+public:
+  SurfaceLOD();
+  ~SurfaceLOD();
+
+  /** Set the mapper that draws the surface. */
+  void SetMapper(vtkPolyDataMapper *mapper);
+
+  /** Set the interactor of the view.  The levels are switched by the
+      interaction events of its current interactor style. */
+  void SetInteractor(vtkRenderWindowInteractor *interactor);
+
+  /** Set the largest number of triangles drawn while interacting.  The
+      default is 250000. */
+  void SetInteractiveTriangles(vtkIdType n)
+  { this->InteractiveTriangles = n; }
+  vtkIdType GetInteractiveTriangles() const
+  { return this->InteractiveTriangles; }
+
+  /** Set the full resolution surface, which the mapper draws at once,
+      and start building its decimated levels.  NULL clears the
+      mapper. */
+  void SetInput(vtkPolyData *surface);
+
+  /** Switch the mapper to a decimated level, or back to the full
+      resolution surface.  These are called on the interaction events
+      of the interactor style. */
+  void StartInteraction();
+  void EndInteraction();
+
+protected:
+  friend class SurfaceLODBuilder;
+
+  /** The body of the builder thread. */
+  void RunBuilder();
+
+private:
+  SurfaceLOD(const SurfaceLOD&);  // Not implemented.
+  void operator=(const SurfaceLOD&);  // Not implemented.
+
+  /** Discards the decimated levels.  Must be called with the Mutex
+      locked. */
+  void DiscardLevels();
+
+  vtkPolyDataMapper *Mapper;
+  vtkInteractorObserver *Style;
+  vtkCommand *Callback;
+  vtkPolyData *Surface;
+  unsigned long SurfaceMTime;
+  vtkIdType InteractiveTriangles;
+
+  /** The copy of the surface waiting to be decimated, or NULL. */
+  vtkPolyData *Pending;
+
+  /** The decimated levels built so far, finest first. */
+  std::vector<vtkPolyData *> Levels;
+
+  /** Incremented whenever the surface changes, so that levels built
+      from an older surface are discarded. */
+  unsigned long Generation;
+
+  /** Guards Pending, Levels, Generation and Quit. */
+  QMutex Mutex;
+  QWaitCondition Wake;
+  bool Quit;
+  SurfaceLODBuilder *Builder;
+};
+
+} // end namespace wse
+
+#endif
@@ -0,0 +1,105 @@
+#include "wseThresholdOverlay.h"
+
+#include "vtkImageData.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkObjectFactory.h"
+#include "vtkDataObject.h"
+
+namespace wse {
+
+vtkCxxRevisionMacro(ThresholdOverlay, "$Revision: 1.2 $");
+
+ThresholdOverlay::ThresholdOverlay()
+{
+  this->ShowThreshold = 1;
+  this->ThresholdLower = 0.0;
+  this->ThresholdUpper = 0.0;
+  this->ThresholdColor[0] = 0.0;
+  this->ThresholdColor[1] = 1.0;
+  this->ThresholdColor[2] = 0.0;
+  this->ThresholdOpacity = 0.75;
+  this->ClipThresholdToMask = 1;
+  this->SetNumberOfInputPorts(2);
+}
+
+void ThresholdOverlay::SetThreshold(double lower, double upper)
+{
+  if (this->ThresholdLower == lower && this->ThresholdUpper == upper)
+    {
+      return;
+    }
+  this->ThresholdLower = lower;
+  this->ThresholdUpper = upper;
+  this->Modified();
+}
+
+int ThresholdOverlay::FillInputPortInformation(int port, vtkInformation *info)
+{
+  info->Set(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkImageData");
+  if (port == 1)
+    {
+      info->Set(vtkAlgorithm::INPUT_IS_OPTIONAL(), 1);
+    }
+  return 1;
+}
+
+int ThresholdOverlay::RequestInformation(vtkInformation *vtkNotUsed(request),
+                                         vtkInformationVector **vtkNotUsed(inputVector),
+                                         vtkInformationVector *outputVector)
+{
+  // Extent, spacing and origin are copied from the image by the
+  // executive.
+  vtkInformation *outInfo = outputVector->GetInformationObject(0);
+  vtkDataObject::SetPointDataActiveScalarInfo(outInfo, VTK_UNSIGNED_CHAR, 4);
+  return 1;
+}
+
+void ThresholdOverlay::GetPaint(ThresholdOverlayPaint &p, bool haveMask) const
+{
+  p.show  = this->ShowThreshold != 0;
+  p.clip  = this->ClipThresholdToMask && haveMask;
+  p.lower = this->ThresholdLower;
+  p.upper = this->ThresholdUpper;
+  p.alpha = static_cast<int>(this->ThresholdOpacity * 256.0 + 0.5);
+  for (int c = 0; c < 3; c++)
+    {
+      p.color[c] = static_cast<int>(this->ThresholdColor[c] * 255.0 + 0.5);
+    }
+}
+
+bool ThresholdOverlay::CoversExtent(vtkImageData *data, int ext[6])
+{
+  int *e = data->GetExtent();
+  return e[0] <= ext[0] && e[1] >= ext[1] && e[2] <= ext[2]
+    && e[3] >= ext[3] && e[4] <= ext[4] && e[5] >= ext[5];
+}
+
+vtkImageData *ThresholdOverlay::GetMaskData(vtkInformationVector **inputVector,
+                                            vtkImageData ***inData, int ext[6])
+{
+  if (inputVector[1]->GetNumberOfInformationObjects() == 0)
+    {
+      return NULL;
+    }
+  vtkImageData *maskData = inData[1][0];
+  if (! ThresholdOverlay::CoversExtent(maskData, ext))
+    {
+      vtkWarningMacro("The mask does not cover the requested extent and is ignored.");
+      return NULL;
+    }
+  return maskData;
+}
+
+void ThresholdOverlay::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "ShowThreshold: " << this->ShowThreshold << "\n";
+  os << indent << "Threshold: " << this->ThresholdLower << ", " << this->ThresholdUpper << "\n";
+  os << indent << "ThresholdColor: (" << this->ThresholdColor[0] << ", " << this->ThresholdColor[1]
+     << ", " << this->ThresholdColor[2] << ")\n";
+  os << indent << "ThresholdOpacity: " << this->ThresholdOpacity << "\n";
+  os << indent << "ClipThresholdToMask: " << this->ClipThresholdToMask << "\n";
+}
+
+} // end namespace wse
@@ -0,0 +1,118 @@
+#ifndef _wse_threshold_overlay_h
+#define _wse_threshold_overlay_h
+
+#include "vtkThreadedImageAlgorithm.h"
+
+class vtkAlgorithmOutput;
+
+namespace wse {
+
+/** The threshold paint of one execution of a ThresholdOverlay, with the
+    color and opacity converted to 8 bit fixed point. */
+struct ThresholdOverlayPaint
+{
+  bool show;
+  bool clip;
+  double lower;
+  double upper;
+  int color[3];
+  int alpha;
+
+  /** Returns true if a voxel of value v, inside the mask or not, is
+      painted. */
+  bool Selects(double v, bool inMask) const
+  { return show && v >= lower && v <= upper && (!clip || inMask); }
+
+  /** Blends the paint color over the color (r, g, b). */
+  void Paint(int &r, int &g, int &b) const
+  {
+    r += ((color[0] - r) * alpha) / 256;
+    g += ((color[1] - g) * alpha) / 256;
+    b += ((color[2] - b) * alpha) / 256;
+  }
+};
+
+/** ThresholdOverlay is the base of filters that paint the voxels of
+    an image whose values fall inside a threshold range over a color
+    rendering of that image.  Optionally, only voxels that are also
+    inside a mask are painted.
+
+    It holds the threshold parameters and the inputs: input 0 is the
+    scalar image that is thresholded and the optional input 1 is the
+    mask, where values of 0.5 or more are inside.  Both inputs must
+    share the same extent.  The output is always RGBA.  Subclasses such
+    as SliceCompositor render the base and paint the threshold in
+    ThreadedRequestData(), using GetPaint() and GetMaskData(). */
+class ThresholdOverlay : public vtkThreadedImageAlgorithm
+{
+public:
+  vtkTypeRevisionMacro(ThresholdOverlay,vtkThreadedImageAlgorithm);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  // Description:
+  // Connect the mask.  Passing NULL removes it.  The image is
+  // connected with SetInputConnection().
+  void SetMaskConnection(vtkAlgorithmOutput *in)
+  { this->SetInputConnection(1, in); }
+
+  // Description:
+  // Set whether voxels inside the (inclusive) threshold range are
+  // painted, and the color and opacity with which they are painted.
+  // The default is green at an opacity of 0.75.
+  vtkSetMacro(ShowThreshold, int);
+  vtkGetMacro(ShowThreshold, int);
+  vtkBooleanMacro(ShowThreshold, int);
+  void SetThreshold(double lower, double upper);
+  vtkGetMacro(ThresholdLower, double);
+  vtkGetMacro(ThresholdUpper, double);
+  vtkSetVector3Macro(ThresholdColor, double);
+  vtkGetVector3Macro(ThresholdColor, double);
+  vtkSetClampMacro(ThresholdOpacity, double, 0.0, 1.0);
+  vtkGetMacro(ThresholdOpacity, double);
+
+  // Description:
+  // When on (the default), threshold voxels outside of the mask are not
+  // painted.  Has no effect if there is no mask input.
+  vtkSetMacro(ClipThresholdToMask, int);
+  vtkGetMacro(ClipThresholdToMask, int);
+  vtkBooleanMacro(ClipThresholdToMask, int);
+
+protected:
+  ThresholdOverlay();
+  ~ThresholdOverlay() {}
+
+  virtual int FillInputPortInformation(int port, vtkInformation *info);
+  virtual int RequestInformation(vtkInformation *request,
+                                 vtkInformationVector **inputVector,
+                                 vtkInformationVector *outputVector);
+
+  // Description:
+  // Fill p with the threshold parameters for an execution with or
+  // without a mask.
+  void GetPaint(ThresholdOverlayPaint &p, bool haveMask) const;
+
+  // Description:
+  // Returns the mask of an execution, or NULL if there is none or it
+  // does not cover ext.
+  vtkImageData *GetMaskData(vtkInformationVector **inputVector,
+                            vtkImageData ***inData, int ext[6]);
+
+  // Description:
+  // Returns true if the extent of data covers ext.
+  static bool CoversExtent(vtkImageData *data, int ext[6]);
+
+  int ShowThreshold;
+  double ThresholdLower;
+  double ThresholdUpper;
+  double ThresholdColor[3];
+  double ThresholdOpacity;
+  int ClipThresholdToMask;
+
+private:
+  ThresholdOverlay(const ThresholdOverlay&);  // Not implemented.
+  void operator=(const ThresholdOverlay&);  // Not implemented.
+};
+
+} // end namespace wse
+
+#endif
@@ -0,0 +1,196 @@
+#include "wseVolumeSampler.h"
+#include "wseSampleKernel.hxx"
+
+#include "vtkMultiThreader.h"
+#include "vtkPointData.h"
+
+#include <algorithm>
+
+namespace wse {
+
+VolumeSampler::VolumeSampler()
+{
+  this->Image = NULL;
+  this->Linear = true;
+  for (int a = 0; a < 3; a++)
+    {
+      this->Scale[a] = 1.0;
+      this->Shift[a] = 0.0;
+    }
+}
+
+VolumeSampler::~VolumeSampler()
+{
+  this->SetImage(NULL);
+}
+
+void VolumeSampler::SetImage(vtkImageData *image)
+{
+  if (image != this->Image)
+    {
+      if (image)       { image->Register(NULL); }
+      if (this->Image) { this->Image->UnRegister(NULL); }
+      this->Image = image;
+    }
+  if (image == NULL)
+    {
+      return;
+    }
+
+  // The continuous index is relative to the first voxel of the extent.
+  const double *origin = image->GetOrigin();
+  const double *spacing = image->GetSpacing();
+  const int *ext = image->GetExtent();
+  for (int a = 0; a < 3; a++)
+    {
+      this->Scale[a] = 1.0 / spacing[a];
+      this->Shift[a] = -origin[a] / spacing[a] - ext[2 * a];
+    }
+}
+
+void VolumeSampler::Sample(const float *points, vtkIdType n, float *values) const
+{
+  const double offset[3] = { 0.0, 0.0, 0.0 };
+  this->Execute(points, NULL, offset, 0.0, n, values);
+}
+
+void VolumeSampler::Sample(const float *points, const double offset[3], vtkIdType n,
+                           float *values) const
+{
+  this->Execute(points, NULL, offset, 0.0, n, values);
+}
+
+void VolumeSampler::SampleAlong(const float *points, const float *directions, double t,
+                                vtkIdType n, float *values) const
+{
+  const double offset[3] = { 0.0, 0.0, 0.0 };
+  this->Execute(points, directions, offset, t, n, values);
+}
+
+/** Arguments of VolumeSamplerCompute(). */
+struct VolumeSamplerWork
+{
+  const void *scalars;
+  int scalarType;
+  SampleGrid grid;
+  float scale[3];
+  float shift[3];
+  float step[3];
+  bool linear;
+
+  const float *points;
+  const float *directions;
+  vtkIdType count;
+  float *values;
+};
+
+/** Samples the points begin to end - 1. */
+template <class T>
+static void VolumeSamplerExecute(const VolumeSamplerWork &w, const T *scalars,
+                                 vtkIdType begin, vtkIdType end)
+{
+  float index[3][SampleBlockSize];
+
+  for (vtkIdType b = begin; b < end; b += SampleBlockSize)
+    {
+      const int m = static_cast<int>(std::min<vtkIdType>(SampleBlockSize, end - b));
+
+      // The continuous indices of the block, one axis at a time
+      const float *p = w.points + 3 * b;
+      for (int a = 0; a < 3; a++)
+        {
+          const float scale = w.scale[a];
+          const float shift = w.shift[a];
+          float *ia = index[a];
+          if (w.directions)
+            {
+              const float *d = w.directions + 3 * b;
+              const float step = w.step[a];
+              for (int i = 0; i < m; i++)
+                {
+                  ia[i] = p[3 * i + a] * scale + d[3 * i + a] * step + shift;
+                }
+            }
+          else
+            {
+              for (int i = 0; i < m; i++)
+                {
+                  ia[i] = p[3 * i + a] * scale + shift;
+                }
+            }
+        }
+
+      float *out = w.values + b;
+      for (int i = 0; i < m; i++)
+        {
+          out[i] = sampleVoxels<float>(scalars, w.grid, index[0][i], index[1][i], index[2][i], w.linear);
+        }
+    }
+}
+
+/** Thread entry point of Execute().  Each thread samples a contiguous
+    range of points. */
+static VTK_THREAD_RETURN_TYPE VolumeSamplerCompute(void *arg)
+{
+  vtkMultiThreader::ThreadInfo *info = static_cast<vtkMultiThreader::ThreadInfo *>(arg);
+  const VolumeSamplerWork *w = static_cast<const VolumeSamplerWork *>(info->UserData);
+  const vtkIdType begin = w->count * info->ThreadID / info->NumberOfThreads;
+  const vtkIdType end = w->count * (info->ThreadID + 1) / info->NumberOfThreads;
+  if (begin >= end)
+    {
+      return VTK_THREAD_RETURN_VALUE;
+    }
+
+  switch (w->scalarType)
+    {
+      vtkTemplateMacro(VolumeSamplerExecute(*w, static_cast<const VTK_TT *>(w->scalars), begin, end));
+    default:
+      break;
+    }
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+void VolumeSampler::Execute(const float *points, const float *directions, const double offset[3],
+                            double t, vtkIdType n, float *values) const
+{
+  if (n <= 0)
+    {
+      return;
+    }
+  if (this->Image == NULL || this->Image->GetPointData()->GetScalars() == NULL)
+    {
+      std::fill(values, values + n, 0.0f);
+      return;
+    }
+
+  VolumeSamplerWork w;
+  w.scalars = this->Image->GetScalarPointer();
+  w.scalarType = this->Image->GetScalarType();
+  vtkIdType inc[3];
+  int dims[3];
+  this->Image->GetIncrements(inc);
+  this->Image->GetDimensions(dims);
+  for (int a = 0; a < 3; a++)
+    {
+      w.grid.size[a] = dims[a];
+      w.grid.stride[a] = static_cast<std::ptrdiff_t>(inc[a]);
+      w.scale[a] = static_cast<float>(this->Scale[a]);
+      w.shift[a] = static_cast<float>(this->Shift[a] + offset[a] * this->Scale[a]);
+      w.step[a] = static_cast<float>(t * this->Scale[a]);
+    }
+  w.linear = this->Linear;
+  w.points = points;
+  w.directions = directions;
+  w.count = n;
+  w.values = values;
+
+  // Fewer than 4096 points are not worth a thread.
+  vtkMultiThreader *threader = vtkMultiThreader::New();
+  threader->SetNumberOfThreads(static_cast<int>(
+    std::max<vtkIdType>(1, std::min<vtkIdType>(threader->GetNumberOfThreads(), n / 4096))));
+  threader->SetSingleMethod(VolumeSamplerCompute, &w);
+  threader->SingleMethodExecute();
+  threader->Delete();
+}
+
+} // end namespace wse
@@ -0,0 +1,62 @@
+#ifndef _wse_volume_sampler_h
+#define _wse_volume_sampler_h
+
+#include "vtkImageData.h"
+
+namespace wse {
+
+/** VolumeSampler interpolates a scalar image at many points at once,
+    e.g. at every vertex of a surface.
+
+    The physical to index transform of the image is computed once when
+    the image is set, rather than once per sample.  Each call samples a
+    whole array of points, split across threads, with the kernel of
+    wseSampleKernel.hxx.
+
+    As with wse::Image::getLinearInterpolatedPixel(), points whose
+    continuous index lies outside of the image sample 0.
+
+    IsoRenderer is its only user, so like it, it is not built yet. */
+class VolumeSampler
+{
+public:
+  VolumeSampler();
+  ~VolumeSampler();
+
+  /** Set the image to sample, which must be up to date, and whether it
+      is interpolated linearly (the default) or by nearest neighbor. */
+  void SetImage(vtkImageData *image);
+  void SetLinear(bool linear)
+  { this->Linear = linear; }
+  bool GetLinear() const
+  { return this->Linear; }
+
+  /** Samples the image at the n points given as x, y, z triples. */
+  void Sample(const float *points, vtkIdType n, float *values) const;
+
+  /** Samples the image at the n points, each moved by offset. */
+  void Sample(const float *points, const double offset[3], vtkIdType n, float *values) const;
+
+  /** Samples the image at the n points, each moved t times along its
+      own direction, also given as x, y, z triples. */
+  void SampleAlong(const float *points, const float *directions, double t,
+                   vtkIdType n, float *values) const;
+
+private:
+  VolumeSampler(const VolumeSampler&);  // Not implemented.
+  void operator=(const VolumeSampler&);  // Not implemented.
+
+  void Execute(const float *points, const float *directions, const double offset[3],
+               double t, vtkIdType n, float *values) const;
+
+  vtkImageData *Image;
+  bool Linear;
+
+  // The continuous index of a point p is p * Scale + Shift.
+  double Scale[3];
+  double Shift[3];
+};
+
+} // end namespace wse
+
+#endif
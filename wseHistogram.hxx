@@ -69,6 +69,19 @@ namespace wse {
               PixelType filterMin, 
               PixelType filterMax);
     
+    /**
+     * Builds the histogram of a whole image whose summary statistics are
+     * already known (see Image::statistics()), which saves a pass over
+     * the image.
+     * @param im - the image to be histogram'ed.
+     * @param numBins - the number of bins to use.
+     * @param min, max - the minimum and maximum values in the image.
+     * @param mean - the mean value of the image.
+     * @param count - the number of pixels in the image.
+     */
+    Histogram(const typename ImageType::Pointer im, unsigned int numBins,
+              PixelType min, PixelType max, double mean, unsigned long count);
+    
     // Implemented to properly copy std::vector members
     const Histogram& operator=(const Histogram &in)
     {
@@ -165,6 +178,14 @@ namespace wse {
                         const typename MaskImageType::Pointer mask,
                         bool useThreshold);
     
+    /**
+     * Second pass of buildHistogram: sets up the bins from m_min and
+     * m_max, then fills them and computes the standard deviation.
+     */
+    void fillBins(const typename ImageType::Pointer im,
+                  const typename MaskImageType::Pointer mask,
+                  bool useThreshold);
+    
     /** Maximum pixel value found in the image. */
     PixelType m_max;
     /** Minimum pixel value found in the image. */
@@ -272,6 +293,24 @@ namespace wse {
   }
   
   
+  template <class TImageType, class TMaskImageType>
+  Histogram<TImageType,TMaskImageType>::Histogram(const typename ImageType::Pointer im, unsigned int numBins,
+                                                  PixelType min, PixelType max, double mean, unsigned long count)
+  :m_max(max),
+  m_min(min),
+  m_mean(mean),
+  m_stdev(0),
+  m_pixelCount(count),
+  m_totalPixels(count),
+  m_hist(numBins),
+  m_bins(numBins),
+  m_binWidth(0),
+  m_filterMin(0),
+  m_filterMax(0)
+  {
+    fillBins(im , MaskImageType::New() , false);
+  }
+  
   template <class TImageType, class TMaskImageType>
   void Histogram<TImageType,TMaskImageType>::buildHistogram(const typename ImageType::Pointer im,
                       const typename MaskImageType::Pointer mask,
@@ -348,6 +387,21 @@ namespace wse {
       m_mean = sum / m_pixelCount;
     }
     
+    fillBins(im, mask, useThreshold);
+  }
+  
+  template <class TImageType, class TMaskImageType>
+  void Histogram<TImageType,TMaskImageType>::fillBins(const typename ImageType::Pointer im,
+                      const typename MaskImageType::Pointer mask,
+                      bool useThreshold)
+  {    
+    typedef typename itk::ImageRegionConstIterator<ImageType> ConstIteratorType;
+    typedef typename itk::ImageRegionConstIterator<MaskImageType> MaskConstIteratorType;
+    
+    typename ImageType::SizeType maskSize = mask->GetLargestPossibleRegion().GetSize();
+    MaskConstIteratorType mit(mask, mask->GetRequestedRegion());
+    ConstIteratorType it( im , im->GetRequestedRegion() );
+    
     // Set up the bins
     m_binWidth = static_cast<double>(m_max-m_min) / m_bins.size();
     for(unsigned int i=0; i < m_bins.size(); ++i)
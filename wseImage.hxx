@@ -3,6 +3,8 @@
 
 #include <iostream>
 #include <limits>
+#include <vector>
+#include <algorithm>
 
 
 // Qt Includes
@@ -12,44 +14,84 @@
 #include "itkLinearInterpolateImageFunction.h"
 #include "itkNearestNeighborInterpolateImageFunction.h"
 #include "itkDiscreteGaussianImageFilter.h"
+#include "itkCommand.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkImageRegionConstIterator.h"
 
 // VTK Includes
 #include "vtkImageData.h"
+#include "vtkPointData.h"
 #include "itkVTKImageExport.h"
 #include "vtkImageImport.h"
 #include "vtkITKUtility.h"
 
+#include "wseParallel.hxx"
+#include "wseMappedImage.hxx"
+#include "wseSampleKernel.hxx"
+#include "wseCompactBuffer.hxx"
+
 namespace wse {
 
+/** Summary statistics of the pixel values of an image. */
+template<class T>
+struct ImageStatistics
+{
+  ImageStatistics() : minimum(0), maximum(0), sum(0.0), count(0), binary(false) {}
+
+  T minimum;
+  T maximum;
+  double sum;
+  unsigned long count;
+
+  /** True if the image contains only the values 0 and 1, and both of
+      them. */
+  bool binary;
+
+  double range() const { return static_cast<double>(maximum) - static_cast<double>(minimum); }
+  double mean() const  { return count == 0 ? 0.0 : sum / static_cast<double>(count); }
+};
+
 /** A wrapper for itk::Image that provides a number of convenient
     functions, including loading and saving from disk and
     interpolation of subpixel image values.  This class also provides
-    convenient export to VTK images through a single method. */
+    convenient export to VTK images through a single method.
+
+    An image may be stored compactly while it is not in use (see
+    compact()).  Its pixels are then widened on the fly by getPixel()
+    and the interpolation functions, and the whole image is widened
+    back to T the first time itkImage() or vtkImporter() is called. */
 template<class T>
 class Image
 {
  public:
   typedef itk::Image<T,3> itkImageType;
+  typedef ImageStatistics<T> Statistics;
   typedef itk::LinearInterpolateImageFunction<itkImageType, double >  LinearInterpolatorType;
   typedef itk::NearestNeighborInterpolateImageFunction<itkImageType, double >  
     NearestNeighborInterpolatorType;
   
- Image() : mITKImage(NULL), mName(""), mVTKImport(NULL)
+ Image() : mITKImage(NULL), mName(""), mVTKImport(NULL), mStatisticsMTime(0),
+    mCompactStorage(FullPrecision)
     {  
       mColor = QColor(100,100,100);
       //  mColor = QColor(cvRandInt(&rng)%255,cvRandInt(&rng)%255,cvRandInt(&rng)%255);
     }
-  ~Image()  { if (mVTKImport != NULL) mVTKImport->Delete();   }
+  ~Image()
+  {
+    if (mVTKImport != NULL) mVTKImport->Delete();
+    if (this->isSpilled())  { QFile::remove(mSpillFile); }
+  }
   
   /** Construct an image using an itk::ImagePointer */
   Image(itkImageType *img);
 
   /** Loads an image from the file "fname" using the
-      itk::ImageFileReader. */
-  bool read(QString fname);
+      itk::ImageFileReader.  If given, "observer" is added to the reader
+      for its ProgressEvent.  No VTK object is created or updated, so a
+      new image may be read on a worker thread; its VTK pipeline is
+      built on the GUI thread by the first call to vtkImporter(). */
+  bool read(QString fname, itk::Command *observer = NULL);
 
   /** Writes an image to the file "fname" using the
       itk::ImageFileWriter. */
@@ -60,14 +102,21 @@ class Image
   //  {    return 1;  }
   
   /** Initializes vtk Importer/Exporter objects and hooks up the
-      ITK->VTK conversion pipeline. Intended to be called only once on
-      initialization. */
+      ITK->VTK conversion pipeline.  This is done by vtkImporter() the
+      first time it is called, so images that are never displayed have
+      no VTK pipeline.  Does nothing if the pipeline exists. */
   void constructVTKPipeline();
 
   /** Inializes the ITK image interpolator objects and hooks them up
-      to the itk image.  Intended to be called only once on
-      initialization. */
+      to the itk image.  This is done by the interpolation functions
+      the first time they are called.  Does nothing if the
+      interpolators exist. */
   void constructImageInterpolators();
+
+  /** Deletes the VTK pipeline and the interpolators, which are built
+      again when they are next needed.  Anything still connected to the
+      output of vtkImporter() should be disconnected first. */
+  void releasePipeline();
     
   /** Returns the number of pixels on the x-axis of the image */
   inline unsigned int x() const { return this->width(); }
@@ -108,8 +157,21 @@ class Image
   // }
   
 
-  /** Returns true if this image has a range of only 2 values. */
-  bool isBinarySegmentation();
+  /** Returns true if this image contains only the values 0 and 1. */
+  bool isBinarySegmentation() const
+  { return this->statistics().binary; }
+
+  /** Returns the minimum, maximum, sum and count of the pixel values.
+      The statistics are computed by a single multi-threaded pass over
+      the pixel buffer the first time they are requested, and again
+      only after the ITK image or its pixel container has been
+      modified. */
+  const Statistics &statistics() const;
+
+  /** Discards the cached statistics.  Call this after writing to the
+      pixel buffer directly without calling Modified() on the image. */
+  void invalidateStatistics() const
+  { mStatisticsMTime = 0; }
 
   /** Returns the pixel value at the (i,j,k) location */
   typename itkImageType::PixelType getPixel(int i, int j, int k) const;
@@ -124,16 +186,35 @@ class Image
   /** Returns the interpolated (nearest-neighbor) pixel value at the given (x,y,z) point. */
   typename itkImageType::PixelType getNearestInterpolatedPixel(double point[3]) const;
 
+  /** Samples the image at the n points given as x, y, z triples of
+      physical coordinates, and writes the n values.  These are the
+      batched forms of getLinearInterpolatedPixel() and
+      getNearestInterpolatedPixel(): the physical to index transform is
+      computed once per call, and the voxels are read straight from
+      the pixel buffer by the kernel of wseSampleKernel.hxx, on all
+      threads for large batches.  Points outside of the image sample 0,
+      and neighbors outside of it are clamped to its edge. */
+  void sampleLinear(const double *points, unsigned long n, T *values) const
+  { this->sample(points, n, values, true); }
+  void sampleNearest(const double *points, unsigned long n, T *values) const
+  { this->sample(points, n, values, false); }
+
   /** Returns the slice number that contains the given point. */
   int getSliceForPoint(double p[3]) const;
 
   /** Returns the closest slice number to the given point */
   double getClosestSlicePoint(double point[3]) const;
 
-  /** Returns the pointer to the itkImage. */
-  typename itkImageType::Pointer itkImage() { return mITKImage; }
+  /** Returns the pointer to the itkImage.  A compact image is widened
+      first. */
+  typename itkImageType::Pointer itkImage()
+  {
+    this->expand();
+    return mITKImage;
+  }
   typename itkImageType::ConstPointer itkImage() const 
     {
+      const_cast<Image<T> *>(this)->expand();
       return typename itkImageType::ConstPointer(mITKImage); 
     }
 
@@ -141,8 +222,18 @@ class Image
   float getMinimumSpacing() const;
 
   /** */  
-  const vtkImageImport *vtkImporter() const { return mVTKImport; }
-  vtkImageImport *vtkImporter() { return mVTKImport;}
+  /** Returns the VTK import of the image.  A compact image is widened
+      first. */
+  const vtkImageImport *vtkImporter() const
+  {
+    return const_cast<Image<T> *>(this)->vtkImporter();
+  }
+  vtkImageImport *vtkImporter()
+  {
+    this->expand();
+    if (mVTKImport == NULL && mITKImage)  { this->constructVTKPipeline(); }
+    return mVTKImport;
+  }
   
   /** Return the color that has been associated with this image
       (useful for GUIs).*/
@@ -159,9 +250,58 @@ class Image
       not a file name.*/
   void name(const QString &n)  { mName = n; }
 
-  /** Computes the maximum value stored in the image.  Note that this
-      requires a traversal of the image each time that it is called.*/
-  T computeMaximumImageValue() const;
+  /** Returns the maximum value stored in the image.  See
+      statistics(). */
+  T computeMaximumImageValue() const
+  { return this->statistics().maximum; }
+
+  /** Returns the number of bytes of pixel data held in memory: the ITK
+      pixel buffer, plus the scalars of the VTK import if VTK has made
+      its own copy of them.  A spilled image holds none, and the buffer
+      of a mapped image is not counted, as its pages are read from its
+      file as they are touched and the system drops them as needed. */
+  qint64 residentBytes() const;
+
+  /** Writes the pixel buffer to the raw file "fname" and releases it,
+      keeping the size, spacing, origin, name and statistics of the
+      image.  Filters and writers that still hold the ITK image keep
+      the old buffer until they finish with it.  Returns false if the
+      image is already spilled or mapped, or the file cannot be
+      written. */
+  bool spill(const QString &fname);
+
+  /** Reads the pixel buffer of a spilled image back from its file and
+      removes the file.  If the file cannot be read, the buffer is
+      filled with zeros and false is returned. */
+  bool reload();
+
+  /** Returns true if the pixel buffer has been spilled to disk. */
+  bool isSpilled() const { return ! mSpillFile.isEmpty(); }
+
+  /** Returns true if the pixel buffer is mapped from the file the
+      image was read from (see mapMetaImage()).  A mapped image is
+      neither compacted nor spilled, which would read all of it. */
+  bool isMapped() const;
+
+  /** Sets the format compact() stores the pixels in.  The default,
+      FullPrecision, never compacts the image. */
+  void setCompactStorage(CompactStorage s) { mCompactStorage = s; }
+  CompactStorage compactStorage() const { return mCompactStorage; }
+
+  /** Converts the pixel buffer to the 16-bit format set by
+      setCompactStorage() and releases it, halving the memory held by a
+      float image.  As with spill(), anyone else holding the ITK image
+      keeps the full buffer.  Returns false if the image is stored at
+      full precision, is mapped, or is already compact or spilled. */
+  bool compact();
+
+  /** Widens a compact image back to its pixel type, reloading it first
+      if it has been spilled.  The widened values are within the
+      precision of the compact format of the original ones. */
+  void expand();
+
+  /** Returns true if the pixels are held in a compact format. */
+  bool isCompact() const { return mCompact.storage() != FullPrecision; }
   
 private:
   /** Linear interpolator used by getPixel functions. */
@@ -183,35 +323,72 @@ private:
       connected to itk::VTKImageExport. */
   vtkImageImport * mVTKImport;
   typename itk::VTKImageExport<itkImageType>::Pointer mITKExporter;
+
+  /** Cached pixel statistics, valid while mStatisticsMTime matches the
+      modified time of the ITK image (see statistics()). */
+  mutable Statistics mStatistics;
+  mutable unsigned long mStatisticsMTime;
+
+  /** Returns the modified time of the image and its pixel buffer. */
+  unsigned long dataMTime() const;
+
+  /** Connects mITKImage to the ITK->VTK exporter and the
+      interpolators after it has been replaced. */
+  void connectITKImage();
+
+  /** Replaces mITKImage with an image of the same size that has no
+      pixel buffer. */
+  void releaseITKBuffer();
+
+  /** Reloads a spilled image. */
+  void makeResident() const;
+
+  /** Returns the widened compact pixel at index, clamped to the
+      image. */
+  double compactPixel(typename itkImageType::IndexType index) const;
+
+  /** Implements sampleLinear() and sampleNearest(). */
+  void sample(const double *points, unsigned long n, T *values, bool linear) const;
+
+  /** The file holding the pixel buffer while the image is spilled. */
+  QString mSpillFile;
+
+  /** The format compact() uses, and the compact pixels, if any. */
+  CompactStorage mCompactStorage;
+  CompactBuffer mCompact;
 };
 
 template<class T>
 Image<T>::Image(itkImageType *img)
+  : mVTKImport(NULL), mStatisticsMTime(0), mCompactStorage(FullPrecision)
 {
   mITKImage = img;
-  
-  // Hook up the ITK->VTK conversion pipeline
-  this->constructVTKPipeline();
-  
-  // Create and hook up the interpolator objects.
-  this->constructImageInterpolators();
+
+  // The VTK pipeline and the interpolators are created when they are
+  // first used.
 }
   
 template<class T>
-bool Image<T>::read(QString fname)
+bool Image<T>::read(QString fname, itk::Command *observer)
 {
-  // Read ITK image data from a file
-  typename itk::ImageFileReader<itkImageType>::Pointer reader =
-    itk::ImageFileReader<itkImageType>::New();  
-  reader->SetFileName(fname.toAscii());
-  reader->Update();
-  mITKImage = reader->GetOutput();
+  // Uncompressed MetaImages are mapped into memory, so that only the
+  // parts of the image that are used are ever read.
+  mITKImage = mapMetaImage<T>(fname);
 
-  // Hook up the ITK->VTK conversion pipeline
-  this->constructVTKPipeline();
+  // Read ITK image data from a file
+  if (mITKImage.IsNull())
+    {
+      typename itk::ImageFileReader<itkImageType>::Pointer reader =
+        itk::ImageFileReader<itkImageType>::New();  
+      reader->SetFileName(fname.toAscii());
+      if (observer != NULL)  { reader->AddObserver(itk::ProgressEvent(), observer); }
+      reader->Update();
+      mITKImage = reader->GetOutput();
+    }
+  this->invalidateStatistics();
 
-  // Create and hook up the interpolator objects.
-  this->constructImageInterpolators();
+  // Hook up an existing VTK pipeline and interpolators to the new image.
+  this->connectITKImage();
 
   // Is image valid?
   if (!mITKImage)  {  return false;  }
@@ -225,6 +402,8 @@ bool Image<T>::read(QString fname)
 template<class T>
 void Image<T>::constructVTKPipeline()
 {  
+  if (mVTKImport != NULL)  { return; }
+
   mVTKImport   = vtkImageImport::New();
   mITKExporter = itk::VTKImageExport<itkImageType>::New();
   mITKExporter->SetInput(mITKImage);
@@ -236,6 +415,8 @@ void Image<T>::constructVTKPipeline()
 template<class T>
 void Image<T>::constructImageInterpolators()
 {
+  if (mLinearInterpolator)  { return; }
+
   mLinearInterpolator = LinearInterpolatorType::New();
   mLinearInterpolator->SetInputImage(mITKImage);
   
@@ -243,6 +424,204 @@ void Image<T>::constructImageInterpolators()
   mNearestInterpolator->SetInputImage(mITKImage);
 }
   
+template<class T>
+void Image<T>::connectITKImage()
+{
+  if (mITKExporter)         { mITKExporter->SetInput(mITKImage); }
+  if (mLinearInterpolator)  { mLinearInterpolator->SetInputImage(mITKImage); }
+  if (mNearestInterpolator) { mNearestInterpolator->SetInputImage(mITKImage); }
+}
+
+template<class T>
+void Image<T>::releasePipeline()
+{
+  if (mVTKImport != NULL)
+    {
+      // A viewer that is still connected to the import gets an empty
+      // image, rather than calling into the deleted exporter.
+      mVTKImport->SetUpdateInformationCallback(NULL);
+      mVTKImport->SetPipelineModifiedCallback(NULL);
+      mVTKImport->SetWholeExtentCallback(NULL);
+      mVTKImport->SetSpacingCallback(NULL);
+      mVTKImport->SetOriginCallback(NULL);
+      mVTKImport->SetScalarTypeCallback(NULL);
+      mVTKImport->SetNumberOfComponentsCallback(NULL);
+      mVTKImport->SetPropagateUpdateExtentCallback(NULL);
+      mVTKImport->SetUpdateDataCallback(NULL);
+      mVTKImport->SetDataExtentCallback(NULL);
+      mVTKImport->SetBufferPointerCallback(NULL);
+      mVTKImport->SetCallbackUserData(NULL);
+      mVTKImport->SetImportVoidPointer(NULL);
+      mVTKImport->GetOutput()->ReleaseData();
+      mVTKImport->Delete();
+      mVTKImport = NULL;
+    }
+  mITKExporter = NULL;
+  mLinearInterpolator = NULL;
+  mNearestInterpolator = NULL;
+}
+
+template<class T>
+bool Image<T>::isMapped() const
+{
+  typedef MappedImageContainer<typename itkImageType::PixelContainer::ElementIdentifier, T> ContainerType;
+  return mITKImage && dynamic_cast<const ContainerType *>(mITKImage->GetPixelContainer()) != NULL;
+}
+
+template<class T>
+qint64 Image<T>::residentBytes() const
+{
+  if (! mITKImage || this->isSpilled())  { return 0; }
+
+  qint64 bytes = static_cast<qint64>(mCompact.size()) * sizeof(unsigned short);
+  const void *buffer = NULL;
+  if (mITKImage->GetPixelContainer() != NULL)
+    {
+      if (! this->isMapped())
+        {
+          bytes += static_cast<qint64>(mITKImage->GetPixelContainer()->Size()) * sizeof(T);
+        }
+      buffer = mITKImage->GetBufferPointer();
+    }
+
+  // vtkImageImport normally uses the ITK buffer in place.
+  vtkImageData *output = mVTKImport != NULL ? mVTKImport->GetOutput() : NULL;
+  if (output != NULL && output->GetPointData()->GetScalars() != NULL
+      && output->GetScalarPointer() != buffer)
+    {
+      bytes += static_cast<qint64>(output->GetActualMemorySize()) * 1024;
+    }
+  return bytes;
+}
+
+template<class T>
+void Image<T>::releaseITKBuffer()
+{
+  // Replace the image, rather than freeing its buffer, so that anyone
+  // else holding the ITK image is unaffected.
+  typename itkImageType::Pointer shell = itkImageType::New();
+  shell->CopyInformation(mITKImage);
+  shell->SetRequestedRegion(mITKImage->GetRequestedRegion());
+  shell->SetBufferedRegion(mITKImage->GetBufferedRegion());
+  mITKImage = shell;
+  this->connectITKImage();
+  if (mVTKImport != NULL)  {  mVTKImport->GetOutput()->ReleaseData();  }
+
+  // The statistics of the pixels do not change while they are stored
+  // elsewhere.  They were computed before the buffer was released.
+  mStatisticsMTime = this->dataMTime();
+}
+
+template<class T>
+bool Image<T>::spill(const QString &fname)
+{
+  if (! mITKImage || this->isSpilled() || this->isMapped())  {  return false;  }
+
+  // A compact image spills its codes.
+  const char *data;
+  qint64 bytes;
+  if (this->isCompact())
+    {
+      data = reinterpret_cast<const char *>(mCompact.codes());
+      bytes = static_cast<qint64>(mCompact.size()) * sizeof(unsigned short);
+    }
+  else
+    {
+      data = reinterpret_cast<const char *>(mITKImage->GetBufferPointer());
+      bytes = static_cast<qint64>(mITKImage->GetPixelContainer()->Size()) * sizeof(T);
+    }
+  if (data == NULL)  {  return false;  }
+
+  QFile file(fname);
+  if (! file.open(QIODevice::WriteOnly))  {  return false;  }
+  if (file.write(data, bytes) != bytes)
+    {
+      file.close();
+      file.remove();
+      return false;
+    }
+  file.close();
+
+  if (this->isCompact())
+    {  mCompact.releaseCodes();  }
+  else
+    {
+      this->statistics();
+      this->releaseITKBuffer();
+    }
+  mSpillFile = fname;
+  return true;
+}
+
+template<class T>
+bool Image<T>::reload()
+{
+  if (! this->isSpilled())  {  return true;  }
+
+  const bool statisticsValid = mStatisticsMTime != 0 && mStatisticsMTime == this->dataMTime();
+  const unsigned long n = mITKImage->GetBufferedRegion().GetNumberOfPixels();
+  char *data;
+  qint64 bytes;
+  if (this->isCompact())
+    {
+      mCompact.resize(n);
+      data = reinterpret_cast<char *>(mCompact.codes());
+      bytes = static_cast<qint64>(n) * sizeof(unsigned short);
+    }
+  else
+    {
+      mITKImage->Allocate();
+      data = reinterpret_cast<char *>(mITKImage->GetBufferPointer());
+      bytes = static_cast<qint64>(n) * sizeof(T);
+    }
+
+  QFile file(mSpillFile);
+  bool ok = file.open(QIODevice::ReadOnly) && file.read(data, bytes) == bytes;
+  file.close();
+  file.remove();
+  if (! ok)  {  std::fill(data, data + bytes, 0);  }
+  mSpillFile = QString();
+
+  if (! this->isCompact())
+    {
+      mITKImage->Modified();
+      this->connectITKImage();
+      mStatisticsMTime = (ok && statisticsValid) ? this->dataMTime() : 0;
+    }
+  return ok;
+}
+
+template<class T>
+bool Image<T>::compact()
+{
+  if (mCompactStorage == FullPrecision || ! mITKImage || this->isCompact() || this->isSpilled()
+      || this->isMapped())
+    {  return false;  }
+
+  const Statistics &stats = this->statistics();
+  mCompact.encode(mITKImage->GetBufferPointer(), mITKImage->GetBufferedRegion().GetNumberOfPixels(),
+                  mCompactStorage, stats.minimum, stats.maximum);
+  this->releaseITKBuffer();
+  return true;
+}
+
+template<class T>
+void Image<T>::expand()
+{
+  if (! this->isCompact())  {  return;  }
+  if (this->isSpilled())    {  this->reload();  }
+
+  mITKImage->Allocate();
+  mCompact.decode(mITKImage->GetBufferPointer());
+  mCompact.clear();
+
+  // The widened pixels are close to, but not always exactly, the
+  // original ones.
+  mITKImage->Modified();
+  this->connectITKImage();
+  this->invalidateStatistics();
+}
+
 template<class T>
 bool Image<T>::write(QString fname) const
 {
@@ -250,7 +629,7 @@ bool Image<T>::write(QString fname) const
     itk::ImageFileWriter<itkImageType>::New();
 
   writer->SetFileName(fname.toAscii());
-  writer->SetInput(mITKImage);
+  writer->SetInput(this->itkImage());
   writer->Update();
 
   return true;
@@ -264,10 +643,36 @@ Image<T>::getPixel(int i, int j, int k)  const
   pixelIndex[0] = i;
   pixelIndex[1] = j;
   pixelIndex[2] = k;
+  this->makeResident();
+  if (this->isCompact())
+    {  return static_cast<T>(this->compactPixel(pixelIndex));  }
   typename Image<T>::itkImageType::PixelType pixelValue = mITKImage->GetPixel(pixelIndex);
   return pixelValue;
 }
 
+template<class T>
+void Image<T>::makeResident() const
+{
+  if (this->isSpilled())  { const_cast<Image<T> *>(this)->reload(); }
+}
+
+template<class T>
+double Image<T>::compactPixel(typename itkImageType::IndexType index) const
+{
+  const typename itkImageType::RegionType &region = mITKImage->GetBufferedRegion();
+  unsigned long offset = 0;
+  unsigned long stride = 1;
+  for (unsigned int d = 0; d < 3; d++)
+    {
+      const long first = region.GetIndex()[d];
+      const long last = first + static_cast<long>(region.GetSize()[d]) - 1;
+      const long i = std::max(first, std::min(last, static_cast<long>(index[d])));
+      offset += static_cast<unsigned long>(i - first) * stride;
+      stride *= region.GetSize()[d];
+    }
+  return mCompact.value(offset);
+}
+
 template<class T>
 typename Image<T>::itkImageType::PixelType 
 Image<T>::getPixel(int ijk[3]) const
@@ -324,6 +729,35 @@ Image<T>::getLinearInterpolatedPixel(double point[3]) const
     {
       return 0.0f;
     }
+
+  this->makeResident();
+  if (this->isCompact())
+    {
+      // Blend the eight neighbors, widening each of them.
+      typename itkImageType::IndexType base;
+      double fraction[3];
+      for (unsigned int d = 0; d < 3; d++)
+        {
+          base[d] = static_cast<long>(std::floor(index[d]));
+          fraction[d] = index[d] - base[d];
+        }
+      double value = 0.0;
+      for (unsigned int corner = 0; corner < 8; corner++)
+        {
+          typename itkImageType::IndexType neighbor;
+          double weight = 1.0;
+          for (unsigned int d = 0; d < 3; d++)
+            {
+              const unsigned int bit = (corner >> d) & 1;
+              neighbor[d] = base[d] + bit;
+              weight *= bit ? fraction[d] : 1.0 - fraction[d];
+            }
+          if (weight != 0.0)  { value += weight * this->compactPixel(neighbor); }
+        }
+      return static_cast<T>(value);
+    }
+
+  if (! mLinearInterpolator)  { const_cast<Image<T> *>(this)->constructImageInterpolators(); }
   //mInterpolator->ConvertPointToContinuousIndex(p, index);
   return mLinearInterpolator->EvaluateAtContinuousIndex(index);
 }
@@ -345,11 +779,118 @@ Image<T>::getNearestInterpolatedPixel(double point[3]) const
     {
       return 0.0f;
     }
+
+  this->makeResident();
+  if (this->isCompact())
+    {
+      typename itkImageType::IndexType nearest;
+      for (unsigned int d = 0; d < 3; d++)
+        {  nearest[d] = static_cast<long>(std::floor(index[d] + 0.5));  }
+      return static_cast<T>(this->compactPixel(nearest));
+    }
   
+  if (! mNearestInterpolator)  { const_cast<Image<T> *>(this)->constructImageInterpolators(); }
   //mInterpolator->ConvertPointToContinuousIndex(p, index);
   return mNearestInterpolator->EvaluateAtContinuousIndex(index);
 }
 
+/** Samples the pixel buffer of an image at the points begin to end - 1
+    for Image::sample(), with the kernel of wseSampleKernel.hxx.  The
+    continuous index of a point p, relative to the first pixel of the
+    buffer, is matrix * p + offset. */
+template<class T>
+struct ImageSampleFunctor
+{
+  const T *buffer;
+  SampleGrid grid;
+  double matrix[3][3];
+  double offset[3];
+  bool linear;
+
+  const double *points;
+  T *values;
+
+  void operator()(unsigned long begin, unsigned long end, unsigned int) const
+  {
+    double index[3][SampleBlockSize];
+
+    for (unsigned long b = begin; b < end; b += SampleBlockSize)
+      {
+        const unsigned long m = std::min<unsigned long>(SampleBlockSize, end - b);
+
+        // The continuous indices of the block, one axis at a time
+        const double *p = points + 3 * b;
+        for (unsigned int a = 0; a < 3; a++)
+          {
+            const double m0 = matrix[a][0], m1 = matrix[a][1], m2 = matrix[a][2];
+            const double o = offset[a];
+            double *ia = index[a];
+            for (unsigned long i = 0; i < m; i++)
+              {
+                ia[i] = m0 * p[3 * i] + m1 * p[3 * i + 1] + m2 * p[3 * i + 2] + o;
+              }
+          }
+
+        T *out = values + b;
+        for (unsigned long i = 0; i < m; i++)
+          {
+            out[i] = static_cast<T>(sampleVoxels<double>(buffer, grid, index[0][i], index[1][i],
+                                                         index[2][i], linear));
+          }
+      }
+  }
+};
+
+template<class T>
+void Image<T>::sample(const double *points, unsigned long n, T *values, bool linear) const
+{
+  if (n == 0)  { return; }
+  if (! mITKImage)
+    {
+      std::fill(values, values + n, T(0));
+      return;
+    }
+
+  this->makeResident();
+  if (this->isCompact())
+    {
+      // Compact pixels are widened one point at a time.
+      for (unsigned long i = 0; i < n; i++)
+        {
+          double p[3] = { points[3 * i], points[3 * i + 1], points[3 * i + 2] };
+          values[i] = linear ? this->getLinearInterpolatedPixel(p) : this->getNearestInterpolatedPixel(p);
+        }
+      return;
+    }
+
+  // The continuous index is inverse(direction * spacing) * (p - origin),
+  // made relative to the start of the buffered region.
+  const typename itkImageType::RegionType &region = mITKImage->GetBufferedRegion();
+  const typename itkImageType::SpacingType &spacing = mITKImage->GetSpacing();
+  const typename itkImageType::PointType &origin = mITKImage->GetOrigin();
+  const vnl_matrix_fixed<double, 3, 3> inverse = mITKImage->GetDirection().GetInverse();
+
+  ImageSampleFunctor<T> f;
+  f.buffer = mITKImage->GetBufferPointer();
+  f.linear = linear;
+  f.points = points;
+  f.values = values;
+  std::ptrdiff_t stride = 1;
+  for (unsigned int a = 0; a < 3; a++)
+    {
+      f.grid.size[a] = static_cast<long>(region.GetSize()[a]);
+      f.grid.stride[a] = stride;
+      stride *= static_cast<std::ptrdiff_t>(region.GetSize()[a]);
+      f.offset[a] = -static_cast<double>(region.GetIndex()[a]);
+      for (unsigned int b = 0; b < 3; b++)
+        {
+          f.matrix[a][b] = inverse[a][b] / spacing[a];
+          f.offset[a] -= f.matrix[a][b] * origin[b];
+        }
+    }
+  parallelFor(n, f, 16 * SampleBlockSize);
+}
+
 template<class T>
 float Image<T>::getMinimumSpacing()  const
 {
@@ -360,32 +901,92 @@ float Image<T>::getMinimumSpacing()  const
   return isoSpacing;
 }
 
+/** Accumulates the statistics of each piece of a pixel buffer into
+    pieces[piece].  The loop body is branch free so that the compiler
+    can vectorize it. */
 template<class T>
-bool Image<T>::isBinarySegmentation()
+struct ImageStatisticsFunctor
 {
-  double *scalarRange = this->vtkImporter()->GetOutput()->GetScalarRange();
+  const T *buffer;
+  std::vector<ImageStatistics<T> > *pieces;
+
+  void operator()(unsigned long begin, unsigned long end, unsigned int piece) const
+  {
+    T lo = buffer[begin];
+    T hi = buffer[begin];
+    double sum = 0.0;
+    unsigned long nonBinary = 0;
+    for (unsigned long i = begin; i < end; i++)
+      {
+        const T v = buffer[i];
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+        sum += static_cast<double>(v);
+        nonBinary += (v != T(0)) & (v != T(1));
+      }
+
+    ImageStatistics<T> &s = (*pieces)[piece];
+    s.minimum = lo;
+    s.maximum = hi;
+    s.sum     = sum;
+    s.count   = end - begin;
+    s.binary  = (nonBinary == 0);
+  }
+};
 
-  if (scalarRange[0] != 0.0f || scalarRange[1] != 1.0f) 
-    {  return false; } 
-  else { return true; }
+template<class T>
+unsigned long Image<T>::dataMTime() const
+{
+  unsigned long t = mITKImage->GetMTime();
+  if (mITKImage->GetPixelContainer() != NULL)
+    { t = std::max(t, mITKImage->GetPixelContainer()->GetMTime()); }
+  return t;
 }
- 
+
 template<class T>
-T Image<T>::computeMaximumImageValue() const
+const typename Image<T>::Statistics &Image<T>::statistics() const
 {
-  itk::ImageRegionConstIterator<itkImageType> it(mITKImage, mITKImage->GetLargestPossibleRegion());
-  
-  T max = std::numeric_limits<T>::min();
-  it.GoToBegin();
-  while (! it.IsAtEnd() )
+  if (! mITKImage)
     {
-      if (it.Value() > max) max = it.Value();
-      ++it;
+      mStatistics = Statistics();
+      return mStatistics;
     }
 
-  return max;
-}
+  // The statistics of an image stored elsewhere were kept when its
+  // buffer was released.
+  if (this->isSpilled() || this->isCompact())
+    {  return mStatistics;  }
+  if (mStatisticsMTime != 0 && mStatisticsMTime == this->dataMTime())
+    {  return mStatistics;  }
+
+  const unsigned long n = mITKImage->GetBufferedRegion().GetNumberOfPixels();
+  const unsigned long grain = 1 << 16;
+  std::vector<Statistics> pieces(parallelNumberOfPieces(n, grain));
+
+  ImageStatisticsFunctor<T> f;
+  f.buffer = mITKImage->GetBufferPointer();
+  f.pieces = &pieces;
+  parallelFor(n, f, grain);
+
+  Statistics s;
+  bool first = true;
+  bool onlyZeroOne = true;
+  for (unsigned int i = 0; i < pieces.size(); i++)
+    {
+      if (pieces[i].count == 0) { continue; }
+      if (first || pieces[i].minimum < s.minimum) { s.minimum = pieces[i].minimum; }
+      if (first || pieces[i].maximum > s.maximum) { s.maximum = pieces[i].maximum; }
+      s.sum   += pieces[i].sum;
+      s.count += pieces[i].count;
+      onlyZeroOne = onlyZeroOne && pieces[i].binary;
+      first = false;
+    }
+  s.binary = (s.count > 0 && onlyZeroOne && s.minimum == T(0) && s.maximum == T(1));
 
+  mStatistics = s;
+  mStatisticsMTime = this->dataMTime();
+  return mStatistics;
+}
 
 // Define some standard types.
 typedef Image<float> FloatImage;
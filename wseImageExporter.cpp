@@ -0,0 +1,514 @@
+#include "wseImageExporter.h"
+#include "wseMappedImage.hxx"
+#include "wseParallel.hxx"
+
+#include "itk_zlib.h"
+#include "itkByteSwapper.h"
+#include "itkImageFileWriter.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <algorithm>
+#include <vector>
+
+namespace wse {
+
+//---------------------------------------------------------------------------
+// Parallel deflate
+//
+// The pixel data is cut into blocks of ExportBlockSize bytes.  Each block
+// is deflated on its own into raw deflate data that ends on a byte
+// boundary (Z_FULL_FLUSH), except the last one, which ends the stream
+// (Z_FINISH).  The blocks then concatenate into one valid deflate stream,
+// and their checksums combine into the checksum of the whole, so the
+// result is an ordinary zlib or gzip stream.
+//---------------------------------------------------------------------------
+static const size_t ExportBlockSize = 1 << 20;
+
+/** The number of blocks deflated together before they are written. */
+static const unsigned long ExportBlocksPerRound = 64;
+
+/** Fast compression: the noise in the low bits of float images leaves
+    little for the higher levels to gain. */
+static const int ExportCompressionLevel = 1;
+
+/** Deflates the blocks first to first + n - 1 of the data. */
+struct ExportDeflateBlocks
+{
+  const unsigned char *data;
+  size_t size;
+  size_t first;
+  size_t lastBlock;
+  bool gzip;
+  std::vector<std::vector<unsigned char> > *output;
+  std::vector<uLong> *checks;
+  std::vector<int> *errors;
+
+  void operator()(unsigned long begin, unsigned long end, unsigned int) const
+  {
+    for (unsigned long i = begin; i < end; i++)
+      {
+        const size_t block = first + i;
+        const size_t offset = block * ExportBlockSize;
+        const uInt length = static_cast<uInt>(std::min(ExportBlockSize, size - offset));
+        const Bytef *in = reinterpret_cast<const Bytef *>(data + offset);
+
+        (*checks)[i] = gzip ? crc32(crc32(0L, Z_NULL, 0), in, length)
+                            : adler32(adler32(0L, Z_NULL, 0), in, length);
+
+        z_stream stream;
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        if (deflateInit2(&stream, ExportCompressionLevel, Z_DEFLATED, -MAX_WBITS, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK)
+          {
+            (*errors)[i] = 1;
+            continue;
+          }
+
+        // The bound covers the flush marker as well.
+        std::vector<unsigned char> &out = (*output)[i];
+        out.resize(deflateBound(&stream, length) + 16);
+        stream.next_in = const_cast<Bytef *>(in);
+        stream.avail_in = length;
+        stream.next_out = &out[0];
+        stream.avail_out = out.size();
+        const int flush = (block == lastBlock) ? Z_FINISH : Z_FULL_FLUSH;
+        const int status = deflate(&stream, flush);
+        if ((flush == Z_FINISH && status != Z_STREAM_END)
+            || (flush != Z_FINISH && status != Z_OK) || stream.avail_in != 0)
+          {
+            (*errors)[i] = 1;
+          }
+        out.resize(out.size() - stream.avail_out);
+        deflateEnd(&stream);
+      }
+  }
+};
+
+/** Writes size bytes of data to file as one zlib (MetaImage) or gzip
+    (NRRD) stream.  Returns the number of bytes written, or -1. */
+static qint64 ExportDeflate(QFile &file, const unsigned char *data, size_t size,
+                            bool gzip, ImageExportProgress *progress)
+{
+  qint64 written = 0;
+  if (gzip)
+    {
+      // ID1 ID2 CM FLG MTIME(4) XFL OS
+      const unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 4, 255 };
+      if (file.write(reinterpret_cast<const char *>(header), 10) != 10) { return -1; }
+      written += 10;
+    }
+  else
+    {
+      // CMF FLG for a 32K window and the fastest level
+      const unsigned char header[2] = { 0x78, 0x01 };
+      if (file.write(reinterpret_cast<const char *>(header), 2) != 2) { return -1; }
+      written += 2;
+    }
+
+  const size_t blocks = std::max<size_t>(1, (size + ExportBlockSize - 1) / ExportBlockSize);
+  uLong check = gzip ? crc32(0L, Z_NULL, 0) : adler32(0L, Z_NULL, 0);
+
+  std::vector<std::vector<unsigned char> > output(ExportBlocksPerRound);
+  std::vector<uLong> checks(ExportBlocksPerRound);
+  std::vector<int> errors(ExportBlocksPerRound);
+  for (size_t first = 0; first < blocks; first += ExportBlocksPerRound)
+    {
+      const unsigned long n = static_cast<unsigned long>(std::min<size_t>(ExportBlocksPerRound, blocks - first));
+      std::fill(errors.begin(), errors.end(), 0);
+
+      ExportDeflateBlocks deflater;
+      deflater.data = data;
+      deflater.size = size;
+      deflater.first = first;
+      deflater.lastBlock = blocks - 1;
+      deflater.gzip = gzip;
+      deflater.output = &output;
+      deflater.checks = &checks;
+      deflater.errors = &errors;
+      parallelFor(n, deflater);
+
+      for (unsigned long i = 0; i < n; i++)
+        {
+          if (errors[i]) { return -1; }
+          const size_t length = std::min(ExportBlockSize, size - (first + i) * ExportBlockSize);
+          check = gzip ? crc32_combine(check, checks[i], length)
+                       : adler32_combine(check, checks[i], length);
+          const qint64 bytes = static_cast<qint64>(output[i].size());
+          if (bytes > 0 && file.write(reinterpret_cast<const char *>(&output[i][0]), bytes) != bytes)
+            {
+              return -1;
+            }
+          written += bytes;
+        }
+
+      if (progress && ! progress->update(static_cast<double>(first + n) / blocks))
+        {
+          return -1;
+        }
+    }
+
+  // gzip ends with the CRC and the length, little endian; zlib with the
+  // Adler-32, big endian.
+  unsigned char trailer[8];
+  int trailerLength;
+  if (gzip)
+    {
+      const unsigned long isize = static_cast<unsigned long>(size & 0xffffffffUL);
+      for (int i = 0; i < 4; i++)
+        {
+          trailer[i] = static_cast<unsigned char>((check >> (8 * i)) & 0xff);
+          trailer[4 + i] = static_cast<unsigned char>((isize >> (8 * i)) & 0xff);
+        }
+      trailerLength = 8;
+    }
+  else
+    {
+      for (int i = 0; i < 4; i++)
+        {
+          trailer[i] = static_cast<unsigned char>((check >> (8 * (3 - i))) & 0xff);
+        }
+      trailerLength = 4;
+    }
+  if (file.write(reinterpret_cast<const char *>(trailer), trailerLength) != trailerLength)
+    {
+      return -1;
+    }
+  return written + trailerLength;
+}
+
+static QString ExportNumber(double x)
+{
+  return QString::number(x, 'g', 17);
+}
+
+/** Replaces the file fname with the file temp.  The old file is only
+    unlinked, so an image that is still mapped from it keeps its
+    pages. */
+static bool ExportReplaceFile(const QString &temp, const QString &fname, QString &error)
+{
+  if (QFile::exists(fname) && ! QFile::remove(fname))
+    {
+      error = QObject::tr("%1 could not be replaced.").arg(fname);
+      QFile::remove(temp);
+      return false;
+    }
+  if (! QFile::rename(temp, fname))
+    {
+      error = QObject::tr("%1 could not be written.").arg(fname);
+      QFile::remove(temp);
+      return false;
+    }
+  return true;
+}
+
+/** Returns true if writing image to fname may overwrite a file that
+    the pixels of the image are mapped from: the file itself, or the
+    data file of a header of the same name. */
+static bool ExportOverwritesMapping(const FloatImage::itkImageType *image, const QString &fname)
+{
+  typedef FloatImage::itkImageType ImageType;
+  typedef MappedImageContainer<ImageType::PixelContainer::ElementIdentifier, float> ContainerType;
+
+  const ContainerType *container = dynamic_cast<const ContainerType *>(image->GetPixelContainer());
+  if (container == NULL)
+    {
+      return false;
+    }
+  const QFileInfo mapped(container->fileName());
+  const QFileInfo target(fname);
+  return mapped.absoluteFilePath() == target.absoluteFilePath()
+    || QDir(mapped.absolutePath()).filePath(mapped.completeBaseName())
+       == QDir(target.absolutePath()).filePath(target.completeBaseName());
+}
+
+bool writeCompressedImage(const FloatImage::itkImageType *image, const QString &fname,
+                          QString &error, ImageExportProgress *progress)
+{
+  typedef FloatImage::itkImageType ImageType;
+
+  const QString suffix = QFileInfo(fname).suffix().toLower();
+  const bool nrrd = (suffix == "nrrd");
+  if (! nrrd && suffix != "mha")
+    {
+      error = QObject::tr("Only .nrrd and .mha files can be written compressed.");
+      return false;
+    }
+
+  const ImageType::SizeType size = image->GetBufferedRegion().GetSize();
+  const ImageType::SpacingType spacing = image->GetSpacing();
+  const ImageType::PointType origin = image->GetOrigin();
+  const ImageType::DirectionType direction = image->GetDirection();
+  const bool bigEndian = itk::ByteSwapper<float>::SystemIsBigEndian();
+
+  // The image may be mapped from the file it is saved over, so the file
+  // is written under a temporary name and replaces the target at the
+  // end.
+  QFile file(fname + ".part");
+  if (! file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+      error = file.errorString();
+      return false;
+    }
+
+  // The MetaImage header gives the size of the compressed data, which
+  // is only known at the end.  It is written as a fixed width number
+  // and filled in afterwards.
+  QByteArray header;
+  qint64 compressedSizePosition = -1;
+  const int compressedSizeWidth = 20;
+  if (nrrd)
+    {
+      QString h("NRRD0004\n");
+      h += "type: float\n";
+      h += "dimension: 3\n";
+      h += "space: left-posterior-superior\n";
+      h += QString("sizes: %1 %2 %3\n").arg(size[0]).arg(size[1]).arg(size[2]);
+      h += "space directions:";
+      for (unsigned int i = 0; i < 3; i++)
+        {
+          h += QString(" (%1,%2,%3)").arg(ExportNumber(direction[0][i] * spacing[i]))
+            .arg(ExportNumber(direction[1][i] * spacing[i]))
+            .arg(ExportNumber(direction[2][i] * spacing[i]));
+        }
+      h += "\nkinds: domain domain domain\n";
+      h += bigEndian ? "endian: big\n" : "endian: little\n";
+      h += "encoding: gzip\n";
+      h += QString("space origin: (%1,%2,%3)\n\n").arg(ExportNumber(origin[0]))
+        .arg(ExportNumber(origin[1])).arg(ExportNumber(origin[2]));
+      header = h.toAscii();
+    }
+  else
+    {
+      QString h("ObjectType = Image\n");
+      h += "NDims = 3\n";
+      h += "BinaryData = True\n";
+      h += bigEndian ? "BinaryDataByteOrderMSB = True\n" : "BinaryDataByteOrderMSB = False\n";
+      h += "CompressedData = True\n";
+      h += "CompressedDataSize = ";
+      compressedSizePosition = h.length();
+      h += QString(compressedSizeWidth, '0') + "\n";
+      h += "TransformMatrix =";
+      for (unsigned int i = 0; i < 3; i++)
+        {
+          for (unsigned int j = 0; j < 3; j++)
+            {
+              h += " " + ExportNumber(direction[j][i]);
+            }
+        }
+      h += QString("\nOffset = %1 %2 %3\n").arg(ExportNumber(origin[0]))
+        .arg(ExportNumber(origin[1])).arg(ExportNumber(origin[2]));
+      h += "CenterOfRotation = 0 0 0\n";
+      h += QString("ElementSpacing = %1 %2 %3\n").arg(ExportNumber(spacing[0]))
+        .arg(ExportNumber(spacing[1])).arg(ExportNumber(spacing[2]));
+      h += QString("DimSize = %1 %2 %3\n").arg(size[0]).arg(size[1]).arg(size[2]);
+      h += "ElementType = MET_FLOAT\n";
+      h += "ElementDataFile = LOCAL\n";
+      header = h.toAscii();
+    }
+  if (file.write(header) != header.size())
+    {
+      error = file.errorString();
+      file.close();
+      file.remove();
+      return false;
+    }
+
+  // size_t, as unsigned long is 32 bits on Win64.
+  const size_t bytes = static_cast<size_t>(size[0]) * size[1] * size[2] * sizeof(float);
+  const qint64 compressed = ExportDeflate(file, reinterpret_cast<const unsigned char *>(
+                                            image->GetBufferPointer()), bytes, nrrd, progress);
+  if (compressed < 0)
+    {
+      error = (file.error() != QFile::NoError) ? file.errorString()
+        : QObject::tr("The volume could not be compressed.");
+      file.close();
+      file.remove();
+      return false;
+    }
+
+  if (compressedSizePosition >= 0)
+    {
+      const QByteArray number = QString("%1").arg(compressed, compressedSizeWidth, 10, QChar('0')).toAscii();
+      if (! file.seek(compressedSizePosition) || file.write(number) != number.size())
+        {
+          error = file.errorString();
+          file.close();
+          file.remove();
+          return false;
+        }
+    }
+  file.close();
+  return ExportReplaceFile(file.fileName(), fname, error);
+}
+
+//---------------------------------------------------------------------------
+// ImageExporter
+//---------------------------------------------------------------------------
+
+/** Runs one job of an ImageExporter on its thread pool. */
+class ImageExporterTask : public QRunnable
+{
+public:
+  ImageExporterTask(ImageExporter *exporter, int id) : mExporter(exporter), mId(id) {}
+  void run()  { mExporter->runJob(mId); }
+
+private:
+  ImageExporter *mExporter;
+  int mId;
+};
+
+/** Forwards the progress of writeCompressedImage() to an ImageExporter. */
+class ImageExporterProgress : public ImageExportProgress
+{
+public:
+  ImageExporterProgress(ImageExporter *exporter, int id)
+    : mExporter(exporter), mId(id), mPercent(-1) {}
+
+  bool update(double fraction)
+  {
+    const int percent = static_cast<int>(100.0 * fraction);
+    if (percent != mPercent)
+      {
+        mPercent = percent;
+        mExporter->reportProgress(mId, percent);
+      }
+    return ! mExporter->isCancelled(mId);
+  }
+
+private:
+  ImageExporter *mExporter;
+  int mId;
+  int mPercent;
+};
+
+ImageExporter::ImageExporter(QObject *parent)
+  : QObject(parent), mNextId(0), mPending(0)
+{
+  // One file at a time: each is already compressed on all threads.
+  mPool.setMaxThreadCount(1);
+}
+
+ImageExporter::~ImageExporter()
+{
+  this->cancel();
+  mPool.waitForDone();
+}
+
+int ImageExporter::save(FloatImage::itkImageType *image, const QString &fname)
+{
+  mMutex.lock();
+  const int id = mNextId++;
+  Job &job = mJobs[id];
+  job.fileName = fname;
+  job.image = image;
+  mPending++;
+  mMutex.unlock();
+
+  mPool.start(new ImageExporterTask(this, id));
+  return id;
+}
+
+void ImageExporter::cancel()
+{
+  QMutexLocker lock(&mMutex);
+  for (QMap<int, Job>::iterator it = mJobs.begin(); it != mJobs.end(); ++it)
+    {
+      it.value().cancelled = true;
+    }
+}
+
+bool ImageExporter::isSaving() const
+{
+  QMutexLocker lock(&mMutex);
+  return mPending > 0;
+}
+
+bool ImageExporter::isCancelled(int id) const
+{
+  QMutexLocker lock(&mMutex);
+  QMap<int, Job>::const_iterator it = mJobs.find(id);
+  return it == mJobs.end() || it.value().cancelled;
+}
+
+void ImageExporter::runJob(int id)
+{
+  mMutex.lock();
+  const QString fname = mJobs[id].fileName;
+  FloatImage::itkImageType::Pointer image = mJobs[id].image;
+  bool wasCancelled = mJobs[id].cancelled;
+  mMutex.unlock();
+
+  bool ok = false;
+  QString error;
+  if (! wasCancelled)
+    {
+      emit started(id, fname);
+
+      const QString suffix = QFileInfo(fname).suffix().toLower();
+      if (suffix == "nrrd" || suffix == "mha")
+        {
+          ImageExporterProgress progress(this, id);
+          ok = writeCompressedImage(image, fname, error, &progress);
+        }
+      else
+        {
+          try
+            {
+              // The writer truncates the target, which must not be a
+              // file the image is mapped from, so such an image is
+              // saved from a copy of its pixels.
+              FloatImage::itkImageType::Pointer input = image;
+              if (ExportOverwritesMapping(image, fname))
+                {
+                  input = FloatImage::itkImageType::New();
+                  input->CopyInformation(image);
+                  input->SetRegions(image->GetBufferedRegion());
+                  input->Allocate();
+                  std::copy(image->GetBufferPointer(),
+                            image->GetBufferPointer() + image->GetBufferedRegion().GetNumberOfPixels(),
+                            input->GetBufferPointer());
+                }
+
+              itk::ImageFileWriter<FloatImage::itkImageType>::Pointer writer =
+                itk::ImageFileWriter<FloatImage::itkImageType>::New();
+              writer->SetFileName(fname.toAscii());
+              writer->SetInput(input);
+              writer->SetUseCompression(true);
+              writer->Update();
+              ok = true;
+            }
+          catch (itk::ExceptionObject &e)
+            {
+              error = e.GetDescription();
+            }
+
+          // The writer cannot be stopped, so a file that was cancelled
+          // while it was written is removed once it is done.
+          if (this->isCancelled(id))
+            {
+              QFile::remove(fname);
+              ok = false;
+            }
+        }
+    }
+
+  // The result is reported under the lock, so that finished() is always
+  // queued after the results of every job.
+  QMutexLocker lock(&mMutex);
+  wasCancelled = mJobs[id].cancelled;
+  mJobs.remove(id);
+  if (ok)                 { emit saved(id, fname); }
+  else if (wasCancelled)  { emit cancelled(id, fname); }
+  else                    { emit failed(id, fname, error); }
+
+  mPending--;
+  if (mPending == 0)  { emit finished(); }
+}
+
+} // end namespace wse
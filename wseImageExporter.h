@@ -0,0 +1,127 @@
+#ifndef _wseImageExporter_h_
+#define _wseImageExporter_h_
+
+#include "wseImage.hxx"
+
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <QMap>
+
+namespace wse {
+
+class ImageExporterTask;
+
+/** Saves image volumes to disk on a worker thread, one file after the
+    other, so that saving never blocks the GUI.
+
+    NRRD (.nrrd) and MetaImage (.mha) files are written compressed by
+    writeCompressedImage(), which deflates blocks of the image on all
+    threads.  Other formats go through itk::ImageFileWriter with its
+    compression turned on, from a copy of the pixels if the image is
+    mapped from the file that is written.
+
+    Every file passed to save() gets a job id, which is reported by the
+    signals below.  The signals are emitted from the worker thread, so
+    connections to GUI objects are queued.  A job holds a reference to
+    the ITK image, so the image may be removed from the image stack
+    while it is being saved. */
+class ImageExporter : public QObject
+{
+  Q_OBJECT
+
+public:
+  ImageExporter(QObject *parent = 0);
+
+  /** Cancels the remaining jobs and waits for the running one. */
+  ~ImageExporter();
+
+  /** Queues the image for saving to fname and returns the id of the
+      job. */
+  int save(FloatImage::itkImageType *image, const QString &fname);
+
+  /** Cancels all jobs that have not finished.  A file that was being
+      written is removed. */
+  void cancel();
+
+  /** Returns true if any job has not yet finished. */
+  bool isSaving() const;
+
+signals:
+  /** The worker has started to write job "id". */
+  void started(int id, QString fileName);
+
+  /** Job "id" is "percent" done. */
+  void progress(int id, int percent);
+
+  /** The file of job "id" has been written. */
+  void saved(int id, QString fileName);
+
+  /** The file of job "id" could not be written. */
+  void failed(int id, QString fileName, QString error);
+
+  /** Job "id" was cancelled. */
+  void cancelled(int id, QString fileName);
+
+  /** Every queued job has finished. */
+  void finished();
+
+protected:
+  friend class ImageExporterTask;
+
+  /** Writes the file of job "id".  Called on the worker thread. */
+  void runJob(int id);
+
+  /** Returns true if job "id" has been cancelled. */
+  bool isCancelled(int id) const;
+
+  /** Emits the progress of job "id". */
+  void reportProgress(int id, int percent)
+  { emit progress(id, percent); }
+
+private:
+  /** The state of one file. */
+  struct Job
+  {
+    Job() : cancelled(false) {}
+    QString fileName;
+    FloatImage::itkImageType::Pointer image;
+    bool cancelled;
+  };
+
+  QThreadPool mPool;
+
+  /** Guards mJobs, mNextId and mPending. */
+  mutable QMutex mMutex;
+  QMap<int, Job> mJobs;
+  int mNextId;
+
+  /** The number of jobs that have not finished. */
+  int mPending;
+};
+
+/** Reports the progress of writeCompressedImage(), and asks it to stop
+    by returning false. */
+class ImageExportProgress
+{
+public:
+  virtual ~ImageExportProgress() {}
+  virtual bool update(double fraction) = 0;
+};
+
+/** Writes a float image as a gzip encoded NRRD (.nrrd) or a compressed
+    MetaImage (.mha), depending on the suffix of fname.
+
+    The pixel data is cut into blocks that are deflated concurrently and
+    joined into a single deflate stream, so the file is read by any
+    NRRD or MetaImage reader.  The file is written under a temporary
+    name in the same directory and then replaces fname, so an image
+    that is mapped from fname may be saved over it.  Returns false with an error message if
+    the suffix is not .nrrd or .mha, if the file cannot be written, or
+    if progress asked to stop. */
+bool writeCompressedImage(const FloatImage::itkImageType *image, const QString &fname,
+                          QString &error, ImageExportProgress *progress = NULL);
+
+} // end namespace wse
+
+#endif
@@ -0,0 +1,205 @@
+#include "wseImageLoader.h"
+
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <algorithm>
+#include <typeinfo>
+
+namespace wse {
+
+/** Runs one job of an ImageLoader on its thread pool. */
+class ImageLoaderTask : public QRunnable
+{
+public:
+  ImageLoaderTask(ImageLoader *loader, int id) : mLoader(loader), mId(id) {}
+  void run()  { mLoader->runJob(mId); }
+
+private:
+  ImageLoader *mLoader;
+  int mId;
+};
+
+/** Forwards the ProgressEvent of a reader to its ImageLoader, and asks
+    the reader to stop once the job has been cancelled. */
+class ImageLoaderProgress : public itk::Command
+{
+public:
+  typedef ImageLoaderProgress Self;
+  typedef itk::Command Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+  itkNewMacro(Self);
+
+  void setJob(ImageLoader *loader, int id)
+  {
+    mLoader = loader;
+    mId = id;
+    mPercent = -1;
+  }
+
+  void Execute(itk::Object *caller, const itk::EventObject &event)
+  {
+    Execute((const itk::Object *)caller, event);
+  }
+
+  void Execute(const itk::Object *caller, const itk::EventObject &event)
+  {
+    const itk::ProcessObject *process = dynamic_cast<const itk::ProcessObject *>(caller);
+    if (process == NULL || typeid(event) != typeid(itk::ProgressEvent))
+      {
+        return;
+      }
+
+    // Only whole percents are reported, to keep the event queue short.
+    const int percent = static_cast<int>(100.0f * process->GetProgress());
+    if (percent != mPercent)
+      {
+        mPercent = percent;
+        mLoader->reportProgress(mId, percent);
+      }
+    if (mLoader->isCancelled(mId))
+      {
+        const_cast<itk::ProcessObject *>(process)->AbortGenerateDataOn();
+      }
+  }
+
+protected:
+  ImageLoaderProgress() : mLoader(NULL), mId(0), mPercent(-1) {}
+
+private:
+  ImageLoader *mLoader;
+  int mId;
+  int mPercent;
+};
+
+ImageLoader::ImageLoader(QObject *parent)
+  : QObject(parent), mNextId(0), mPending(0)
+{
+  // Reading is limited by the disk and by decompression, which a few
+  // concurrent readers keep busy without making the disk seek between
+  // too many files.
+  mPool.setMaxThreadCount(std::max(1, std::min(QThread::idealThreadCount(), 4)));
+}
+
+ImageLoader::~ImageLoader()
+{
+  this->cancel();
+  mPool.waitForDone();
+
+  for (QMap<int, Job>::iterator it = mJobs.begin(); it != mJobs.end(); ++it)
+    {
+      delete it.value().image;
+    }
+}
+
+int ImageLoader::load(const QStringList &files)
+{
+  if (files.isEmpty())  { return -1; }
+
+  mMutex.lock();
+  const int first = mNextId;
+  for (int i = 0; i < files.size(); i++)
+    {
+      mJobs[mNextId++].fileName = files.at(i);
+      mPending++;
+    }
+  mMutex.unlock();
+
+  for (int i = 0; i < files.size(); i++)
+    {
+      mPool.start(new ImageLoaderTask(this, first + i));
+    }
+  return first;
+}
+
+void ImageLoader::cancel()
+{
+  // Queued tasks still run, but only to report their job as cancelled.
+  QMutexLocker lock(&mMutex);
+  for (QMap<int, Job>::iterator it = mJobs.begin(); it != mJobs.end(); ++it)
+    {
+      if (! it.value().done)  { it.value().cancelled = true; }
+    }
+}
+
+bool ImageLoader::isLoading() const
+{
+  QMutexLocker lock(&mMutex);
+  return mPending > 0;
+}
+
+bool ImageLoader::isCancelled(int id) const
+{
+  QMutexLocker lock(&mMutex);
+  QMap<int, Job>::const_iterator it = mJobs.find(id);
+  return it == mJobs.end() || it.value().cancelled;
+}
+
+FloatImage *ImageLoader::takeImage(int id)
+{
+  QMutexLocker lock(&mMutex);
+  QMap<int, Job>::iterator it = mJobs.find(id);
+  if (it == mJobs.end() || it.value().image == NULL)  { return NULL; }
+
+  FloatImage *img = it.value().image;
+  mJobs.erase(it);
+  return img;
+}
+
+void ImageLoader::runJob(int id)
+{
+  mMutex.lock();
+  const QString fname = mJobs[id].fileName;
+  bool wasCancelled = mJobs[id].cancelled;
+  mMutex.unlock();
+
+  FloatImage *img = NULL;
+  QString error;
+  if (! wasCancelled)
+    {
+      emit started(id);
+
+      ImageLoaderProgress::Pointer observer = ImageLoaderProgress::New();
+      observer->setJob(this, id);
+      // Only ITK runs here.  The VTK pipeline of the image is built when
+      // the GUI thread first displays it.
+      img = new FloatImage();
+      try
+        {
+          if (! img->read(fname, observer))  { error = tr("The file contains no image."); }
+        }
+      catch (itk::ExceptionObject &e)
+        {
+          error = e.GetDescription();
+        }
+      if (! error.isEmpty())
+        {
+          delete img;
+          img = NULL;
+        }
+    }
+
+  // The result is reported under the lock, so that finished() is always
+  // queued after the results of every job.
+  QMutexLocker lock(&mMutex);
+  Job &job = mJobs[id];
+  wasCancelled = job.cancelled;
+  if (wasCancelled || img == NULL)
+    {
+      delete img;
+      mJobs.remove(id);
+      if (wasCancelled)  { emit cancelled(id, fname); }
+      else               { emit failed(id, fname, error); }
+    }
+  else
+    {
+      job.done = true;
+      job.image = img;
+      emit loaded(id);
+    }
+
+  mPending--;
+  if (mPending == 0)  { emit finished(); }
+}
+
+} // end namespace wse
@@ -0,0 +1,107 @@
+#ifndef _wseImageLoader_h_
+#define _wseImageLoader_h_
+
+#include "wseImage.hxx"
+
+#include <QObject>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <QMap>
+
+namespace wse {
+
+class ImageLoaderTask;
+
+/** Loads image volumes from disk on a pool of worker threads, so that
+    importing several files neither blocks the GUI nor reads them one
+    after the other.
+
+    Every file passed to load() gets a job id, which is reported by the
+    signals below as the job goes through the queue.  The signals are
+    emitted from the worker threads, so connections to GUI objects are
+    queued.  An image that has loaded is kept by the loader until it is
+    collected with takeImage().  Jobs that have not finished when
+    cancel() is called are dropped, and their files are reported as
+    cancelled. */
+class ImageLoader : public QObject
+{
+  Q_OBJECT
+
+public:
+  ImageLoader(QObject *parent = 0);
+
+  /** Cancels the remaining jobs and waits for the running ones. */
+  ~ImageLoader();
+
+  /** Queues the files for loading and returns the id of the job of the
+      first one.  The others get consecutive ids. */
+  int load(const QStringList &files);
+
+  /** Cancels all jobs that have not finished. */
+  void cancel();
+
+  /** Returns true if any job has not yet finished. */
+  bool isLoading() const;
+
+  /** Returns the image of a job that has loaded, and passes its
+      ownership to the caller.  Returns NULL for any other job. */
+  FloatImage *takeImage(int id);
+
+signals:
+  /** A worker has started to read the file of job "id". */
+  void started(int id);
+
+  /** The reader of job "id" reported "percent" progress. */
+  void progress(int id, int percent);
+
+  /** The image of job "id" is ready for takeImage(). */
+  void loaded(int id);
+
+  /** The file of job "id" could not be read. */
+  void failed(int id, QString fileName, QString error);
+
+  /** Job "id" was cancelled. */
+  void cancelled(int id, QString fileName);
+
+  /** Every queued job has finished. */
+  void finished();
+
+protected:
+  friend class ImageLoaderTask;
+
+  /** Loads the file of job "id".  Called on a worker thread. */
+  void runJob(int id);
+
+  /** Returns true if job "id" has been cancelled. */
+  bool isCancelled(int id) const;
+
+  /** Emits the progress of job "id". */
+  void reportProgress(int id, int percent)
+  { emit progress(id, percent); }
+
+private:
+  /** The state of one file. */
+  struct Job
+  {
+    Job() : cancelled(false), done(false), image(NULL) {}
+    QString fileName;
+    bool cancelled;
+    bool done;
+    FloatImage *image;
+  };
+
+  QThreadPool mPool;
+
+  /** Guards mJobs, mNextId and mPending. */
+  mutable QMutex mMutex;
+  QMap<int, Job> mJobs;
+  int mNextId;
+
+  /** The number of jobs that have not finished. */
+  int mPending;
+};
+
+} // end namespace wse
+
+#endif
@@ -8,23 +8,40 @@ namespace wse {
 
 /** This is a convenience class for managing a stack of wse::Image
     pointers. It includes the concept of a "currently selected" image.
-    Useful for underneath GUIs. */
+    Useful for underneath GUIs.
+
+    The stack owns its images and keeps the memory they hold within a
+    budget.  Images that are not pinned are stored compactly if their
+    compact storage allows it (see Image::compact()).  When the budget
+    is still exceeded, the pixel buffers of the
+    least recently used images that are not pinned are spilled to raw
+    files in the cache directory (see Image::spill()).  Images mapped
+    from their files are not counted against the budget and are never
+    spilled.  A spilled image
+    is read back when it is next returned by image() or
+    selectedImage(), so callers never see an image without its
+    pixels. */
 template <class T>
 class imageStack : public QObject
 {
 
 public:
-  imageStack() : mSelectedImage(-1) {}
+  imageStack() : mSelectedImage(-1), mClock(0), mMemoryBudget(0), mSpillCount(0)
+  {  mCacheDirectory = QDir::tempPath();  }
   ~imageStack();
 
   /** Returns the number of images in the stack. */
   int numImages() const { return mImages.size(); }
 
-  /** Adds a wse::Image pointer to the stack. */
+  /** Adds a wse::Image pointer to the stack.  The stack takes
+      ownership of the image. */
   bool addImage(Image<T> *img) 
   {
     mImages.push_back(img); 
+    mLastUsed.push_back(++mClock);
+    mPinned.push_back(false);
     mSelectedImage = mImages.size()-1;
+    this->enforceMemoryBudget(mSelectedImage);
     return true;
   }
 
@@ -44,6 +61,14 @@ public:
   Image<T> *selectedImage();
   const Image<T> *selectedImage() const;
 
+  /** Returns the index of the image "img" in the stack, or -1 if it
+      is not in the stack.  Unlike image(), neither this nor
+      imageWithoutReload() reloads a spilled image or marks it as used,
+      so images can be kept track of without loading them. */
+  int indexOf(const Image<T> *img) const;
+  const Image<T> *imageWithoutReload(unsigned int i) const
+  {  return (i < mImages.size()) ? mImages[i] : NULL;  }
+
   /** Returns the image color at location "i" in the stack. */
   QColor imageColor(unsigned int i) const;
 
@@ -64,23 +89,73 @@ public:
   vtkImageImport *selectedImageVTK()
   {   return mImages[mSelectedImage]->vtkImporter();  }
   const vtkImageImport *selectedImageVTK() const
-  {   return mImages[mSelectedImage]->vtkImporter();  }
+  {   return this->selectedImage()->vtkImporter();  }
+
+  /** Sets the number of bytes of pixel data the images may hold in
+      memory.  A budget of 0, the default, is unlimited. */
+  void setMemoryBudget(qint64 bytes)
+  {
+    mMemoryBudget = bytes;
+    this->enforceMemoryBudget(-1);
+  }
+  qint64 memoryBudget() const { return mMemoryBudget; }
+
+  /** Sets the directory that spilled images are written to.  The
+      default is the system temporary directory. */
+  void setCacheDirectory(const QString &dir) { mCacheDirectory = dir; }
+  QString cacheDirectory() const { return mCacheDirectory; }
+
+  /** Returns the number of bytes of pixel data held in memory by all
+      of the images in the stack. */
+  qint64 residentBytes() const;
+
+  /** A pinned image keeps its VTK pipeline and its full precision
+      pixels and is never spilled, for example because it is connected
+      to a viewer.  Pins move with the image when images
+      before it are removed. */
+  void setPinned(unsigned int i, bool pinned)
+  {  if (i < mPinned.size())  { mPinned[i] = pinned; }  }
+  void clearPins()
+  {  std::fill(mPinned.begin(), mPinned.end(), false);  }
+
+  /** Releases the VTK pipelines of the images that are not pinned and
+      compacts them, then spills the least recently used of them until
+      the resident bytes are within the budget.  Image "keep" is left
+      alone.  This is done whenever an image is added or reloaded; call
+      it after changing the pins. */
+  void enforceMemoryBudget(int keep = -1);
 
 private:
   /** Convert an ITK 2D image to a QImage */
   //  QImage ITKImageToQImage(Image::itkFloatImage::Pointer img);
 
+  /** Reloads image "i" if it has been spilled and marks it as the most
+      recently used. */
+  void touch(unsigned int i);
+
   int mSelectedImage;
   std::vector<Image<T> *> mImages;
+
+  /** The value of mClock when each image was last used, and whether
+      each image is pinned. */
+  std::vector<unsigned long> mLastUsed;
+  std::vector<bool> mPinned;
+  unsigned long mClock;
+
+  qint64 mMemoryBudget;
+  QString mCacheDirectory;
+
+  /** Numbers the files of spilled images. */
+  unsigned long mSpillCount;
 };
 
 template<class T>
 imageStack<T>::~imageStack()
 {
-  // TODO: Clean up images stored in this stack
+  // Deleting an image also removes its spill file.
   for (unsigned int i = 0; i < mImages.size(); i++)
     {
-      //      delete mImages[i];
+      delete mImages[i];
     }
 }
 
@@ -88,11 +163,80 @@ template<class T>
 bool imageStack<T>::addImage(QString fname)
 {
   Image<T> *img = new Image<T>();
-  if (!img->read(fname))  return false;
-  mImages.push_back(img);
+  if (!img->read(fname))
+    {
+      delete img;
+      return false;
+    }
+  return this->addImage(img);
+}
 
-  mSelectedImage = mImages.size()-1;
-  return true;
+template<class T>
+qint64 imageStack<T>::residentBytes() const
+{
+  qint64 bytes = 0;
+  for (unsigned int i = 0; i < mImages.size(); i++)
+    {
+      bytes += mImages[i]->residentBytes();
+    }
+  return bytes;
+}
+
+template<class T>
+void imageStack<T>::touch(unsigned int i)
+{
+  mLastUsed[i] = ++mClock;
+  if (mImages[i]->isSpilled())
+    {
+      if (! mImages[i]->reload())
+        {
+          qWarning("Could not reload the image %s from the disk cache.",
+                   mImages[i]->name().toAscii().constData());
+        }
+      this->enforceMemoryBudget(i);
+    }
+}
+
+template<class T>
+void imageStack<T>::enforceMemoryBudget(int keep)
+{
+  // Images that are not displayed need no VTK pipeline.
+  for (unsigned int i = 0; i < mImages.size(); i++)
+    {
+      if ((int) i != keep && ! mPinned[i])
+        {
+          mImages[i]->releasePipeline();
+          mImages[i]->compact();
+        }
+    }
+
+  if (mMemoryBudget <= 0)  { return; }
+
+  qint64 resident = this->residentBytes();
+  while (resident > mMemoryBudget)
+    {
+      int oldest = -1;
+      for (unsigned int i = 0; i < mImages.size(); i++)
+        {
+          if ((int) i == keep || mPinned[i] || mImages[i]->isMapped()
+              || mImages[i]->residentBytes() == 0)
+            { continue; }
+          if (oldest == -1 || mLastUsed[i] < mLastUsed[oldest])
+            { oldest = i; }
+        }
+      if (oldest == -1)  { return; }
+
+      const qint64 bytes = mImages[oldest]->residentBytes();
+      const QString fname = QDir(mCacheDirectory).filePath(
+        QString("wse-%1-%2.raw").arg(QCoreApplication::applicationPid()).arg(mSpillCount++));
+      if (! mImages[oldest]->spill(fname))
+        {
+          qWarning("Could not spill the image %s to %s.",
+                   mImages[oldest]->name().toAscii().constData(), fname.toAscii().constData());
+          return;
+        }
+      resident -= bytes;
+    }
 }
 
 template<class T>
@@ -104,7 +248,10 @@ bool imageStack<T>::removeImage(QString fname)
     {
       delete mImages[i];
       mImages.erase(mImages.begin()+i);
+      mLastUsed.erase(mLastUsed.begin()+i);
+      mPinned.erase(mPinned.begin()+i);
       if (mSelectedImage == (int) i) { mSelectedImage = -1; }
+      else if (mSelectedImage > (int) i) { mSelectedImage--; }
       return true;
     }
   }
@@ -116,7 +263,7 @@ template<class T>
 Image<T> *imageStack<T>::selectedImage()
 {
   if (mSelectedImage >= 0)
-    {    return mImages[mSelectedImage];  }
+    {    return this->image(mSelectedImage);  }
   else
     return NULL;
 }
@@ -124,26 +271,35 @@ Image<T> *imageStack<T>::selectedImage()
 template<class T>
 const Image<T> *imageStack<T>::selectedImage() const
 {
-  if (mSelectedImage >= 0)
-    {  return mImages[mSelectedImage];   }
-  else
-    return NULL;
+  // Reloading a spilled image does not change what the stack holds.
+  return const_cast<imageStack<T> *>(this)->selectedImage();
 }
 
 template<class T>
 Image<T> *imageStack<T>::image(unsigned int i)
 {
   if (i >= 0 && i < mImages.size())
-    {    return mImages[i];    }
+    {
+      this->touch(i);
+      return mImages[i];
+    }
   else return NULL;
 }
 
 template<class T>
 const Image<T> *imageStack<T>::image(unsigned int i) const
 {
-  if (i >= 0 && i < mImages.size())
-    {    return mImages[i];    }
-  else return NULL;
+  return const_cast<imageStack<T> *>(this)->image(i);
+}
+
+template<class T>
+int imageStack<T>::indexOf(const Image<T> *img) const
+{
+  for (unsigned int i = 0; i < mImages.size(); i++)
+    {
+      if (mImages[i] == img)  { return i; }
+    }
+  return -1;
 }
 
 template<class T>
@@ -0,0 +1,269 @@
+#include "wseMappedImage.hxx"
+
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace wse {
+
+MetaImageHeader::MetaImageHeader()
+  : dimensions(0), channels(1), compressed(false), bigEndian(false),
+    dataOffset(0), headerSize(0)
+{
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      size[i] = 1;
+      spacing[i] = 1.0;
+      origin[i] = 0.0;
+    }
+  for (unsigned int i = 0; i < 9; i++)
+    {
+      transform[i] = (i % 4 == 0) ? 1.0 : 0.0;
+    }
+}
+
+/** Parses up to n numbers from a header value.  Returns the number of
+    values parsed. */
+template <class T>
+static unsigned int MetaImageValues(const QString &value, T *values, unsigned int n)
+{
+  QStringList fields = value.split(' ', QString::SkipEmptyParts);
+  unsigned int count = 0;
+  for (int i = 0; i < fields.size() && count < n; i++, count++)
+    {
+      bool ok = false;
+      values[count] = static_cast<T>(fields.at(i).toDouble(&ok));
+      if (! ok) { break; }
+    }
+  return count;
+}
+
+static bool MetaImageTrue(const QString &value)
+{
+  return value.compare("True", Qt::CaseInsensitive) == 0 || value == "1";
+}
+
+bool readMetaImageHeader(const QString &fname, MetaImageHeader &header)
+{
+  const QString suffix = QFileInfo(fname).suffix().toLower();
+  if (suffix != "mha" && suffix != "mhd")
+    {
+      return false;
+    }
+
+  QFile file(fname);
+  if (! file.open(QIODevice::ReadOnly))
+    {
+      return false;
+    }
+
+  // The header is text and ends with ElementDataFile.  Anything much
+  // longer than a header is not one.
+  const qint64 maximumHeaderLength = 65536;
+  while (file.pos() < maximumHeaderLength)
+    {
+      QByteArray line = file.readLine(4096);
+      if (line.isEmpty())
+        {
+          return false;
+        }
+      const int equals = line.indexOf('=');
+      if (equals < 0)
+        {
+          continue;
+        }
+      const QString key = QString::fromAscii(line.left(equals)).trimmed();
+      const QString value = QString::fromAscii(line.mid(equals + 1)).trimmed();
+
+      if (key == "ObjectType")
+        {
+          if (value != "Image") { return false; }
+        }
+      else if (key == "NDims")
+        {
+          header.dimensions = value.toUInt();
+          if (header.dimensions < 2 || header.dimensions > 3) { return false; }
+        }
+      else if (key == "DimSize")
+        {
+          if (MetaImageValues(value, header.size, 3) != header.dimensions) { return false; }
+        }
+      else if (key == "ElementSpacing")
+        {
+          MetaImageValues(value, header.spacing, 3);
+        }
+      else if (key == "Offset" || key == "Origin" || key == "Position")
+        {
+          MetaImageValues(value, header.origin, 3);
+        }
+      else if (key == "TransformMatrix" || key == "Rotation" || key == "Orientation")
+        {
+          // A 2D matrix is the upper left of the 3D one.
+          double m[9];
+          const unsigned int d = header.dimensions;
+          if (d != 0 && MetaImageValues(value, m, d * d) == d * d)
+            {
+              for (unsigned int i = 0; i < d; i++)
+                {
+                  for (unsigned int j = 0; j < d; j++)
+                    {
+                      header.transform[3 * i + j] = m[d * i + j];
+                    }
+                }
+            }
+        }
+      else if (key == "ElementType")
+        {
+          header.elementType = value.toStdString();
+        }
+      else if (key == "ElementNumberOfChannels")
+        {
+          header.channels = value.toUInt();
+        }
+      else if (key == "CompressedData")
+        {
+          header.compressed = MetaImageTrue(value);
+        }
+      else if (key == "BinaryData")
+        {
+          if (! MetaImageTrue(value)) { return false; }
+        }
+      else if (key == "BinaryDataByteOrderMSB" || key == "ElementByteOrderMSB")
+        {
+          header.bigEndian = MetaImageTrue(value);
+        }
+      else if (key == "HeaderSize")
+        {
+          header.headerSize = value.toLongLong();
+        }
+      else if (key == "ElementDataFile")
+        {
+          if (header.dimensions == 0)
+            {
+              return false;
+            }
+          if (value == "LOCAL")
+            {
+              header.dataFile = fname;
+              header.dataOffset = file.pos();
+              return true;
+            }
+
+          // Lists and patterns of slice files cannot be mapped as one.
+          if (value == "LIST" || value.contains('%') || value.contains(' '))
+            {
+              return false;
+            }
+          QFileInfo data(value);
+          header.dataFile = data.isAbsolute() ? value
+            : QFileInfo(fname).dir().filePath(value);
+          header.dataOffset = header.headerSize > 0 ? header.headerSize : 0;
+          return true;
+        }
+    }
+  return false;
+}
+
+MappedFile::MappedFile()
+  : mBase(NULL), mBaseLength(0), mData(NULL), mLength(0)
+#ifdef _WIN32
+  , mFile(INVALID_HANDLE_VALUE), mMapping(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+  this->close();
+}
+
+bool MappedFile::open(const QString &fname, qint64 offset, qint64 length)
+{
+  this->close();
+  if (offset < 0 || length <= 0 || QFileInfo(fname).size() < offset + length)
+    {
+      return false;
+    }
+
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  const qint64 alignedOffset = offset - offset % info.dwAllocationGranularity;
+
+  mFile = CreateFileW(reinterpret_cast<const wchar_t *>(fname.utf16()), GENERIC_READ,
+                      FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (mFile == INVALID_HANDLE_VALUE)
+    {
+      return false;
+    }
+  mMapping = CreateFileMappingW(mFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  if (mMapping == NULL)
+    {
+      this->close();
+      return false;
+    }
+  mBaseLength = length + (offset - alignedOffset);
+  mBase = MapViewOfFile(mMapping, FILE_MAP_COPY, static_cast<DWORD>(alignedOffset >> 32),
+                        static_cast<DWORD>(alignedOffset & 0xffffffff),
+                        static_cast<SIZE_T>(mBaseLength));
+  if (mBase == NULL)
+    {
+      this->close();
+      return false;
+    }
+#else
+  const qint64 page = sysconf(_SC_PAGESIZE);
+  const qint64 alignedOffset = offset - offset % page;
+
+  const int fd = ::open(QFile::encodeName(fname).constData(), O_RDONLY);
+  if (fd < 0)
+    {
+      return false;
+    }
+
+  // A private mapping is copy-on-write, so it may be writable although
+  // the file is only open for reading.  The mapping outlives the file
+  // descriptor.
+  mBaseLength = length + (offset - alignedOffset);
+  void *base = mmap(NULL, static_cast<size_t>(mBaseLength), PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fd, static_cast<off_t>(alignedOffset));
+  ::close(fd);
+  if (base == MAP_FAILED)
+    {
+      mBaseLength = 0;
+      return false;
+    }
+  mBase = base;
+#endif
+
+  mData = static_cast<char *>(mBase) + (offset - alignedOffset);
+  mLength = length;
+  return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+  if (mBase)                        { UnmapViewOfFile(mBase); }
+  if (mMapping)                     { CloseHandle(mMapping); }
+  if (mFile != INVALID_HANDLE_VALUE) { CloseHandle(mFile); }
+  mMapping = NULL;
+  mFile = INVALID_HANDLE_VALUE;
+#else
+  if (mBase)  { munmap(mBase, static_cast<size_t>(mBaseLength)); }
+#endif
+  mBase = NULL;
+  mBaseLength = 0;
+  mData = NULL;
+  mLength = 0;
+}
+
+} // end namespace wse
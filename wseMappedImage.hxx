@@ -0,0 +1,217 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    wseMappedImage.hxx
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+#ifndef _wse_mapped_image_hxx
+#define _wse_mapped_image_hxx
+
+#include <QFileInfo>
+#include <QString>
+#include <QtGlobal>
+#include <string>
+
+#include "itkImage.h"
+#include "itkImportImageContainer.h"
+#include "itkByteSwapper.h"
+
+namespace wse {
+
+/** The fields of a MetaImage (.mha or .mhd) header that are needed to
+    map its pixel data into memory. */
+struct MetaImageHeader
+{
+  MetaImageHeader();
+
+  unsigned int dimensions;
+  unsigned long size[3];
+  double spacing[3];
+  double origin[3];
+
+  /** The direction cosines, row major as written in the file. */
+  double transform[9];
+
+  std::string elementType;
+  unsigned int channels;
+  bool compressed;
+  bool bigEndian;
+
+  /** The file that holds the pixel data, and the byte offset of the
+      data in it.  For .mha files this is the header file itself. */
+  QString dataFile;
+  qint64 dataOffset;
+
+  /** The HeaderSize field: -1 means the data ends the data file. */
+  qint64 headerSize;
+};
+
+/** Reads the header of the MetaImage fname.  Returns false if the file
+    is not a MetaImage whose data lies in a single file. */
+bool readMetaImageHeader(const QString &fname, MetaImageHeader &header);
+
+/** A read-only file mapped into memory with copy-on-write pages, so
+    that writing to the memory never changes the file. */
+class MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+
+  /** Maps length bytes of the file from offset.  Returns false if the
+      file is too short or cannot be mapped. */
+  bool open(const QString &fname, qint64 offset, qint64 length);
+  void close();
+
+  void *data() const { return mData; }
+  qint64 length() const { return mLength; }
+
+private:
+  MappedFile(const MappedFile &);  // Not implemented.
+  void operator=(const MappedFile &);  // Not implemented.
+
+  /** The start of the mapping, which is aligned to the page size and
+      so may lie before mData. */
+  void *mBase;
+  qint64 mBaseLength;
+  void *mData;
+  qint64 mLength;
+#ifdef _WIN32
+  void *mFile;
+  void *mMapping;
+#endif
+};
+
+/** An itk::ImportImageContainer whose elements are a file mapped into
+    memory.  The mapping is released with the container.  Like any
+    imported container, it copies its elements into its own memory if
+    it needs to grow. */
+template <typename TElementIdentifier, typename TElement>
+class MappedImageContainer : public itk::ImportImageContainer<TElementIdentifier, TElement>
+{
+public:
+  typedef MappedImageContainer Self;
+  typedef itk::ImportImageContainer<TElementIdentifier, TElement> Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+  itkNewMacro(Self);
+  itkTypeMacro(MappedImageContainer, ImportImageContainer);
+
+  /** Maps the elements from the data of a MetaImage.  Returns false if
+      the file cannot be mapped. */
+  bool map(const QString &fname, qint64 offset, TElementIdentifier n)
+  {
+    if (! mFile.open(fname, offset, static_cast<qint64>(n) * sizeof(TElement)))
+      {
+        return false;
+      }
+    this->SetImportPointer(static_cast<TElement *>(mFile.data()), n, false);
+    mFileName = fname;
+    return true;
+  }
+
+  /** The file that the elements are mapped from. */
+  const QString &fileName() const { return mFileName; }
+
+protected:
+  MappedImageContainer() {}
+  ~MappedImageContainer() {}
+
+private:
+  MappedImageContainer(const Self &);  // Not implemented.
+  void operator=(const Self &);  // Not implemented.
+
+  MappedFile mFile;
+  QString mFileName;
+};
+
+/** The MetaImage ElementType of a pixel type, or NULL if it has none
+    that matches its size on every platform. */
+template <class T> struct MetaElementType { static const char *name() { return NULL; } };
+template <> struct MetaElementType<float>          { static const char *name() { return "MET_FLOAT"; } };
+template <> struct MetaElementType<double>         { static const char *name() { return "MET_DOUBLE"; } };
+template <> struct MetaElementType<char>           { static const char *name() { return "MET_CHAR"; } };
+template <> struct MetaElementType<unsigned char>  { static const char *name() { return "MET_UCHAR"; } };
+template <> struct MetaElementType<short>          { static const char *name() { return "MET_SHORT"; } };
+template <> struct MetaElementType<unsigned short> { static const char *name() { return "MET_USHORT"; } };
+template <> struct MetaElementType<int>            { static const char *name() { return "MET_INT"; } };
+template <> struct MetaElementType<unsigned int>   { static const char *name() { return "MET_UINT"; } };
+
+/** Opens an uncompressed MetaImage by mapping its pixel data into
+    memory instead of reading it.  Nothing is read up front: pages are
+    read from the file as the image is first touched, and pages that
+    are written become private copies.
+
+    Returns NULL, so that the caller can fall back to
+    itk::ImageFileReader, unless the file is a 2D or 3D scalar MetaImage
+    with uncompressed data in a single file, in the byte order of this
+    machine and of exactly the pixel type T. */
+template <class T>
+typename itk::Image<T, 3>::Pointer mapMetaImage(const QString &fname)
+{
+  typedef itk::Image<T, 3> ImageType;
+  typedef MappedImageContainer<typename ImageType::PixelContainer::ElementIdentifier, T> ContainerType;
+
+  MetaImageHeader header;
+  const char *elementType = MetaElementType<T>::name();
+  if (elementType == NULL || ! readMetaImageHeader(fname, header)
+      || header.elementType != elementType
+      || header.compressed || header.channels != 1
+      || header.bigEndian != itk::ByteSwapper<T>::SystemIsBigEndian())
+    {
+      return NULL;
+    }
+
+  typename ImageType::SizeType size;
+  typename ImageType::SpacingType spacing;
+  typename ImageType::PointType origin;
+  typename ImageType::DirectionType direction;
+  unsigned long n = 1;
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      size[i] = header.size[i];
+      spacing[i] = header.spacing[i];
+      origin[i] = header.origin[i];
+      n *= size[i];
+    }
+
+  // Each row of TransformMatrix is the direction of an image axis.
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      for (unsigned int j = 0; j < 3; j++)
+        {
+          direction[j][i] = header.transform[3 * i + j];
+        }
+    }
+
+  // A HeaderSize of -1 places the data at the end of the data file.
+  qint64 offset = header.dataOffset;
+  if (header.headerSize == -1)
+    {
+      offset = QFileInfo(header.dataFile).size() - static_cast<qint64>(n) * sizeof(T);
+      if (offset < 0) { return NULL; }
+    }
+
+  typename ContainerType::Pointer container = ContainerType::New();
+  if (n == 0 || ! container->map(header.dataFile, offset, n))
+    {
+      return NULL;
+    }
+
+  typename ImageType::Pointer image = ImageType::New();
+  typename ImageType::RegionType region;
+  region.SetSize(size);
+  image->SetRegions(region);
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  image->SetDirection(direction);
+  image->SetPixelContainer(container);
+  return image;
+}
+
+} // end namespace wse
+
+#endif
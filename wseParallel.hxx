@@ -0,0 +1,99 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    wseParallel.hxx
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+#ifndef _wse_parallel_hxx
+#define _wse_parallel_hxx
+
+#include "itkMultiThreader.h"
+#include <algorithm>
+
+namespace wse {
+
+/** Returns the number of pieces that parallelFor() will cut a range of
+    n items into when no piece may be smaller than grain items.  This is
+    at most the ITK global default number of threads. */
+inline unsigned int parallelNumberOfPieces(unsigned long n, unsigned long grain = 1)
+{
+  if (grain == 0) { grain = 1; }
+  unsigned long pieces = (n + grain - 1) / grain;
+  unsigned long threads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  if (pieces > threads) { pieces = threads; }
+  if (pieces < 1)       { pieces = 1; }
+  return static_cast<unsigned int>(pieces);
+}
+
+/** Shared state for one call to parallelFor(). */
+template <class TFunctor>
+struct ParallelForData
+{
+  const TFunctor *functor;
+  unsigned long n;
+  unsigned int pieces;
+};
+
+/** Returns the first item of the given piece when n items are split
+    into the given number of nearly equal contiguous pieces. */
+inline unsigned long parallelPieceBegin(unsigned long n, unsigned int pieces, unsigned int piece)
+{
+  return (n / pieces) * piece + std::min<unsigned long>(piece, n % pieces);
+}
+
+/** Thread entry point used by parallelFor(). */
+template <class TFunctor>
+ITK_THREAD_RETURN_TYPE parallelForCallback(void *arg)
+{
+  itk::MultiThreader::ThreadInfoStruct *info
+    = static_cast<itk::MultiThreader::ThreadInfoStruct *>(arg);
+  const ParallelForData<TFunctor> *data
+    = static_cast<const ParallelForData<TFunctor> *>(info->UserData);
+
+  const unsigned int piece = info->ThreadID;
+  if (piece < data->pieces)
+    {
+      const unsigned long begin = parallelPieceBegin(data->n, data->pieces, piece);
+      const unsigned long end   = parallelPieceBegin(data->n, data->pieces, piece + 1);
+      if (begin < end) { (*data->functor)(begin, end, piece); }
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** Splits the range [0,n) into parallelNumberOfPieces(n, grain)
+    contiguous pieces and calls f(begin, end, piece) for each of them on
+    the ITK thread pool.  The call returns when every piece is done.  The
+    functor is shared by all threads, so it must only write to data that
+    belongs to its own piece (per-piece results can be indexed by the
+    piece number).  Small ranges are run on the calling thread. */
+template <class TFunctor>
+void parallelFor(unsigned long n, const TFunctor &f, unsigned long grain = 1)
+{
+  if (n == 0) { return; }
+
+  ParallelForData<TFunctor> data;
+  data.functor = &f;
+  data.n       = n;
+  data.pieces  = parallelNumberOfPieces(n, grain);
+
+  if (data.pieces == 1)
+    {
+      f(0, n, 0);
+      return;
+    }
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads(data.pieces);
+  // The threader may clamp the request to its own maximum.
+  if (threader->GetNumberOfThreads() < static_cast<int>(data.pieces))
+    { data.pieces = threader->GetNumberOfThreads(); }
+  threader->SetSingleMethod(parallelForCallback<TFunctor>, &data);
+  threader->SingleMethodExecute();
+}
+
+} // end namespace wse
+
+#endif
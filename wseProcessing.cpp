@@ -26,8 +26,21 @@ void wseGUI::mITKFilteringThread_finished()
     }  
   this->output("Filtering operation finished");
 
-  FloatImage *img = new FloatImage(mITKFilteringThread->filter()->GetOutput());
+  // The result is taken from the filter, and the filter is released, so
+  // that the image holds the only reference to its pixels and storing
+  // it compactly or spilling it frees them.
+  FloatImage::itkImageType::Pointer output = mITKFilteringThread->filter()->GetOutput();
+  output->DisconnectPipeline();
+  mITKFilteringThread->setFilter(NULL);
+
+  FloatImage *img = new FloatImage(output);
   img->name(mITKFilteringThread->description());
+
+  // Filter results are kept at full precision, unless 16-bit storage
+  // has been asked for while they are not displayed.
+  const QString storage = g_settings->value("derived_image_storage").toString();
+  if (storage == "uint16")       { img->setCompactStorage(Quantized16); }
+  else if (storage == "float16") { img->setCompactStorage(HalfFloat); }
   this->addImageFromData(img);
 
   // Switch view to the last image loaded
@@ -190,18 +203,51 @@ void wseGUI::mITKSegmentationThread_finished()
     }  
   this->output("Segmentation operation finished");
   
-  // First clean up old segmentation
-  if (mSegmentation != NULL) { delete mSegmentation; }
-  
   // Create the segmentation object.
   
   ULongImage *img = new ULongImage(mITKSegmentationThread->filter()->GetOutput());
   img->name(mITKSegmentationThread->description());
   
   //  mSegmentation = new Segmentation(mITKSegmentationThread->filter()->GetOutput(),
-  mSegmentation = new Segmentation(img, dynamic_cast<itk::WatershedImageFilter<FloatImage::itkImageType> *>
-                                   (mITKSegmentationThread->filter().GetPointer())->GetSegmentTree());
-  
+  this->installSegmentation(new Segmentation(img, dynamic_cast<itk::WatershedImageFilter<FloatImage::itkImageType> *>
+                                             (mITKSegmentationThread->filter().GetPointer())->GetSegmentTree()));
+}
+
+void wseGUI::installSegmentation(Segmentation *seg)
+{
+  // First clean up old segmentation, and the surface and the cached
+  // slices read from it
+  mRegionSurface->SetLabels(NULL, NULL, NULL);
+  mRegionSurfaceLOD->SetInput(NULL);
+  mSegmentSliceViewer->DisableDisplay();
+  if (mSegmentation != NULL) { delete mSegmentation; }
+  mSegmentation = seg;
+
+  // The region outlines must not outlive the segmentation they read
+  this->updateBoundaryDisplay();
+
+  // Show the flood level of the segmentation on the sliders.  Each
+  // slider would merge on its own, the first one to a level made of its
+  // new value and the old value of the other, so their signals are
+  // blocked and the segmentation is merged once below.  A fraction that
+  // rounds up to 100 carries into the coarse slider, unless that one is
+  // already at its maximum.
+  const float lvl = mSegmentation->floodLevel() * 100.0;
+  int coarse = static_cast<int>(floor(lvl));
+  int fine = static_cast<int>((lvl - floor(lvl)) * 100.0 + 0.5);
+  if (fine >= 100 && coarse < ui.floodLevelA->maximum())
+    {
+      coarse++;
+      fine = 0;
+    }
+  ui.floodLevelA->blockSignals(true);
+  ui.floodLevelB->blockSignals(true);
+  ui.floodLevelA->setValue(coarse);
+  ui.floodLevelB->setValue(fine);
+  ui.floodLevelA->blockSignals(false);
+  ui.floodLevelB->blockSignals(false);
+  this->floodLevelChanged();
+
   this->setNormalView();
   ui.floodLevelA->setEnabled(true);
   ui.floodLevelB->setEnabled(true);
@@ -0,0 +1,73 @@
+#include "wseRenderScheduler.h"
+#include "wseSliceViewer.h"
+
+namespace wse {
+
+RenderScheduler::RenderScheduler(QObject *parent)
+  : QObject(parent)
+{
+  mTimer.setSingleShot(true);
+  mTimer.setInterval(16);
+  connect(&mTimer, SIGNAL(timeout()), this, SLOT(mTimer_timeout()));
+}
+
+void RenderScheduler::scheduleRender(SliceViewer *viewer)
+{
+  if (viewer == NULL)  { return; }
+
+  if (mDirty.contains(viewer))
+    {
+      mStatistics.coalesced++;
+      return;
+    }
+  if (mDirty.isEmpty())
+    {
+      mFirstRequest.start();
+      mTimer.start();
+    }
+  mDirty.append(viewer);
+}
+
+void RenderScheduler::cancel(SliceViewer *viewer)
+{
+  mDirty.removeAll(viewer);
+  if (mDirty.isEmpty())  { mTimer.stop(); }
+}
+
+void RenderScheduler::setInterval(int msecs)
+{
+  mTimer.setInterval(msecs > 0 ? msecs : 1);
+}
+
+void RenderScheduler::flush()
+{
+  mTimer.stop();
+  if (mDirty.isEmpty())  { return; }
+
+  // A viewer may ask for another render while it draws, so the list is
+  // taken first.  Such requests start the next frame.
+  const QList<SliceViewer *> viewers = mDirty;
+  mDirty.clear();
+
+  QTime start;
+  start.start();
+  for (int i = 0; i < viewers.size(); i++)
+    {  viewers.at(i)->Render();  }
+  const int renderMsecs = start.elapsed();
+  const int latency = mFirstRequest.elapsed();
+
+  mStatistics.frames++;
+  mStatistics.renders += viewers.size();
+  mStatistics.totalRenderMsecs += renderMsecs;
+  if (renderMsecs > mStatistics.maximumRenderMsecs)  { mStatistics.maximumRenderMsecs = renderMsecs; }
+  if (latency > mStatistics.maximumLatencyMsecs)     { mStatistics.maximumLatencyMsecs = latency; }
+  if (latency > 2 * this->interval())
+    {  mStatistics.droppedFrames += (latency - 1) / this->interval() - 1;  }
+}
+
+void RenderScheduler::mTimer_timeout()
+{
+  this->flush();
+}
+
+} // end namespace wse
@@ -0,0 +1,107 @@
+#ifndef _wseRenderScheduler_h_
+#define _wseRenderScheduler_h_
+
+#include <QObject>
+#include <QList>
+#include <QTime>
+#include <QTimer>
+
+namespace wse {
+
+class SliceViewer;
+
+/** Coalesces render requests from the GUI, so that a slider or a mouse
+    drag that changes the display many times between screen refreshes
+    draws each viewer only once per refresh.
+
+    scheduleRender() marks a viewer dirty and starts a single-shot timer
+    of one display interval.  When the timer fires, every dirty viewer
+    is rendered once.  Qt 4 does not expose the refresh of the display,
+    so the interval, 16 ms by default, approximates a 60 Hz display
+    rather than following its vertical sync.  Requests for a viewer that is
+    already dirty are counted as coalesced and otherwise ignored.
+
+    The scheduler also times its frames.  A frame that is not drawn
+    by the refresh after the one it was requested for has dropped the
+    frames in between, which is how sluggish interaction shows up in
+    statistics(). */
+class RenderScheduler : public QObject
+{
+  Q_OBJECT
+
+public:
+  /** The timing of the frames drawn since the last resetStatistics(). */
+  struct Statistics
+  {
+    Statistics() : frames(0), renders(0), coalesced(0), droppedFrames(0),
+                   totalRenderMsecs(0), maximumRenderMsecs(0), maximumLatencyMsecs(0) {}
+
+    /** The number of times the dirty viewers were rendered. */
+    int frames;
+
+    /** The number of viewer renders, which is at most the number of
+        viewers per frame. */
+    int renders;
+
+    /** The number of requests that did not cause a render of their own. */
+    int coalesced;
+
+    /** The number of display intervals that passed between the first
+        request of a frame and the end of its drawing, beyond the two a
+        frame is allowed: one to wait for the refresh, one to draw. */
+    int droppedFrames;
+
+    int totalRenderMsecs;
+    int maximumRenderMsecs;
+
+    /** The longest time from the first request of a frame to the end
+        of its drawing. */
+    int maximumLatencyMsecs;
+  };
+
+  RenderScheduler(QObject *parent = 0);
+
+  /** Marks the viewer to be rendered at the next display refresh. */
+  void scheduleRender(SliceViewer *viewer);
+
+  /** Renders the dirty viewers now, as when the display must be current
+      before the caller goes on. */
+  void flush();
+
+  /** Forgets a viewer that is about to be deleted.  Viewers given the
+      scheduler with SliceViewer::SetRenderScheduler() do this
+      themselves. */
+  void cancel(SliceViewer *viewer);
+
+  /** Returns true if any viewer waits to be rendered. */
+  bool isPending() const
+  { return ! mDirty.isEmpty(); }
+
+  /** The display interval in milliseconds.  The default is 16. */
+  void setInterval(int msecs);
+  int interval() const
+  { return mTimer.interval(); }
+
+  const Statistics &statistics() const
+  { return mStatistics; }
+  void resetStatistics()
+  { mStatistics = Statistics(); }
+
+private slots:
+  void mTimer_timeout();
+
+private:
+  QTimer mTimer;
+
+  /** The viewers to render, each one once, in the order requested. */
+  QList<SliceViewer *> mDirty;
+
+  /** The time of the first request since the last frame. */
+  QTime mFirstRequest;
+
+  Statistics mStatistics;
+};
+
+} // end namespace wse
+
+#endif
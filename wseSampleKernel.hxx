@@ -0,0 +1,92 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    wseSampleKernel.hxx
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+#ifndef _wse_sample_kernel_hxx
+#define _wse_sample_kernel_hxx
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace wse {
+
+/** The interpolation kernel shared by the batched samplers,
+    Image::sampleLinear() and Image::sampleNearest() on ITK images and
+    VolumeSampler on VTK images.
+
+    The samplers cut the points into blocks of SampleBlockSize.  For
+    each block they compute the continuous indices over contiguous
+    arrays, one axis at a time, with a branch free loop that the
+    compiler can vectorize.  Then sampleVoxels() gathers and
+    interpolates the voxels at each index. */
+enum { SampleBlockSize = 256 };
+
+/** The layout of a scalar buffer: the number of voxels along each axis,
+    and the distance in elements between neighbors along it. */
+struct SampleGrid
+{
+  long size[3];
+  std::ptrdiff_t stride[3];
+};
+
+/** Returns the value of buffer at the continuous index (x, y, z),
+    interpolated linearly or taken from the nearest voxel, computed in
+    the type R.  Indices more than half a voxel outside of the buffer
+    sample 0.  Linear interpolation clamps the neighbors of an index
+    near the edge to the buffer. */
+template <class R, class T>
+inline R sampleVoxels(const T *buffer, const SampleGrid &g, R x, R y, R z, bool linear)
+{
+  const R half = static_cast<R>(0.5);
+  const long nx = g.size[0], ny = g.size[1], nz = g.size[2];
+  if (!(x >= -half && x < nx - half && y >= -half && y < ny - half
+        && z >= -half && z < nz - half))
+    {
+      return static_cast<R>(0);
+    }
+
+  if (! linear)
+    {
+      const std::ptrdiff_t ix = static_cast<std::ptrdiff_t>(std::floor(x + half));
+      const std::ptrdiff_t iy = static_cast<std::ptrdiff_t>(std::floor(y + half));
+      const std::ptrdiff_t iz = static_cast<std::ptrdiff_t>(std::floor(z + half));
+      return static_cast<R>(buffer[ix * g.stride[0] + iy * g.stride[1] + iz * g.stride[2]]);
+    }
+
+  const R fx = std::floor(x), fy = std::floor(y), fz = std::floor(z);
+  const R tx = x - fx, ty = y - fy, tz = z - fz;
+  const long x0 = static_cast<long>(fx), y0 = static_cast<long>(fy), z0 = static_cast<long>(fz);
+  const std::ptrdiff_t ox0 = std::max(x0, 0L) * g.stride[0];
+  const std::ptrdiff_t ox1 = std::min(x0 + 1, nx - 1) * g.stride[0];
+  const std::ptrdiff_t oy0 = std::max(y0, 0L) * g.stride[1];
+  const std::ptrdiff_t oy1 = std::min(y0 + 1, ny - 1) * g.stride[1];
+  const std::ptrdiff_t oz0 = std::max(z0, 0L) * g.stride[2];
+  const std::ptrdiff_t oz1 = std::min(z0 + 1, nz - 1) * g.stride[2];
+
+  const R v000 = static_cast<R>(buffer[ox0 + oy0 + oz0]);
+  const R v100 = static_cast<R>(buffer[ox1 + oy0 + oz0]);
+  const R v010 = static_cast<R>(buffer[ox0 + oy1 + oz0]);
+  const R v110 = static_cast<R>(buffer[ox1 + oy1 + oz0]);
+  const R v001 = static_cast<R>(buffer[ox0 + oy0 + oz1]);
+  const R v101 = static_cast<R>(buffer[ox1 + oy0 + oz1]);
+  const R v011 = static_cast<R>(buffer[ox0 + oy1 + oz1]);
+  const R v111 = static_cast<R>(buffer[ox1 + oy1 + oz1]);
+
+  const R v00 = v000 + tx * (v100 - v000);
+  const R v10 = v010 + tx * (v110 - v010);
+  const R v01 = v001 + tx * (v101 - v001);
+  const R v11 = v011 + tx * (v111 - v011);
+  const R v0 = v00 + ty * (v10 - v00);
+  const R v1 = v01 + ty * (v11 - v01);
+  return v0 + tz * (v1 - v0);
+}
+
+} // end namespace wse
+
+#endif
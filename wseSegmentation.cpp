@@ -1,29 +1,634 @@
 #include "wseSegmentation.h"
+#include "wseException.h"
+#include "itkRunLengthCodec.h"
+#include "itkChunkedLabelImageReader.h"
+#include "itkChunkedLabelImageWriter.h"
+#include "itkIntTypes.h"
+#include "wseParallel.hxx"
+#include <fstream>
+#include <cstring>
+#include <algorithm>
 
 namespace wse {
 
+//---------------------------------------------------------------------------
+// Segmentation bundle layout
+//
+// The file begins with a BundleHeader followed by numberOfSections
+// BundleSection entries.  Section payloads follow, each starting at a
+// multiple of BundleAlignment bytes.  All values are written in the
+// byte order of the machine that wrote the bundle; the byteOrder field
+// lets a reader detect a mismatch.
+//---------------------------------------------------------------------------
+const unsigned int Segmentation::BundleVersion = 1;
+
+static const char          BundleMagic[8]  = { 'W','S','E','S','E','G','\r','\n' };
+static const itk::uint32_t BundleByteOrder = 0x01020304;
+static const itk::uint64_t BundleAlignment = 4096;
+
+enum BundleSectionId
+{
+  SectionGeometry     = 1,
+  SectionLabels       = 2,
+  SectionMergeTree    = 3,
+  SectionBoundingBox  = 4,
+  SectionState        = 5,
+  SectionEditVolume   = 6,
+  SectionLabelMap     = 7,
+  SectionCount        = 7
+};
+
+struct BundleHeader
+{
+  char          magic[8];
+  itk::uint32_t version;
+  itk::uint32_t byteOrder;
+  itk::uint32_t numberOfSections;
+  itk::uint32_t alignment;
+};
+
+struct BundleSection
+{
+  itk::uint32_t id;
+  itk::uint32_t reserved;
+  itk::uint64_t offset;
+  itk::uint64_t size;
+};
+
+struct BundleGeometry
+{
+  itk::int64_t  index[3];
+  itk::uint64_t size[3];
+  double        spacing[3];
+  double        origin[3];
+  double        direction[9];
+};
+
+struct BundleMerge
+{
+  itk::uint64_t from;
+  itk::uint64_t to;
+  double        saliency;
+};
+
+struct BundleBoundingBox
+{
+  itk::uint64_t label;
+  itk::int32_t  extent[6];
+};
+
+struct BundleState
+{
+  double        floodLevel;
+  itk::uint64_t numberOfLabels;
+};
+
+typedef itk::RunLengthCodec<unsigned char> MaskCodec;
+
+/** Pads the stream with zeros up to the next section boundary and
+    returns the resulting offset. */
+static itk::uint64_t alignBundleStream(std::ofstream &out)
+{
+  itk::uint64_t pos = static_cast<itk::uint64_t>(out.tellp());
+  itk::uint64_t pad = (BundleAlignment - (pos % BundleAlignment)) % BundleAlignment;
+  static const char zeros[4096] = { 0 };
+  out.write(zeros, static_cast<std::streamsize>(pad));
+  return pos + pad;
+}
+
+/** Reads a section payload into buf.  Throws if the section lies
+    outside of the file or the read fails. */
+static void readBundleSection(std::ifstream &in, const BundleSection &s,
+                              char *buf, itk::uint64_t expectedSize)
+{
+  if (s.size != expectedSize)
+    { throw Exception("Segmentation bundle section has an unexpected size."); }
+  in.seekg(static_cast<std::streamoff>(s.offset), std::ios::beg);
+  in.read(buf, static_cast<std::streamsize>(s.size));
+  if (!in)
+    { throw Exception("Segmentation bundle is truncated."); }
+}
+
+//---------------------------------------------------------------------------
+// Label compaction
+//---------------------------------------------------------------------------
+
+/** Sorts the list and removes duplicate entries. */
+static void sortUniqueLabels(std::vector<unsigned long> &v)
+{
+  std::sort(v.begin(), v.end());
+  v.erase(std::unique(v.begin(), v.end()), v.end());
+}
+
+/** Collects the distinct labels of each piece of a label buffer into
+    found[piece].  Labels come in long runs, so only the start of each
+    run is recorded, and the list is compacted whenever it has doubled
+    in size to keep it proportional to the number of distinct labels. */
+struct CollectLabelsFunctor
+{
+  const unsigned long *labels;
+  std::vector<std::vector<unsigned long> > *found;
+
+  void operator()(unsigned long begin, unsigned long end, unsigned int piece) const
+  {
+    std::vector<unsigned long> &f = (*found)[piece];
+    unsigned long limit = 1 << 16;
+    unsigned long last = labels[begin];
+    f.push_back(last);
+    for (unsigned long i = begin + 1; i < end; i++)
+      {
+        if (labels[i] == last) { continue; }
+        last = labels[i];
+        f.push_back(last);
+        if (f.size() >= limit)
+          {
+            sortUniqueLabels(f);
+            limit = std::max(limit, 2 * static_cast<unsigned long>(f.size()));
+          }
+      }
+    sortUniqueLabels(f);
+  }
+};
+
+/** Replaces each label of a piece of a label buffer with its position
+    in the sorted list of distinct labels. */
+struct RemapLabelsFunctor
+{
+  unsigned long *labels;
+  const std::vector<unsigned long> *sorted;
+
+  void operator()(unsigned long begin, unsigned long end, unsigned int) const
+  {
+    const unsigned long *first = &(*sorted)[0];
+    const unsigned long *last  = first + sorted->size();
+    unsigned long from = labels[begin];
+    unsigned long to   = std::lower_bound(first, last, from) - first;
+    for (unsigned long i = begin; i < end; i++)
+      {
+        if (labels[i] != from)
+          {
+            from = labels[i];
+            to   = std::lower_bound(first, last, from) - first;
+          }
+        labels[i] = to;
+      }
+  }
+};
+
+unsigned long Segmentation::compactLabels()
+{
+  ULongImage::itkImageType *img = mWatershedTransform->itkImage().GetPointer();
+  unsigned long *labels = img->GetBufferPointer();
+  const unsigned long n = img->GetBufferedRegion().GetNumberOfPixels();
+  const unsigned long grain = 1 << 16;
+
+  // Gather the distinct labels of the image, piece by piece, and of the
+  // merge tree.
+  std::vector<std::vector<unsigned long> > found(parallelNumberOfPieces(n, grain) + 1);
+  CollectLabelsFunctor collect;
+  collect.labels = labels;
+  collect.found  = &found;
+  parallelFor(n, collect, grain);
+
+  std::vector<unsigned long> &treeLabels = found.back();
+  if (mSegmentTree.IsNotNull())
+    {
+      for (SegmentTreeType::ConstIterator it = mSegmentTree->Begin(); it != mSegmentTree->End(); ++it)
+        {
+          treeLabels.push_back(it->from);
+          treeLabels.push_back(it->to);
+        }
+      sortUniqueLabels(treeLabels);
+    }
+
+  std::vector<unsigned long> sorted;
+  for (unsigned int i = 0; i < found.size(); i++)
+    {
+      const unsigned long mid = sorted.size();
+      sorted.insert(sorted.end(), found[i].begin(), found[i].end());
+      std::vector<unsigned long>().swap(found[i]);
+      std::inplace_merge(sorted.begin(), sorted.begin() + mid, sorted.end());
+      sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    }
+
+  // Labels that are already dense need no renumbering.
+  if (sorted.empty() || sorted.back() == sorted.size() - 1)
+    {
+      mOriginalLabels.clear();
+      return sorted.empty() ? 0 : sorted.size();
+    }
+
+  RemapLabelsFunctor remap;
+  remap.labels = labels;
+  remap.sorted = &sorted;
+  parallelFor(n, remap, grain);
+
+  if (mSegmentTree.IsNotNull())
+    {
+      for (SegmentTreeType::Iterator it = mSegmentTree->Begin(); it != mSegmentTree->End(); ++it)
+        {
+          it->from = std::lower_bound(sorted.begin(), sorted.end(), it->from) - sorted.begin();
+          it->to   = std::lower_bound(sorted.begin(), sorted.end(), it->to)   - sorted.begin();
+        }
+    }
+
+  img->Modified();
+  mWatershedTransform->vtkImporter()->Modified();
+
+  mOriginalLabels.swap(sorted);
+  return mOriginalLabels.size();
+}
+
+//---------------------------------------------------------------------------
 Segmentation::Segmentation(ULongImage *img, SegmentTreeType *tree)
+  : mWatershedTransform(NULL), mBinaryLogic(NULL), mBinaryVolume(NULL),
+    mLUTManager(NULL), mBoundingBoxManager(NULL)
 {
   mWatershedTransform = img;
   mSegmentTree        = tree;
 
+  this->initialize(this->compactLabels());
+}
+
+Segmentation::Segmentation()
+  : mWatershedTransform(NULL), mBinaryLogic(NULL), mBinaryVolume(NULL),
+    mLUTManager(NULL), mBoundingBoxManager(NULL)
+{
+}
+
+Segmentation::~Segmentation()
+{
+  this->clear();
+}
+
+void Segmentation::initialize(unsigned long numberOfLabels)
+{
   // Allocate the lookup table manager object
   mLUTManager = vtkWSLookupTableManager::New();
   mLUTManager->SetHighlightColor(1.0, 1.0, 1.0);
   mLUTManager->SetRepaintHighlights(1);
   mLUTManager->Initialize();
-  mLUTManager->LoadTree(tree);
-  mLUTManager->SetNumberOfLabels(mWatershedTransform->computeMaximumImageValue()+1);
+  mLUTManager->LoadTree(mSegmentTree);
+  mLUTManager->SetNumberOfLabels(numberOfLabels);
   mLUTManager->GenerateColorTable();
 
+  // The bounding box table is filled on demand (see write()) or from a
+  // saved bundle (see read()).
+  mBoundingBoxManager = vtkWSBoundingBoxManager::New();
+  mBoundingBoxManager->SetLabeledImage(mWatershedTransform->vtkImporter()->GetOutput());
+
+  mBinaryLogic = vtkBinaryVolumeLogic::New();
+  mBinaryLogic->SetSourceVolume(mWatershedTransform->vtkImporter()->GetOutput());
 }
 
-Segmentation::~Segmentation() 
+void Segmentation::clear()
 {
+  if (mBinaryLogic != NULL)        { mBinaryLogic->Delete();        mBinaryLogic = NULL; }
+  if (mBinaryVolume != NULL)       { mBinaryVolume->Delete();       mBinaryVolume = NULL; }
+  if (mBoundingBoxManager != NULL) { mBoundingBoxManager->Delete(); mBoundingBoxManager = NULL; }
+  if (mLUTManager != NULL)         { mLUTManager->Delete();         mLUTManager = NULL; }
 
-  // TODO:  Delete VTK objects here
+  delete mWatershedTransform;
+  mWatershedTransform = NULL;
+  mSegmentTree = NULL;
+  mOriginalLabels.clear();
+}
 
+vtkBinaryVolume *Segmentation::binaryVolume()
+{
+  if (mBinaryVolume == NULL)
+    {
+      vtkImageData *labels = mWatershedTransform->vtkImporter()->GetOutput();
+      mBinaryVolume = vtkBinaryVolume::New();
+      mBinaryVolume->SetExtent(labels->GetExtent());
+      mBinaryVolume->SetSpacing(labels->GetSpacing());
+      mBinaryVolume->SetOrigin(labels->GetOrigin());
+      mBinaryVolume->AllocateScalars();
+      mBinaryVolume->Clear();
+      mBinaryLogic->SetBinaryVolume(mBinaryVolume);
+    }
+  return mBinaryVolume;
 }
 
+bool Segmentation::write(const char *fn) const
+{
+  if (mWatershedTransform == NULL)
+    { throw Exception("There is no segmentation to write."); }
+
+  std::ofstream out(fn, std::ios::binary | std::ios::trunc);
+  if (!out) { return false; }
+
+  const ULongImage::itkImageType *img = mWatershedTransform->itkImage().GetPointer();
+  const ULongImage::itkImageType::RegionType region = img->GetBufferedRegion();
+
+  // Reserve space for the header and section table, which are written
+  // last, once the section offsets are known.
+  BundleSection sections[SectionCount];
+  std::memset(sections, 0, sizeof(sections));
+  unsigned int ns = 0;
+
+  BundleHeader header;
+  std::memcpy(header.magic, BundleMagic, sizeof(BundleMagic));
+  header.version   = BundleVersion;
+  header.byteOrder = BundleByteOrder;
+  header.alignment = static_cast<itk::uint32_t>(BundleAlignment);
+  header.numberOfSections = 0;
+  out.write((const char *)&header, sizeof(header));
+  out.write((const char *)sections, sizeof(sections));
+
+  // Geometry
+  BundleGeometry geom;
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      geom.index[i]   = region.GetIndex()[i];
+      geom.size[i]    = region.GetSize()[i];
+      geom.spacing[i] = img->GetSpacing()[i];
+      geom.origin[i]  = img->GetOrigin()[i];
+      for (unsigned int j = 0; j < 3; j++)
+        { geom.direction[i*3+j] = img->GetDirection()[i][j]; }
+    }
+  sections[ns].id     = SectionGeometry;
+  sections[ns].offset = alignBundleStream(out);
+  sections[ns].size   = sizeof(geom);
+  out.write((const char *)&geom, sizeof(geom));
+  ns++;
+
+  // Label image, as compressed bricks that can be read a slice or a
+  // region at a time.
+  itk::ChunkedLabelImageWriter<ULongImage::itkImageType>::Pointer labelWriter
+    = itk::ChunkedLabelImageWriter<ULongImage::itkImageType>::New();
+  labelWriter->SetInput(img);
+  labelWriter->SetFileName(fn);
+  sections[ns].id     = SectionLabels;
+  sections[ns].offset = alignBundleStream(out);
+  labelWriter->Write(out);
+  sections[ns].size   = static_cast<itk::uint64_t>(out.tellp()) - sections[ns].offset;
+  ns++;
+
+  // Merge tree, written in buffered chunks as in WatershedSegmentTreeWriter.
+  sections[ns].id     = SectionMergeTree;
+  sections[ns].offset = alignBundleStream(out);
+  sections[ns].size   = 0;
+  if (mSegmentTree.IsNotNull())
+    {
+      const unsigned int BUFSZ = 16384;
+      std::vector<BundleMerge> buf(BUFSZ);
+      unsigned int n = 0;
+      for (SegmentTreeType::ConstIterator it = mSegmentTree->Begin(); it != mSegmentTree->End(); ++it)
+        {
+          buf[n].from     = it->from;
+          buf[n].to       = it->to;
+          buf[n].saliency = it->saliency;
+          if (++n == BUFSZ)
+            {
+              out.write((const char *)&buf[0], sizeof(BundleMerge) * n);
+              sections[ns].size += sizeof(BundleMerge) * n;
+              n = 0;
+            }
+        }
+      out.write((const char *)&buf[0], sizeof(BundleMerge) * n);
+      sections[ns].size += sizeof(BundleMerge) * n;
+    }
+  ns++;
+
+  // Bounding boxes.  Generate the table now if it has not been filled.
+  if (mBoundingBoxManager->GetBoundingBoxTable().size() == 0)
+    {  mBoundingBoxManager->GenerateBoundingBoxes();  }
+
+  sections[ns].id     = SectionBoundingBox;
+  sections[ns].offset = alignBundleStream(out);
+  sections[ns].size   = 0;
+  for (vtkBoundingBoxHash::const_iterator it = mBoundingBoxManager->GetBoundingBoxTable().begin();
+       it != mBoundingBoxManager->GetBoundingBoxTable().end(); ++it)
+    {
+      BundleBoundingBox b;
+      b.label     = it->first;
+      b.extent[0] = it->second.x0;   b.extent[1] = it->second.x1;
+      b.extent[2] = it->second.y0;   b.extent[3] = it->second.y1;
+      b.extent[4] = it->second.z0;   b.extent[5] = it->second.z1;
+      out.write((const char *)&b, sizeof(b));
+      sections[ns].size += sizeof(b);
+    }
+  ns++;
+
+  // Editing state
+  BundleState state;
+  state.floodLevel     = mLUTManager->GetCurrentThreshold();
+  state.numberOfLabels = mLUTManager->GetNumberOfLabels();
+  sections[ns].id     = SectionState;
+  sections[ns].offset = alignBundleStream(out);
+  sections[ns].size   = sizeof(state);
+  out.write((const char *)&state, sizeof(state));
+  ns++;
+
+  // Original watershed labels, if the labels were renumbered.
+  if (! mOriginalLabels.empty())
+    {
+      std::vector<itk::uint64_t> map(mOriginalLabels.begin(), mOriginalLabels.end());
+      sections[ns].id     = SectionLabelMap;
+      sections[ns].offset = alignBundleStream(out);
+      sections[ns].size   = map.size() * sizeof(itk::uint64_t);
+      out.write((const char *)&map[0], static_cast<std::streamsize>(sections[ns].size));
+      ns++;
+    }
+
+  // Binary edit volume, if one exists: its extent followed by its
+  // run-length encoded voxels.
+  if (mBinaryVolume != NULL)
+    {
+      itk::int32_t ext[6];
+      const int *e = mBinaryVolume->GetExtent();
+      for (unsigned int i = 0; i < 6; i++) { ext[i] = e[i]; }
+      const unsigned long n = (unsigned long)(e[1]-e[0]+1) * (e[3]-e[2]+1) * (e[5]-e[4]+1);
+
+      std::vector<char> mask;
+      MaskCodec::Encode((const unsigned char *)mBinaryVolume->GetScalarPointer(), n, mask);
+
+      sections[ns].id     = SectionEditVolume;
+      sections[ns].offset = alignBundleStream(out);
+      sections[ns].size   = sizeof(ext) + mask.size();
+      out.write((const char *)ext, sizeof(ext));
+      if (!mask.empty())
+        { out.write(&mask[0], static_cast<std::streamsize>(mask.size())); }
+      ns++;
+    }
+
+  // Now go back and fill in the header and section table
+  header.numberOfSections = ns;
+  out.seekp(0, std::ios::beg);
+  out.write((const char *)&header, sizeof(header));
+  out.write((const char *)sections, sizeof(sections));
+  out.close();
+
+  if (!out)
+    { throw Exception(std::string("Error writing segmentation bundle ") + fn); }
+  return true;
+}
+
+bool Segmentation::read(const char *fn)
+{
+  std::ifstream in(fn, std::ios::binary);
+  if (!in) { return false; }
+
+  BundleHeader header;
+  in.read((char *)&header, sizeof(header));
+  if (!in || std::memcmp(header.magic, BundleMagic, sizeof(BundleMagic)) != 0)
+    { throw Exception(std::string(fn) + " is not a segmentation bundle."); }
+  if (header.byteOrder != BundleByteOrder)
+    { throw Exception("Segmentation bundle was written on a machine with a different byte order."); }
+  if (header.version != BundleVersion)
+    { throw Exception("Segmentation bundle was written by an incompatible version of this program."); }
+  if (header.numberOfSections > SectionCount)
+    { throw Exception("Segmentation bundle has a corrupt section table."); }
+
+  BundleSection sections[SectionCount];
+  in.read((char *)sections, sizeof(sections));
+  if (!in) { throw Exception("Segmentation bundle is truncated."); }
+
+  const BundleSection *table[SectionCount + 1];
+  for (unsigned int i = 0; i <= SectionCount; i++) { table[i] = NULL; }
+  for (unsigned int i = 0; i < header.numberOfSections; i++)
+    {
+      if (sections[i].id >= 1 && sections[i].id <= SectionCount)
+        { table[sections[i].id] = &sections[i]; }
+    }
+  if (table[SectionGeometry] == NULL || table[SectionLabels] == NULL
+      || table[SectionMergeTree] == NULL || table[SectionState] == NULL)
+    { throw Exception("Segmentation bundle is missing required sections."); }
+
+  // Geometry
+  BundleGeometry geom;
+  readBundleSection(in, *table[SectionGeometry], (char *)&geom, sizeof(geom));
+
+  ULongImage::itkImageType::RegionType region;
+  ULongImage::itkImageType::IndexType index;
+  ULongImage::itkImageType::SizeType size;
+  ULongImage::itkImageType::SpacingType spacing;
+  ULongImage::itkImageType::PointType origin;
+  ULongImage::itkImageType::DirectionType direction;
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      index[i]   = geom.index[i];
+      size[i]    = geom.size[i];
+      spacing[i] = geom.spacing[i];
+      origin[i]  = geom.origin[i];
+      for (unsigned int j = 0; j < 3; j++)
+        { direction[i][j] = geom.direction[i*3+j]; }
+    }
+  region.SetIndex(index);
+  region.SetSize(size);
+
+  // Labels, stored as a chunked label image
+  itk::ChunkedLabelImageReader<ULongImage::itkImageType>::Pointer labelReader
+    = itk::ChunkedLabelImageReader<ULongImage::itkImageType>::New();
+  labelReader->SetFileName(fn);
+  labelReader->SetFileOffset(table[SectionLabels]->offset);
+  if (labelReader->GetLargestPossibleRegion() != region)
+    { throw Exception("Segmentation bundle label image does not match its geometry."); }
+  ULongImage::itkImageType::Pointer img = labelReader->Read();
+  img->SetSpacing(spacing);
+  img->SetOrigin(origin);
+  img->SetDirection(direction);
+
+  // Merge tree
+  const BundleSection &ts = *table[SectionMergeTree];
+  if (ts.size % sizeof(BundleMerge) != 0)
+    { throw Exception("Segmentation bundle merge tree is corrupt."); }
+  SegmentTreeType::Pointer tree = SegmentTreeType::New();
+  {
+    std::vector<BundleMerge> merges(ts.size / sizeof(BundleMerge) + 1);
+    readBundleSection(in, ts, (char *)&merges[0], ts.size);
+    for (unsigned long i = 0; i < ts.size / sizeof(BundleMerge); i++)
+      {
+        SegmentTreeType::ValueType m;
+        m.from     = merges[i].from;
+        m.to       = merges[i].to;
+        m.saliency = merges[i].saliency;
+        tree->PushBack(m);
+      }
+  }
+
+  // Editing state
+  BundleState state;
+  readBundleSection(in, *table[SectionState], (char *)&state, sizeof(state));
+
+  // Bounding boxes
+  std::vector<BundleBoundingBox> boxes;
+  if (table[SectionBoundingBox] != NULL)
+    {
+      const BundleSection &bs = *table[SectionBoundingBox];
+      if (bs.size % sizeof(BundleBoundingBox) != 0)
+        { throw Exception("Segmentation bundle bounding box table is corrupt."); }
+      boxes.resize(bs.size / sizeof(BundleBoundingBox) + 1);
+      readBundleSection(in, bs, (char *)&boxes[0], bs.size);
+      boxes.pop_back();
+    }
+
+  // Original labels
+  std::vector<itk::uint64_t> labelMap;
+  if (table[SectionLabelMap] != NULL)
+    {
+      const BundleSection &ms = *table[SectionLabelMap];
+      if (ms.size != state.numberOfLabels * sizeof(itk::uint64_t))
+        { throw Exception("Segmentation bundle label map is corrupt."); }
+      labelMap.resize(state.numberOfLabels + 1);
+      readBundleSection(in, ms, (char *)&labelMap[0], ms.size);
+      labelMap.pop_back();
+    }
+
+  // Binary edit volume, which covers the extent of the label image
+  std::vector<unsigned char> mask;
+  if (table[SectionEditVolume] != NULL)
+    {
+      const BundleSection &es = *table[SectionEditVolume];
+      itk::int32_t ext[6];
+      if (es.size < sizeof(ext))
+        { throw Exception("Segmentation bundle edit volume is corrupt."); }
+      std::vector<char> buf(es.size);
+      readBundleSection(in, es, &buf[0], es.size);
+      std::memcpy(ext, &buf[0], sizeof(ext));
+
+      for (unsigned int i = 0; i < 3; i++)
+        {
+          if (ext[2*i] != geom.index[i]
+              || ext[2*i+1] != geom.index[i] + static_cast<itk::int64_t>(geom.size[i]) - 1)
+            { throw Exception("Segmentation bundle edit volume does not match the label image."); }
+        }
+      mask.resize(geom.size[0] * geom.size[1] * geom.size[2]);
+      if (! MaskCodec::Decode(&buf[0] + sizeof(ext), es.size - sizeof(ext),
+                              &mask[0], mask.size()))
+        { throw Exception("Segmentation bundle edit volume is corrupt."); }
+    }
+
+  // Every section has been read and checked, so replace the current
+  // contents.
+  this->clear();
+  mWatershedTransform = new ULongImage(img);
+  mWatershedTransform->name(QFileInfo(fn).fileName());
+  mSegmentTree = tree;
+  this->initialize(state.numberOfLabels);
+  this->Merge(state.floodLevel);
+
+  for (unsigned long i = 0; i < boxes.size(); i++)
+    {
+      bounding_box_t b;
+      b.x0 = boxes[i].extent[0];  b.x1 = boxes[i].extent[1];
+      b.y0 = boxes[i].extent[2];  b.y1 = boxes[i].extent[3];
+      b.z0 = boxes[i].extent[4];  b.z1 = boxes[i].extent[5];
+      mBoundingBoxManager->SetBoundingBox(static_cast<unsigned long>(boxes[i].label), b);
+    }
+
+  if (!labelMap.empty())
+    { mOriginalLabels.assign(labelMap.begin(), labelMap.end()); }
+
+  if (!mask.empty())
+    {
+      vtkBinaryVolume *vol = this->binaryVolume();
+      std::memcpy(vol->GetScalarPointer(), &mask[0], mask.size());
+      vol->Modified();
+    }
+
+  return true;
+}
 
 }
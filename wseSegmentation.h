@@ -32,17 +32,44 @@
 #include <vtkImageCast.h>
 #include <vtkImageMapToColors.h>
 
+#include <vector>
+
 namespace wse {
 
-/** */
+/** A watershed segmentation: the labeled image of the watershed
+    transform, its merge tree, and the lookup table, bounding box and
+    binary edit volume objects that are used to display and edit it.
+
+    A Segmentation can be saved to and restored from a single "bundle"
+    file (see write() and read()) so that an editing session can be
+    resumed without recomputing the watershed transform.  The bundle
+    starts with a versioned header and a table of sections.  Each
+    section begins on a page boundary so that it can be memory mapped
+    directly.  The sections are: the image geometry, the label image
+    in the chunked format of itk::ChunkedLabelImageWriter, the merge
+    tree, the bounding box table, the flood level and (if one has been
+    created) the run-length encoded binary edit volume.
+
+    When a Segmentation is constructed from the output of the watershed
+    filter, its labels are renumbered to the dense range
+    0..numberOfLabels()-1 so that the lookup table and the other
+    per-label tables are sized to the number of regions that actually
+    exist.  The original watershed labels are available through
+    originalLabel().  */
 class Segmentation
 {
  public:
   // NOTE: ULongImage is defined in wseImage.hxx
   typedef itk::WatershedSegmentTreeWriter<float>::SegmentTreeType SegmentTreeType;
 
-  /** Constructor takes a ULongImage pointer and a SegmentTreeType pointer*/
+  /** Constructor takes a ULongImage pointer and a SegmentTreeType
+      pointer.  The Segmentation takes ownership of the ULongImage.  The
+      labels of the image and the tree are renumbered in place. */
   Segmentation(ULongImage *, SegmentTreeType *t);
+
+  /** Constructs an empty segmentation, which is intended to be filled
+      by a call to read(). */
+  Segmentation();
   ~Segmentation();
 
   /** Return the segment tree object. */
@@ -68,11 +95,51 @@ class Segmentation
   unsigned int nSlices() const
   { return mWatershedTransform->nSlices(); }
  
-  /** Write the segmentation to disk.  ToDo: UNIMPLEMENTED */
-  bool write() const { return false;}
-
-  /** Read a segmentation from disk. ToDo: UNIMPLEMENTED */
-  bool read(const char *fn) { return false; }
+  /** Returns the number of labels.  Labels run from 0 to
+      numberOfLabels()-1. */
+  unsigned long numberOfLabels() const
+  { return mLUTManager->GetNumberOfLabels(); }
+
+  /** Returns the label that the watershed transform originally assigned
+      to the label n. */
+  unsigned long originalLabel(unsigned long n) const
+  { return n < mOriginalLabels.size() ? mOriginalLabels[n] : n; }
+
+  /** Write the segmentation bundle to the file fn.  Returns false if
+      the file cannot be opened and throws a wse::Exception if writing
+      fails part way through. */
+  bool write(const char *fn) const;
+
+  /** Read a segmentation bundle from the file fn, replacing any data
+      currently held by this object.  Returns false if the file cannot
+      be opened and throws a wse::Exception if it is not a valid
+      segmentation bundle. */
+  bool read(const char *fn);
+
+  /** The version number written into the header of segmentation
+      bundles.  Readers reject bundles with any other version. */
+  static const unsigned int BundleVersion;
+
+  /** Returns the current flood level, as last passed to Merge(). */
+  float floodLevel() const
+  { return mLUTManager->GetCurrentThreshold(); }
+
+  /** Returns the lookup table manager, which holds the merges of the
+      labeled image. */
+  vtkWSLookupTableManager *lookupTableManager()
+  { return mLUTManager; }
+
+  /** Returns the bounding box manager for the labeled image. */
+  vtkWSBoundingBoxManager *boundingBoxManager()
+  { return mBoundingBoxManager; }
+
+  /** Returns the binary edit volume, allocating an empty volume with
+      the extent of the labeled image the first time it is called. */
+  vtkBinaryVolume *binaryVolume();
+
+  /** Returns true if a binary edit volume has been created. */
+  bool hasBinaryVolume() const
+  { return mBinaryVolume != NULL; }
 
   /** Return an output port for the VTK rendering pipeline. */
   vtkAlgorithmOutput *GetOutputPort()
@@ -90,6 +157,18 @@ class Segmentation
 
 
  private:
+  /** Creates the lookup table and bounding box managers for the
+      current transform and tree. */
+  void initialize(unsigned long numberOfLabels);
+
+  /** Renumbers the labels of the watershed transform and the segment
+      tree to the dense range 0..N-1, preserving their order, and
+      records the original labels in mOriginalLabels.  Returns N. */
+  unsigned long compactLabels();
+
+  /** Releases all data held by this object. */
+  void clear();
+
   /** A wseImage wrapper around the labeled image of the watershed
       transform, which is one of the outputs of the
       itkWatershedImageFilter. */
@@ -103,14 +182,22 @@ class Segmentation
   /** Logic for merging and splitting regions from the watershed transform. */
   vtkBinaryVolumeLogic* mBinaryLogic;
 
+  /** The binary edit volume.  NULL until binaryVolume() is first
+      called or a bundle containing an edit volume is read. */
+  vtkBinaryVolume* mBinaryVolume;
+
   /** Lookup table manager for the segmented image.  This object holds the segmentation merge tree. */
   vtkWSLookupTableManager* mLUTManager;
 
   /** Bounding box manager for the segmented image. */
   vtkWSBoundingBoxManager* mBoundingBoxManager;
 
+  /** The original watershed label of each compacted label.  Empty if
+      the labels were not renumbered. */
+  std::vector<unsigned long> mOriginalLabels;
+
 };
 
 } // end namespace wse
 
-#endif // _wseSegmentation_h_x
+#endif // _wseSegmentation_h_
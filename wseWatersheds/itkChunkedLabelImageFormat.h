@@ -0,0 +1,74 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    itkChunkedLabelImageFormat.h
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+// .Name ChunkedLabelImageFormat
+// .Section Description
+// On-disk layout shared by ChunkedLabelImageWriter and
+// ChunkedLabelImageReader.  A chunked label image holds a 3D label image
+// cut into bricks (64^3 voxels by default).  Each brick is run-length
+// encoded independently (see RunLengthCodec), so any slice or region of
+// interest can be decoded by reading only the bricks that it overlaps.
+//
+//   ChunkedLabelImageHeader
+//   ChunkedLabelImageBrick[numberOfBricks]    (x-fastest brick order)
+//   brick data ...
+//
+// The image may be a file of its own or a part of a larger file, such
+// as a segmentation bundle.  Brick offsets are counted from the start of
+// the header.
+//
+// Header and index values are stored in the byte order of the writing
+// machine and the byteOrder field is checked on reading.  Brick data is
+// little endian, with labels always stored as 64-bit values.  When the
+// compression field is DeflateCompression, each run-length encoded
+// brick is further deflated with zlib and stored as its 64-bit encoded
+// size followed by the zlib stream.
+#ifndef __itkChunkedLabelImageFormat_h
+#define __itkChunkedLabelImageFormat_h
+
+#include "itkIntTypes.h"
+
+namespace itk
+{
+
+struct ChunkedLabelImageHeader
+{
+  char          magic[8];
+  itk::uint32_t version;
+  itk::uint32_t byteOrder;
+  itk::uint32_t brickSize[3];
+  itk::uint32_t compression;
+  itk::int64_t  index[3];
+  itk::uint64_t size[3];
+  double        spacing[3];
+  double        origin[3];
+  double        direction[9];
+  itk::uint64_t numberOfBricks;
+};
+
+struct ChunkedLabelImageBrick
+{
+  itk::uint64_t offset;  // from the start of the header
+  itk::uint64_t size;    // encoded size in bytes
+};
+
+class ChunkedLabelImageFormat
+{
+public:
+  enum { NoCompression = 0, DeflateCompression = 1 };
+
+  static const char *Magic()    { return "WSELBL\r\n"; }
+  static itk::uint32_t Version()   { return 1; }
+  static itk::uint32_t ByteOrder() { return 0x01020304; }
+  static unsigned int DefaultBrickSize() { return 64; }
+};
+
+} // end namespace itk
+
+#endif
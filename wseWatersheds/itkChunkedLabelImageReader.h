@@ -0,0 +1,113 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    itkChunkedLabelImageReader.h
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+#ifndef __itkChunkedLabelImageReader_h
+#define __itkChunkedLabelImageReader_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImage.h"
+#include "itkChunkedLabelImageFormat.h"
+#include <fstream>
+#include <vector>
+
+namespace itk
+{
+
+/** \class ChunkedLabelImageReader
+ * \brief Reads label images written by ChunkedLabelImageWriter.
+ *
+ * Only the bricks that overlap the requested region are read from disk,
+ * and within each brick only the span of voxels between the first and
+ * last requested slice is expanded.  Reading a single slice of a large
+ * label volume therefore touches a small fraction of the file.
+ *
+ * The image need not start at the beginning of the file: a segmentation
+ * bundle, for one, stores its labels as a section.  SetFileOffset()
+ * gives the position of the image in the file.
+ **/
+template <class TImage>
+class ITK_EXPORT ChunkedLabelImageReader : public Object
+{
+public:
+  /** Standard Itk typedefs and smart pointer declaration.   */
+  typedef ChunkedLabelImageReader Self;
+  typedef Object Superclass;
+  typedef SmartPointer<Self> Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+  itkNewMacro(Self);
+  itkTypeMacro(ChunkedLabelImageReader, Object);
+
+  /** Convenient typedefs. */
+  typedef TImage ImageType;
+  typedef typename ImageType::Pointer ImagePointer;
+  typedef typename ImageType::PixelType PixelType;
+  typedef typename ImageType::RegionType RegionType;
+
+  /** Set the name of the file to read.  The header and brick index are
+      read on the first call to one of the Read methods. */
+  void SetFileName(const char *fn)
+    {
+      m_FileName = fn;
+      m_InformationRead = false;
+      this->Modified();
+    }
+
+  /** Set the position of the image in the file (default 0). */
+  void SetFileOffset(itk::uint64_t offset)
+    {
+      m_FileOffset = offset;
+      m_InformationRead = false;
+      this->Modified();
+    }
+
+  /** Returns the full region stored in the file. */
+  RegionType GetLargestPossibleRegion();
+
+  /** Reads the given region into a newly allocated image.  The region
+      must lie inside GetLargestPossibleRegion(). */
+  ImagePointer ReadRegion(const RegionType &r);
+
+  /** Reads the z-slice k (an index into the largest possible region). */
+  ImagePointer ReadSlice(long k);
+
+  /** Reads the whole image. */
+  ImagePointer Read()
+    { return this->ReadRegion(this->GetLargestPossibleRegion()); }
+
+protected:
+  ChunkedLabelImageReader() : m_FileOffset(0), m_InformationRead(false) {}
+  ~ChunkedLabelImageReader() {}
+
+  /** Reads and validates the header and brick index. */
+  void ReadInformation();
+
+  /** Reads a brick and returns its run-length encoded data in encoded,
+      which is inflated first if the image is compressed. */
+  void ReadBrick(std::ifstream &in, const ChunkedLabelImageBrick &brick,
+                 std::vector<char> &encoded, std::vector<char> &scratch);
+
+private:
+  ChunkedLabelImageReader(const Self&); // purposely not implemented
+  void operator=(const Self&);          // purposely not implemented
+
+  std::string   m_FileName;
+  itk::uint64_t m_FileOffset;
+  bool          m_InformationRead;
+  ChunkedLabelImageHeader m_Header;
+  std::vector<ChunkedLabelImageBrick> m_Index;
+};
+
+}// end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkChunkedLabelImageReader.txx"
+#endif
+
+#endif
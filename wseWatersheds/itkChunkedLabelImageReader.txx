@@ -0,0 +1,268 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    itkChunkedLabelImageReader.txx
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+#ifndef __itkChunkedLabelImageReader_txx
+#define __itkChunkedLabelImageReader_txx
+
+#include "itkChunkedLabelImageReader.h"
+#include "itkRunLengthCodec.h"
+#include "itkByteSwapper.h"
+#include "itk_zlib.h"
+#include <cstring>
+#include <algorithm>
+
+namespace itk
+{
+
+template <class TImage>
+void ChunkedLabelImageReader<TImage>
+::ReadInformation()
+{
+  if (m_InformationRead) { return; }
+
+  std::ifstream in(m_FileName.c_str(), std::ios::binary);
+  if (!in)
+    {
+      itkExceptionMacro(<< "Could not open " << m_FileName);
+    }
+
+  in.seekg(static_cast<std::streamoff>(m_FileOffset), std::ios::beg);
+  in.read((char *)&m_Header, sizeof(m_Header));
+  if (!in || std::memcmp(m_Header.magic, ChunkedLabelImageFormat::Magic(), sizeof(m_Header.magic)) != 0)
+    {
+      itkExceptionMacro(<< m_FileName << " is not a chunked label image.");
+    }
+  if (m_Header.byteOrder != ChunkedLabelImageFormat::ByteOrder())
+    {
+      itkExceptionMacro(<< m_FileName << " was written on a machine with a different byte order.");
+    }
+  if (m_Header.version != ChunkedLabelImageFormat::Version())
+    {
+      itkExceptionMacro(<< m_FileName << " was written by an incompatible version of this program.");
+    }
+  if (m_Header.compression != ChunkedLabelImageFormat::NoCompression
+      && m_Header.compression != ChunkedLabelImageFormat::DeflateCompression)
+    {
+      itkExceptionMacro(<< m_FileName << " uses an unknown compression.");
+    }
+
+  itk::uint64_t nbricks = 1;
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      if (m_Header.brickSize[i] == 0)
+        {
+          itkExceptionMacro(<< m_FileName << " has an invalid brick size.");
+        }
+      nbricks *= (m_Header.size[i] + m_Header.brickSize[i] - 1) / m_Header.brickSize[i];
+    }
+  if (nbricks != m_Header.numberOfBricks)
+    {
+      itkExceptionMacro(<< m_FileName << " has a corrupt brick index.");
+    }
+
+  m_Index.resize(m_Header.numberOfBricks);
+  if (!m_Index.empty())
+    {
+      in.read((char *)&m_Index[0], sizeof(ChunkedLabelImageBrick) * m_Index.size());
+    }
+  if (!in)
+    {
+      itkExceptionMacro(<< m_FileName << " is truncated.");
+    }
+
+  m_InformationRead = true;
+}
+
+template <class TImage>
+void ChunkedLabelImageReader<TImage>
+::ReadBrick(std::ifstream &in, const ChunkedLabelImageBrick &brick,
+            std::vector<char> &encoded, std::vector<char> &scratch)
+{
+  std::vector<char> &stored =
+    (m_Header.compression == ChunkedLabelImageFormat::DeflateCompression) ? scratch : encoded;
+  stored.resize(brick.size + 1);
+  in.seekg(static_cast<std::streamoff>(m_FileOffset + brick.offset), std::ios::beg);
+  in.read(&stored[0], static_cast<std::streamsize>(brick.size));
+  if (!in)
+    {
+      itkExceptionMacro(<< m_FileName << " is truncated.");
+    }
+  if (&stored == &encoded)
+    {
+      encoded.resize(brick.size);
+      return;
+    }
+
+  // A deflated brick starts with its run-length encoded size.
+  itk::uint64_t rleSize;
+  if (brick.size < sizeof(rleSize))
+    {
+      itkExceptionMacro(<< m_FileName << " has corrupt brick data.");
+    }
+  std::memcpy(&rleSize, &scratch[0], sizeof(rleSize));
+  ByteSwapper<itk::uint64_t>::SwapFromLittleEndianToSystem(&rleSize);
+
+  encoded.resize(rleSize + 1);
+  uLongf size = static_cast<uLongf>(rleSize);
+  if (uncompress(reinterpret_cast<Bytef *>(&encoded[0]), &size,
+                 reinterpret_cast<const Bytef *>(&scratch[sizeof(rleSize)]),
+                 static_cast<uLong>(brick.size - sizeof(rleSize))) != Z_OK
+      || size != rleSize)
+    {
+      itkExceptionMacro(<< m_FileName << " has corrupt brick data.");
+    }
+  encoded.resize(rleSize);
+}
+
+template <class TImage>
+typename ChunkedLabelImageReader<TImage>::RegionType
+ChunkedLabelImageReader<TImage>
+::GetLargestPossibleRegion()
+{
+  this->ReadInformation();
+
+  typename RegionType::IndexType idx;
+  typename RegionType::SizeType  sz;
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      idx[i] = m_Header.index[i];
+      sz[i]  = m_Header.size[i];
+    }
+  return RegionType(idx, sz);
+}
+
+template <class TImage>
+typename ChunkedLabelImageReader<TImage>::ImagePointer
+ChunkedLabelImageReader<TImage>
+::ReadSlice(long k)
+{
+  RegionType r = this->GetLargestPossibleRegion();
+  typename RegionType::IndexType idx = r.GetIndex();
+  typename RegionType::SizeType  sz  = r.GetSize();
+  idx[2] = k;
+  sz[2]  = 1;
+  r.SetIndex(idx);
+  r.SetSize(sz);
+  return this->ReadRegion(r);
+}
+
+template <class TImage>
+typename ChunkedLabelImageReader<TImage>::ImagePointer
+ChunkedLabelImageReader<TImage>
+::ReadRegion(const RegionType &r)
+{
+  const RegionType largest = this->GetLargestPossibleRegion();
+  if (! largest.IsInside(r))
+    {
+      itkExceptionMacro(<< "Requested region lies outside of the image in " << m_FileName);
+    }
+
+  ImagePointer img = ImageType::New();
+  typename ImageType::SpacingType   spacing;
+  typename ImageType::PointType     origin;
+  typename ImageType::DirectionType direction;
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      spacing[i] = m_Header.spacing[i];
+      origin[i]  = m_Header.origin[i];
+      for (unsigned int j = 0; j < 3; j++)
+        { direction[i][j] = m_Header.direction[i*3+j]; }
+    }
+  img->SetLargestPossibleRegion(largest);
+  img->SetBufferedRegion(r);
+  img->SetRequestedRegion(r);
+  img->SetSpacing(spacing);
+  img->SetOrigin(origin);
+  img->SetDirection(direction);
+  img->Allocate();
+
+  std::ifstream in(m_FileName.c_str(), std::ios::binary);
+  if (!in)
+    {
+      itkExceptionMacro(<< "Could not open " << m_FileName);
+    }
+
+  // Requested voxel range relative to the stored region
+  unsigned long r0[3], r1[3], nbricks[3], b0[3], b1[3];
+  const unsigned int *bs = m_Header.brickSize;
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      r0[i] = r.GetIndex()[i] - largest.GetIndex()[i];
+      r1[i] = r0[i] + r.GetSize()[i];   // one past the end
+      nbricks[i] = (m_Header.size[i] + bs[i] - 1) / bs[i];
+      b0[i] = r0[i] / bs[i];
+      b1[i] = (r1[i] + bs[i] - 1) / bs[i];
+    }
+
+  PixelType *out = img->GetBufferPointer();
+  const typename RegionType::SizeType osz = r.GetSize();
+  std::vector<char> encoded;
+  std::vector<char> scratch;
+  std::vector<PixelType> span;
+
+  for (unsigned long bz = b0[2]; bz < b1[2]; bz++)
+    {
+    for (unsigned long by = b0[1]; by < b1[1]; by++)
+      {
+      for (unsigned long bx = b0[0]; bx < b1[0]; bx++)
+        {
+        const ChunkedLabelImageBrick &brick = m_Index[(bz * nbricks[1] + by) * nbricks[0] + bx];
+
+        // Extent of this brick in stored coordinates
+        const unsigned long bi[3] = { bx, by, bz };
+        unsigned long s[3], e[3];
+        for (unsigned int i = 0; i < 3; i++)
+          {
+            s[i] = bi[i] * bs[i];
+            e[i] = s[i] + bs[i];
+            if (e[i] > m_Header.size[i]) { e[i] = m_Header.size[i]; }
+          }
+        const unsigned long nx = e[0] - s[0];
+        const unsigned long ny = e[1] - s[1];
+
+        // Only the slices of the brick between the first and last
+        // requested z are expanded.
+        const unsigned long z0 = std::max(s[2], r0[2]);
+        const unsigned long z1 = std::min(e[2], r1[2]);
+        const unsigned long first = (z0 - s[2]) * nx * ny;
+        const unsigned long count = (z1 - z0) * nx * ny;
+
+        this->ReadBrick(in, brick, encoded, scratch);
+        span.resize(count);
+        if (encoded.empty()
+            || ! RunLengthCodec<PixelType, itk::uint64_t>::DecodeSpan(&encoded[0], encoded.size(),
+                                                                      first, &span[0], count))
+          {
+            itkExceptionMacro(<< m_FileName << " has corrupt brick data.");
+          }
+
+        // Copy the overlapping rows into the output
+        const unsigned long x0 = std::max(s[0], r0[0]);
+        const unsigned long x1 = std::min(e[0], r1[0]);
+        const unsigned long y0 = std::max(s[1], r0[1]);
+        const unsigned long y1 = std::min(e[1], r1[1]);
+        for (unsigned long z = z0; z < z1; z++)
+          {
+          for (unsigned long y = y0; y < y1; y++)
+            {
+              const PixelType *src = &span[0] + ((z - z0) * ny + (y - s[1])) * nx + (x0 - s[0]);
+              PixelType *dst = out + ((z - r0[2]) * osz[1] + (y - r0[1])) * osz[0] + (x0 - r0[0]);
+              std::memcpy(dst, src, (x1 - x0) * sizeof(PixelType));
+            }
+          }
+        }
+      }
+    }
+
+  return img;
+}
+
+} // end namespace itk
+
+#endif
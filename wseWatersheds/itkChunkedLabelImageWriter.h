@@ -0,0 +1,112 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    itkChunkedLabelImageWriter.h
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+#ifndef __itkChunkedLabelImageWriter_h
+#define __itkChunkedLabelImageWriter_h
+
+#include "itkProcessObject.h"
+#include "itkImage.h"
+#include "itkChunkedLabelImageFormat.h"
+#include <ostream>
+
+namespace itk
+{
+
+/** \class ChunkedLabelImageWriter
+ * \brief Writes a 3D label image as independently run-length encoded
+ * bricks.  See itkChunkedLabelImageFormat.h for the file layout.
+ *
+ * By default the buffered region of the input is written.  A smaller
+ * region may be selected with SetRegion(), in which case bricks are
+ * gathered directly from the input buffer without an intermediate copy.
+ * Unless compression is turned off, each run-length encoded brick is
+ * also deflated with zlib at its fastest level.
+ **/
+template <class TImage>
+class ITK_EXPORT ChunkedLabelImageWriter : public ProcessObject
+{
+public:
+  /** Standard Itk typedefs and smart pointer declaration.   */
+  typedef ChunkedLabelImageWriter Self;
+  typedef ProcessObject Superclass;
+  typedef SmartPointer<Self> Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+  itkNewMacro(Self);
+  itkTypeMacro(ChunkedLabelImageWriter, ProcessObject);
+
+  /** Convenient typedefs. */
+  typedef TImage ImageType;
+  typedef typename ImageType::PixelType PixelType;
+  typedef typename ImageType::RegionType RegionType;
+
+  void SetInput(const ImageType *input)
+    {   this->ProcessObject::SetNthInput(0, const_cast<ImageType *>(input)); }
+
+  const ImageType *GetInput()
+    {      return static_cast<ImageType *>
+             (this->ProcessObject::GetInput(0));    }
+
+  /** Set the name of the file to write.   */
+  void SetFileName(const char *fn)
+    {
+      m_FileName = fn;
+      this->Modified();
+    }
+
+  /** Set the region of the input to write.  It must lie inside the
+      buffered region of the input. */
+  void SetRegion(const RegionType &r)
+    {
+      m_Region = r;
+      m_UseRegion = true;
+      this->Modified();
+    }
+
+  /** Set the edge length of the cubic bricks (default 64). */
+  itkSetMacro(BrickSize, unsigned int);
+  itkGetMacro(BrickSize, unsigned int);
+
+  /** Turn the deflation of the bricks on or off (default on). */
+  itkSetMacro(Compression, bool);
+  itkGetMacro(Compression, bool);
+  itkBooleanMacro(Compression);
+
+  void  Write();
+
+  /** Writes the image at the current position of out, which must be
+      seekable, as when the image is a section of a larger file.  The
+      stream is left at the end of the image. */
+  void  Write(std::ostream &out);
+
+protected:
+  std::string  m_FileName;
+  RegionType   m_Region;
+  bool         m_UseRegion;
+  unsigned int m_BrickSize;
+  bool         m_Compression;
+
+  ChunkedLabelImageWriter()
+    {
+      m_UseRegion = false;
+      m_BrickSize = ChunkedLabelImageFormat::DefaultBrickSize();
+      m_Compression = true;
+      this->ProcessObject::SetNumberOfRequiredInputs(1);
+    }
+  ~ChunkedLabelImageWriter() {}
+
+  void  GenerateData() { this->Write(); }
+};
+
+}// end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkChunkedLabelImageWriter.txx"
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    itkChunkedLabelImageWriter.txx
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+#ifndef __itkChunkedLabelImageWriter_txx
+#define __itkChunkedLabelImageWriter_txx
+
+#include "itkChunkedLabelImageWriter.h"
+#include "itkRunLengthCodec.h"
+#include "itkByteSwapper.h"
+#include "itk_zlib.h"
+#include <fstream>
+#include <vector>
+#include <cstring>
+
+namespace itk
+{
+
+template <class TImage>
+void ChunkedLabelImageWriter<TImage>
+::Write()
+{
+  std::ofstream out(m_FileName.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out)
+    {
+      itkExceptionMacro(<< "Could not open " << m_FileName << " for writing.");
+    }
+
+  this->Write(out);
+  out.close();
+
+  if (!out)
+    {
+      itkExceptionMacro(<< "Error writing " << m_FileName);
+    }
+}
+
+template <class TImage>
+void ChunkedLabelImageWriter<TImage>
+::Write(std::ostream &out)
+{
+  const ImageType *input = this->GetInput();
+  if (input == 0)
+    {
+      itkExceptionMacro(<< "No input image to write.");
+    }
+
+  const RegionType buffered = input->GetBufferedRegion();
+  const RegionType region   = m_UseRegion ? m_Region : buffered;
+  if (! buffered.IsInside(region))
+    {
+      itkExceptionMacro(<< "The region to write lies outside of the buffered region of the input.");
+    }
+
+  const std::streampos start = out.tellp();
+
+  // Header
+  ChunkedLabelImageHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, ChunkedLabelImageFormat::Magic(), sizeof(header.magic));
+  header.version   = ChunkedLabelImageFormat::Version();
+  header.byteOrder = ChunkedLabelImageFormat::ByteOrder();
+  header.compression = m_Compression ? ChunkedLabelImageFormat::DeflateCompression
+                                     : ChunkedLabelImageFormat::NoCompression;
+
+  unsigned long nbricks[3];
+  for (unsigned int i = 0; i < 3; i++)
+    {
+      header.brickSize[i] = m_BrickSize;
+      header.index[i]     = region.GetIndex()[i];
+      header.size[i]      = region.GetSize()[i];
+      header.spacing[i]   = input->GetSpacing()[i];
+      header.origin[i]    = input->GetOrigin()[i];
+      for (unsigned int j = 0; j < 3; j++)
+        { header.direction[i*3+j] = input->GetDirection()[i][j]; }
+      nbricks[i] = (region.GetSize()[i] + m_BrickSize - 1) / m_BrickSize;
+    }
+  header.numberOfBricks = nbricks[0] * nbricks[1] * nbricks[2];
+
+  std::vector<ChunkedLabelImageBrick> index(header.numberOfBricks);
+  out.write((const char *)&header, sizeof(header));
+  if (header.numberOfBricks > 0)
+    { out.write((const char *)&index[0], sizeof(ChunkedLabelImageBrick) * index.size()); }
+
+  // Gather each brick directly from the input buffer into a scratch
+  // brick, encode it and append it to the stream.
+  const typename RegionType::SizeType  bsz = buffered.GetSize();
+  const typename RegionType::IndexType bix = buffered.GetIndex();
+  const PixelType *buf = input->GetBufferPointer();
+
+  std::vector<PixelType> brick(static_cast<unsigned long>(m_BrickSize) * m_BrickSize * m_BrickSize);
+  std::vector<char> encoded;
+  std::vector<char> deflated;
+  itk::uint64_t offset = sizeof(header) + sizeof(ChunkedLabelImageBrick) * index.size();
+
+  unsigned long b = 0;
+  for (unsigned long bz = 0; bz < nbricks[2]; bz++)
+    {
+    for (unsigned long by = 0; by < nbricks[1]; by++)
+      {
+      for (unsigned long bx = 0; bx < nbricks[0]; bx++, b++)
+        {
+        // Extent of this brick, clipped to the region
+        unsigned long e[3];
+        unsigned long s[3];
+        const unsigned long bi[3] = { bx, by, bz };
+        for (unsigned int i = 0; i < 3; i++)
+          {
+            s[i] = bi[i] * m_BrickSize;
+            e[i] = s[i] + m_BrickSize;
+            if (e[i] > region.GetSize()[i]) { e[i] = region.GetSize()[i]; }
+          }
+        const unsigned long nx = e[0] - s[0];
+
+        PixelType *dst = &brick[0];
+        for (unsigned long z = s[2]; z < e[2]; z++)
+          {
+          for (unsigned long y = s[1]; y < e[1]; y++)
+            {
+              const unsigned long ix = region.GetIndex()[0] + s[0] - bix[0];
+              const unsigned long iy = region.GetIndex()[1] + y - bix[1];
+              const unsigned long iz = region.GetIndex()[2] + z - bix[2];
+              const PixelType *src = buf + (iz * bsz[1] + iy) * bsz[0] + ix;
+              std::memcpy(dst, src, nx * sizeof(PixelType));
+              dst += nx;
+            }
+          }
+
+        encoded.clear();
+        RunLengthCodec<PixelType, itk::uint64_t>::Encode(&brick[0], dst - &brick[0], encoded);
+        const std::vector<char> *data = &encoded;
+        if (m_Compression)
+          {
+            // The run-length encoded size, which the reader needs to
+            // inflate the brick, followed by the zlib stream
+            itk::uint64_t rleSize = encoded.size();
+            ByteSwapper<itk::uint64_t>::SwapFromSystemToLittleEndian(&rleSize);
+            uLongf zsize = compressBound(static_cast<uLong>(encoded.size()));
+            deflated.resize(sizeof(rleSize) + zsize);
+            std::memcpy(&deflated[0], &rleSize, sizeof(rleSize));
+            if (compress2(reinterpret_cast<Bytef *>(&deflated[sizeof(rleSize)]), &zsize,
+                          reinterpret_cast<const Bytef *>(&encoded[0]),
+                          static_cast<uLong>(encoded.size()), Z_BEST_SPEED) != Z_OK)
+              {
+                itkExceptionMacro(<< "Could not deflate a brick of " << m_FileName);
+              }
+            deflated.resize(sizeof(rleSize) + zsize);
+            data = &deflated;
+          }
+        index[b].offset = offset;
+        index[b].size   = data->size();
+        if (!data->empty())
+          { out.write(&(*data)[0], static_cast<std::streamsize>(data->size())); }
+        offset += data->size();
+        }
+      }
+
+    this->UpdateProgress(static_cast<float>(bz + 1) / static_cast<float>(nbricks[2]));
+    }
+
+  // Now go back and fill in the brick index, then leave the stream at
+  // the end of the image.
+  out.seekp(start + static_cast<std::streamoff>(sizeof(header)));
+  if (header.numberOfBricks > 0)
+    { out.write((const char *)&index[0], sizeof(ChunkedLabelImageBrick) * index.size()); }
+  out.seekp(start + static_cast<std::streamoff>(offset));
+
+  if (!out)
+    {
+      itkExceptionMacro(<< "Error writing the chunked label image " << m_FileName);
+    }
+}
+
+} // end namespace itk
+
+#endif
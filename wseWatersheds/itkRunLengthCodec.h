@@ -0,0 +1,140 @@
+/*=========================================================================
+
+  Program:   Watershed Segmentation Editor
+  Module:    itkRunLengthCodec.h
+  Language:  C++
+
+  Copyright 2010 University of Utah.  All rights reserved
+
+=========================================================================*/
+// .Name RunLengthCodec
+// .Section Description
+// A minimal run-length codec for label and mask buffers.  Watershed label
+// images and binary edit volumes consist almost entirely of long runs of a
+// single value along the x axis, so a run-length encoding is both very fast
+// and compresses them well.  The encoded stream is a sequence of
+// (unsigned 32-bit run length, pixel value) records, stored little endian
+// and unaligned.  Labels are always stored as 64-bit values so that the
+// stream does not depend on the size of unsigned long on the platform that
+// wrote it.
+#ifndef __itkRunLengthCodec_h
+#define __itkRunLengthCodec_h
+
+#include <vector>
+#include <cstring>
+#include "itkIntTypes.h"
+#include "itkByteSwapper.h"
+
+namespace itk
+{
+
+template <class TPixel, class TStoredPixel = TPixel>
+class RunLengthCodec
+{
+public:
+  typedef TPixel       PixelType;
+  typedef TStoredPixel StoredPixelType;
+  typedef ::itk::uint32_t RunLengthType;
+
+  /** Size in bytes of a single (run length, value) record. */
+  static unsigned int RecordSize()
+  { return sizeof(RunLengthType) + sizeof(StoredPixelType); }
+
+  /** Appends the encoding of n pixels starting at in to the end of out.
+      Returns the number of bytes appended. */
+  static unsigned long Encode(const PixelType *in, unsigned long n,
+                              std::vector<char> &out)
+  {
+    const unsigned long start = out.size();
+    unsigned long i = 0;
+    while (i < n)
+      {
+      const PixelType v = in[i];
+      unsigned long j = i + 1;
+      while (j < n && in[j] == v && (j - i) < 0xffffffffUL)
+        { ++j; }
+      AppendRecord(static_cast<RunLengthType>(j - i), v, out);
+      i = j;
+      }
+    return out.size() - start;
+  }
+
+  /** Decodes nbytes of encoded data into exactly n pixels.  Returns false
+      if the stream is malformed or does not describe exactly n pixels. */
+  static bool Decode(const char *in, unsigned long nbytes,
+                     PixelType *out, unsigned long n)
+  {
+    const unsigned int rs = RecordSize();
+    unsigned long pos = 0;
+    unsigned long k = 0;
+    while (pos + rs <= nbytes)
+      {
+      RunLengthType len;
+      StoredPixelType sv;
+      std::memcpy(&len, in + pos, sizeof(RunLengthType));
+      std::memcpy(&sv,  in + pos + sizeof(RunLengthType), sizeof(StoredPixelType));
+      ByteSwapper<RunLengthType>::SwapFromSystemToLittleEndian(&len);
+      ByteSwapper<StoredPixelType>::SwapFromSystemToLittleEndian(&sv);
+      pos += rs;
+
+      if (k + len > n) { return false; }
+      const PixelType v = static_cast<PixelType>(sv);
+      PixelType *p = out + k;
+      for (RunLengthType r = 0; r < len; ++r) { p[r] = v; }
+      k += len;
+      }
+    return (k == n && pos == nbytes);
+  }
+
+  /** Decodes pixels [first, first+n) of an encoded stream into out,
+      skipping over the runs that precede the requested span without
+      expanding them.  Returns false if the stream ends early. */
+  static bool DecodeSpan(const char *in, unsigned long nbytes,
+                         unsigned long first, PixelType *out, unsigned long n)
+  {
+    const unsigned int rs = RecordSize();
+    unsigned long pos = 0;
+    unsigned long k = 0;   // index of the first pixel of the current run
+    unsigned long written = 0;
+    while (pos + rs <= nbytes && written < n)
+      {
+      RunLengthType len;
+      StoredPixelType sv;
+      std::memcpy(&len, in + pos, sizeof(RunLengthType));
+      std::memcpy(&sv,  in + pos + sizeof(RunLengthType), sizeof(StoredPixelType));
+      ByteSwapper<RunLengthType>::SwapFromSystemToLittleEndian(&len);
+      ByteSwapper<StoredPixelType>::SwapFromSystemToLittleEndian(&sv);
+      pos += rs;
+
+      const unsigned long runEnd = k + len;
+      if (runEnd > first + written)
+        {
+        const unsigned long b = first + written;
+        unsigned long e = runEnd;
+        if (e > first + n) { e = first + n; }
+        const PixelType v = static_cast<PixelType>(sv);
+        for (unsigned long i = b; i < e; ++i) { out[i - first] = v; }
+        written += e - b;
+        }
+      k = runEnd;
+      }
+    return (written == n);
+  }
+
+private:
+  static void AppendRecord(RunLengthType len, PixelType v, std::vector<char> &out)
+  {
+    StoredPixelType sv = static_cast<StoredPixelType>(v);
+    ByteSwapper<RunLengthType>::SwapFromSystemToLittleEndian(&len);
+    ByteSwapper<StoredPixelType>::SwapFromSystemToLittleEndian(&sv);
+
+    const unsigned long pos = out.size();
+    out.resize(pos + RecordSize());
+    std::memcpy(&out[pos], &len, sizeof(RunLengthType));
+    std::memcpy(&out[pos + sizeof(RunLengthType)], &sv, sizeof(StoredPixelType));
+  }
+};
+
+} // end namespace itk
+
+#endif
@@ -17,8 +17,7 @@
 #ifndef __itkWatershedFilterAndWriter_h
 #define __itkWatershedFilterAndWriter_h
 
-#include "itkImageFileWriter.h"
-#include "itkRawImageIO.h"
+#include "itkChunkedLabelImageWriter.h"
 #include "itkImageToImageFilter.h"
 #include "itkWatershedImageFilter.h"
 #include "itkWatershedSegmentTreeWriter.h"
@@ -29,7 +28,8 @@ namespace itk
 /**
  * \class WatershedFilterAndWriter
  * This is a simple wrapper for the WatershedImageFilter which also writes
- * the segment tree and basic segmentation to disk.  This class is necessary
+ * the segment tree and basic segmentation to disk.  The basic segmentation
+ * is written in the chunked label format of ChunkedLabelImageWriter.  This class is necessary
  * to wrap for vtk using the vtkITK protocol.
  */
 template <class TInputImageType>
@@ -18,7 +18,6 @@
 #define __itkWatershedFilterAndWriter_txx
 
 #include "itkWatershedFilterAndWriter.h"
-#include "itkImageRegionIterator.h"
 #include <stdio.h>
 
 namespace itk
@@ -32,39 +31,28 @@ WatershedFilterAndWriter<TInputImageType>
   // First execute the superclass filter
   Superclass::GenerateData();
 
-  // Now set up the writers for this data
-  typename WatershedSegmentTreeWriter<ScalarType>::Pointer treeWriter
-    = WatershedSegmentTreeWriter<ScalarType>::New();
-
-  typename RawImageIO<unsigned long, TInputImageType::ImageDimension>::Pointer io = RawImageIO<unsigned long, TInputImageType::ImageDimension>::New();
-  
-  typename ImageFileWriter< OutputImageType >::Pointer writer
-    = ImageFileWriter< OutputImageType >::New();
-
-  io->SetByteOrderToLittleEndian();
-  io->SetFileDimensionality(TInputImageType::ImageDimension );
-
-  //
-  // Crop the border of the basic segmentation.
-  //
-  typename  OutputImageType::Pointer output = OutputImageType::New();
-  output->SetRegions(this->GetBasicSegmentation()->GetRequestedRegion());
-  output->Allocate();
-  
-  ImageRegionIterator<OutputImageType> it_from(this->GetBasicSegmentation(), output->GetRequestedRegion());
-  ImageRegionIterator<OutputImageType> it_to(output, output->GetRequestedRegion());
-
-  for (; !it_to.IsAtEnd(); ++it_to, ++it_from)
-    {      it_to.Set(it_from.Get());    }
-
+  // Nothing to do unless both files have been named.
   if((this->m_SegmentationFileName == "") ||
   (this->m_TreeFileName == "")) {
     return;
   }
- 
-  writer->SetImageIO(io);
+
+  // Now set up the writers for this data
+  typename WatershedSegmentTreeWriter<ScalarType>::Pointer treeWriter
+    = WatershedSegmentTreeWriter<ScalarType>::New();
+
+  // The basic segmentation is written as run-length encoded bricks,
+  // which are far smaller than a raw dump and can be read back a slice
+  // or region at a time (see ChunkedLabelImageReader).  The writer
+  // gathers the requested region (i.e. the basic segmentation without
+  // its border) straight from the segmentation buffer, so no cropped
+  // copy of the image is made.
+  typename ChunkedLabelImageWriter< OutputImageType >::Pointer writer
+    = ChunkedLabelImageWriter< OutputImageType >::New();
+
+  writer->SetInput(this->GetBasicSegmentation());
+  writer->SetRegion(this->GetBasicSegmentation()->GetRequestedRegion());
   writer->SetFileName(this->m_SegmentationFileName.c_str());
-  writer->SetInput(output);
   writer->Write();
 
   treeWriter->SetInput(this->GetSegmentTree());
@@ -40,6 +40,19 @@ public:
   bounding_box_t GetBoundingBox(unsigned long n);
   void GetBoundingBox(vtkBoundingBox *box, unsigned long n);       
 
+  // Inserts or replaces the box for label n.  Used to restore a table that
+  // was saved to disk without rescanning the LabeledImage.
+  void SetBoundingBox(unsigned long n, const bounding_box_t &box)
+    { BoundingBoxTable[n] = box; }
+
+  // Removes all boxes from the table.
+  void ClearBoundingBoxes()
+    { BoundingBoxTable.clear(); }
+
+  // Read-only access to the whole table, e.g. for serialization.
+  const vtkBoundingBoxHash &GetBoundingBoxTable() const
+    { return BoundingBoxTable; }
+
   // Merges a list of boxes into a single box, returned as an array of 6 ints
   // [x0 x1 y0 y1 z0 z1].  Input is an array of unsigned long labels whose
   // first element denotes the number of labels to follow (i.e. length of the
@@ -257,6 +257,9 @@ void vtkWSLookupTableManager::Initialize()
   this->CurrentPositionPointer = 0;
   HighlightedValueList.clear();
   EquivalencyTable.Clear();
+  RootTable.clear();
+  MergedLabels.clear();
+  RootTableTime.Modified();
 
   this->CurrentThreshold       = 0.0;
   this->CurrentPositionPointer = 0;
@@ -342,6 +345,14 @@ void vtkWSLookupTableManager::SetNumberOfLabels(unsigned long n)
   this->LookupTable->SetTableRange(0, n);
   this->LookupTable->SetNumberOfColors(n);
   this->LookupTable->SetNumberOfTableValues(n);
+
+  this->RootTable.resize(n);
+  for (unsigned long i = 0; i < n; i++)
+    {
+      this->RootTable[i] = i;
+    }
+  this->MergedLabels.clear();
+  this->RootTableTime.Modified();
   this->Modified();
 }
 
@@ -481,16 +492,30 @@ void vtkWSLookupTableManager::Merge(float t)
 void vtkWSLookupTableManager::MergeEquivalencies()
 {
 
+  // Reset the roots of the labels merged last time; those still merged
+  // are set again below.
+  for (unsigned long i = 0; i < MergedLabels.size(); i++)
+    {
+      RootTable[MergedLabels[i]] = MergedLabels[i];
+    }
+  MergedLabels.clear();
+
   // Merge colors in the lookup table
   vtkLookupTableEquivalencyHash::Iterator it;
   it = EquivalencyTable.Begin();
 
   while (it != EquivalencyTable.End())
     {
-      LookupTable->SetTableValue((*it).first,
-        LookupTable->GetTableValue(EquivalencyTable.RecursiveLookup((*it).second))); 
+      unsigned long root = EquivalencyTable.RecursiveLookup((*it).second);
+      LookupTable->SetTableValue((*it).first, LookupTable->GetTableValue(root)); 
+      if ((*it).first < RootTable.size())
+        {
+          RootTable[(*it).first] = root;
+          MergedLabels.push_back((*it).first);
+        }
       it++;
     }
+  RootTableTime.Modified();
 
 }
 
@@ -27,6 +27,7 @@
 #include "vtkLookupTableEquivalencyHash.h"
 #include "vtkImageData.h"
 #include "itkWatershedSegmentTreeWriter.h"
+#include <vector>
 
 class VTK_EXPORT vtkWSLookupTableManager : public vtkObject
 {
@@ -117,6 +118,15 @@ public:
   unsigned long GetMergedToLabel(unsigned long n)
     { return EquivalencyTable.RecursiveLookup(n); }
 
+  // Returns a table of NumberOfLabels entries holding the label that
+  // each label is currently merged to, i.e. GetMergedToLabel() for
+  // every label.  The table is kept up to date by MergeEquivalencies()
+  // and GetRootTableMTime() changes whenever it does.
+  const unsigned long *GetRootTable() const
+    { return RootTable.empty() ? 0 : &RootTable[0]; }
+  unsigned long GetRootTableMTime() const
+    { return RootTableTime.GetMTime(); }
+
   void HighlightComputedEquivalencyList();
   void ClearComputedEquivalencyList()
     {
@@ -168,6 +178,11 @@ private:
                                             // SHOULD PROBABLY BE CALLED THE
                                             // SelectedLabelsList 
 
+  std::vector<unsigned long> RootTable;    // See GetRootTable.
+  std::vector<unsigned long> MergedLabels; // Labels whose RootTable entry
+                                           // is not the label itself.
+  vtkTimeStamp RootTableTime;
+
   unsigned_long_list_t HighlightedValueList;
 
   int RepaintHighlights;